@@ -0,0 +1,122 @@
+#include <iostream>         // cout
+#include <algorithm>        // max, min
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "assetbuild.h"
+#include "mipmaps.h"
+#include "scene.h"
+#include "texturecache.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	// What happened to one output
+	struct UAssetBuildStep
+	{
+		string output;
+		bool current = false;       // Already built from the same source and parameters
+		bool succeeded = false;
+		double milliseconds = 0.0;
+	};
+
+	/* The binary scene is current when it carries the stamp of the text scene, there
+	 * are no parameters. Its texture list is needed either way, so it is read here.
+	 */
+	void UBuildSceneAsset(const char* sceneFilename, UAssetBuildStep& step, vector<string>& textures)
+	{
+		auto start = chrono::steady_clock::now();
+		step.output = sceneFilename;
+		bool binaryOnly = step.output.size() > 4 && step.output.compare(step.output.size() - 4, 4, ".bin") == 0;
+		if (!binaryOnly)
+			step.output += ".bin";
+
+		UMappedFile mapping;
+		UScene scene;
+		USceneView view;
+		step.current = UMapBinaryScene(step.output.c_str(), binaryOnly ? nullptr : sceneFilename, mapping, view);
+		if (step.current)
+			step.succeeded = true;
+		else if (!binaryOnly && ULoadScene(sceneFilename, scene))
+		{
+			view = UGetSceneView(scene);
+			step.succeeded = UWriteBinaryScene(scene, step.output.c_str(), sceneFilename);
+			if (!step.succeeded)
+				cout << "Failed to write binary scene " << step.output << endl;
+		}
+
+		for (GLuint i = 0; i < view.textureCount; ++i)
+			textures.push_back(view.strings + view.textures[i].filename);
+		UUnmapFile(mapping);
+
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+		step.milliseconds = elapsed.count();
+	}
+
+	// The cache records the hash of the image and the mip filter, a mismatch in either rebuilds it
+	void UBuildTextureAsset(const string& filename, GLuint mipFilter, UAssetBuildStep& step)
+	{
+		auto start = chrono::steady_clock::now();
+		step.output = filename + ".btc";
+
+		// The cache file is the output, so a transcode that could not write it fails the step
+		bool transcoded = false;
+		step.succeeded = UBuildTextureCache(filename.c_str(), mipFilter, transcoded);
+		step.current = step.succeeded && !transcoded;
+		if (!step.succeeded)
+			cout << "Failed to build texture cache " << step.output << endl;
+
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+		step.milliseconds = elapsed.count();
+	}
+}
+
+
+bool UBuildAssets(const char* sceneFilename, GLuint mipFilter, GLuint threadCount)
+{
+	auto start = chrono::steady_clock::now();
+
+	// The scene lists the textures, so it goes first
+	vector<string> textures;
+	vector<UAssetBuildStep> steps(1);
+	UBuildSceneAsset(sceneFilename, steps[0], textures);
+
+	// Each texture is independent, workers take the next one until none are left
+	steps.resize(1 + textures.size());
+	if (threadCount == 0)
+		threadCount = max(1u, thread::hardware_concurrency());
+	threadCount = max(1u, min(threadCount, (GLuint)textures.size()));
+
+	atomic<size_t> next(0);
+	auto work = [&]()
+	{
+		for (size_t i = next++; i < textures.size(); i = next++)
+			UBuildTextureAsset(textures[i], mipFilter, steps[1 + i]);
+	};
+	vector<thread> workers;
+	for (GLuint i = 0; i < threadCount; ++i)
+		workers.emplace_back(work);
+	for (thread& worker : workers)
+		worker.join();
+
+	GLuint current = 0;
+	GLuint failed = 0;
+	for (const UAssetBuildStep& step : steps)
+	{
+		cout << "INFO: Asset " << step.output << ": " << (!step.succeeded ? "failed" : step.current ? "up to date" : "built")
+			<< " in " << step.milliseconds << " ms" << endl;
+		current += step.current ? 1 : 0;
+		failed += step.succeeded ? 0 : 1;
+	}
+
+	chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+	cout << "INFO: Asset build: " << steps.size() << " assets, " << current << " up to date ("
+		<< 100.0 * current / steps.size() << "% hit rate), " << steps.size() - current - failed << " built, "
+		<< failed << " failed in " << elapsed.count() << " ms on " << threadCount << " threads with the "
+		<< MIP_FILTER_NAMES[mipFilter] << " mip filter" << endl;
+	return failed == 0;
+}
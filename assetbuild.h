@@ -0,0 +1,13 @@
+#ifndef ASSETBUILD_H
+#define ASSETBUILD_H
+
+#include <GL/glew.h>
+
+/* Brings every generated asset of a scene up to date: the binary scene and the
+ * BC texture cache of each image. An output is rebuilt only when its source or
+ * the parameters it was built with changed, and the texture caches build in
+ * parallel. Prints the time of each asset and how many were already current.
+ */
+bool UBuildAssets(const char* sceneFilename, GLuint mipFilter, GLuint threadCount);
+
+#endif
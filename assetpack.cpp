@@ -0,0 +1,176 @@
+#include <iostream>         // cout
+#include <fstream>          // ofstream
+#include <cstring>          // memcmp, strlen
+#include <algorithm>        // sort, min
+
+#include "assetpack.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	/* Pack layout: the header, the table of contents sorted by name, the name
+	 * table, then every blob on its own ASSET_PACK_ALIGNMENT boundary.
+	 */
+	const char ASSET_PACK_MAGIC[4] = { 'U', 'P', 'A', 'K' };
+	const uint32_t ASSET_PACK_VERSION = 1;
+
+	struct UAssetPackHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t headerSize;
+		uint32_t entryCount;
+		uint64_t namesOffset;
+		uint64_t namesSize;
+	};
+
+	uint64_t UAlignUp(uint64_t value)
+	{
+		return (value + ASSET_PACK_ALIGNMENT - 1) / ASSET_PACK_ALIGNMENT * ASSET_PACK_ALIGNMENT;
+	}
+
+	// Orders names like memcmp with the shorter name first on a tie, the same order the search expects
+	int UCompareNames(const char* a, size_t aLength, const char* b, size_t bLength)
+	{
+		int order = memcmp(a, b, min(aLength, bLength));
+		if (order != 0)
+			return order;
+		return aLength < bLength ? -1 : (aLength > bLength ? 1 : 0);
+	}
+}
+
+
+bool UWriteAssetPack(const char* packFilename, const vector<UAssetPackSource>& sources)
+{
+	vector<UAssetPackSource> sorted = sources;
+	sort(sorted.begin(), sorted.end(), [](const UAssetPackSource& a, const UAssetPackSource& b)
+	{
+		return UCompareNames(a.name.data(), a.name.size(), b.name.data(), b.name.size()) < 0;
+	});
+
+	// Map every source first so the table of contents knows their sizes
+	vector<UMappedFile> files(sorted.size());
+	bool mapped = true;
+	for (size_t i = 0; i < sorted.size() && mapped; ++i)
+	{
+		mapped = UMapFile(sorted[i].filename.c_str(), files[i]);
+		if (!mapped)
+			cout << "Failed to read " << sorted[i].filename << " for the asset pack" << endl;
+	}
+
+	string names;
+	vector<UAssetPackEntry> entries(sorted.size());
+	for (size_t i = 0; i < sorted.size(); ++i)
+	{
+		entries[i].nameOffset = (uint32_t)names.size();
+		entries[i].nameLength = (uint32_t)sorted[i].name.size();
+		names += sorted[i].name;
+	}
+
+	UAssetPackHeader header = {};
+	memcpy(header.magic, ASSET_PACK_MAGIC, sizeof(header.magic));
+	header.version = ASSET_PACK_VERSION;
+	header.headerSize = sizeof(UAssetPackHeader);
+	header.entryCount = (uint32_t)entries.size();
+	header.namesOffset = sizeof(UAssetPackHeader) + entries.size() * sizeof(UAssetPackEntry);
+	header.namesSize = names.size();
+
+	uint64_t offset = UAlignUp(header.namesOffset + header.namesSize);
+	for (size_t i = 0; i < entries.size() && mapped; ++i)
+	{
+		entries[i].offset = offset;
+		entries[i].size = files[i].size;
+		offset = UAlignUp(offset + files[i].size);
+	}
+
+	bool written = false;
+	ofstream pack;
+	if (mapped)
+		pack.open(packFilename, ios::binary | ios::trunc);
+	if (pack.is_open())
+	{
+		const char padding[ASSET_PACK_ALIGNMENT] = {};
+		pack.write((const char*)&header, sizeof(header));
+		pack.write((const char*)entries.data(), (streamsize)(entries.size() * sizeof(UAssetPackEntry)));
+		pack.write(names.data(), (streamsize)names.size());
+		for (size_t i = 0; i < entries.size(); ++i)
+		{
+			pack.write(padding, (streamsize)(entries[i].offset - (uint64_t)pack.tellp()));
+			pack.write((const char*)files[i].data, (streamsize)files[i].size);
+		}
+		written = pack.good();
+	}
+
+	for (UMappedFile& file : files)
+		UUnmapFile(file);
+	return written;
+}
+
+
+bool UOpenAssetPack(const char* packFilename, UAssetPack& pack)
+{
+	pack = UAssetPack();
+	if (!UMapFile(packFilename, pack.file))
+		return false;
+
+	const UMappedFile& file = pack.file;
+	const UAssetPackHeader* header = (const UAssetPackHeader*)file.data;
+	bool valid = file.size >= sizeof(UAssetPackHeader)
+		&& memcmp(header->magic, ASSET_PACK_MAGIC, sizeof(header->magic)) == 0
+		&& header->version == ASSET_PACK_VERSION
+		&& header->headerSize == sizeof(UAssetPackHeader)
+		&& header->namesOffset == sizeof(UAssetPackHeader) + (uint64_t)header->entryCount * sizeof(UAssetPackEntry)
+		&& header->namesOffset + header->namesSize <= file.size;
+
+	const UAssetPackEntry* entries = (const UAssetPackEntry*)(file.data + sizeof(UAssetPackHeader));
+	for (uint32_t i = 0; valid && i < header->entryCount; ++i)
+	{
+		valid = entries[i].offset % ASSET_PACK_ALIGNMENT == 0
+			&& entries[i].offset <= file.size && entries[i].size <= file.size - entries[i].offset
+			&& (uint64_t)entries[i].nameOffset + entries[i].nameLength <= header->namesSize;
+	}
+
+	if (!valid)
+	{
+		UUnmapFile(pack.file);
+		return false;
+	}
+
+	pack.entries = entries;
+	pack.entryCount = header->entryCount;
+	pack.names = (const char*)(file.data + header->namesOffset);
+	return true;
+}
+
+
+void UCloseAssetPack(UAssetPack& pack)
+{
+	UUnmapFile(pack.file);
+	pack = UAssetPack();
+}
+
+
+bool UFindAsset(const UAssetPack& pack, const char* name, UAssetSpan& span)
+{
+	const size_t length = strlen(name);
+	uint32_t first = 0;
+	uint32_t end = pack.entryCount;
+	while (first < end)
+	{
+		const uint32_t middle = first + (end - first) / 2;
+		const UAssetPackEntry& entry = pack.entries[middle];
+		int order = UCompareNames(pack.names + entry.nameOffset, entry.nameLength, name, length);
+		if (order == 0)
+		{
+			span.data = pack.file.data + entry.offset;
+			span.size = (size_t)entry.size;
+			return true;
+		}
+		if (order < 0)
+			first = middle + 1;
+		else
+			end = middle;
+	}
+	return false;
+}
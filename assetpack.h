@@ -0,0 +1,58 @@
+#ifndef ASSETPACK_H
+#define ASSETPACK_H
+
+#include <cstddef>          // size_t
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mappedfile.h"
+
+// Blobs start on page boundaries so each one maps and pages in on its own
+const size_t ASSET_PACK_ALIGNMENT = 4096;
+
+// Table of contents entry, sorted by name
+struct UAssetPackEntry
+{
+	uint64_t offset;        // From the start of the pack, a multiple of ASSET_PACK_ALIGNMENT
+	uint64_t size;
+	uint32_t nameOffset;    // Into the name table, names are not terminated
+	uint32_t nameLength;
+};
+
+/* One file holding every asset the app reads at startup. It is mapped once and
+ * loaders get spans pointing into the mapping, so no asset is opened or copied
+ * on its own.
+ */
+struct UAssetPack
+{
+	UMappedFile file;
+	const UAssetPackEntry* entries = nullptr;
+	uint32_t entryCount = 0;
+	const char* names = nullptr;
+};
+
+// A read-only view of one asset inside a mapped pack
+struct UAssetSpan
+{
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+};
+
+// A file to pack and the name loaders look it up by, usually the same path
+struct UAssetPackSource
+{
+	std::string name;
+	std::string filename;
+};
+
+bool UWriteAssetPack(const char* packFilename, const std::vector<UAssetPackSource>& sources);
+
+// Maps the pack and checks its table of contents
+bool UOpenAssetPack(const char* packFilename, UAssetPack& pack);
+void UCloseAssetPack(UAssetPack& pack);
+
+// Binary search of the table of contents
+bool UFindAsset(const UAssetPack& pack, const char* name, UAssetSpan& span);
+
+#endif
@@ -0,0 +1,484 @@
+#include <algorithm>        // min, max, nth_element, partition
+#include <limits>           // infinity
+
+#include <emmintrin.h>      // SSE2
+
+#include "bvh.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	// Candidate split planes per axis when building
+	const GLuint SAH_BINS = 16;
+	// Below this depth splits halve the run, which bounds the depth of the tree and the query stacks
+	const GLuint SAH_MAX_DEPTH = 40;
+	const GLuint STACK_SIZE = 256;
+
+	// Binary tree the build produces before it is collapsed to four-wide nodes
+	struct UBuildNode
+	{
+		UBounds box;
+		GLuint first;
+		GLuint count;
+		GLuint left;        // 0 for a leaf, the root is never a child
+		GLuint right;
+	};
+
+	struct UBuilder
+	{
+		const UBounds* bounds;
+		vector<glm::vec3> centroids;
+		vector<GLuint> order;
+		vector<UBuildNode> nodes;
+	};
+
+	UBounds UEmptyBounds()
+	{
+		const float infinity = numeric_limits<float>::infinity();
+		return { glm::vec3(infinity), glm::vec3(-infinity) };
+	}
+
+	void UGrow(UBounds& box, const UBounds& other)
+	{
+		box.min = glm::min(box.min, other.min);
+		box.max = glm::max(box.max, other.max);
+	}
+
+	// Half the surface area, the SAH only compares areas
+	float UHalfArea(const UBounds& box)
+	{
+		const glm::vec3 size = glm::max(box.max - box.min, glm::vec3(0.0f));
+		return size.x * size.y + size.y * size.z + size.z * size.x;
+	}
+
+	GLuint UBuildBinary(UBuilder& builder, GLuint first, GLuint count, GLuint depth)
+	{
+		const GLuint index = (GLuint)builder.nodes.size();
+		builder.nodes.push_back(UBuildNode());
+
+		UBounds box = UEmptyBounds();
+		UBounds centroidBox = UEmptyBounds();
+		for (GLuint i = first; i < first + count; ++i)
+		{
+			UGrow(box, builder.bounds[builder.order[i]]);
+			UGrow(centroidBox, { builder.centroids[builder.order[i]], builder.centroids[builder.order[i]] });
+		}
+		builder.nodes[index] = { box, first, count, 0, 0 };
+		if (count <= BVH_LEAF_SIZE)
+			return index;
+
+		const glm::vec3 extent = centroidBox.max - centroidBox.min;
+		const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : (extent.y >= extent.z ? 1 : 2);
+		GLuint* begin = builder.order.data() + first;
+		GLuint* end = begin + count;
+		GLuint* split = begin;
+
+		// Binned SAH on the longest centroid axis: cost of a split is area times objects on each side
+		if (extent[axis] > 0.0f && depth < SAH_MAX_DEPTH)
+		{
+			const float scale = SAH_BINS / extent[axis];
+			auto binOf = [&](GLuint object)
+			{
+				return min(SAH_BINS - 1, (GLuint)((builder.centroids[object][axis] - centroidBox.min[axis]) * scale));
+			};
+
+			GLuint binCounts[SAH_BINS] = {};
+			UBounds binBoxes[SAH_BINS];
+			for (UBounds& binBox : binBoxes)
+				binBox = UEmptyBounds();
+			for (GLuint* object = begin; object < end; ++object)
+			{
+				const GLuint bin = binOf(*object);
+				++binCounts[bin];
+				UGrow(binBoxes[bin], builder.bounds[*object]);
+			}
+
+			// Right side areas and counts swept from the top bin down
+			float rightAreas[SAH_BINS];
+			GLuint rightCounts[SAH_BINS];
+			UBounds right = UEmptyBounds();
+			GLuint rightCount = 0;
+			for (GLuint bin = SAH_BINS - 1; bin > 0; --bin)
+			{
+				UGrow(right, binBoxes[bin]);
+				rightCount += binCounts[bin];
+				rightAreas[bin] = UHalfArea(right);
+				rightCounts[bin] = rightCount;
+			}
+
+			UBounds left = UEmptyBounds();
+			GLuint leftCount = 0;
+			float bestCost = numeric_limits<float>::max();
+			GLuint bestBin = 0;
+			for (GLuint bin = 0; bin + 1 < SAH_BINS; ++bin)
+			{
+				UGrow(left, binBoxes[bin]);
+				leftCount += binCounts[bin];
+				if (leftCount == 0 || rightCounts[bin + 1] == 0)
+					continue;
+				const float cost = UHalfArea(left) * leftCount + rightAreas[bin + 1] * rightCounts[bin + 1];
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestBin = bin;
+				}
+			}
+
+			if (bestCost < numeric_limits<float>::max())
+				split = partition(begin, end, [&](GLuint object) { return binOf(object) <= bestBin; });
+		}
+
+		// Identical centroids give no plane to split at, halve the run instead
+		if (split == begin || split == end)
+		{
+			split = begin + count / 2;
+			nth_element(begin, split, end, [&](GLuint a, GLuint b) { return builder.centroids[a][axis] < builder.centroids[b][axis]; });
+		}
+
+		const GLuint leftCount = (GLuint)(split - begin);
+		const GLuint leftChild = UBuildBinary(builder, first, leftCount, depth + 1);
+		const GLuint rightChild = UBuildBinary(builder, first + leftCount, count - leftCount, depth + 1);
+		builder.nodes[index].left = leftChild;
+		builder.nodes[index].right = rightChild;
+		return index;
+	}
+
+	void USetSlot(UBvhNode& node, GLuint slot, const UBounds& box)
+	{
+		node.minX[slot] = box.min.x;
+		node.minY[slot] = box.min.y;
+		node.minZ[slot] = box.min.z;
+		node.maxX[slot] = box.max.x;
+		node.maxY[slot] = box.max.y;
+		node.maxZ[slot] = box.max.z;
+	}
+
+	UBounds UNodeBounds(const UBvhNode& node)
+	{
+		UBounds box = UEmptyBounds();
+		for (GLuint slot = 0; slot < node.childCount; ++slot)
+			UGrow(box, { glm::vec3(node.minX[slot], node.minY[slot], node.minZ[slot]), glm::vec3(node.maxX[slot], node.maxY[slot], node.maxZ[slot]) });
+		return box;
+	}
+
+	// Emits a four-wide node for a binary inner node by opening its largest inner descendants
+	GLuint UCollapse(const vector<UBuildNode>& binary, GLuint index, UBvh& bvh)
+	{
+		GLuint children[4] = { binary[index].left, binary[index].right };
+		GLuint childCount = 2;
+		while (childCount < 4)
+		{
+			int open = -1;
+			float largest = -1.0f;
+			for (GLuint i = 0; i < childCount; ++i)
+			{
+				const UBuildNode& child = binary[children[i]];
+				if (child.left && UHalfArea(child.box) > largest)
+				{
+					open = (int)i;
+					largest = UHalfArea(child.box);
+				}
+			}
+			if (open < 0)
+				break;
+
+			const UBuildNode& opened = binary[children[open]];
+			children[open] = opened.left;
+			children[childCount++] = opened.right;
+		}
+
+		const GLuint nodeIndex = (GLuint)bvh.nodes.size();
+		bvh.nodes.push_back(UBvhNode());
+		for (GLuint slot = 0; slot < childCount; ++slot)
+		{
+			const UBuildNode& child = binary[children[slot]];
+			const GLuint inner = child.left ? UCollapse(binary, children[slot], bvh) : 0;
+
+			// Fetched again, the recursion may have grown the array
+			UBvhNode& node = bvh.nodes[nodeIndex];
+			USetSlot(node, slot, child.box);
+			node.child[slot] = inner;
+			node.first[slot] = child.first;
+			node.count[slot] = child.count;
+		}
+		bvh.nodes[nodeIndex].childCount = childCount;
+		return nodeIndex;
+	}
+
+	// Mask of a node's used slots
+	int USlotMask(const UBvhNode& node)
+	{
+		return (1 << node.childCount) - 1;
+	}
+}
+
+
+UBounds USphereBounds(const glm::vec3& center, float radius)
+{
+	return { center - glm::vec3(radius), center + glm::vec3(radius) };
+}
+
+
+bool UBoxTouchesFrustum(const UBounds& box, const UFrustum& frustum)
+{
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		// The corner furthest along the normal
+		const glm::vec3 corner(plane.x >= 0.0f ? box.max.x : box.min.x,
+			plane.y >= 0.0f ? box.max.y : box.min.y,
+			plane.z >= 0.0f ? box.max.z : box.min.z);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+			return false;
+	}
+	return true;
+}
+
+
+bool URayEntersBox(const UBounds& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& entry)
+{
+	const glm::vec3 t0 = (box.min - origin) * inverseDirection;
+	const glm::vec3 t1 = (box.max - origin) * inverseDirection;
+	const glm::vec3 enter = glm::min(t0, t1);
+	const glm::vec3 leave = glm::max(t0, t1);
+	entry = max(max(max(enter.x, enter.y), enter.z), 0.0f);
+	const float exit = min(min(leave.x, leave.y), leave.z);
+	return exit >= entry && entry <= maxDistance;
+}
+
+
+bool UBoxTouchesSphere(const UBounds& box, const glm::vec3& center, float radius)
+{
+	const glm::vec3 outside = glm::max(glm::max(box.min - center, center - box.max), glm::vec3(0.0f));
+	return glm::dot(outside, outside) <= radius * radius;
+}
+
+
+void UBuildBvh(UBvh& bvh, const UBounds* bounds, GLuint count)
+{
+	bvh = UBvh();
+	if (count == 0)
+		return;
+
+	UBuilder builder;
+	builder.bounds = bounds;
+	builder.centroids.resize(count);
+	builder.order.resize(count);
+	for (GLuint i = 0; i < count; ++i)
+	{
+		builder.centroids[i] = (bounds[i].min + bounds[i].max) * 0.5f;
+		builder.order[i] = i;
+	}
+	UBuildBinary(builder, 0, count, 0);
+
+	// A small scene is a single leaf, which still needs a root to hang from
+	if (builder.nodes[0].left == 0)
+	{
+		UBvhNode root = UBvhNode();
+		USetSlot(root, 0, builder.nodes[0].box);
+		root.count[0] = count;
+		root.childCount = 1;
+		bvh.nodes.push_back(root);
+	}
+	else
+		UCollapse(builder.nodes, 0, bvh);
+
+	bvh.objects = move(builder.order);
+	bvh.objectBounds.resize(count);
+	for (GLuint i = 0; i < count; ++i)
+		bvh.objectBounds[i] = bounds[bvh.objects[i]];
+}
+
+
+void URefitBvh(UBvh& bvh, const UBounds* bounds)
+{
+	for (size_t i = 0; i < bvh.objects.size(); ++i)
+		bvh.objectBounds[i] = bounds[bvh.objects[i]];
+
+	// Children follow their parents, so walking backwards refits them first
+	for (size_t index = bvh.nodes.size(); index-- > 0;)
+	{
+		UBvhNode& node = bvh.nodes[index];
+		for (GLuint slot = 0; slot < node.childCount; ++slot)
+		{
+			UBounds box = UEmptyBounds();
+			if (node.child[slot])
+				box = UNodeBounds(bvh.nodes[node.child[slot]]);
+			else
+			{
+				for (GLuint i = node.first[slot]; i < node.first[slot] + node.count[slot]; ++i)
+					UGrow(box, bvh.objectBounds[i]);
+			}
+			USetSlot(node, slot, box);
+		}
+	}
+}
+
+
+void UCullBvh(const UBvh& bvh, const UFrustum& frustum, vector<GLuint>& visible)
+{
+	if (bvh.nodes.empty())
+		return;
+
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int i = 0; i < 6; ++i)
+	{
+		planeX[i] = _mm_set1_ps(frustum.planes[i].x);
+		planeY[i] = _mm_set1_ps(frustum.planes[i].y);
+		planeZ[i] = _mm_set1_ps(frustum.planes[i].z);
+		planeW[i] = _mm_set1_ps(frustum.planes[i].w);
+	}
+
+	GLuint stack[STACK_SIZE];
+	GLuint depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0)
+	{
+		const UBvhNode& node = bvh.nodes[stack[--depth]];
+		const __m128 minX = _mm_loadu_ps(node.minX), maxX = _mm_loadu_ps(node.maxX);
+		const __m128 minY = _mm_loadu_ps(node.minY), maxY = _mm_loadu_ps(node.maxY);
+		const __m128 minZ = _mm_loadu_ps(node.minZ), maxZ = _mm_loadu_ps(node.maxZ);
+
+		// Out when the corner furthest along a normal is behind its plane,
+		// fully in when the nearest corner is in front of every plane
+		__m128 outside = _mm_setzero_ps();
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int i = 0; i < 6; ++i)
+		{
+			const glm::vec4& plane = frustum.planes[i];
+			const __m128 farX = plane.x >= 0.0f ? maxX : minX, nearX = plane.x >= 0.0f ? minX : maxX;
+			const __m128 farY = plane.y >= 0.0f ? maxY : minY, nearY = plane.y >= 0.0f ? minY : maxY;
+			const __m128 farZ = plane.z >= 0.0f ? maxZ : minZ, nearZ = plane.z >= 0.0f ? minZ : maxZ;
+			const __m128 furthest = _mm_add_ps(_mm_add_ps(_mm_mul_ps(farX, planeX[i]), _mm_mul_ps(farY, planeY[i])),
+				_mm_add_ps(_mm_mul_ps(farZ, planeZ[i]), planeW[i]));
+			const __m128 nearest = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nearX, planeX[i]), _mm_mul_ps(nearY, planeY[i])),
+				_mm_add_ps(_mm_mul_ps(nearZ, planeZ[i]), planeW[i]));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(furthest, _mm_setzero_ps()));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(nearest, _mm_setzero_ps()));
+		}
+
+		const int touching = ~_mm_movemask_ps(outside) & USlotMask(node);
+		const int contained = _mm_movemask_ps(inside) & touching;
+		for (GLuint slot = 0; slot < node.childCount; ++slot)
+		{
+			if (!(touching & (1 << slot)))
+				continue;
+
+			// A contained child's whole run is visible, the run covers its subtree
+			if (contained & (1 << slot))
+				visible.insert(visible.end(), bvh.objects.begin() + node.first[slot], bvh.objects.begin() + node.first[slot] + node.count[slot]);
+			else if (node.child[slot])
+				stack[depth++] = node.child[slot];
+			else
+			{
+				for (GLuint i = node.first[slot]; i < node.first[slot] + node.count[slot]; ++i)
+				{
+					if (UBoxTouchesFrustum(bvh.objectBounds[i], frustum))
+						visible.push_back(bvh.objects[i]);
+				}
+			}
+		}
+	}
+}
+
+
+bool URaycastBvh(const UBvh& bvh, const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+	GLuint& object, float& distance)
+{
+	if (bvh.nodes.empty())
+		return false;
+
+	const glm::vec3 inverseDirection = 1.0f / direction;
+	const __m128 originX = _mm_set1_ps(origin.x), originY = _mm_set1_ps(origin.y), originZ = _mm_set1_ps(origin.z);
+	const __m128 inverseX = _mm_set1_ps(inverseDirection.x), inverseY = _mm_set1_ps(inverseDirection.y), inverseZ = _mm_set1_ps(inverseDirection.z);
+
+	bool hit = false;
+	distance = maxDistance;
+
+	GLuint stack[STACK_SIZE];
+	GLuint depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0)
+	{
+		const UBvhNode& node = bvh.nodes[stack[--depth]];
+
+		// Slab test of the four child boxes
+		const __m128 x0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), originX), inverseX);
+		const __m128 x1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxX), originX), inverseX);
+		const __m128 y0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), originY), inverseY);
+		const __m128 y1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxY), originY), inverseY);
+		const __m128 z0 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), originZ), inverseZ);
+		const __m128 z1 = _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(node.maxZ), originZ), inverseZ);
+		__m128 entry = _mm_max_ps(_mm_max_ps(_mm_min_ps(x0, x1), _mm_min_ps(y0, y1)), _mm_max_ps(_mm_min_ps(z0, z1), _mm_setzero_ps()));
+		__m128 exit = _mm_min_ps(_mm_min_ps(_mm_max_ps(x0, x1), _mm_max_ps(y0, y1)), _mm_max_ps(z0, z1));
+		const __m128 hits = _mm_and_ps(_mm_cmpge_ps(exit, entry), _mm_cmple_ps(entry, _mm_set1_ps(distance)));
+
+		const int mask = _mm_movemask_ps(hits) & USlotMask(node);
+		for (GLuint slot = 0; slot < node.childCount; ++slot)
+		{
+			if (!(mask & (1 << slot)))
+				continue;
+
+			if (node.child[slot])
+			{
+				stack[depth++] = node.child[slot];
+				continue;
+			}
+
+			for (GLuint i = node.first[slot]; i < node.first[slot] + node.count[slot]; ++i)
+			{
+				float objectEntry;
+				if (URayEntersBox(bvh.objectBounds[i], origin, inverseDirection, distance, objectEntry) && (!hit || objectEntry < distance))
+				{
+					hit = true;
+					object = bvh.objects[i];
+					distance = objectEntry;
+				}
+			}
+		}
+	}
+	return hit;
+}
+
+
+void UQueryBvhSphere(const UBvh& bvh, const glm::vec3& center, float radius, vector<GLuint>& results)
+{
+	if (bvh.nodes.empty())
+		return;
+
+	const __m128 centerX = _mm_set1_ps(center.x), centerY = _mm_set1_ps(center.y), centerZ = _mm_set1_ps(center.z);
+	const __m128 radiusSquared = _mm_set1_ps(radius * radius);
+
+	GLuint stack[STACK_SIZE];
+	GLuint depth = 0;
+	stack[depth++] = 0;
+	while (depth > 0)
+	{
+		const UBvhNode& node = bvh.nodes[stack[--depth]];
+
+		// Squared distance from the center to each child box
+		const __m128 dx = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(node.minX), centerX), _mm_sub_ps(centerX, _mm_loadu_ps(node.maxX))), _mm_setzero_ps());
+		const __m128 dy = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(node.minY), centerY), _mm_sub_ps(centerY, _mm_loadu_ps(node.maxY))), _mm_setzero_ps());
+		const __m128 dz = _mm_max_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(node.minZ), centerZ), _mm_sub_ps(centerZ, _mm_loadu_ps(node.maxZ))), _mm_setzero_ps());
+		const __m128 squared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+
+		const int mask = _mm_movemask_ps(_mm_cmple_ps(squared, radiusSquared)) & USlotMask(node);
+		for (GLuint slot = 0; slot < node.childCount; ++slot)
+		{
+			if (!(mask & (1 << slot)))
+				continue;
+
+			if (node.child[slot])
+				stack[depth++] = node.child[slot];
+			else
+			{
+				for (GLuint i = node.first[slot]; i < node.first[slot] + node.count[slot]; ++i)
+				{
+					if (UBoxTouchesSphere(bvh.objectBounds[i], center, radius))
+						results.push_back(bvh.objects[i]);
+				}
+			}
+		}
+	}
+}
+
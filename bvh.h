@@ -0,0 +1,68 @@
+#ifndef BVH_H
+#define BVH_H
+
+#include <GL/glew.h>        // GLuint
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "culling.h"
+
+// Axis-aligned box
+struct UBounds
+{
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+// Objects per leaf at most
+const GLuint BVH_LEAF_SIZE = 4;
+
+/* Node with up to four children, their boxes stored per component so one SSE
+ * instruction tests all four. Children fill the slots from 0. Each child covers
+ * a contiguous run of UBvh::objects, a whole subtree included.
+ */
+struct UBvhNode
+{
+	float minX[4], minY[4], minZ[4];
+	float maxX[4], maxY[4], maxZ[4];
+	GLuint child[4];        // Node index of an inner child, 0 for a leaf (the root is never a child)
+	GLuint first[4];        // First entry of the child's run in UBvh::objects
+	GLuint count[4];        // Objects under the child
+	GLuint childCount;
+};
+
+/* Bounding volume hierarchy over object boxes, built with the surface area
+ * heuristic and flattened depth first, so children always follow their parent.
+ */
+struct UBvh
+{
+	std::vector<UBvhNode> nodes;        // nodes[0] is the root
+	std::vector<GLuint> objects;        // Object indices in leaf order
+	std::vector<UBounds> objectBounds;  // Box of each entry of objects, in the same order
+};
+
+// The box of a world-space bounding sphere
+UBounds USphereBounds(const glm::vec3& center, float radius);
+
+// Box tests shared by the spatial indexes
+bool UBoxTouchesFrustum(const UBounds& box, const UFrustum& frustum);
+// Entry distance of the ray into the box, or false when it misses within maxDistance
+bool URayEntersBox(const UBounds& box, const glm::vec3& origin, const glm::vec3& inverseDirection, float maxDistance, float& entry);
+bool UBoxTouchesSphere(const UBounds& box, const glm::vec3& center, float radius);
+
+void UBuildBvh(UBvh& bvh, const UBounds* bounds, GLuint count);
+// Updates the boxes after objects moved, keeping the tree. bounds is indexed by object like for the build.
+void URefitBvh(UBvh& bvh, const UBounds* bounds);
+
+// Appends the objects whose boxes touch the frustum, in no particular order
+void UCullBvh(const UBvh& bvh, const UFrustum& frustum, std::vector<GLuint>& visible);
+// Nearest object whose box the ray enters within maxDistance. direction need not be normalized,
+// distance is in units of its length.
+bool URaycastBvh(const UBvh& bvh, const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+	GLuint& object, float& distance);
+// Appends the objects whose boxes touch the sphere
+void UQueryBvhSphere(const UBvh& bvh, const glm::vec3& center, float radius, std::vector<GLuint>& results);
+
+#endif
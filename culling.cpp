@@ -0,0 +1,102 @@
+#include <algorithm>        // max
+#include <cmath>            // sqrt
+#include <limits>           // quiet_NaN
+
+#include <emmintrin.h>      // SSE2
+
+#include "culling.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	// Padding spheres have NaN centers, every comparison with them fails
+	const float PADDING_CENTER = numeric_limits<float>::quiet_NaN();
+}
+
+
+void UExtractFrustum(const glm::mat4& viewProjection, UFrustum& frustum)
+{
+	// GLM is column major, row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i])
+	const glm::mat4& m = viewProjection;
+	const glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+	const glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+	const glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+	const glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+	frustum.planes[0] = row3 + row0;
+	frustum.planes[1] = row3 - row0;
+	frustum.planes[2] = row3 + row1;
+	frustum.planes[3] = row3 - row1;
+	frustum.planes[4] = row3 + row2;
+	frustum.planes[5] = row3 - row2;
+
+	// Unit normals make the plane distance comparable with the radius
+	for (glm::vec4& plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));
+}
+
+
+void UResetCullBounds(UCullBounds& bounds, GLuint count)
+{
+	const size_t padded = (count + 3) & ~3u;
+	bounds.centerX.assign(padded, PADDING_CENTER);
+	bounds.centerY.assign(padded, PADDING_CENTER);
+	bounds.centerZ.assign(padded, PADDING_CENTER);
+	bounds.radius.assign(padded, 0.0f);
+	bounds.count = count;
+}
+
+
+void USetCullBounds(UCullBounds& bounds, GLuint index, const glm::vec4& modelSphere, const glm::mat4& transform)
+{
+	const glm::vec3 center = glm::vec3(transform * glm::vec4(glm::vec3(modelSphere), 1.0f));
+
+	// The largest axis scale keeps the sphere enclosing under non-uniform scaling
+	const float scale = sqrt(max(glm::dot(glm::vec3(transform[0]), glm::vec3(transform[0])),
+		max(glm::dot(glm::vec3(transform[1]), glm::vec3(transform[1])), glm::dot(glm::vec3(transform[2]), glm::vec3(transform[2])))));
+
+	bounds.centerX[index] = center.x;
+	bounds.centerY[index] = center.y;
+	bounds.centerZ[index] = center.z;
+	bounds.radius[index] = modelSphere.w * scale;
+}
+
+
+void UCullSpheres(const UCullBounds& bounds, const UFrustum& frustum, vector<GLuint>& visible)
+{
+	__m128 planeX[6], planeY[6], planeZ[6], planeW[6];
+	for (int i = 0; i < 6; ++i)
+	{
+		planeX[i] = _mm_set1_ps(frustum.planes[i].x);
+		planeY[i] = _mm_set1_ps(frustum.planes[i].y);
+		planeZ[i] = _mm_set1_ps(frustum.planes[i].z);
+		planeW[i] = _mm_set1_ps(frustum.planes[i].w);
+	}
+
+	// A sphere is out when it lies entirely behind any plane: distance < -radius
+	const size_t padded = bounds.radius.size();
+	for (size_t first = 0; first < padded; first += 4)
+	{
+		const __m128 x = _mm_loadu_ps(&bounds.centerX[first]);
+		const __m128 y = _mm_loadu_ps(&bounds.centerY[first]);
+		const __m128 z = _mm_loadu_ps(&bounds.centerZ[first]);
+		const __m128 negativeRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&bounds.radius[first]));
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int i = 0; i < 6; ++i)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, planeX[i]), _mm_mul_ps(y, planeY[i])),
+				_mm_add_ps(_mm_mul_ps(z, planeZ[i]), planeW[i]));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, negativeRadius));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		while (mask)
+		{
+			const int lane = mask & 1 ? 0 : mask & 2 ? 1 : mask & 4 ? 2 : 3;
+			visible.push_back((GLuint)(first + lane));
+			mask &= mask - 1;
+		}
+	}
+}
@@ -0,0 +1,39 @@
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <GL/glew.h>        // GLuint
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+// Clip planes of a view, each normalized with the inside where dot(plane.xyz, p) + plane.w >= 0
+struct UFrustum
+{
+	glm::vec4 planes[6];    // Left, right, bottom, top, near, far
+};
+
+/* World-space bounding spheres of the scene's objects, one array per component so
+ * the culling pass tests four objects per SSE instruction. The arrays are padded
+ * to a multiple of four with spheres that never pass.
+ */
+struct UCullBounds
+{
+	std::vector<float> centerX;
+	std::vector<float> centerY;
+	std::vector<float> centerZ;
+	std::vector<float> radius;
+	GLuint count = 0;
+};
+
+// Extracts the planes from projection * view, the Gribb and Hartmann method
+void UExtractFrustum(const glm::mat4& viewProjection, UFrustum& frustum);
+
+// Sphere of each object from its mesh's model-space sphere (center, radius) and its model matrix
+void UResetCullBounds(UCullBounds& bounds, GLuint count);
+void USetCullBounds(UCullBounds& bounds, GLuint index, const glm::vec4& modelSphere, const glm::mat4& transform);
+
+// Appends the indices of the spheres inside or crossing the frustum, in ascending order
+void UCullSpheres(const UCullBounds& bounds, const UFrustum& frustum, std::vector<GLuint>& visible);
+
+#endif
@@ -0,0 +1,224 @@
+#include <iostream>         // cout
+#include <cstddef>          // offsetof
+#include <algorithm>        // max
+
+#include "framedata.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	GLsizeiptr UAlignUp(GLsizeiptr size, GLsizeiptr alignment)
+	{
+		return (size + alignment - 1) / alignment * alignment;
+	}
+
+	GLintptr UFrameOffset(const UUniformRing& ring)
+	{
+		return (GLintptr)ring.frame * ring.frameStride;
+	}
+}
+
+
+bool UCreateUniformRing(UUniformRing& ring, GLuint objectCapacity, GLuint commandCapacity)
+{
+	UDestroyUniformRing(ring);
+
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+
+	ring.frameDataSize = UAlignUp(sizeof(UFrameData), alignment);
+	ring.objectStride = UAlignUp(sizeof(UObjectData), alignment);
+	ring.objectCapacity = objectCapacity;
+	ring.commandCapacity = commandCapacity;
+	ring.frameStride = ring.frameDataSize + ring.objectStride * objectCapacity;
+	ring.frame = 0;
+
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	const GLsizeiptr size = ring.frameStride * UNIFORM_RING_FRAMES;
+
+	glGenBuffers(1, &ring.buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, ring.buffer);
+	glBufferStorage(GL_UNIFORM_BUFFER, size, NULL, flags);
+	ring.mapped = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, size, flags);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	const GLsizeiptr instanceSize = sizeof(UObjectData) * objectCapacity * UNIFORM_RING_FRAMES;
+	glGenBuffers(1, &ring.instanceBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, ring.instanceBuffer);
+	glBufferStorage(GL_ARRAY_BUFFER, instanceSize, NULL, flags);
+	ring.instances = (UObjectData*)glMapBufferRange(GL_ARRAY_BUFFER, 0, instanceSize, flags);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	const GLsizeiptr commandSize = sizeof(UDrawElementsIndirectCommand) * max(commandCapacity, 1u) * UNIFORM_RING_FRAMES;
+	glGenBuffers(1, &ring.indirectBuffer);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring.indirectBuffer);
+	glBufferStorage(GL_DRAW_INDIRECT_BUFFER, commandSize, NULL, flags);
+	ring.commands = (UDrawElementsIndirectCommand*)glMapBufferRange(GL_DRAW_INDIRECT_BUFFER, 0, commandSize, flags);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+	if (!ring.mapped || !ring.instances || !ring.commands)
+	{
+		cout << "Failed to map the uniform ring buffer" << endl;
+		UDestroyUniformRing(ring);
+		return false;
+	}
+
+	return true;
+}
+
+
+void UDestroyUniformRing(UUniformRing& ring)
+{
+	for (GLsync& fence : ring.fences)
+	{
+		if (fence)
+			glDeleteSync(fence);
+		fence = 0;
+	}
+
+	if (ring.buffer)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, ring.buffer);
+		if (ring.mapped)
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+		glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		glDeleteBuffers(1, &ring.buffer);
+	}
+
+	if (ring.instanceBuffer)
+	{
+		glBindBuffer(GL_ARRAY_BUFFER, ring.instanceBuffer);
+		if (ring.instances)
+			glUnmapBuffer(GL_ARRAY_BUFFER);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+		glDeleteBuffers(1, &ring.instanceBuffer);
+	}
+
+	if (ring.indirectBuffer)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, ring.indirectBuffer);
+		if (ring.commands)
+			glUnmapBuffer(GL_DRAW_INDIRECT_BUFFER);
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		glDeleteBuffers(1, &ring.indirectBuffer);
+	}
+
+	ring = UUniformRing();
+}
+
+
+void UBeginUniformFrame(UUniformRing& ring)
+{
+	GLsync& fence = ring.fences[ring.frame];
+	if (!fence)
+		return;
+
+	// Normally already signaled, the GPU is at most UNIFORM_RING_FRAMES - 1 frames behind
+	GLenum result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+	while (result == GL_TIMEOUT_EXPIRED)
+		result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000); // 1 ms
+
+	glDeleteSync(fence);
+	fence = 0;
+}
+
+
+void UEndUniformFrame(UUniformRing& ring)
+{
+	ring.fences[ring.frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	ring.frame = (ring.frame + 1) % UNIFORM_RING_FRAMES;
+}
+
+
+UFrameData* UFrameDataPtr(UUniformRing& ring)
+{
+	return (UFrameData*)(ring.mapped + UFrameOffset(ring));
+}
+
+
+UObjectData* UObjectDataPtr(UUniformRing& ring, GLuint object)
+{
+	return (UObjectData*)(ring.mapped + UFrameOffset(ring) + ring.frameDataSize + ring.objectStride * object);
+}
+
+
+UObjectData* UInstanceDataPtr(UUniformRing& ring, GLuint instance)
+{
+	return ring.instances + UInstanceBase(ring) + instance;
+}
+
+
+UDrawElementsIndirectCommand* UCommandDataPtr(UUniformRing& ring)
+{
+	return ring.commands + ring.frame * ring.commandCapacity;
+}
+
+
+GLintptr UCommandOffset(const UUniformRing& ring)
+{
+	return (GLintptr)sizeof(UDrawElementsIndirectCommand) * ring.frame * ring.commandCapacity;
+}
+
+
+GLuint UInstanceBase(const UUniformRing& ring)
+{
+	return ring.frame * ring.objectCapacity;
+}
+
+
+void UBindFrameData(const UUniformRing& ring)
+{
+	glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_DATA_BINDING, ring.buffer, UFrameOffset(ring), sizeof(UFrameData));
+}
+
+
+void UBindObjectData(const UUniformRing& ring, GLuint object)
+{
+	GLintptr offset = UFrameOffset(ring) + ring.frameDataSize + ring.objectStride * object;
+	glBindBufferRange(GL_UNIFORM_BUFFER, OBJECT_DATA_BINDING, ring.buffer, offset, sizeof(UObjectData));
+}
+
+
+void UBindInstanceAttributes(const UUniformRing& ring, GLuint firstLocation)
+{
+	const GLsizei stride = sizeof(UObjectData);
+
+	glBindBuffer(GL_ARRAY_BUFFER, ring.instanceBuffer);
+	for (GLuint column = 0; column < 4; ++column)
+	{
+		GLuint location = firstLocation + column;
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, stride, (void*)(offsetof(UObjectData, model) + sizeof(glm::vec4) * column));
+		glVertexAttribDivisor(location, 1);
+		glEnableVertexAttribArray(location);
+	}
+	for (GLuint column = 0; column < 3; ++column)
+	{
+		GLuint location = firstLocation + 4 + column;
+		glVertexAttribPointer(location, 3, GL_FLOAT, GL_FALSE, stride, (void*)(offsetof(UObjectData, normalMatrix) + sizeof(glm::vec4) * column));
+		glVertexAttribDivisor(location, 1);
+		glEnableVertexAttribArray(location);
+	}
+
+	const GLuint layerLocation = firstLocation + 7;
+	glVertexAttribIPointer(layerLocation, 1, GL_INT, stride, (void*)offsetof(UObjectData, textureLayer));
+	glVertexAttribDivisor(layerLocation, 1);
+	glEnableVertexAttribArray(layerLocation);
+}
+
+
+void UWriteObjectData(UObjectData& data, const glm::mat4& model, const glm::vec4& positionDecode, GLint textureLayer)
+{
+	glm::mat4 normalMatrix = glm::transpose(glm::inverse(model));
+
+	// model * translate(offset) * scale(w), the decode scale is uniform so normals do not need it
+	const float scale = positionDecode.w;
+	data.model[0] = model[0] * scale;
+	data.model[1] = model[1] * scale;
+	data.model[2] = model[2] * scale;
+	data.model[3] = model * glm::vec4(glm::vec3(positionDecode), 1.0f);
+	data.normalMatrix[0] = normalMatrix[0];
+	data.normalMatrix[1] = normalMatrix[1];
+	data.normalMatrix[2] = normalMatrix[2];
+	data.textureLayer = textureLayer;
+}
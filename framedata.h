@@ -0,0 +1,107 @@
+#ifndef FRAMEDATA_H
+#define FRAMEDATA_H
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+// Uniform block binding points shared by the C++ code and the shaders
+const GLuint FRAME_DATA_BINDING = 0;
+const GLuint OBJECT_DATA_BINDING = 1;
+
+// Number of frames the CPU may run ahead of the GPU before it waits on a fence
+const GLuint UNIFORM_RING_FRAMES = 3;
+
+// CPU mirror of the std140 FrameData block. Every vec3 is padded to a vec4.
+struct UFrameData
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec4 viewPosition;     // xyz
+	glm::vec4 ambientColor;     // rgb, a = ambient strength
+	glm::vec4 light1Color;      // rgb
+	glm::vec4 light1Position;   // xyz
+	glm::vec4 light2Color;      // rgb
+	glm::vec4 light2Position;   // xyz
+	glm::vec4 specular;         // x = intensity, y = highlight size
+};
+
+// CPU mirror of the std140 ObjectData block. A std140 mat3 is three vec4 columns.
+struct UObjectData
+{
+	glm::mat4 model;
+	glm::vec4 normalMatrix[3];  // transpose(inverse(mat3(model)))
+	GLint textureLayer;         // Layer of the texture array, see UTextureArray
+	GLint padding[3];
+};
+
+// Layout of one glMultiDrawElementsIndirect command, fixed by the GL specification
+struct UDrawElementsIndirectCommand
+{
+	GLuint count;
+	GLuint instanceCount;
+	GLuint firstIndex;
+	GLint baseVertex;
+	GLuint baseInstance;
+};
+
+/* A persistently mapped uniform buffer split into UNIFORM_RING_FRAMES regions.
+ * Each region holds one UFrameData followed by one UObjectData per object, every
+ * record aligned to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT so it can be bound with
+ * glBindBufferRange. A fence per region keeps the CPU from overwriting data the
+ * GPU has not consumed yet.
+ *
+ * A second, tightly packed buffer holds the same UObjectData records as per-instance
+ * vertex attributes for instanced draws. Its regions are guarded by the same fences
+ * and selected with the base instance, so VAOs point at it once.
+ *
+ * A third buffer holds the indirect draw commands built on the CPU each frame.
+ */
+struct UUniformRing
+{
+	GLuint buffer = 0;
+	unsigned char* mapped = nullptr;
+	GLsizeiptr frameStride = 0;     // Bytes per region
+	GLsizeiptr frameDataSize = 0;   // sizeof(UFrameData) rounded up to the offset alignment
+	GLsizeiptr objectStride = 0;    // sizeof(UObjectData) rounded up to the offset alignment
+	GLuint objectCapacity = 0;
+	GLuint frame = 0;               // Region being written this frame
+	GLuint instanceBuffer = 0;
+	UObjectData* instances = nullptr;
+	GLuint indirectBuffer = 0;
+	UDrawElementsIndirectCommand* commands = nullptr;
+	GLuint commandCapacity = 0;     // Commands per region
+	GLsync fences[UNIFORM_RING_FRAMES] = {};
+};
+
+// Creates the ring with room for objectCapacity objects and commandCapacity indirect commands per frame
+bool UCreateUniformRing(UUniformRing& ring, GLuint objectCapacity, GLuint commandCapacity);
+void UDestroyUniformRing(UUniformRing& ring);
+
+// Waits until the GPU is done with the next region and returns it for writing
+void UBeginUniformFrame(UUniformRing& ring);
+// Fences the region written this frame
+void UEndUniformFrame(UUniformRing& ring);
+
+UFrameData* UFrameDataPtr(UUniformRing& ring);
+UObjectData* UObjectDataPtr(UUniformRing& ring, GLuint object);
+UObjectData* UInstanceDataPtr(UUniformRing& ring, GLuint instance);
+UDrawElementsIndirectCommand* UCommandDataPtr(UUniformRing& ring);
+// Byte offset of the region's first command in the indirect buffer
+GLintptr UCommandOffset(const UUniformRing& ring);
+// Base instance of the first record of the region being written
+GLuint UInstanceBase(const UUniformRing& ring);
+
+// Binds the frame block and the block of one object for the region being written
+void UBindFrameData(const UUniformRing& ring);
+void UBindObjectData(const UUniformRing& ring, GLuint object);
+
+// Points instanced attributes firstLocation .. firstLocation + 7 of the bound VAO at the
+// instance buffer: the model matrix columns, the normal matrix columns, then the texture layer
+void UBindInstanceAttributes(const UUniformRing& ring, GLuint firstLocation);
+
+// Fills a per-object record from a model matrix. positionDecode maps the mesh's stored
+// positions to model space (xyz = offset, w = uniform scale), (0, 0, 0, 1) for float vertices.
+void UWriteObjectData(UObjectData& data, const glm::mat4& model, const glm::vec4& positionDecode, GLint textureLayer);
+
+#endif
@@ -0,0 +1,610 @@
+#include <iostream>         // cout
+#include <algorithm>        // max, min
+#include <cmath>            // fabs
+
+#include "gpuculling.h"
+
+using namespace std; // Uses the standard namespace
+
+/*Shader program Macro*/
+#ifndef GLSL
+#define GLSL(Version, Source) "#version " #Version " core \n" #Source
+#endif
+
+namespace
+{
+	// Invocations per work group of the two programs
+	const GLuint CULL_GROUP_SIZE = 64;
+	const GLuint PYRAMID_GROUP_SIZE = 8;
+
+	// Shows this many disagreements per validated frame, the rest are only counted
+	const GLuint VALIDATION_REPORT_LIMIT = 4;
+
+	// The GPU and the CPU round the same tests apart. A decision this close to its threshold,
+	// in clip space relative to w, in NDC or in depth, may go either way.
+	const float VALIDATION_TOLERANCE = 1.0e-5f;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////////
+/* Cull Compute Shader Source Code*/
+const GLchar* cullComputeShaderSource = GLSL(440,
+
+	layout(local_size_x = 64) in; // CULL_GROUP_SIZE
+
+	// CPU mirror: UObjectData
+	struct ObjectData
+	{
+		mat4 model;
+		vec4 normalMatrix[3];
+		ivec4 textureLayer;
+	};
+
+	layout(std430, binding = 0) readonly buffer Objects { ObjectData objects[]; };
+	layout(std430, binding = 1) readonly buffer Boxes { vec4 boxes[]; };
+	layout(std430, binding = 2) readonly buffer SlotGroups { uint slotGroups[]; };
+	layout(std430, binding = 3) readonly buffer Groups { uvec4 groups[]; }; // UGpuCullGroup
+	layout(std430, binding = 4) readonly buffer GroupCommands { uint groupCommands[]; };
+	layout(std430, binding = 5) writeonly buffer Instances { ObjectData instances[]; };
+	layout(std430, binding = 6) buffer Commands { uint commands[]; }; // Five per UDrawElementsIndirectCommand
+	layout(std430, binding = 7) writeonly buffer Visibility { uint visibility[]; };
+
+	uniform int uSlotCount;
+	uniform int uInstanceBase;
+	uniform int uCommandBase; // In uints
+	uniform mat4 uViewProjection;
+	uniform bool uUsePyramid;
+	uniform mat4 uPyramidViewProjection;
+	uniform int uPyramidLevels;
+	uniform sampler2D uPyramid;
+
+	vec3 boxCorner(vec3 boxMin, vec3 boxMax, int i)
+	{
+		return vec3((i & 1) != 0 ? boxMax.x : boxMin.x, (i & 2) != 0 ? boxMax.y : boxMin.y, (i & 4) != 0 ? boxMax.z : boxMin.z);
+	}
+
+	// Outside when every corner is beyond the same clip plane
+	bool inFrustum(vec3 boxMin, vec3 boxMax)
+	{
+		vec3 below = vec3(0.0);
+		vec3 above = vec3(0.0);
+		for (int i = 0; i < 8; ++i)
+		{
+			vec4 clip = uViewProjection * vec4(boxCorner(boxMin, boxMax, i), 1.0);
+			below += vec3(lessThan(clip.xyz, -clip.www));
+			above += vec3(greaterThan(clip.xyz, clip.www));
+		}
+		return !any(equal(below, vec3(8.0))) && !any(equal(above, vec3(8.0)));
+	}
+
+	// Compares the box's nearest depth with the farthest depth the pyramid holds over its rectangle
+	bool notOccluded(vec3 boxMin, vec3 boxMax)
+	{
+		vec2 low = vec2(1.0e30);
+		vec2 high = vec2(-1.0e30);
+		float nearest = 1.0e30;
+		for (int i = 0; i < 8; ++i)
+		{
+			vec4 clip = uPyramidViewProjection * vec4(boxCorner(boxMin, boxMax, i), 1.0);
+			// A box reaching behind the near plane has no rectangle
+			if (clip.z < -clip.w)
+				return true;
+			vec3 ndc = clip.xyz / clip.w;
+			low = min(low, ndc.xy);
+			high = max(high, ndc.xy);
+			nearest = min(nearest, ndc.z * 0.5 + 0.5);
+		}
+
+		// Off last frame's screen there is no depth to test against
+		if (any(greaterThan(low, vec2(1.0))) || any(lessThan(high, vec2(-1.0))))
+			return true;
+
+		ivec2 size = textureSize(uPyramid, 0);
+		ivec2 first = clamp(ivec2((low * 0.5 + 0.5) * vec2(size)), ivec2(0), size - 1);
+		ivec2 last = clamp(ivec2((high * 0.5 + 0.5) * vec2(size)), ivec2(0), size - 1);
+
+		// The finest level where the rectangle covers at most two texels each way
+		int level = 0;
+		while (level + 1 < uPyramidLevels && any(greaterThan((last >> level) - (first >> level), ivec2(1))))
+			++level;
+		// Immutable levels halve rounding down, which is cheaper than asking for each size
+		ivec2 levelSize = max(size >> level, ivec2(1));
+		first = min(first >> level, levelSize - 1);
+		last = min(last >> level, levelSize - 1);
+
+		float farthest = 0.0;
+		for (int y = first.y; y <= last.y; ++y)
+		{
+			for (int x = first.x; x <= last.x; ++x)
+				farthest = max(farthest, texelFetch(uPyramid, ivec2(x, y), level).r);
+		}
+		return nearest <= farthest;
+	}
+
+	void main()
+	{
+		int slot = int(gl_GlobalInvocationID.x);
+		if (slot >= uSlotCount)
+			return;
+
+		vec3 boxMin = boxes[slot * 2].xyz;
+		vec3 boxMax = boxes[slot * 2 + 1].xyz;
+		bool inside = inFrustum(boxMin, boxMax);
+		bool drawn = inside && (!uUsePyramid || notOccluded(boxMin, boxMax));
+		visibility[slot] = (inside ? 1u : 0u) | (drawn ? 2u : 0u);
+		if (!drawn)
+			return;
+
+		// Every command of the group draws the same instances, the first one's count places the record.
+		// A group without commands has only ranges no multi-draw call takes.
+		uvec4 group = groups[slotGroups[slot]];
+		if (group.y == 0u)
+			return;
+		uint instance = atomicAdd(commands[uCommandBase + groupCommands[group.x] * 5u + 1u], 1u);
+		for (uint i = 1u; i < group.y; ++i)
+			atomicAdd(commands[uCommandBase + groupCommands[group.x + i] * 5u + 1u], 1u);
+		instances[uInstanceBase + int(group.z + instance)] = objects[slot];
+	}
+);
+
+
+/* Pyramid Compute Shader Source Code*/
+const GLchar* pyramidComputeShaderSource = GLSL(440,
+
+	layout(local_size_x = 8, local_size_y = 8) in; // PYRAMID_GROUP_SIZE
+
+	layout(r32f, binding = 0) writeonly uniform image2D uDestination;
+	layout(r32f, binding = 1) readonly uniform image2D uSource;
+	uniform sampler2D uDepth;
+	uniform bool uFromDepth; // Level 0 copies the depth texture, every other level reduces the one before
+
+	void main()
+	{
+		ivec2 texel = ivec2(gl_GlobalInvocationID.xy);
+		ivec2 size = imageSize(uDestination);
+		if (any(greaterThanEqual(texel, size)))
+			return;
+
+		float farthest = 0.0;
+		if (uFromDepth)
+			farthest = texelFetch(uDepth, texel, 0).r;
+		else
+		{
+			// The last row and column also cover what an odd source size leaves over
+			ivec2 sourceSize = imageSize(uSource);
+			ivec2 first = texel * 2;
+			ivec2 last = first + 1;
+			if (texel.x == size.x - 1)
+				last.x = sourceSize.x - 1;
+			if (texel.y == size.y - 1)
+				last.y = sourceSize.y - 1;
+
+			for (int y = first.y; y <= last.y; ++y)
+			{
+				for (int x = first.x; x <= last.x; ++x)
+					farthest = max(farthest, imageLoad(uSource, ivec2(x, y)).r);
+			}
+		}
+		imageStore(uDestination, texel, vec4(farthest));
+	}
+);
+
+
+namespace
+{
+	// An immutable shader storage buffer holding a copy of data, never empty so it can always be bound
+	template<typename T>
+	GLuint UCreateStorageBuffer(const vector<T>& data)
+	{
+		const GLsizeiptr size = (GLsizeiptr)(data.size() * sizeof(T));
+		GLuint buffer = 0;
+		glGenBuffers(1, &buffer);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+		glBufferStorage(GL_SHADER_STORAGE_BUFFER, max(size, (GLsizeiptr)sizeof(GLuint)), size ? data.data() : NULL, 0);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		return buffer;
+	}
+
+	void UDeleteSceneBuffers(UGpuCuller& culler)
+	{
+		GLuint* const buffers[] = { &culler.objectBuffer, &culler.boxBuffer, &culler.slotGroupBuffer, &culler.groupBuffer,
+			&culler.groupCommandBuffer, &culler.visibilityBuffer };
+		for (GLuint* buffer : buffers)
+		{
+			if (*buffer)
+				glDeleteBuffers(1, buffer);
+			*buffer = 0;
+		}
+	}
+
+	// The pyramid read back for validation, level by level
+	struct UPyramidLevels
+	{
+		vector<vector<float>> texels;
+		vector<glm::ivec2> sizes;
+	};
+
+	glm::ivec2 ULevelSize(const UGpuCuller& culler, GLuint level)
+	{
+		return glm::ivec2(max(1u, culler.width >> level), max(1u, culler.height >> level));
+	}
+
+	glm::vec3 UBoxCorner(const glm::vec3& boxMin, const glm::vec3& boxMax, int i)
+	{
+		return glm::vec3((i & 1) ? boxMax.x : boxMin.x, (i & 2) ? boxMax.y : boxMin.y, (i & 4) ? boxMax.z : boxMin.z);
+	}
+
+	/* The shader's tests on the CPU take a slack: positive moves every threshold so more
+	 * boxes pass, negative so fewer do, and zero is the shader's exact test.
+	 */
+
+	// The shader's inFrustum on the CPU
+	bool UBoxInClipSpace(const glm::mat4& viewProjection, const glm::vec3& boxMin, const glm::vec3& boxMax, float slack)
+	{
+		int below[3] = {};
+		int above[3] = {};
+		for (int i = 0; i < 8; ++i)
+		{
+			const glm::vec4 clip = viewProjection * glm::vec4(UBoxCorner(boxMin, boxMax, i), 1.0f);
+			for (int axis = 0; axis < 3; ++axis)
+			{
+				below[axis] += clip[axis] < -clip.w - slack * fabs(clip.w) ? 1 : 0;
+				above[axis] += clip[axis] > clip.w + slack * fabs(clip.w) ? 1 : 0;
+			}
+		}
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			if (below[axis] == 8 || above[axis] == 8)
+				return false;
+		}
+		return true;
+	}
+
+	// Level 0 texel an NDC coordinate falls in, clamped to the screen like the shader's clamp
+	int UTexelOf(float ndc, int size)
+	{
+		return min(max((int)((ndc * 0.5f + 0.5f) * (float)size), 0), size - 1);
+	}
+
+	// The shader's notOccluded on the CPU, against the pyramid read back
+	bool UBoxNotOccluded(const glm::mat4& viewProjection, const UPyramidLevels& pyramid, const glm::vec3& boxMin, const glm::vec3& boxMax,
+		float slack)
+	{
+		glm::vec2 low(1.0e30f);
+		glm::vec2 high(-1.0e30f);
+		float nearest = 1.0e30f;
+		for (int i = 0; i < 8; ++i)
+		{
+			const glm::vec4 clip = viewProjection * glm::vec4(UBoxCorner(boxMin, boxMax, i), 1.0f);
+			if (clip.z < -clip.w + slack * fabs(clip.w))
+				return true;
+			const glm::vec3 ndc = glm::vec3(clip) / clip.w;
+			low = glm::min(low, glm::vec2(ndc.x, ndc.y));
+			high = glm::max(high, glm::vec2(ndc.x, ndc.y));
+			nearest = min(nearest, ndc.z * 0.5f + 0.5f);
+		}
+
+		if (low.x > 1.0f - slack || low.y > 1.0f - slack || high.x < -1.0f + slack || high.y < -1.0f + slack)
+			return true;
+
+		// Growing the rectangle can only cover more or coarser texels, a negative slack shrinks it no further than its center
+		const glm::vec2 center = (low + high) * 0.5f;
+		low = glm::min(low - slack, center);
+		high = glm::max(high + slack, center);
+
+		const glm::ivec2 size = pyramid.sizes[0];
+		int firstX = UTexelOf(low.x, size.x);
+		int firstY = UTexelOf(low.y, size.y);
+		int lastX = UTexelOf(high.x, size.x);
+		int lastY = UTexelOf(high.y, size.y);
+
+		int level = 0;
+		while (level + 1 < (int)pyramid.sizes.size() && ((lastX >> level) - (firstX >> level) > 1 || (lastY >> level) - (firstY >> level) > 1))
+			++level;
+		const glm::ivec2 levelSize = pyramid.sizes[level];
+		firstX = min(firstX >> level, levelSize.x - 1);
+		firstY = min(firstY >> level, levelSize.y - 1);
+		lastX = min(lastX >> level, levelSize.x - 1);
+		lastY = min(lastY >> level, levelSize.y - 1);
+
+		float farthest = 0.0f;
+		for (int y = firstY; y <= lastY; ++y)
+		{
+			for (int x = firstX; x <= lastX; ++x)
+				farthest = max(farthest, pyramid.texels[level][y * levelSize.x + x]);
+		}
+		return nearest - slack <= farthest;
+	}
+
+	// Checks every pyramid level against the farthest depth of its footprint, returns the wrong texels.
+	// Level 0 and the depth read back each convert 24-bit depth to float, which may round apart.
+	GLuint UCheckPyramid(const UPyramidLevels& pyramid, const vector<float>& depth)
+	{
+		const float depthStep = 1.0f / 16777215.0f;
+		GLuint wrong = 0;
+		for (size_t i = 0; i < depth.size(); ++i)
+			wrong += fabs(pyramid.texels[0][i] - depth[i]) > depthStep ? 1 : 0;
+
+		for (size_t level = 1; level < pyramid.sizes.size(); ++level)
+		{
+			const glm::ivec2 size = pyramid.sizes[level];
+			const glm::ivec2 sourceSize = pyramid.sizes[level - 1];
+			const vector<float>& source = pyramid.texels[level - 1];
+			for (int y = 0; y < size.y; ++y)
+			{
+				for (int x = 0; x < size.x; ++x)
+				{
+					const int lastX = x == size.x - 1 ? sourceSize.x - 1 : x * 2 + 1;
+					const int lastY = y == size.y - 1 ? sourceSize.y - 1 : y * 2 + 1;
+					float farthest = 0.0f;
+					for (int sy = y * 2; sy <= lastY; ++sy)
+					{
+						for (int sx = x * 2; sx <= lastX; ++sx)
+							farthest = max(farthest, source[sy * sourceSize.x + sx]);
+					}
+					wrong += pyramid.texels[level][y * size.x + x] != farthest ? 1 : 0;
+				}
+			}
+		}
+		return wrong;
+	}
+}
+
+
+bool UCreateGpuCuller(UGpuCuller& culler, GLuint width, GLuint height, const char* cacheFolder)
+{
+	UDestroyGpuCuller(culler);
+
+	// Samplers are set while each program is current after linking
+	UGpuCullUniforms& uniforms = culler.uniforms;
+	if (!UCreateComputeProgram("gpu_cull", cullComputeShaderSource, cacheFolder, culler.cullProgram))
+		return false;
+	UGetUniform(culler.cullProgram, "uSlotCount", uniforms.slotCount);
+	UGetUniform(culler.cullProgram, "uInstanceBase", uniforms.instanceBase);
+	UGetUniform(culler.cullProgram, "uCommandBase", uniforms.commandBase);
+	UGetUniform(culler.cullProgram, "uViewProjection", uniforms.viewProjection);
+	UGetUniform(culler.cullProgram, "uUsePyramid", uniforms.usePyramid);
+	UGetUniform(culler.cullProgram, "uPyramidViewProjection", uniforms.pyramidViewProjection);
+	UGetUniform(culler.cullProgram, "uPyramidLevels", uniforms.pyramidLevels);
+	UGetUniform(culler.cullProgram, "uPyramid", uniforms.pyramid);
+	USetUniform(culler.cullProgram, uniforms.pyramid, (int)GPU_CULL_TEXTURE_UNIT);
+
+	if (!UCreateComputeProgram("hiz_pyramid", pyramidComputeShaderSource, cacheFolder, culler.pyramidProgram))
+		return false;
+	UGetUniform(culler.pyramidProgram, "uDepth", uniforms.depth);
+	UGetUniform(culler.pyramidProgram, "uFromDepth", uniforms.fromDepth);
+	USetUniform(culler.pyramidProgram, uniforms.depth, (int)GPU_CULL_TEXTURE_UNIT);
+	glUseProgram(0);
+
+	UResizeGpuCuller(culler, width, height);
+	return true;
+}
+
+
+void UResizeGpuCuller(UGpuCuller& culler, GLuint width, GLuint height)
+{
+	if (culler.depthTexture)
+		glDeleteTextures(1, &culler.depthTexture);
+	if (culler.pyramid)
+		glDeleteTextures(1, &culler.pyramid);
+	culler.depthTexture = 0;
+	culler.pyramid = 0;
+	culler.pyramidValid = false;
+
+	// A minimized window has no framebuffer to copy, culling goes without the pyramid until it is restored
+	culler.width = width;
+	culler.height = height;
+	culler.levels = 0;
+	if (width == 0 || height == 0)
+		return;
+
+	// Levels down to 1 x 1, each half the one before rounded down
+	culler.levels = 1;
+	while ((max(width, height) >> culler.levels) > 0)
+		++culler.levels;
+
+	glActiveTexture(GL_TEXTURE0 + GPU_CULL_TEXTURE_UNIT);
+	glGenTextures(1, &culler.depthTexture);
+	glBindTexture(GL_TEXTURE_2D, culler.depthTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, (GLsizei)width, (GLsizei)height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenTextures(1, &culler.pyramid);
+	glBindTexture(GL_TEXTURE_2D, culler.pyramid);
+	glTexStorage2D(GL_TEXTURE_2D, (GLsizei)culler.levels, GL_R32F, (GLsizei)width, (GLsizei)height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+
+void UDestroyGpuCuller(UGpuCuller& culler)
+{
+	UDeleteSceneBuffers(culler);
+	if (culler.depthTexture)
+		glDeleteTextures(1, &culler.depthTexture);
+	if (culler.pyramid)
+		glDeleteTextures(1, &culler.pyramid);
+	UDestroyShaderProgram(culler.cullProgram);
+	UDestroyShaderProgram(culler.pyramidProgram);
+	culler = UGpuCuller();
+}
+
+
+void USetGpuCullScene(UGpuCuller& culler, const UGpuCullScene& scene)
+{
+	UDeleteSceneBuffers(culler);
+	culler.scene = scene;
+	culler.slotCount = (GLuint)scene.slotGroups.size();
+
+	culler.objectBuffer = UCreateStorageBuffer(scene.objects);
+	culler.boxBuffer = UCreateStorageBuffer(scene.boxes);
+	culler.slotGroupBuffer = UCreateStorageBuffer(scene.slotGroups);
+	culler.groupBuffer = UCreateStorageBuffer(scene.groups);
+	culler.groupCommandBuffer = UCreateStorageBuffer(scene.groupCommands);
+	culler.visibilityBuffer = UCreateStorageBuffer(vector<GLuint>(culler.slotCount));
+}
+
+
+void UCullOnGpu(UGpuCuller& culler, const glm::mat4& viewProjection, const UUniformRing& ring)
+{
+	culler.viewProjection = viewProjection;
+	culler.usedPyramid = culler.pyramidValid;
+
+	UShaderProgram& program = culler.cullProgram;
+	const UGpuCullUniforms& uniforms = culler.uniforms;
+	glUseProgram(program.id);
+	USetUniform(program, uniforms.slotCount, (int)culler.slotCount);
+	USetUniform(program, uniforms.instanceBase, (int)UInstanceBase(ring));
+	USetUniform(program, uniforms.commandBase, (int)(UCommandOffset(ring) / sizeof(GLuint)));
+	USetUniform(program, uniforms.viewProjection, viewProjection);
+	USetUniform(program, uniforms.usePyramid, culler.usedPyramid ? 1 : 0);
+	USetUniform(program, uniforms.pyramidViewProjection, culler.pyramidViewProjection);
+	USetUniform(program, uniforms.pyramidLevels, (int)culler.levels);
+
+	glActiveTexture(GL_TEXTURE0 + GPU_CULL_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, culler.pyramid);
+	glActiveTexture(GL_TEXTURE0);
+
+	// The ring's buffers are bound whole, the region being written is picked by the bases
+	const GLuint buffers[8] = { culler.objectBuffer, culler.boxBuffer, culler.slotGroupBuffer, culler.groupBuffer,
+		culler.groupCommandBuffer, ring.instanceBuffer, ring.indirectBuffer, culler.visibilityBuffer };
+	glBindBuffersBase(GL_SHADER_STORAGE_BUFFER, 0, 8, buffers);
+	glDispatchCompute((culler.slotCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+	// The draws read the commands and instance records the shader wrote
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+}
+
+
+void UBuildHiZPyramid(UGpuCuller& culler, const glm::mat4& viewProjection)
+{
+	if (!culler.depthTexture)
+		return;
+
+	// The depth buffer of the default framebuffer cannot be sampled, level 0 reads a copy
+	glActiveTexture(GL_TEXTURE0 + GPU_CULL_TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, culler.depthTexture);
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 0, 0, (GLsizei)culler.width, (GLsizei)culler.height);
+
+	UShaderProgram& program = culler.pyramidProgram;
+	glUseProgram(program.id);
+	for (GLuint level = 0; level < culler.levels; ++level)
+	{
+		USetUniform(program, culler.uniforms.fromDepth, level == 0 ? 1 : 0);
+		glBindImageTexture(0, culler.pyramid, (GLint)level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+		glBindImageTexture(1, culler.pyramid, (GLint)(level ? level - 1 : 0), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+
+		const glm::ivec2 size = ULevelSize(culler, level);
+		glDispatchCompute((size.x + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, (size.y + PYRAMID_GROUP_SIZE - 1) / PYRAMID_GROUP_SIZE, 1);
+
+		// Each level reads the one written before it
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	}
+
+	// The next frame's cull samples the pyramid
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glActiveTexture(GL_TEXTURE0);
+
+	culler.pyramidViewProjection = viewProjection;
+	culler.pyramidValid = true;
+}
+
+
+bool UValidateGpuCulling(UGpuCuller& culler, const UUniformRing& ring)
+{
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT);
+
+	vector<GLuint> visibility(culler.slotCount);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, culler.visibilityBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, (GLsizeiptr)(visibility.size() * sizeof(GLuint)), visibility.data());
+	vector<UDrawElementsIndirectCommand> commands(ring.commandCapacity);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, ring.indirectBuffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, UCommandOffset(ring), (GLsizeiptr)(commands.size() * sizeof(UDrawElementsIndirectCommand)), commands.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	GLuint errors = 0;
+	UPyramidLevels pyramid;
+	if (culler.usedPyramid)
+	{
+		glActiveTexture(GL_TEXTURE0 + GPU_CULL_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D, culler.pyramid);
+		for (GLuint level = 0; level < culler.levels; ++level)
+		{
+			pyramid.sizes.push_back(ULevelSize(culler, level));
+			pyramid.texels.emplace_back(pyramid.sizes.back().x * pyramid.sizes.back().y);
+			glGetTexImage(GL_TEXTURE_2D, (GLint)level, GL_RED, GL_FLOAT, pyramid.texels.back().data());
+		}
+		vector<float> depth(culler.width * culler.height);
+		glBindTexture(GL_TEXTURE_2D, culler.depthTexture);
+		glGetTexImage(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, GL_FLOAT, depth.data());
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
+
+		const GLuint wrongTexels = UCheckPyramid(pyramid, depth);
+		if (wrongTexels)
+			cout << "GPU culling: " << wrongTexels << " pyramid texels differ from the farthest depth they cover" << endl;
+		errors += wrongTexels;
+	}
+
+	// Run the shader's tests again. The GPU's bits are right when the strict and the lenient
+	// tests bracket them, and each group's commands must count the slots the GPU drew.
+	const UGpuCullScene& scene = culler.scene;
+	vector<GLuint> groupDrawn(scene.groups.size(), 0);
+	GLuint reported = 0;
+	culler.visibleObjects = 0;
+	culler.occludedObjects = 0;
+	for (GLuint slot = 0; slot < culler.slotCount; ++slot)
+	{
+		const glm::vec3 boxMin(scene.boxes[slot * 2]);
+		const glm::vec3 boxMax(scene.boxes[slot * 2 + 1]);
+		// The strictest and the most lenient answer
+		GLuint expected[2];
+		for (int i = 0; i < 2; ++i)
+		{
+			const float slack = i == 0 ? -VALIDATION_TOLERANCE : VALIDATION_TOLERANCE;
+			const bool inside = UBoxInClipSpace(culler.viewProjection, boxMin, boxMax, slack);
+			const bool drawn = inside && (!culler.usedPyramid || UBoxNotOccluded(culler.pyramidViewProjection, pyramid, boxMin, boxMax, slack));
+			expected[i] = (inside ? 1u : 0u) | (drawn ? 2u : 0u);
+		}
+		const GLuint visible = visibility[slot];
+		groupDrawn[scene.slotGroups[slot]] += (visible & 2u) ? 1 : 0;
+
+		culler.visibleObjects += (visible & 2u) ? 1 : 0;
+		culler.occludedObjects += visible == 1u ? 1 : 0;
+		if (visible == 2u || (visible & ~expected[1]) != 0 || (expected[0] & ~visible) != 0)
+		{
+			if (reported++ < VALIDATION_REPORT_LIMIT)
+			{
+				cout << "GPU culling: slot " << slot << " has visibility " << visible << ", expected " << expected[0];
+				if (expected[1] != expected[0])
+					cout << " to " << expected[1];
+				cout << endl;
+			}
+			++errors;
+		}
+	}
+
+	for (size_t group = 0; group < scene.groups.size(); ++group)
+	{
+		const UGpuCullGroup& cullGroup = scene.groups[group];
+		for (GLuint i = 0; i < cullGroup.commandCount; ++i)
+		{
+			const GLuint command = scene.groupCommands[cullGroup.firstCommand + i];
+			if (commands[command].instanceCount != groupDrawn[group])
+			{
+				if (reported++ < VALIDATION_REPORT_LIMIT)
+					cout << "GPU culling: command " << command << " draws " << commands[command].instanceCount
+						<< " instances, expected " << groupDrawn[group] << endl;
+				++errors;
+			}
+		}
+	}
+
+	++culler.validatedFrames;
+	culler.mismatches += errors;
+	return errors == 0;
+}
@@ -0,0 +1,121 @@
+#ifndef GPUCULLING_H
+#define GPUCULLING_H
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "framedata.h"
+#include "program.h"
+
+// Texture unit the cull shader samples the Hi-Z pyramid from, past the ones the surface shaders use
+const GLuint GPU_CULL_TEXTURE_UNIT = 2;
+
+// An instance group as the cull shader sees it
+struct UGpuCullGroup
+{
+	GLuint firstCommand;    // Into UGpuCullScene::groupCommands
+	GLuint commandCount;    // One per draw range, every command draws the same instances
+	GLuint firstInstance;   // Instance slot the group's visible objects are packed from
+	GLuint padding;
+};
+
+// The static scene, indexed by instance slot so the objects of a group are contiguous
+struct UGpuCullScene
+{
+	std::vector<UObjectData> objects;
+	std::vector<glm::vec4> boxes;           // World-space box per slot, min then max
+	std::vector<GLuint> slotGroups;
+	std::vector<UGpuCullGroup> groups;
+	std::vector<GLuint> groupCommands;      // Command indices from the first command of a ring region
+};
+
+// Uniforms of the cull and pyramid programs, resolved once after linking
+struct UGpuCullUniforms
+{
+	UUniform<int> slotCount;
+	UUniform<int> instanceBase;
+	UUniform<int> commandBase;
+	UUniform<glm::mat4> viewProjection;
+	UUniform<int> usePyramid;
+	UUniform<glm::mat4> pyramidViewProjection;
+	UUniform<int> pyramidLevels;
+	UUniform<int> pyramid;
+	UUniform<int> depth;
+	UUniform<int> fromDepth;
+};
+
+/* Culling on the GPU for the multi-draw indirect path. A compute shader tests every
+ * object's box against the frustum and against a Hi-Z pyramid, the farthest depth
+ * of each texel's footprint, built from the previous frame's depth buffer. Objects
+ * that pass have their record copied into the ring's instance buffer and bump the
+ * instance count of their group's commands, so the draw reads its visibility
+ * without the CPU ever seeing it.
+ *
+ * Boxes are tested with the view-projection the pyramid was built with, so an object
+ * uncovered by a camera move shows up one frame late.
+ */
+struct UGpuCuller
+{
+	UShaderProgram cullProgram;
+	UShaderProgram pyramidProgram;
+	UGpuCullUniforms uniforms;
+
+	// Static scene buffers, bound as shader storage
+	GLuint objectBuffer = 0;
+	GLuint boxBuffer = 0;
+	GLuint slotGroupBuffer = 0;
+	GLuint groupBuffer = 0;
+	GLuint groupCommandBuffer = 0;
+	GLuint visibilityBuffer = 0;        // Per slot, bit 0 inside the frustum and bit 1 drawn
+	UGpuCullScene scene;                // CPU copy for validation
+	GLuint slotCount = 0;
+
+	// Last frame's depth and its pyramid, level 0 has the framebuffer size
+	GLuint width = 0;
+	GLuint height = 0;
+	GLuint levels = 0;
+	GLuint depthTexture = 0;
+	GLuint pyramid = 0;
+	bool pyramidValid = false;          // False until a frame has been drawn
+	glm::mat4 pyramidViewProjection = glm::mat4(1.0f);
+
+	// This frame's cull, kept for validation
+	glm::mat4 viewProjection = glm::mat4(1.0f);
+	bool usedPyramid = false;
+
+	// Validation totals
+	GLuint validatedFrames = 0;
+	GLuint visibleObjects = 0;          // Drawn in the last validated frame
+	GLuint occludedObjects = 0;         // Inside the frustum but behind the pyramid in the last validated frame
+	GLuint mismatches = 0;
+};
+
+// Compiles the compute programs and creates the pyramid for a framebuffer of width x height
+bool UCreateGpuCuller(UGpuCuller& culler, GLuint width, GLuint height, const char* cacheFolder);
+
+// Recreates the depth copy and the pyramid for a framebuffer of the new size, the next frame culls without them
+void UResizeGpuCuller(UGpuCuller& culler, GLuint width, GLuint height);
+void UDestroyGpuCuller(UGpuCuller& culler);
+
+// Uploads the static scene, replacing the previous one
+void USetGpuCullScene(UGpuCuller& culler, const UGpuCullScene& scene);
+
+/* Culls every slot into the ring region being written. Its commands must already hold
+ * this frame's templates with no instances. Returns with the barriers the indirect
+ * draw and the instanced attributes need.
+ */
+void UCullOnGpu(UGpuCuller& culler, const glm::mat4& viewProjection, const UUniformRing& ring);
+
+// Copies the depth buffer of the frame just drawn and reduces it into the pyramid the next frame tests against
+void UBuildHiZPyramid(UGpuCuller& culler, const glm::mat4& viewProjection);
+
+/* Reads back this frame's pyramid, visibility and commands and checks them against
+ * the same tests run on the CPU. Call after UCullOnGpu and before the pyramid is
+ * rebuilt. Prints the first disagreements and returns false when there were any.
+ */
+bool UValidateGpuCulling(UGpuCuller& culler, const UUniformRing& ring);
+
+#endif
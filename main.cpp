@@ -1,5 +1,12 @@
 #include <iostream>         // cout, cerr
-#include <cstdlib>          // EXIT_FAILURE
+#include <cstdlib>          // EXIT_FAILURE, atoi
+#include <cstring>          // strcmp, memcpy
+#include <cmath>            // tan, sqrt, fabs
+#include <algorithm>        // sort, max
+#include <chrono>           // startup timing
+#include <thread>           // hardware_concurrency
+#include <string>
+#include <vector>
 #include <GL/glew.h>        // GLEW library
 #include <GLFW/glfw3.h>     // GLFW library
 
@@ -11,7 +18,24 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include "assetbuild.h"
+#include "assetpack.h"
 #include "camera.h"
+#include "culling.h"
+#include "framedata.h"
+#include "gpuculling.h"
+#include "mesharena.h"
+#include "meshopt.h"
+#include "mipmaps.h"
+#include "occlusion.h"
+#include "program.h"
+#include "renderqueue.h"
+#include "scene.h"
+#include "shapes.h"
+#include "spatialindex.h"
+#include "textureloader.h"
+#include "texturearray.h"
+#include "texturestream.h"
 
 using namespace std; // Uses the standard namespace
 
@@ -32,32 +56,178 @@ namespace
 	// Stores the GL data relative to a given mesh
 	struct GLMesh
 	{
-		GLuint vao;         // Handle for the vertex array object
-		GLuint vbo;         // Handle for the vertex buffer object
-		GLuint nVertices;    // Number of indices of the mesh
+		GLuint vao[VERTEX_FORMAT_COUNT];    // Handle for the vertex array object per UVertexFormat, 0 when not built
+		GLuint vbo[VERTEX_FORMAT_COUNT];    // Handle for the vertex buffer object per UVertexFormat
+		GLuint ibo;         // Handle for the index buffer object, shared by every format
+		GLuint nVertices;   // Number of vertices of the mesh
+		GLuint nIndices;    // Number of indices of the mesh
+		GLenum indexType;   // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+		USceneDrawRange parts[MESH_PART_COUNT];    // Named index ranges by UMeshPart, empty when the mesh has none
+		glm::vec4 packedDecode;     // Position decode of the packed vertices, see UQuantizeVertices
+		glm::vec4 bounds;           // Bounding sphere of the vertices, center and radius
+		glm::vec3 boxMin;           // Box of the vertices
+		glm::vec3 boxMax;
+		vector<glm::vec3> positions;    // Kept for drawing occluders on the CPU
+		vector<GLuint> indices;
 	};
 
 	// Main GLFW window
 	GLFWwindow* gWindow = nullptr;
-	// Triangle mesh data
-	GLMesh gCubeMesh;
-	GLMesh gCylinderMesh;
-	GLMesh gBackgroundPlaneMesh;
-	GLMesh gPlaneMesh;
-	GLMesh gPyramidMesh;
-	// Texture id
-	GLuint gBookBindingTextureId;
-	GLuint gCigaretteBoxTextureId;
-	GLuint gHeadphoneTextureId;
-	GLuint gMetalTextureId;
-	GLuint gPaperTextureId;
-	GLuint gRugTextureId;
-	GLuint gTapeTextureId;
-	GLuint gWallTextureId;
-	GLuint gWoodTextureId;
+	// Triangle mesh data, indexed by UMeshType
+	GLMesh gMeshes[MESH_COUNT] = {};
+	// The same meshes packed into one VBO for multi-draw indirect submission, per UVertexFormat
+	UMeshArena gMeshArenas[VERTEX_FORMAT_COUNT];
+	// Vertex format drawn. --float-vertices starts with full floats, --compare-vertex-formats
+	// builds both formats so F3 can switch between them.
+	GLuint gVertexFormat = VERTEX_FORMAT_PACKED;
+	bool gCompareVertexFormats = false;
+	// Scene description: either parsed from text into gScene or mapped from its binary cache
+	const char* gSceneFilename = "resources/desk.scene";
+	UScene gScene;
+	UMappedFile gSceneMapping;
+	USceneView gSceneView;
+	// --pack maps one archive holding the binary scene and the images with their caches.
+	// Assets missing from it are read from their own files.
+	UAssetPack gAssetPack;
+	// Texture ids for the scene's texture table, the placeholder until an image is uploaded
+	vector<GLuint> gTextureIds;
+	GLuint gPlaceholderTexture = 0;
+	// Decodes the scene's images off the GL thread
+	UTextureLoader gTextureLoader;
+	// --uncompressed-textures uploads decoded RGB8 instead of the BC texture cache
+	bool gCompressTextures = true;
+	// Filter the texture cache builds mip levels with, --mip-filter box|kaiser
+	GLuint gMipFilter = MIP_FILTER_KAISER;
+
+	// Compressed textures keep only the mip levels objects need on screen resident
+	UTextureStreamer gTextureStreamer;
+	bool gStreamTextures = true;
+	GLsizeiptr gTextureBudget = 16 * 1024 * 1024;   // --texture-budget in MB, 0 for no limit
+
+	// With --texture-array <size> every texture is a layer of one array texture and
+	// the scene draws without texture changes, 0 binds a 2D texture per object
+	UTextureArray gTextureArray;
+	GLuint gTextureArraySize = 0;
+	const GLuint TEXTURE_ARRAY_UNIT = 1;
+	// Linked programs are cached in resources, --no-program-cache always compiles
+	bool gProgramCache = true;
+	// Startup time, for reporting when the first frame and the last texture are ready
+	chrono::steady_clock::time_point gStartTime;
+	bool gFirstFrameReported = false;
 	// Shader program
-	GLuint gSurfaceProgramId;
-	GLuint gLightProgramId;
+	UShaderProgram gSurfaceProgram;
+	UShaderProgram gSurfaceInstancedProgram;
+	UShaderProgram gLightProgram;
+
+	// Surface shader uniforms outside the uniform blocks, resolved once after linking
+	struct USurfaceUniforms
+	{
+		UUniform<int> texture;
+		UUniform<glm::vec2> uvScale;
+		UUniform<int> octahedralNormals;
+		UUniform<int> textureArray;
+		UUniform<int> useTextureArray;
+	};
+	USurfaceUniforms gSurfaceUniforms;
+	USurfaceUniforms gSurfaceInstancedUniforms;
+
+	// First vertex attribute location of the per-instance model and normal matrices
+	const GLuint INSTANCE_ATTRIBUTE_LOCATION = 3;
+
+	// Objects drawn with one instanced call per draw range: same mesh, texture and ranges
+	struct UInstanceGroup
+	{
+		GLuint mesh;
+		GLuint texture;
+		GLuint firstRange;      // Draw ranges of the first object, shared by the whole group
+		GLuint rangeCount;
+		GLuint firstInstance;   // First entry in gInstanceObjects
+		GLuint instanceCount;
+		GLuint firstVisible;    // This frame's instance slots, the group's objects that passed culling
+		GLuint visibleCount;
+	};
+	vector<UInstanceGroup> gInstanceGroups;
+	vector<GLuint> gInstanceObjects;    // Object index per instance slot, grouped
+	GLuint gInstanceDrawCount = 0;      // Draws needed for every group, one per draw range
+
+	// How the opaque pass is submitted, F2 cycles through them
+	enum USubmitMode
+	{
+		SUBMIT_INDIRECT,        // Instance groups as glMultiDrawElementsIndirect commands over the mesh arena
+		SUBMIT_INSTANCED,       // One instanced draw per group and draw range
+		SUBMIT_OBJECTS,         // One draw per object and draw range
+		SUBMIT_MODE_COUNT
+	};
+	const char* const SUBMIT_MODE_NAMES[SUBMIT_MODE_COUNT] = { "multi-draw indirect", "instanced groups", "one object at a time" };
+	GLuint gSubmitMode = SUBMIT_INDIRECT;
+
+	// Commands of the current texture run. Every range is a triangle list, so one multi-draw call covers the run.
+	vector<UDrawElementsIndirectCommand> gIndirectBatch;
+
+	// Programs a sort key can select, in the order of the key's program field
+	enum URenderProgram
+	{
+		RENDER_PROGRAM_SURFACE,
+		RENDER_PROGRAM_SURFACE_INSTANCED,
+		RENDER_PROGRAM_COUNT
+	};
+
+	// Draws of the current frame, sorted by state before submission
+	URenderQueue gRenderQueue;
+
+	// --stress N draws N x N copies of the scene
+	GLuint gStressSize = 1;
+
+	// Objects whose bounding spheres miss the view frustum are not drawn.
+	// --no-culling starts with every object drawn, F4 toggles.
+	bool gFrustumCulling = true;
+	UCullBounds gCullBounds;
+	// Culling walks a spatial index over the objects' boxes, --flat-culling tests every sphere instead.
+	// Picking uses the index either way. --spatial-index picks a BVH or a loose grid.
+	bool gFlatCulling = false;
+	GLuint gSpatialIndexType = SPATIAL_INDEX_BVH;
+	USpatialIndex gSpatialIndex;
+	// Objects hidden behind the scene's occluders are not drawn either. --no-occlusion-culling
+	// starts with every object in the frustum drawn, F5 toggles.
+	bool gOcclusionCulling = true;
+	UOcclusionCuller gOcclusionCuller;
+	// --gpu-culling culls the multi-draw indirect path in a compute shader instead, against the frustum
+	// and a Hi-Z pyramid of the previous frame's depth, and the shader writes the indirect commands.
+	// F6 toggles, --validate-gpu-culling reads every frame's results back and checks them.
+	bool gGpuCulling = false;
+	bool gValidateGpuCulling = false;
+	UGpuCuller gGpuCuller;
+	// The commands the cull shader fills in, sorted into one multi-draw call per texture
+	struct UGpuDrawBatch
+	{
+		GLuint texture;
+		GLuint firstCommand;
+		GLuint commandCount;
+	};
+	vector<UDrawElementsIndirectCommand> gGpuCommands;  // Without instances, base instances from the region start
+	vector<UGpuDrawBatch> gGpuDrawBatches;
+	vector<GLuint> gVisibleObjects;         // This frame's objects that passed, in no particular order
+	vector<unsigned char> gObjectVisible;   // The same as a flag per object
+
+	// Frame and per-object uniform blocks
+	UUniformRing gUniformRing;
+
+	// Counters for the last rendered frame
+	struct URenderStats
+	{
+		GLuint drawCalls;
+		GLuint objectBinds;     // glBindBufferRange calls for per-object data
+		GLuint instances;       // Objects drawn through instanced calls
+		GLuint indirectCommands;    // Commands issued through multi-draw calls
+		GLuint visibleObjects;  // Objects that passed frustum and occlusion culling
+		GLuint occludedObjects; // Objects in the frustum the occluders hide
+		bool gpuCulled;         // Culled and drawn by UCullOnGpu, the CPU counts nothing
+		double cullMilliseconds;
+		double cpuMilliseconds; // Time spent in URender() before the buffer swap
+		UStateChanges sceneOrderChanges;    // State changes the queue would need unsorted
+		UStateChanges sortedChanges;        // State changes actually made after sorting
+	};
+	URenderStats gFrameStats;
 	Camera gCameraFront(glm::vec3(0.0f, 1.0f, 9.0f));
 	Camera gCameraOrtho(glm::vec3(0.0f, 1.25f, 5.0f));
 	Camera* g_pCurrentCamera = &gCameraFront;
@@ -87,17 +257,49 @@ namespace
 const GLchar* surfaceVertexShaderSource = GLSL(440,
 
 	layout(location = 0) in vec3 vertexPosition; // VAP position 0 for vertex position data
-	layout(location = 1) in vec3 vertexNormal; // VAP position 1 for normals
+	layout(location = 1) in vec3 vertexNormal; // VAP position 1 for normals, xy only when packed
 	layout(location = 2) in vec2 textureCoordinate;
 
 	out vec3 vertexFragmentNormal; // For outgoing normals to fragment shader
 	out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
 	out vec2 vertexTextureCoordinate;
+	flat out int vertexTextureLayer;
 
-	//Uniform / Global variables for the  transform matrices
-	uniform mat4 model;
-	uniform mat4 view;
-	uniform mat4 projection;
+	uniform bool uOctahedralNormals; // Normals arrive as two octahedral components (VERTEX_FORMAT_PACKED)
+
+	// Per-frame camera and lighting data, binding 0 = FRAME_DATA_BINDING (see UFrameData)
+	layout(std140, binding = 0) uniform FrameData
+	{
+		mat4 view;
+		mat4 projection;
+		vec4 viewPosition;
+		vec4 ambientColor;
+		vec4 light1Color;
+		vec4 light1Position;
+		vec4 light2Color;
+		vec4 light2Position;
+		vec4 specular;
+	};
+
+	// Per-object transforms, binding 1 = OBJECT_DATA_BINDING (see UObjectData)
+	layout(std140, binding = 1) uniform ObjectData
+	{
+		mat4 model;
+		mat3 normalMatrix;
+		int textureLayer;
+	};
+
+	// Unfolds an octahedral normal, plain float normals pass through
+	vec3 decodeNormal(vec3 normal)
+	{
+		if (!uOctahedralNormals)
+			return normal;
+
+		vec3 n = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));
+		if (n.z < 0.0)
+			n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+		return normalize(n);
+	}
 
 	void main()
 	{
@@ -105,8 +307,65 @@ const GLchar* surfaceVertexShaderSource = GLSL(440,
 
 		vertexFragmentPos = vec3(model * vec4(vertexPosition, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
 
-		vertexFragmentNormal = mat3(transpose(inverse(model))) * vertexNormal; // get normal vectors in world space only and exclude normal translation properties
+		vertexFragmentNormal = normalMatrix * decodeNormal(vertexNormal); // get normal vectors in world space only and exclude normal translation properties
+		vertexTextureCoordinate = textureCoordinate;
+		vertexTextureLayer = textureLayer;
+	}
+);
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+////////////////////////////////////////////////////////////////////////////////////////////////////////
+/* Instanced Surface Vertex Shader Source Code, per-object transforms come from the instance buffer*/
+const GLchar* surfaceInstancedVertexShaderSource = GLSL(440,
+
+	layout(location = 0) in vec3 vertexPosition; // VAP position 0 for vertex position data
+	layout(location = 1) in vec3 vertexNormal; // VAP position 1 for normals, xy only when packed
+	layout(location = 2) in vec2 textureCoordinate;
+	layout(location = 3) in mat4 instanceModel; // INSTANCE_ATTRIBUTE_LOCATION, takes locations 3 - 6
+	layout(location = 7) in mat3 instanceNormalMatrix; // takes locations 7 - 9
+	layout(location = 10) in int instanceTextureLayer;
+
+	out vec3 vertexFragmentNormal; // For outgoing normals to fragment shader
+	out vec3 vertexFragmentPos; // For outgoing color / pixels to fragment shader
+	out vec2 vertexTextureCoordinate;
+	flat out int vertexTextureLayer;
+
+	uniform bool uOctahedralNormals; // Normals arrive as two octahedral components (VERTEX_FORMAT_PACKED)
+
+	// Per-frame camera and lighting data, binding 0 = FRAME_DATA_BINDING (see UFrameData)
+	layout(std140, binding = 0) uniform FrameData
+	{
+		mat4 view;
+		mat4 projection;
+		vec4 viewPosition;
+		vec4 ambientColor;
+		vec4 light1Color;
+		vec4 light1Position;
+		vec4 light2Color;
+		vec4 light2Position;
+		vec4 specular;
+	};
+
+	// Unfolds an octahedral normal, plain float normals pass through
+	vec3 decodeNormal(vec3 normal)
+	{
+		if (!uOctahedralNormals)
+			return normal;
+
+		vec3 n = vec3(normal.xy, 1.0 - abs(normal.x) - abs(normal.y));
+		if (n.z < 0.0)
+			n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+		return normalize(n);
+	}
+
+	void main()
+	{
+		gl_Position = projection * view * instanceModel * vec4(vertexPosition, 1.0f); // Transforms vertices into clip coordinates
+
+		vertexFragmentPos = vec3(instanceModel * vec4(vertexPosition, 1.0f)); // Gets fragment / pixel position in world space only (exclude view and projection)
+
+		vertexFragmentNormal = instanceNormalMatrix * decodeNormal(vertexNormal); // get normal vectors in world space only and exclude normal translation properties
 		vertexTextureCoordinate = textureCoordinate;
+		vertexTextureLayer = instanceTextureLayer;
 	}
 );
 ////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -117,53 +376,65 @@ const GLchar* surfaceFragmentShaderSource = GLSL(440,
 	in vec3 vertexFragmentNormal; // For incoming normals
 	in vec3 vertexFragmentPos; // For incoming fragment position
 	in vec2 vertexTextureCoordinate;
+	flat in int vertexTextureLayer;
 
 	out vec4 fragmentColor; // For outgoing cube color to the GPU
 
-	// Uniform / Global variables for object color, light color, light position, and camera/view position
-	uniform vec3 objectColor;
-	uniform vec3 ambientColor;
-	uniform vec3 light1Color;
-	uniform vec3 light1Position;
-	uniform vec3 light2Color;
-	uniform vec3 light2Position;
-	uniform vec3 viewPosition;
+	// Per-frame camera and lighting data, must match the declaration in the vertex shader
+	layout(std140, binding = 0) uniform FrameData
+	{
+		mat4 view;
+		mat4 projection;
+		vec4 viewPosition;      // xyz
+		vec4 ambientColor;      // rgb, a = ambient strength
+		vec4 light1Color;       // rgb
+		vec4 light1Position;    // xyz
+		vec4 light2Color;       // rgb
+		vec4 light2Position;    // xyz
+		vec4 specular;          // x = intensity, y = highlight size
+	};
+
 	uniform sampler2D uTexture; // Useful when working with multiple textures
+	uniform sampler2DArray uTextureArray; // Every texture as a layer, on TEXTURE_ARRAY_UNIT
+	uniform bool uUseTextureArray;
 	uniform vec2 uvScale;
-	uniform float ambientStrength = 0.1f; // Set ambient or global lighting strength
-	uniform float specularIntensity = 0.8f;
-	uniform float highlightSize = 16.0f;
 
 	void main()
 	{
 		/*Phong lighting model calculations to generate ambient, diffuse, and specular components*/
 
 		//Calculate Ambient lighting
-		vec3 ambient = ambientStrength * ambientColor; // Generate ambient light color
+		vec3 ambient = ambientColor.a * ambientColor.rgb; // Generate ambient light color
 
 		//**Calculate Diffuse lighting**
 		vec3 norm = normalize(vertexFragmentNormal); // Normalize vectors to 1 unit
-		vec3 light1Direction = normalize(light1Position - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
+		vec3 light1Direction = normalize(light1Position.xyz - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
 		float impact1 = max(dot(norm, light1Direction), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-		vec3 diffuse1 = impact1 * light1Color; // Generate diffuse light color
-		vec3 light2Direction = normalize(light2Position - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
+		vec3 diffuse1 = impact1 * light1Color.rgb; // Generate diffuse light color
+		vec3 light2Direction = normalize(light2Position.xyz - vertexFragmentPos); // Calculate distance (light direction) between light source and fragments/pixels on cube
 		float impact2 = max(dot(norm, light2Direction), 0.0);// Calculate diffuse impact by generating dot product of normal and light
-		vec3 diffuse2 = impact2 * light2Color; // Generate diffuse light color
+		vec3 diffuse2 = impact2 * light2Color.rgb; // Generate diffuse light color
 
 		//**Calculate Specular lighting**
-		vec3 viewDir = normalize(viewPosition - vertexFragmentPos); // Calculate view direction
+		vec3 viewDir = normalize(viewPosition.xyz - vertexFragmentPos); // Calculate view direction
 		vec3 reflectDir1 = reflect(-light1Direction, norm);// Calculate reflection vector
 		//Calculate specular component
-		float specularComponent1 = pow(max(dot(viewDir, reflectDir1), 0.0), highlightSize);
-		vec3 specular1 = specularIntensity * specularComponent1 * light1Color;
+		float specularComponent1 = pow(max(dot(viewDir, reflectDir1), 0.0), specular.y);
+		vec3 specular1 = specular.x * specularComponent1 * light1Color.rgb;
 		vec3 reflectDir2 = reflect(-light2Direction, norm);// Calculate reflection vector
 		//Calculate specular component
-		float specularComponent2 = pow(max(dot(viewDir, reflectDir2), 0.0), highlightSize);
-		vec3 specular2 = specularIntensity * specularComponent2 * light2Color;
+		float specularComponent2 = pow(max(dot(viewDir, reflectDir2), 0.0), specular.y);
+		vec3 specular2 = specular.x * specularComponent2 * light2Color.rgb;
 
 		//**Calculate phong result**
 		//Texture holds the color to be used for all three components
-		vec4 textureColor = texture(uTexture, vertexTextureCoordinate * uvScale);
+		// Images are uploaded top row first, reversing V here saves flipping them on load
+		vec2 uv = vertexTextureCoordinate * uvScale;
+		vec4 textureColor;
+		if (uUseTextureArray)
+			textureColor = texture(uTextureArray, vec3(uv.x, 1.0 - uv.y, float(vertexTextureLayer)));
+		else
+			textureColor = texture(uTexture, vec2(uv.x, 1.0 - uv.y));
 		vec3 phong1 = (ambient + diffuse1 + specular1) * textureColor.xyz; //objectColor;
 		vec3 phong2 = (ambient + diffuse2 + specular2) * textureColor.xyz; //objectColor;
 
@@ -204,112 +475,347 @@ const GLchar* lightFragmentShaderSource = GLSL(440,
  * and render graphics on the screen
  */
 bool UInitialize(int, char*[], GLFWwindow** window);
+bool UOpenScene(const char* filename);
+bool UBuildAssetPack(const char* packFilename);
+void UBuildInstanceGroups();
+bool UValidateDrawRanges();
+void UBuildCullBounds();
+void UBuildOccluders();
+void UBuildGpuCulling();
+void UCullObjects(const glm::mat4& viewProjection);
+void UPickObject();
 void UResizeWindow(GLFWwindow* window, int width, int height);
 void UProcessInput(GLFWwindow* window);
 void UMousePositionCallback(GLFWwindow* window, double xpos, double ypos);
 void UMouseScrollCallback(GLFWwindow* window, double xoffset, double yoffset);
 void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods);
+void UKeyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
 void UCreatePlaneMesh(GLMesh& mesh);
 void UCreatePyramidMesh(GLMesh& mesh);
 void UCreateCubeMesh(GLMesh& mesh);
-void UCreateCylinderMesh(GLMesh& mesh);
+void UCreateCylinderMesh(GLMesh& mesh, const char* name, const UCylinderDesc& desc);
+void UCreateIndexedMesh(GLMesh& mesh, const char* name, const float* soup, GLuint soupVertexCount, const UShapeRange* parts, GLuint partCount);
+USceneDrawRange UResolveDrawRange(GLuint mesh, const USceneDrawRange& range);
 void URender();
+void UQueueObjects();
+void UQueueInstanceGroups();
+void USubmitRenderQueue();
+void USubmitIndirect();
+void USubmitGpuCulled(const glm::mat4& viewProjection);
+void UFlushIndirectBatch(UDrawElementsIndirectCommand* commands, GLuint& written);
+void UDrawObject(GLuint object);
+void UDrawInstanceGroup(const UInstanceGroup& group);
 void UDestroyMesh(GLMesh& mesh);
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId);
-void UDestroyShaderProgram(GLuint programId);
-bool UCreateTexture(const char* filename, GLuint& textureId);
+void UResolveSurfaceUniforms(const UShaderProgram& program, USurfaceUniforms& uniforms);
+void UApplyVertexFormat();
+glm::vec4 UPositionDecode(GLuint mesh);
+void UPrintRenderStats();
+bool UCreateTexture(const UDecodedImage& image, GLuint& textureId);
+bool UCreateCompressedTexture(const UDecodedImage& image, GLuint& textureId);
+void UCreatePlaceholderTexture(GLuint& textureId);
+void UUploadDecodedTextures();
+void UNoteTextureUses(const glm::mat4& view);
 void UDestroyTexture(GLuint textureId);
+GLuint USortTexture(GLuint object);
 
 // main function. Entry point to the OpenGL program
 int main(int argc, char* argv[])
 {
-	if (!UInitialize(argc, argv, &gWindow))
-		return EXIT_FAILURE;
+	gStartTime = chrono::steady_clock::now();
+	bool benchFlip = false;
+	bool benchMips = false;
+	const char* buildPackFilename = nullptr;
+	bool buildAssets = false;
+	bool benchUniforms = false;
+	GLuint benchBvh = 0;
+	GLuint benchSpatialIndexes = 0;
+	float benchMovingFraction = 0.0f;
+
+	// Command line options:
+	//   --scene <filename>               scene to load, text or .bin
+	//   --convert-scene <in> <out>       write the binary scene for a text scene and exit
+	//   --stress <n>                     draw n x n copies of the scene
+	//   --float-vertices                 draw with 32-byte float vertices instead of packed ones
+	//   --compare-vertex-formats         build both vertex formats, F3 switches between them
+	//   --bench-flip                     time the image flips on the scene's textures and exit
+	//   --uncompressed-textures          skip the BC1/BC3 texture cache and upload RGB8
+	//   --mip-filter <box|kaiser>        filter for mip levels built into the texture cache
+	//   --bench-mips                     time glGenerateMipmap against CPU built mips and exit
+	//   --texture-budget <MB>            memory streamed texture levels may take, 0 for no limit
+	//   --no-texture-streaming           keep every mip level of every texture resident
+	//   --texture-array <size>           draw from one array of size x size texture layers
+	//   --pack <filename>                read the scene and its textures from an asset pack
+	//   --build-pack <filename>          pack the scene, its images and their caches and exit
+	//   --no-program-cache               compile the shaders instead of loading cached program binaries
+	//   --no-culling                     draw every object instead of those in the view, F4 toggles
+	//   --no-occlusion-culling           draw the objects occluders hide, F5 toggles
+	//   --flat-culling                   test every object's sphere instead of walking the spatial index
+	//   --gpu-culling                    cull the multi-draw path on the GPU against last frame's depth, F6 toggles
+	//   --validate-gpu-culling           cull on the GPU, check every frame's results on the CPU and exit with failure on a mismatch
+	//   --spatial-index <bvh|grid>       index objects for culling and picking with a BVH or a loose grid
+	//   --bench-bvh <n>                  time the BVH on a synthetic scene of n objects and exit
+	//   --bench-spatial-index <n> <%>    time the BVH against the grid with % of n objects moving and exit
+	//   --bench-uniforms                 time uniform setters with name lookups against cached handles and exit
+	//   --build-assets                   rebuild the binary scene and texture caches that are out of date and exit
+	for (int i = 1; i < argc; ++i)
+	{
+		if (strcmp(argv[i], "--scene") == 0 && i + 1 < argc)
+			gSceneFilename = argv[++i];
+		else if (strcmp(argv[i], "--stress") == 0 && i + 1 < argc)
+			gStressSize = (GLuint)max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--float-vertices") == 0)
+			gVertexFormat = VERTEX_FORMAT_FLOAT;
+		else if (strcmp(argv[i], "--compare-vertex-formats") == 0)
+			gCompareVertexFormats = true;
+		else if (strcmp(argv[i], "--bench-flip") == 0)
+			benchFlip = true;
+		else if (strcmp(argv[i], "--uncompressed-textures") == 0)
+			gCompressTextures = false;
+		else if (strcmp(argv[i], "--bench-mips") == 0)
+			benchMips = true;
+		else if (strcmp(argv[i], "--texture-budget") == 0 && i + 1 < argc)
+			gTextureBudget = (GLsizeiptr)max(0, atoi(argv[++i])) * 1024 * 1024;
+		else if (strcmp(argv[i], "--no-texture-streaming") == 0)
+			gStreamTextures = false;
+		else if (strcmp(argv[i], "--texture-array") == 0 && i + 1 < argc)
+			gTextureArraySize = (GLuint)max(0, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--pack") == 0 && i + 1 < argc)
+		{
+			if (!UOpenAssetPack(argv[++i], gAssetPack))
+			{
+				cout << "Failed to open asset pack " << argv[i] << endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "--build-pack") == 0 && i + 1 < argc)
+			buildPackFilename = argv[++i];
+		else if (strcmp(argv[i], "--no-program-cache") == 0)
+			gProgramCache = false;
+		else if (strcmp(argv[i], "--no-culling") == 0)
+			gFrustumCulling = false;
+		else if (strcmp(argv[i], "--no-occlusion-culling") == 0)
+			gOcclusionCulling = false;
+		else if (strcmp(argv[i], "--flat-culling") == 0)
+			gFlatCulling = true;
+		else if (strcmp(argv[i], "--gpu-culling") == 0)
+			gGpuCulling = true;
+		else if (strcmp(argv[i], "--validate-gpu-culling") == 0)
+			gGpuCulling = gValidateGpuCulling = true;
+		else if (strcmp(argv[i], "--bench-bvh") == 0 && i + 1 < argc)
+			benchBvh = (GLuint)max(1, atoi(argv[++i]));
+		else if (strcmp(argv[i], "--bench-spatial-index") == 0 && i + 2 < argc)
+		{
+			benchSpatialIndexes = (GLuint)max(1, atoi(argv[++i]));
+			benchMovingFraction = (float)atof(argv[++i]) / 100.0f;
+		}
+		else if (strcmp(argv[i], "--spatial-index") == 0 && i + 1 < argc)
+		{
+			gSpatialIndexType = USpatialIndexFromName(argv[++i]);
+			if (gSpatialIndexType == SPATIAL_INDEX_COUNT)
+			{
+				cout << "Unknown spatial index " << argv[i] << ", use bvh or grid" << endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "--bench-uniforms") == 0)
+			benchUniforms = true;
+		else if (strcmp(argv[i], "--build-assets") == 0)
+			buildAssets = true;
+		else if (strcmp(argv[i], "--mip-filter") == 0 && i + 1 < argc)
+		{
+			gMipFilter = UMipFilterFromName(argv[++i]);
+			if (gMipFilter == MIP_FILTER_COUNT)
+			{
+				cout << "Unknown mip filter " << argv[i] << ", use box or kaiser" << endl;
+				return EXIT_FAILURE;
+			}
+		}
+		else if (strcmp(argv[i], "--convert-scene") == 0 && i + 2 < argc)
+			return UConvertScene(argv[i + 1], argv[i + 2]) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
 
-	// Create the mesh
-	UCreatePlaneMesh(gPlaneMesh);
-	UCreatePyramidMesh(gPyramidMesh);
-	UCreateCubeMesh(gCubeMesh);
-	UCreateCylinderMesh(gCylinderMesh);
+	if (benchBvh)
+	{
+		UBenchmarkBvh(benchBvh);
+		return EXIT_SUCCESS;
+	}
 
-	// Create the shader program
-	if (!UCreateShaderProgram(surfaceVertexShaderSource, surfaceFragmentShaderSource, gSurfaceProgramId))
-		return EXIT_FAILURE;
+	if (benchSpatialIndexes)
+	{
+		UBenchmarkSpatialIndexes(benchSpatialIndexes, benchMovingFraction);
+		return EXIT_SUCCESS;
+	}
+
+	// Building assets needs no window, the scene and mip filter options may follow the flag
+	if (buildAssets)
+		return UBuildAssets(gSceneFilename, gMipFilter, 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 
-	if (!UCreateShaderProgram(lightVertexShaderSource, lightFragmentShaderSource, gLightProgramId))
+	// Neither does packing them
+	if (buildPackFilename)
+		return UBuildAssetPack(buildPackFilename) ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	if (!UInitialize(argc, argv, &gWindow))
 		return EXIT_FAILURE;
 
-	// Load textures
+	// Load the scene description
+	if (!UOpenScene(gSceneFilename))
+		return EXIT_FAILURE;
 
-	const char* texBookBindingFilename = "resources/book_binding.jpg";
-	if (!UCreateTexture(texBookBindingFilename, gBookBindingTextureId))
+	if (benchFlip || benchMips)
 	{
-		cout << "Failed to load texture " << texBookBindingFilename << endl;
-		return EXIT_FAILURE;
+		vector<string> filenames;
+		for (GLuint i = 0; i < gSceneView.textureCount; ++i)
+			filenames.push_back(gSceneView.strings + gSceneView.textures[i].filename);
+		bool succeeded = benchFlip ? UBenchmarkImageFlip(filenames) : UBenchmarkMipmaps(filenames);
+		return succeeded ? EXIT_SUCCESS : EXIT_FAILURE;
 	}
 
-	const char* texCigaretteBoxFilename = "resources/cigarette.jpg";
-	if (!UCreateTexture(texCigaretteBoxFilename, gCigaretteBoxTextureId))
+	// Stress mode: the replicas are owned by gScene, which may also be the source
+	if (gStressSize > 1)
 	{
-		cout << "Failed to load texture " << texCigaretteBoxFilename << endl;
-		return EXIT_FAILURE;
+		UScene replicated;
+		UReplicateScene(gSceneView, gStressSize, gStressSize, replicated);
+		gScene = move(replicated);
+		gSceneView = UGetSceneView(gScene);
 	}
 
-	const char* texPaperFilename = "resources/paper.jpg";
-	if (!UCreateTexture(texPaperFilename, gPaperTextureId))
-	{
-		cout << "Failed to load texture " << texPaperFilename << endl;
+	UBuildInstanceGroups();
+
+	// Create the mesh
+	UCreatePlaneMesh(gMeshes[MESH_PLANE]);
+	UCreatePyramidMesh(gMeshes[MESH_PYRAMID]);
+	UCreateCubeMesh(gMeshes[MESH_CUBE]);
+	UCylinderDesc cylinder;
+	UCreateCylinderMesh(gMeshes[MESH_CYLINDER], "cylinder", cylinder);
+	cylinder.segments = 12;
+	UCreateCylinderMesh(gMeshes[MESH_CYLINDER_LOW], "cylinder_low", cylinder);
+
+	// Explicit ranges are only known to fit once the index buffers exist
+	if (!UValidateDrawRanges())
 		return EXIT_FAILURE;
-	}
 
-	const char* texCarpetFilename = "resources/rug.jpg";
-	if (!UCreateTexture(texCarpetFilename, gRugTextureId))
-	{
-		cout << "Failed to load texture " << texCarpetFilename << endl;
+	// Needs the mesh bounds
+	UBuildCullBounds();
+	UBuildOccluders();
+
+	GLuint totalVertices = 0;
+	for (const GLMesh& mesh : gMeshes)
+		totalVertices += mesh.nVertices;
+	cout << "INFO: Vertex memory: " << totalVertices * UVertexSize(VERTEX_FORMAT_FLOAT) << " bytes as floats, "
+		<< totalVertices * UVertexSize(VERTEX_FORMAT_PACKED) << " bytes packed" << endl;
+
+	// Create the shader programs, cached as resources/<name>.glprog
+	const char* programCache = gProgramCache ? "resources" : nullptr;
+	if (!UCreateShaderProgram("surface", surfaceVertexShaderSource, surfaceFragmentShaderSource, programCache, gSurfaceProgram))
 		return EXIT_FAILURE;
-	}
 
-	const char* texWoodFilename = "resources/wood.jpg";
-	if (!UCreateTexture(texWoodFilename, gWoodTextureId))
-	{
-		cout << "Failed to load texture " << texWoodFilename << endl;
+	if (!UCreateShaderProgram("surface_instanced", surfaceInstancedVertexShaderSource, surfaceFragmentShaderSource, programCache, gSurfaceInstancedProgram))
 		return EXIT_FAILURE;
-	}
 
-	const char* texMetalFilename = "resources/metal.jpg";
-	if (!UCreateTexture(texMetalFilename, gMetalTextureId))
-	{
-		cout << "Failed to load texture " << texMetalFilename << endl;
+	if (!UCreateShaderProgram("light", lightVertexShaderSource, lightFragmentShaderSource, programCache, gLightProgram))
 		return EXIT_FAILURE;
-	}
 
-	const char* texHeadphoneFilename = "resources/headphone.jpg";
-	if (!UCreateTexture(texHeadphoneFilename, gHeadphoneTextureId))
+	if (benchUniforms)
+		return UBenchmarkUniforms(gLightProgram, "model") ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	UResolveSurfaceUniforms(gSurfaceProgram, gSurfaceUniforms);
+	UResolveSurfaceUniforms(gSurfaceInstancedProgram, gSurfaceInstancedUniforms);
+
+	// Pack the meshes into one VBO per vertex format for the multi-draw path
+	for (GLuint format = 0; format < VERTEX_FORMAT_COUNT; ++format)
 	{
-		cout << "Failed to load texture " << texHeadphoneFilename << endl;
-		return EXIT_FAILURE;
+		if (!gMeshes[0].vao[format])
+			continue;
+
+		UMeshBuffers meshBuffers[MESH_COUNT];
+		for (GLuint i = 0; i < MESH_COUNT; ++i)
+		{
+			meshBuffers[i].vbo = gMeshes[i].vbo[format];
+			meshBuffers[i].ibo = gMeshes[i].ibo;
+			meshBuffers[i].vertexCount = gMeshes[i].nVertices;
+			meshBuffers[i].indexCount = gMeshes[i].nIndices;
+			meshBuffers[i].indexType = gMeshes[i].indexType;
+		}
+		if (!UCreateMeshArena(gMeshArenas[format], meshBuffers, MESH_COUNT, format))
+			return EXIT_FAILURE;
 	}
 
-	const char* texTapeFilename = "resources/tape.jpg";
-	if (!UCreateTexture(texTapeFilename, gTapeTextureId))
-	{
-		cout << "Failed to load texture " << texTapeFilename << endl;
+	// Uniform blocks for the frame and for every object of the scene
+	if (!UCreateUniformRing(gUniformRing, gSceneView.objectCount, gInstanceDrawCount))
 		return EXIT_FAILURE;
+
+	// Every mesh VAO and the arenas read the instanced transforms from the ring's instance buffer
+	for (GLuint format = 0; format < VERTEX_FORMAT_COUNT; ++format)
+	{
+		if (!gMeshArenas[format].vao)
+			continue;
+
+		for (GLMesh& mesh : gMeshes)
+		{
+			glBindVertexArray(mesh.vao[format]);
+			UBindInstanceAttributes(gUniformRing, INSTANCE_ATTRIBUTE_LOCATION);
+		}
+		glBindVertexArray(gMeshArenas[format].vao);
+		UBindInstanceAttributes(gUniformRing, INSTANCE_ATTRIBUTE_LOCATION);
 	}
+	glBindVertexArray(0);
 
-	const char* texWallFilename = "resources/wall.jpg";
-	if (!UCreateTexture(texWallFilename, gWallTextureId))
+	// The cull shader writes into the ring's instance and command buffers
+	if (gGpuCulling)
 	{
-		cout << "Failed to load texture " << texWallFilename << endl;
+		// On a HiDPI display the framebuffer has more pixels than the window
+		int framebufferWidth, framebufferHeight;
+		glfwGetFramebufferSize(gWindow, &framebufferWidth, &framebufferHeight);
+		if (!UCreateGpuCuller(gGpuCuller, framebufferWidth, framebufferHeight, programCache))
+			return EXIT_FAILURE;
+		UBuildGpuCulling();
+	}
+
+	// Load textures: decoded in parallel on worker threads and uploaded by
+	// UUploadDecodedTextures as they finish, the placeholder is drawn until then
+	UCreatePlaceholderTexture(gPlaceholderTexture);
+	gTextureIds.assign(gSceneView.textureCount, gPlaceholderTexture);
+	gTextureLoader.compress = gCompressTextures && GLEW_EXT_texture_compression_s3tc;
+	gTextureLoader.buildMips = gTextureArraySize && !gTextureLoader.compress;
+	gTextureLoader.mipFilter = gMipFilter;
+	gTextureLoader.pack = gAssetPack.entryCount ? &gAssetPack : nullptr;
+	if (gCompressTextures && !gTextureLoader.compress)
+		cout << "INFO: S3TC is not supported, textures are uploaded uncompressed" << endl;
+	UStartTextureLoader(gTextureLoader, min(gSceneView.textureCount, max(1u, thread::hardware_concurrency())));
+
+	// Streaming needs the mip levels of the texture cache. An array layer keeps its
+	// whole chain, so the array and streaming do not mix.
+	gStreamTextures = gStreamTextures && gTextureLoader.compress && !gTextureArraySize;
+	if (gTextureArraySize && !UCreateTextureArray(gTextureArray, gSceneView.textureCount, gTextureArraySize, gTextureLoader.compress))
 		return EXIT_FAILURE;
+
+	if (gStreamTextures)
+	{
+		vector<string> filenames;
+		for (GLuint i = 0; i < gSceneView.textureCount; ++i)
+			filenames.push_back(gSceneView.strings + gSceneView.textures[i].filename);
+		UStartTextureStreaming(gTextureStreamer, gTextureLoader, filenames, gTextureBudget);
+	}
+	else
+	{
+		for (GLuint i = 0; i < gSceneView.textureCount; ++i)
+			UQueueImageDecode(gTextureLoader, i, gSceneView.strings + gSceneView.textures[i].filename);
 	}
 
 
 	// tell opengl for each sampler to which texture unit it belongs to (only has to be done once)
-	glUseProgram(gSurfaceProgramId);
+	glUseProgram(gSurfaceProgram.id);
 	// We set the texture as texture unit 0
-	glUniform1i(glGetUniformLocation(gSurfaceProgramId, "uTexture"), 0);
-	glUniform2f(glGetUniformLocation(gSurfaceProgramId, "uvScale"), gUVScale.x, gUVScale.y);
+	USetUniform(gSurfaceProgram, gSurfaceUniforms.texture, 0);
+	USetUniform(gSurfaceProgram, gSurfaceUniforms.uvScale, gUVScale);
+	USetUniform(gSurfaceProgram, gSurfaceUniforms.textureArray, (int)TEXTURE_ARRAY_UNIT);
+	USetUniform(gSurfaceProgram, gSurfaceUniforms.useTextureArray, gTextureArray.id ? 1 : 0);
+	glUseProgram(gSurfaceInstancedProgram.id);
+	USetUniform(gSurfaceInstancedProgram, gSurfaceInstancedUniforms.texture, 0);
+	USetUniform(gSurfaceInstancedProgram, gSurfaceInstancedUniforms.uvScale, gUVScale);
+	USetUniform(gSurfaceInstancedProgram, gSurfaceInstancedUniforms.textureArray, (int)TEXTURE_ARRAY_UNIT);
+	USetUniform(gSurfaceInstancedProgram, gSurfaceInstancedUniforms.useTextureArray, gTextureArray.id ? 1 : 0);
+	UApplyVertexFormat();
 
 	// Sets the background color of the window to black (it will be implicitely used by glClear)
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
@@ -328,33 +834,61 @@ int main(int argc, char* argv[])
 		// -----
 		UProcessInput(gWindow);
 
+		UUploadDecodedTextures();
 		URender();
 
+		if (!gFirstFrameReported)
+		{
+			chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - gStartTime;
+			cout << "INFO: First frame after " << elapsed.count() << " ms" << endl;
+			gFirstFrameReported = true;
+		}
+
 		glfwPollEvents();
 	}
 
+	// A validation run ends with a verdict, so tools/headless can gate on the exit status
+	bool validationFailed = false;
+	if (gValidateGpuCulling)
+	{
+		cout << "INFO: GPU culling validation: " << gGpuCuller.mismatches << " mismatches in "
+			<< gGpuCuller.validatedFrames << " validated frames" << endl;
+		validationFailed = gGpuCuller.mismatches > 0 || gGpuCuller.validatedFrames == 0;
+	}
+
 	// Release mesh data
-	UDestroyMesh(gCubeMesh);
-	UDestroyMesh(gCylinderMesh);
-	UDestroyMesh(gPlaneMesh);
-	UDestroyMesh(gPyramidMesh);
+	for (GLMesh& mesh : gMeshes)
+		UDestroyMesh(mesh);
+	for (UMeshArena& arena : gMeshArenas)
+		UDestroyMeshArena(arena);
+	UStopOcclusionCuller(gOcclusionCuller);
 
 	// Release textures
-	UDestroyTexture(gBookBindingTextureId);
-	UDestroyTexture(gCigaretteBoxTextureId);
-	UDestroyTexture(gHeadphoneTextureId);
-	UDestroyTexture(gMetalTextureId);
-	UDestroyTexture(gPaperTextureId);
-	UDestroyTexture(gRugTextureId);
-	UDestroyTexture(gTapeTextureId);
-	UDestroyTexture(gWallTextureId);
-	UDestroyTexture(gWoodTextureId);
+	UStopTextureLoader(gTextureLoader);
+	if (gStreamTextures)
+		UStopTextureStreaming(gTextureStreamer);
+	else
+	{
+		for (GLuint textureId : gTextureIds)
+		{
+			if (textureId != gPlaceholderTexture)
+				UDestroyTexture(textureId);
+		}
+	}
+	UDestroyTexture(gPlaceholderTexture);
+	UDestroyTextureArray(gTextureArray);
 
 
-	UDestroyShaderProgram(gSurfaceProgramId);
-	UDestroyShaderProgram(gLightProgramId);
+	UDestroyShaderProgram(gSurfaceProgram);
+	UDestroyShaderProgram(gSurfaceInstancedProgram);
+	UDestroyShaderProgram(gLightProgram);
+	UDestroyGpuCuller(gGpuCuller);
+	UDestroyUniformRing(gUniformRing);
 
-	exit(EXIT_SUCCESS); // Terminates the program successfully
+	UUnmapFile(gSceneMapping);
+	UCloseAssetPack(gAssetPack);
+
+	exit(validationFailed ? EXIT_FAILURE : EXIT_SUCCESS); // Terminates the program
 }
 
 
@@ -386,6 +920,7 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 	glfwSetCursorPosCallback(*window, UMousePositionCallback);
 	glfwSetScrollCallback(*window, UMouseScrollCallback);
 	glfwSetMouseButtonCallback(*window, UMouseButtonCallback);
+	glfwSetKeyCallback(*window, UKeyCallback);
 	// tell GLFW to capture our mouse
 	glfwSetInputMode(*window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
@@ -408,6 +943,164 @@ bool UInitialize(int argc, char* argv[], GLFWwindow** window)
 }
 
 
+// Loads the scene from its binary cache (<filename>.bin) when that is up to date with
+// the text scene, otherwise parses the text and refreshes the cache for the next run.
+// A binary scene in the asset pack is used as it is, the pack was built from current files.
+bool UOpenScene(const char* filename)
+{
+	auto start = chrono::steady_clock::now();
+	string binFilename = filename;
+	bool binaryOnly = binFilename.size() > 4 && binFilename.compare(binFilename.size() - 4, 4, ".bin") == 0;
+	if (!binaryOnly)
+		binFilename += ".bin";
+
+	UAssetSpan packed;
+	bool mapped = gAssetPack.entryCount && UFindAsset(gAssetPack, binFilename.c_str(), packed)
+		&& UViewBinaryScene(packed.data, packed.size, gSceneView);
+	if (mapped)
+		binFilename = "pack:" + binFilename;
+	else
+		mapped = UMapBinaryScene(binFilename.c_str(), binaryOnly ? nullptr : filename, gSceneMapping, gSceneView);
+	if (!mapped)
+	{
+		if (binaryOnly)
+		{
+			cout << "Failed to map binary scene " << filename << endl;
+			return false;
+		}
+
+		if (!ULoadScene(filename, gScene))
+			return false;
+		gSceneView = UGetSceneView(gScene);
+
+		// Best effort, a read-only resources folder only costs us the faster startup
+		if (UWriteBinaryScene(gScene, binFilename.c_str(), filename))
+			cout << "INFO: Wrote binary scene cache " << binFilename << endl;
+	}
+
+	chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+	cout << "INFO: Scene ready in " << elapsed.count() << " ms (" << (mapped ? "mapped " : "parsed ")
+		<< (mapped ? binFilename : string(filename)) << ", " << gSceneView.objectCount << " objects)" << endl;
+
+	return true;
+}
+
+
+// Writes the binary scene, every image it uses and their texture caches into one pack.
+// UBuildAssets first brings the outputs that are missing or stale up to date with the current mip filter.
+bool UBuildAssetPack(const char* packFilename)
+{
+	auto start = chrono::steady_clock::now();
+	if (!UBuildAssets(gSceneFilename, gMipFilter, 0) || !UOpenScene(gSceneFilename))
+		return false;
+
+	vector<UAssetPackSource> sources;
+
+	string binFilename = gSceneFilename;
+	if (binFilename.size() <= 4 || binFilename.compare(binFilename.size() - 4, 4, ".bin") != 0)
+		binFilename += ".bin";
+	sources.push_back({ binFilename, binFilename });
+
+	for (GLuint i = 0; i < gSceneView.textureCount; ++i)
+	{
+		const string filename = gSceneView.strings + gSceneView.textures[i].filename;
+		sources.push_back({ filename, filename });
+		sources.push_back({ filename + ".btc", filename + ".btc" });
+	}
+
+	if (!UWriteAssetPack(packFilename, sources))
+	{
+		cout << "Failed to write asset pack " << packFilename << endl;
+		return false;
+	}
+
+	chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+	cout << "INFO: Wrote asset pack " << packFilename << " with " << sources.size() << " assets in "
+		<< elapsed.count() << " ms" << endl;
+	return true;
+}
+
+
+// Groups the objects that share mesh, texture and draw ranges so each group can be
+// drawn with one instanced call per range. The scene is static, so this runs once.
+void UBuildInstanceGroups()
+{
+	// Objects often carry their own copy of identical ranges (every cylinder does),
+	// so ranges are compared by value and each distinct list gets a small id
+	vector<GLuint> rangeSetFirst;
+	vector<GLuint> rangeSetCount;
+	vector<GLuint> rangeSetIds(gSceneView.objectCount);
+	for (GLuint object = 0; object < gSceneView.objectCount; ++object)
+	{
+		const USceneMeshRef& meshRef = gSceneView.meshRefs[object];
+		GLuint id = 0;
+		for (; id < rangeSetFirst.size(); ++id)
+		{
+			if (rangeSetCount[id] != meshRef.rangeCount)
+				continue;
+
+			GLuint i = 0;
+			for (; i < meshRef.rangeCount; ++i)
+			{
+				const USceneDrawRange& a = gSceneView.ranges[rangeSetFirst[id] + i];
+				const USceneDrawRange& b = gSceneView.ranges[meshRef.firstRange + i];
+				if (a.mode != b.mode || a.first != b.first || a.count != b.count || a.part != b.part)
+					break;
+			}
+			if (i == meshRef.rangeCount)
+				break;
+		}
+
+		if (id == rangeSetFirst.size())
+		{
+			rangeSetFirst.push_back(meshRef.firstRange);
+			rangeSetCount.push_back(meshRef.rangeCount);
+		}
+		rangeSetIds[object] = id;
+	}
+
+	// Sort the objects by mesh, then texture, then range list
+	vector<unsigned long long> keys(gSceneView.objectCount);
+	for (GLuint object = 0; object < gSceneView.objectCount; ++object)
+	{
+		keys[object] = ((unsigned long long)gSceneView.meshRefs[object].mesh << 48)
+			| ((unsigned long long)USortTexture(object) << 24)
+			| rangeSetIds[object];
+	}
+
+	gInstanceObjects.resize(gSceneView.objectCount);
+	for (GLuint object = 0; object < gSceneView.objectCount; ++object)
+		gInstanceObjects[object] = object;
+	stable_sort(gInstanceObjects.begin(), gInstanceObjects.end(),
+		[&keys](GLuint a, GLuint b) { return keys[a] < keys[b]; });
+
+	gInstanceGroups.clear();
+	for (GLuint slot = 0; slot < gSceneView.objectCount; ++slot)
+	{
+		GLuint object = gInstanceObjects[slot];
+		if (gInstanceGroups.empty() || keys[gInstanceObjects[slot - 1]] != keys[object])
+		{
+			const USceneMeshRef& meshRef = gSceneView.meshRefs[object];
+			UInstanceGroup group;
+			group.mesh = meshRef.mesh;
+			group.texture = USortTexture(object);
+			group.firstRange = meshRef.firstRange;
+			group.rangeCount = meshRef.rangeCount;
+			group.firstInstance = slot;
+			group.instanceCount = 0;
+			gInstanceGroups.push_back(group);
+		}
+		++gInstanceGroups.back().instanceCount;
+	}
+
+	gInstanceDrawCount = 0;
+	for (const UInstanceGroup& group : gInstanceGroups)
+		gInstanceDrawCount += max(group.rangeCount, 1u);
+
+	cout << "INFO: " << gSceneView.objectCount << " objects in " << gInstanceGroups.size() << " instance groups" << endl;
+}
+
+
 // process all input: query GLFW whether relevant keys are pressed/released this frame and react accordingly
 void UProcessInput(GLFWwindow* window)
 {
@@ -450,6 +1143,10 @@ void UProcessInput(GLFWwindow* window)
 void UResizeWindow(GLFWwindow* window, int width, int height)
 {
 	glViewport(0, 0, width, height);
+
+	// The pyramid is built from a copy of the whole framebuffer
+	if (gGpuCuller.cullProgram.id)
+		UResizeGpuCuller(gGpuCuller, width, height);
 }
 
 // glfw: whenever the mouse moves, this callback is called
@@ -489,7 +1186,10 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 	case GLFW_MOUSE_BUTTON_LEFT:
 	{
 		if (action == GLFW_PRESS)
+		{
 			cout << "Left mouse button pressed" << endl;
+			UPickObject();
+		}
 		else
 			cout << "Left mouse button released" << endl;
 	}
@@ -519,31 +1219,116 @@ void UMouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 	}
 }
 
+// glfw: handle key events that toggle state or report something once per press
+// ------------------------------------------------------------------------------
+void UKeyCallback(GLFWwindow* /*window*/, int key, int /*scancode*/, int action, int /*mods*/)
+{
+	if (action != GLFW_PRESS)
+		return;
+
+	switch (key)
+	{
+	// Print render statistics
+	case GLFW_KEY_F1:
+		UPrintRenderStats();
+		break;
+
+	// Cycle through the ways of submitting the scene
+	case GLFW_KEY_F2:
+		gSubmitMode = (gSubmitMode + 1) % SUBMIT_MODE_COUNT;
+		cout << "Drawing " << SUBMIT_MODE_NAMES[gSubmitMode] << endl;
+		break;
+
+	// Compare drawing only the visible objects with drawing all of them
+	case GLFW_KEY_F4:
+		gFrustumCulling = !gFrustumCulling;
+		cout << "Frustum culling " << (gFrustumCulling ? "on" : "off") << endl;
+		break;
+
+	case GLFW_KEY_F5:
+		gOcclusionCulling = !gOcclusionCulling;
+		cout << "Occlusion culling " << (gOcclusionCulling ? "on" : "off") << endl;
+		break;
+
+	// Compare culling on the GPU with culling on the CPU
+	case GLFW_KEY_F6:
+		if (!gGpuCuller.cullProgram.id)
+		{
+			cout << "Start with --gpu-culling to cull on the GPU" << endl;
+			break;
+		}
+		gGpuCulling = !gGpuCulling;
+		cout << "GPU culling " << (gGpuCulling ? "on" : "off") << endl;
+		break;
+
+	// Switch between packed and float vertices to compare them
+	case GLFW_KEY_F3:
+		if (!gCompareVertexFormats)
+		{
+			cout << "Start with --compare-vertex-formats to switch vertex formats" << endl;
+			break;
+		}
+		gVertexFormat = gVertexFormat == VERTEX_FORMAT_PACKED ? VERTEX_FORMAT_FLOAT : VERTEX_FORMAT_PACKED;
+		UApplyVertexFormat();
+		// The cull shader's copies of the object records decode positions for one format
+		if (gGpuCuller.cullProgram.id)
+			UBuildGpuCulling();
+		cout << "Drawing " << (gVertexFormat == VERTEX_FORMAT_PACKED ? "packed" : "float") << " vertices, "
+			<< UVertexSize(gVertexFormat) << " bytes each" << endl;
+		break;
+
+	default:
+		break;
+	}
+}
+
+// Prints the counters collected while rendering
+void UPrintRenderStats()
+{
+	cout << "Uniform updates: " << gSurfaceProgram.issuedUpdates << " issued, "
+		<< gSurfaceProgram.skippedUpdates << " skipped" << endl;
+	cout << "Last frame: " << gFrameStats.drawCalls << " draw calls, "
+		<< gFrameStats.objectBinds << " object data binds, "
+		<< gFrameStats.instances << " instanced objects, "
+		<< gFrameStats.indirectCommands << " indirect commands, "
+		<< gFrameStats.cpuMilliseconds << " ms CPU" << endl;
+	if (gFrameStats.gpuCulled)
+	{
+		cout << "GPU culling: " << gSceneView.objectCount << " objects against the frustum and a "
+			<< gGpuCuller.levels << " level Hi-Z pyramid";
+		if (gValidateGpuCulling)
+		{
+			cout << ", " << gGpuCuller.visibleObjects << " drawn and " << gGpuCuller.occludedObjects << " occluded, "
+				<< gGpuCuller.mismatches << " mismatches in " << gGpuCuller.validatedFrames << " validated frames";
+		}
+		cout << endl;
+	}
+	else
+	{
+		cout << "Culling: " << gFrameStats.visibleObjects << " of " << gSceneView.objectCount << " objects visible in "
+			<< gFrameStats.cullMilliseconds << " ms" << (gFrustumCulling ? "" : " (culling off)") << endl;
+	}
+	if (gOcclusionCulling && !gFrameStats.gpuCulled)
+	{
+		cout << "Occlusion: " << gFrameStats.occludedObjects << " objects hidden by " << gOcclusionCuller.triangles.size()
+			<< " occluder triangles, drawn in " << gOcclusionCuller.drawMilliseconds << " ms and tested in "
+			<< gOcclusionCuller.testMilliseconds << " ms on " << gOcclusionCuller.workers.size() + 1 << " threads" << endl;
+	}
+	cout << "State changes (program/texture/VAO): "
+		<< gFrameStats.sceneOrderChanges.programs << "/" << gFrameStats.sceneOrderChanges.textures << "/"
+		<< gFrameStats.sceneOrderChanges.vertexArrays << " in scene order, "
+		<< gFrameStats.sortedChanges.programs << "/" << gFrameStats.sortedChanges.textures << "/"
+		<< gFrameStats.sortedChanges.vertexArrays << " sorted" << endl;
+	if (gStreamTextures)
+		UPrintTextureStreaming(gTextureStreamer);
+}
+
 void URender()
 {
+	auto start = chrono::steady_clock::now();
 
-	GLint modelLoc;
-	GLint viewLoc;
-	GLint projLoc;
-	GLint viewPosLoc;
-	GLint ambStrLoc;
-	GLint ambColLoc;
-	GLint light1ColLoc;
-	GLint light1PosLoc;
-	GLint light2ColLoc;
-	GLint light2PosLoc;
-	GLint objColLoc;
-	GLint specIntLoc;
-	GLint highlghtSzLoc;
-	glm::mat4 scale;
-	glm::mat4 rotation;
-	glm::mat4 translation;
-	glm::mat4 model;
 	glm::mat4 view;
 	glm::mat4 projection;
-	glm::vec3 location;
-	glm::vec3 loc1;
-	glm::vec3 loc2;
 
 	glEnable(GL_DEPTH_TEST);
 
@@ -554,674 +1339,596 @@ void URender()
 	view = g_pCurrentCamera->GetViewMatrix();
 	projection = glm::perspective(glm::radians(g_pCurrentCamera->Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
 
-	// Set the shader to be used
-	glUseProgram(gSurfaceProgramId);
-
-	// Retrieves and passes transform matrices to the Shader program
-	modelLoc = glGetUniformLocation(gSurfaceProgramId, "model");
-	viewLoc = glGetUniformLocation(gSurfaceProgramId, "view");
-	projLoc = glGetUniformLocation(gSurfaceProgramId, "projection");
-	viewPosLoc = glGetUniformLocation(gSurfaceProgramId, "viewPosition");
-	ambStrLoc = glGetUniformLocation(gSurfaceProgramId, "ambientStrength");
-	ambColLoc = glGetUniformLocation(gSurfaceProgramId, "ambientColor");
-	light1ColLoc = glGetUniformLocation(gSurfaceProgramId, "light1Color");
-	light1PosLoc = glGetUniformLocation(gSurfaceProgramId, "light1Position");
-	light2ColLoc = glGetUniformLocation(gSurfaceProgramId, "light2Color");
-	light2PosLoc = glGetUniformLocation(gSurfaceProgramId, "light2Position");
-	objColLoc = glGetUniformLocation(gSurfaceProgramId, "objectColor");
-	specIntLoc = glGetUniformLocation(gSurfaceProgramId, "specularIntensity");
-	highlghtSzLoc = glGetUniformLocation(gSurfaceProgramId, "highlightSize");
-
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-	glUniformMatrix4fv(projLoc, 1, GL_FALSE, glm::value_ptr(projection));
+	// Wait until the GPU is done with this frame's slice of the uniform ring
+	UBeginUniformFrame(gUniformRing);
+	gFrameStats = URenderStats();
 
+	// Frame data: camera and lights
+	UFrameData frame;
+	frame.view = view;
+	frame.projection = projection;
 	//set the camera view location
-	glUniform3f(viewPosLoc, g_pCurrentCamera->Position.x, g_pCurrentCamera->Position.y, g_pCurrentCamera->Position.z);
-	//set ambient lighting strength
-	glUniform1f(ambStrLoc, 1.0f);
-	//set ambient color
-	glUniform3f(ambColLoc, 0.2f, 0.2f, 0.2f);
-	glUniform3f(light1ColLoc, 1.0f, 1.0f, 1.0f);	//white
-
-	//UPDATE BOTH glUniform3f and loc1 FOR EASE OF ACCESS
-	glUniform3f(light1PosLoc, -20.0f, 18.0f, 23.0f);
-	loc1 = glm::vec3(-20.0f, 18.0f, 23.0f);
-
-	glUniform3f(light2ColLoc, 0.1f, 0.2f, 0.0f);	//green-ish
-
-	//UPDATE BOTH glUniform3f and loc2 FOR EASE OF ACCESS
-	glUniform3f(light2PosLoc, 0.0f, 10.0f, -12.0f);
-	loc2 = glm::vec3(0.0f, 10.0f, -12.0f);
-	//set specular intensity
-	glUniform1f(specIntLoc, 1.0f);
-	//set specular highlight size
-	glUniform1f(highlghtSzLoc, 2.0f);
-
-
-	//LIGHT INDICATORS	
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(gPlaneMesh.vao);
-
-	//White light
-	scale = glm::scale(glm::vec3(0.1f, 0.1f, 0.1f));
-	rotation = glm::rotate(1.0f, glm::vec3(-0.5f, 0.1f, 0.1f));
-	translation = glm::translate(loc1);
-	// Model matrix: transformations are applied right-to-left order
-	model = translation * rotation * scale;
+	frame.viewPosition = glm::vec4(g_pCurrentCamera->Position, 1.0f);
+	//set ambient color and lighting strength
+	frame.ambientColor = glm::vec4(0.2f, 0.2f, 0.2f, 1.0f);
+
+	// The surface shader takes two lights, missing scene lights are left dark
+	USceneLight lights[2] = {};
+	for (GLuint i = 0; i < gSceneView.lightCount && i < 2; ++i)
+		lights[i] = gSceneView.lights[i];
+	frame.light1Color = glm::vec4(lights[0].color, 1.0f);
+	frame.light1Position = glm::vec4(lights[0].position, 1.0f);
+	frame.light2Color = glm::vec4(lights[1].color, 1.0f);
+	frame.light2Position = glm::vec4(lights[1].position, 1.0f);
+	//set specular intensity and highlight size
+	frame.specular = glm::vec4(1.0f, 2.0f, 0.0f, 0.0f);
+
+	*UFrameDataPtr(gUniformRing) = frame;
+	UBindFrameData(gUniformRing);
+
+	if (gStreamTextures)
+		UNoteTextureUses(view);
+
+	// GPU culling only feeds the multi-draw path, the other modes still cull on the CPU
+	gFrameStats.gpuCulled = gGpuCulling && gSubmitMode == SUBMIT_INDIRECT;
+	if (!gFrameStats.gpuCulled)
+	{
+		UCullObjects(projection * view);
 
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+		// Queue this frame's draws, then submit them sorted by state
+		UClearRenderQueue(gRenderQueue);
+		if (gSubmitMode == SUBMIT_OBJECTS)
+			UQueueObjects();
+		else
+			UQueueInstanceGroups();
 
-	glDrawArrays(GL_TRIANGLES, 0, gPlaneMesh.nVertices);
+		gFrameStats.sceneOrderChanges = UCountStateChanges(gRenderQueue);
+		USortRenderQueue(gRenderQueue);
+		gFrameStats.sortedChanges = UCountStateChanges(gRenderQueue);
+	}
 
+	if (gTextureArray.id)
+	{
+		glActiveTexture(GL_TEXTURE0 + TEXTURE_ARRAY_UNIT);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, gTextureArray.id);
+	}
 
-	//Greenish light
-	scale = glm::scale(glm::vec3(0.1f, 0.1f, 0.1f));
-	rotation = glm::rotate(1.0f, glm::vec3(0.0, 0.0f, -0.25f));
-	translation = glm::translate(loc2);
-	model = translation * rotation * scale;
+	if (gFrameStats.gpuCulled)
+		USubmitGpuCulled(projection * view);
+	else if (gSubmitMode == SUBMIT_INDIRECT)
+		USubmitIndirect();
+	else
+		USubmitRenderQueue();
 
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	// The next frame culls against this frame's depth. While culling runs on the CPU the
+	// pyramid stops following the view, so it is dropped.
+	if (gFrameStats.gpuCulled)
+	{
+		if (gValidateGpuCulling)
+			UValidateGpuCulling(gGpuCuller, gUniformRing);
+		UBuildHiZPyramid(gGpuCuller, projection * view);
+	}
+	else
+		gGpuCuller.pyramidValid = false;
 
-	glDrawArrays(GL_TRIANGLES, 0, gPlaneMesh.nVertices);
+	UEndUniformFrame(gUniformRing);
 
+	// Deactivate the Vertex Array Object
 	glBindVertexArray(0);
+	glUseProgram(0);
 
+	chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+	gFrameStats.cpuMilliseconds = elapsed.count();
 
-	//CARPET
-
-	// bind textures on corresponding texture units
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gRugTextureId);
-
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(gPlaneMesh.vao);
-	scale = glm::scale(glm::vec3(10.0f, 1.0f, 10.0f));
-	rotation = glm::rotate(0.0f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(0.0f, -3.58f, 0.0f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the plane for my rug.
-	glDrawArrays(GL_TRIANGLES, 0, gPlaneMesh.nVertices);
-
-	glBindVertexArray(0);
-
-	// BOOK
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(gCylinderMesh.vao);
+	// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
+	glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+}
 
-	//PAPER CYLINDERS
+// Bounding spheres in world space, the scene is static so this runs once
+void UBuildCullBounds()
+{
+	UResetCullBounds(gCullBounds, gSceneView.objectCount);
+	for (GLuint object = 0; object < gSceneView.objectCount; ++object)
+		USetCullBounds(gCullBounds, object, gMeshes[gSceneView.meshRefs[object].mesh].bounds, gSceneView.transforms[object]);
+	gObjectVisible.assign(gSceneView.objectCount, 0);
+
+	auto start = chrono::steady_clock::now();
+	vector<UBounds> bounds(gSceneView.objectCount);
+	for (GLuint object = 0; object < gSceneView.objectCount; ++object)
+	{
+		const glm::vec3 center(gCullBounds.centerX[object], gCullBounds.centerY[object], gCullBounds.centerZ[object]);
+		bounds[object] = USphereBounds(center, gCullBounds.radius[object]);
+	}
+	UBuildSpatialIndex(gSpatialIndex, gSpatialIndexType, bounds.data(), gSceneView.objectCount);
+
+	chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+	cout << "INFO: " << SPATIAL_INDEX_NAMES[gSpatialIndexType] << " index over " << gSceneView.objectCount
+		<< " objects built in " << elapsed.count() << " ms, ";
+	if (gSpatialIndexType == SPATIAL_INDEX_GRID)
+		cout << gSpatialIndex.grid.cells.size() << " cells of " << gSpatialIndex.grid.cellSize << endl;
+	else
+		cout << gSpatialIndex.bvh.nodes.size() << " nodes" << endl;
+}
 
-	// bind textures on corresponding texture units
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gPaperTextureId);
+// Occluder triangles in world space and the box of every object for the occlusion culler,
+// the scene is static so this runs once
+void UBuildOccluders()
+{
+	gOcclusionCuller.boxes.resize(gSceneView.objectCount);
+	GLuint occluders = 0;
+	for (GLuint object = 0; object < gSceneView.objectCount; ++object)
+	{
+		const GLMesh& mesh = gMeshes[gSceneView.meshRefs[object].mesh];
+		const glm::vec3 center = (mesh.boxMin + mesh.boxMax) * 0.5f;
+		const glm::vec3 halfSize = (mesh.boxMax - mesh.boxMin) * 0.5f;
+		gOcclusionCuller.boxes[object] = gSceneView.transforms[object] * glm::translate(center) * glm::scale(halfSize);
 
-	//paper curve top
-	scale = glm::scale(glm::vec3(1.0f, 0.2f, 0.2f));
-	rotation = glm::rotate(0.0f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(0.0f, 0.0f, -0.026f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+		// Occluders are solid, so the whole mesh stands in whatever ranges the object draws
+		if (gSceneView.objectFlags[object] & SCENE_OBJECT_OCCLUDER)
+		{
+			UAddOccluder(gOcclusionCuller, mesh.positions, mesh.indices, gSceneView.transforms[object]);
+			++occluders;
+		}
+	}
 
-	// Draw the top and bottom of the paper cylinder only
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 72);
-	// Draw the circumference of the paper cylinder only
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 180);
+	// A fifth of the window each way is enough to hide whole objects
+	UStartOcclusionCuller(gOcclusionCuller, WINDOW_WIDTH / 5, WINDOW_HEIGHT / 5, 0);
+	cout << "INFO: Occlusion culling: " << occluders << " occluders, " << gOcclusionCuller.occluders.size() / 3
+		<< " triangles, " << gOcclusionCuller.width << "x" << gOcclusionCuller.height << " depth buffer, "
+		<< gOcclusionCuller.workers.size() + 1 << " threads" << endl;
+}
 
+// Static data for the cull shader in instance slot order, and the commands of every group sorted
+// into one multi-draw call per texture
+void UBuildGpuCulling()
+{
+	const UMeshArena& arena = gMeshArenas[gVertexFormat];
+	UGpuCullScene scene;
+	scene.objects.resize(gSceneView.objectCount);
+	scene.boxes.resize(gSceneView.objectCount * 2);
+	scene.slotGroups.resize(gSceneView.objectCount);
+
+	// The commands USubmitIndirect would build, with no instances yet
+	struct UGroupCommand
+	{
+		GLuint group;
+		UDrawElementsIndirectCommand command;
+	};
+	vector<UGroupCommand> groupCommands;
+	for (GLuint group = 0; group < gInstanceGroups.size(); ++group)
+	{
+		const UInstanceGroup& instanceGroup = gInstanceGroups[group];
+		const GLMesh& mesh = gMeshes[instanceGroup.mesh];
+		for (GLuint slot = instanceGroup.firstInstance; slot < instanceGroup.firstInstance + instanceGroup.instanceCount; ++slot)
+		{
+			const GLuint object = gInstanceObjects[slot];
+			const glm::mat4& transform = gSceneView.transforms[object];
+			UWriteObjectData(scene.objects[slot], transform, UPositionDecode(instanceGroup.mesh), (GLint)gSceneView.materials[object].texture);
+
+			// World-space box around the transformed corners of the mesh box
+			glm::vec3 boxMin(transform * glm::vec4(mesh.boxMin, 1.0f));
+			glm::vec3 boxMax = boxMin;
+			for (int i = 1; i < 8; ++i)
+			{
+				const glm::vec3 corner((i & 1) ? mesh.boxMax.x : mesh.boxMin.x, (i & 2) ? mesh.boxMax.y : mesh.boxMin.y,
+					(i & 4) ? mesh.boxMax.z : mesh.boxMin.z);
+				const glm::vec3 world(transform * glm::vec4(corner, 1.0f));
+				boxMin = glm::min(boxMin, world);
+				boxMax = glm::max(boxMax, world);
+			}
+			scene.boxes[slot * 2] = glm::vec4(boxMin, 1.0f);
+			scene.boxes[slot * 2 + 1] = glm::vec4(boxMax, 1.0f);
+			scene.slotGroups[slot] = group;
+		}
 
-	//paper curve bottom
-	rotation = glm::rotate(3.12f, glm::vec3(0.0f, 1.0f, 0.0f));
-	location = glm::vec3(0.0f, 0.0f, 2.0f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+		UGroupCommand entry;
+		entry.group = group;
+		entry.command.instanceCount = 0;
+		entry.command.baseInstance = instanceGroup.firstInstance;
+		entry.command.baseVertex = arena.baseVertex[instanceGroup.mesh];
 
-	// Draw the top and bottom of the paper cylinder
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 72);
-	// Draw the circumference of the paper cylinder
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 180);
+		const GLuint meshFirst = arena.firstIndex[instanceGroup.mesh];
+		if (instanceGroup.rangeCount == 0)
+		{
+			entry.command.count = arena.indexCount[instanceGroup.mesh];
+			entry.command.firstIndex = meshFirst;
+			groupCommands.push_back(entry);
+		}
 
+		for (GLuint i = 0; i < instanceGroup.rangeCount; ++i)
+		{
+			USceneDrawRange range = UResolveDrawRange(instanceGroup.mesh, gSceneView.ranges[instanceGroup.firstRange + i]);
+			entry.command.count = range.count;
+			entry.command.firstIndex = meshFirst + range.first;
+			groupCommands.push_back(entry);
+		}
+	}
 
-	//LEATHER CYLINDERS
+	// Runs of the same texture become one multi-draw call each
+	stable_sort(groupCommands.begin(), groupCommands.end(), [](const UGroupCommand& a, const UGroupCommand& b)
+	{
+		return gInstanceGroups[a.group].texture < gInstanceGroups[b.group].texture;
+	});
 
-	// bind textures on corresponding texture units
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gBookBindingTextureId);
-
-	//leather curve top TOP
-	scale = glm::scale(glm::vec3(1.05f, 0.018f, 0.25f));
-	rotation = glm::rotate(0.0f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(0.0f, 0.2005f, 0.0f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draw the top and bottom of the leather cylinder
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 72);
-	// Draw the circumference of the leather cylinder
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 180);
-
-
-	//leather curve top BOTTOM
-	scale = glm::scale(glm::vec3(1.05f, 0.019f, 0.25f));
-	rotation = glm::rotate(0.0f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(0.0f, -0.01825f, 0.0f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draw the top and bottom of the leather cylinder
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 72);
-	// Draw the circumference of the leather cylinder
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 180);
-
-
-	//leather curve bottom TOP
-	scale = glm::scale(glm::vec3(1.05f, 0.018f, 0.25f));
-	rotation = glm::rotate(3.1f, glm::vec3(0.0f, 1.0f, 0.0f));
-	location = glm::vec3(0.0f, 0.2005f, 2.0f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draw the top and bottom of the leather cylinder
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 72);
-	// Draw the circumference of the leather cylinder
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 180);
-
-
-	//leather curve bottom BOTTOM
-	scale = glm::scale(glm::vec3(1.05f, 0.019f, 0.25f));
-	rotation = glm::rotate(3.1f, glm::vec3(0.0f, 1.0f, 0.0f));
-	location = glm::vec3(0.0f, -0.01825f, 2.0f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draw the top and bottom of the leather cylinder
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 72);
-	// Draw the circumference of the leather cylinder
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 180);
+	gGpuCommands.clear();
+	gGpuDrawBatches.clear();
+	vector<vector<GLuint>> commandsOfGroup(gInstanceGroups.size());
+	for (const UGroupCommand& entry : groupCommands)
+	{
+		const GLuint texture = gInstanceGroups[entry.group].texture;
+		if (gGpuDrawBatches.empty() || gGpuDrawBatches.back().texture != texture)
+		{
+			UGpuDrawBatch batch = { texture, (GLuint)gGpuCommands.size(), 0 };
+			gGpuDrawBatches.push_back(batch);
+		}
+		++gGpuDrawBatches.back().commandCount;
+		commandsOfGroup[entry.group].push_back((GLuint)gGpuCommands.size());
+		gGpuCommands.push_back(entry.command);
+	}
 
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+	scene.groups.resize(gInstanceGroups.size());
+	for (GLuint group = 0; group < gInstanceGroups.size(); ++group)
+	{
+		UGpuCullGroup& cullGroup = scene.groups[group];
+		cullGroup.firstCommand = (GLuint)scene.groupCommands.size();
+		cullGroup.commandCount = (GLuint)commandsOfGroup[group].size();
+		cullGroup.firstInstance = gInstanceGroups[group].firstInstance;
+		cullGroup.padding = 0;
+		scene.groupCommands.insert(scene.groupCommands.end(), commandsOfGroup[group].begin(), commandsOfGroup[group].end());
+	}
 
+	USetGpuCullScene(gGpuCuller, scene);
+	cout << "INFO: GPU culling: " << gSceneView.objectCount << " objects, " << gGpuCommands.size() << " commands in "
+		<< gGpuDrawBatches.size() << " multi-draw calls, " << gGpuCuller.levels << " level Hi-Z pyramid" << endl;
+}
 
+// Finds the objects to draw this frame, as a list and as flags
+void UCullObjects(const glm::mat4& viewProjection)
+{
+	auto start = chrono::steady_clock::now();
 
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(gCubeMesh.vao);
+	gVisibleObjects.clear();
+	if (gFrustumCulling)
+	{
+		UFrustum frustum;
+		UExtractFrustum(viewProjection, frustum);
+		if (gFlatCulling)
+			UCullSpheres(gCullBounds, frustum, gVisibleObjects);
+		else
+			UCullSpatialIndex(gSpatialIndex, frustum, gVisibleObjects);
+	}
+	else
+	{
+		for (GLuint object = 0; object < gSceneView.objectCount; ++object)
+			gVisibleObjects.push_back(object);
+	}
 
-	// leather book TOP FACE
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(2.05f, 0.01705f, 2.05f));
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	location = glm::vec3(0.025f, 0.21f, 1.02f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	if (gOcclusionCulling)
+	{
+		UCullOccludedObjects(gOcclusionCuller, viewProjection, gVisibleObjects);
+		gFrameStats.occludedObjects = gOcclusionCuller.occludedCount;
+	}
 
-	// Draws the top face of the book
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
+	fill(gObjectVisible.begin(), gObjectVisible.end(), 0);
+	for (GLuint object : gVisibleObjects)
+		gObjectVisible[object] = 1;
 
+	chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+	gFrameStats.visibleObjects = (GLuint)gVisibleObjects.size();
+	gFrameStats.cullMilliseconds = elapsed.count();
+}
 
-	// leather book BOTTOM FACE
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(2.05f, 0.01875f, 2.05f));
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	location = glm::vec3(0.025f, -0.009f, 1.02f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+// Names the object in the middle of the view and counts the objects close to where the view ray hits it
+void UPickObject()
+{
+	const Camera& camera = *g_pCurrentCamera;
+	GLuint object;
+	float distance;
+	if (!URaycastSpatialIndex(gSpatialIndex, camera.Position, camera.Front, 100.0f, object, distance))
+	{
+		cout << "Picked nothing" << endl;
+		return;
+	}
 
-	// Draws the bottom face of the book
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
+	vector<GLuint> nearby;
+	UQuerySpatialIndexSphere(gSpatialIndex, camera.Position + camera.Front * distance, 0.5f, nearby);
+	cout << "Picked " << gSceneView.strings + gSceneView.objectNames[object] << " at distance " << distance
+		<< ", " << nearby.size() - 1 << " other objects within 0.5" << endl;
+}
 
+// Queues one draw per visible object, nearest first within the same state, and fills their blocks
+void UQueueObjects()
+{
+	const glm::vec3 cameraPosition = g_pCurrentCamera->Position;
 
-	// leather book TOP FACE @ spine
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(1.36f, 0.018f, 2.48f));
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	location = glm::vec3(-0.38f, 0.2096f, 1.005f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	for (GLuint object : gVisibleObjects)
+	{
+		const glm::mat4& transform = gSceneView.transforms[object];
+		UWriteObjectData(*UObjectDataPtr(gUniformRing, object), transform, UPositionDecode(gSceneView.meshRefs[object].mesh),
+			(GLint)gSceneView.materials[object].texture);
 
-	// Draws the top face of the book
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
+		float depth = glm::length(glm::vec3(transform[3]) - cameraPosition);
+		USortKey key = UMakeSortKey(RENDER_PROGRAM_SURFACE, USortTexture(object), gSceneView.meshRefs[object].mesh, depth);
+		UPushDraw(gRenderQueue, key, object);
+	}
+}
 
+// Queues one draw per instance group with visible objects and fills the instance buffer in group order
+void UQueueInstanceGroups()
+{
+	// Instance data: the visible objects of each group written as a contiguous run
+	GLuint slot = 0;
+	for (UInstanceGroup& group : gInstanceGroups)
+	{
+		group.firstVisible = slot;
+		for (GLuint i = group.firstInstance; i < group.firstInstance + group.instanceCount; ++i)
+		{
+			const GLuint object = gInstanceObjects[i];
+			if (!gObjectVisible[object])
+				continue;
+			UWriteObjectData(*UInstanceDataPtr(gUniformRing, slot++), gSceneView.transforms[object], UPositionDecode(gSceneView.meshRefs[object].mesh),
+				(GLint)gSceneView.materials[object].texture);
+		}
+		group.visibleCount = slot - group.firstVisible;
+	}
 
-	// leather book TOP BOTTOM @ spine
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(1.36f, 0.018f, 2.48f));
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	location = glm::vec3(-0.38f, -0.009f, 1.005f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	// A group spreads over the scene, so groups are only ordered by state.
+	// The indirect path draws every mesh from the arena VAO.
+	for (GLuint i = 0; i < gInstanceGroups.size(); ++i)
+	{
+		const UInstanceGroup& group = gInstanceGroups[i];
+		if (group.visibleCount == 0)
+			continue;
+		GLuint vertexArray = gSubmitMode == SUBMIT_INDIRECT ? 0 : group.mesh;
+		UPushDraw(gRenderQueue, UMakeSortKey(RENDER_PROGRAM_SURFACE_INSTANCED, group.texture, vertexArray, 0.0f), i);
+	}
+}
 
-	// Draws the top face of the book
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
+// Turns the sorted instance groups into indirect commands and issues one
+// glMultiDrawElementsIndirect per texture
+void USubmitIndirect()
+{
+	const UMeshArena& arena = gMeshArenas[gVertexFormat];
 
+	glUseProgram(gSurfaceInstancedProgram.id);
+	glBindVertexArray(arena.vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gUniformRing.indirectBuffer);
+	glActiveTexture(GL_TEXTURE0);
 
-	// leather book SPINE
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(0.02f, 0.235f, 2.481f));
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	location = glm::vec3(-1.05f, 0.1f, 1.005f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	UDrawElementsIndirectCommand* commands = UCommandDataPtr(gUniformRing);
+	const GLuint instanceBase = UInstanceBase(gUniformRing);
+	GLuint written = 0;
+	GLuint boundTexture = (GLuint)-1;
 
-	// Draws the spine of the book
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
+	for (const URenderItem& draw : gRenderQueue.items)
+	{
+		const UInstanceGroup& group = gInstanceGroups[draw.item];
 
+		// A multi-draw call cannot switch textures, so each texture run is flushed on its own.
+		// With the texture array every group has texture 0 and one call covers the whole scene.
+		if (group.texture != boundTexture)
+		{
+			UFlushIndirectBatch(commands, written);
+			if (!gTextureArray.id)
+				glBindTexture(GL_TEXTURE_2D, gTextureIds[group.texture]);
+			boundTexture = group.texture;
+		}
 
-	// bind textures on corresponding texture units
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gPaperTextureId);
+		UDrawElementsIndirectCommand command;
+		command.instanceCount = group.visibleCount;
+		command.baseInstance = instanceBase + group.firstVisible;
 
-	// book spine paper additive
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(1.0f, 0.21f, 2.4f));
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	location = glm::vec3(-0.55f, 0.1f, 1.0f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+		command.baseVertex = arena.baseVertex[group.mesh];
 
-	// Draws the spine paper
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
+		const GLuint meshFirst = arena.firstIndex[group.mesh];
+		if (group.rangeCount == 0)
+		{
+			command.count = arena.indexCount[group.mesh];
+			command.firstIndex = meshFirst;
+			gIndirectBatch.push_back(command);
+		}
 
+		for (GLuint i = 0; i < group.rangeCount; ++i)
+		{
+			USceneDrawRange range = UResolveDrawRange(group.mesh, gSceneView.ranges[group.firstRange + i]);
+			command.count = range.count;
+			command.firstIndex = meshFirst + range.first;
+			gIndirectBatch.push_back(command);
+		}
+		gFrameStats.instances += group.visibleCount;
+	}
+	UFlushIndirectBatch(commands, written);
 
-	// paper
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(1.0f, 0.21f, 2.05f));
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	location = glm::vec3(0.5f, 0.1f, 1.0f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
 
-	// Draws the paper body
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
+// Lets the cull shader fill in this frame's commands and instances, then draws every batch.
+// Nothing is read back, a command whose objects were all culled draws no instances.
+void USubmitGpuCulled(const glm::mat4& viewProjection)
+{
+	const UMeshArena& arena = gMeshArenas[gVertexFormat];
 
+	UDrawElementsIndirectCommand* commands = UCommandDataPtr(gUniformRing);
+	const GLuint instanceBase = UInstanceBase(gUniformRing);
+	for (size_t i = 0; i < gGpuCommands.size(); ++i)
+	{
+		commands[i] = gGpuCommands[i];
+		commands[i].baseInstance += instanceBase;
+	}
+	UCullOnGpu(gGpuCuller, viewProjection, gUniformRing);
 
-	// Table
-	
-	// bind textures on corresponding texture units
+	glUseProgram(gSurfaceInstancedProgram.id);
+	glBindVertexArray(arena.vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, gUniformRing.indirectBuffer);
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gWoodTextureId);
-
-	//Table TOP 1/4
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(7.0f, 0.4f, 1.4f));
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	location = glm::vec3(0.0f, -0.2185f, 2.82f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-	 
-
-	//Table TOP 2/4
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(7.0f, 0.4f, 1.4f));
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	location = glm::vec3(0.0f, -0.2185f, 1.41f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-
-
-	//Table TOP 3/4
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(7.0f, 0.4f, 1.4f));
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	location = glm::vec3(0.0f, -0.2185f, 0.0f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-
-
-	//Table TOP 4/4
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(7.0f, 0.4f, 1.4f));
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	location = glm::vec3(0.0f, -0.2185f, -1.41f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-
-
-	//Table Under-Support Left (smaller)
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(5.15f, 0.3f, 0.6f));
-	rotation = glm::rotate(1.575f, glm::vec3(0.0f, 1.0f, 0.0f));
-	location = glm::vec3(-1.55f, -0.57f, 0.725f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-
-
-	//Table Under-Support Right (smaller)
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(5.15f, 0.3f, 0.6f));
-	rotation = glm::rotate(1.575f, glm::vec3(0.0f, 1.0f, 0.0f));
-	location = glm::vec3(1.6f, -0.57f, 0.725f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-
-
-	//Table Under-Support Left (larger)
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(4.25f, 0.4f, 0.9f));
-	rotation = glm::rotate(1.575f, glm::vec3(0.0f, 1.0f, 0.0f));
-	location = glm::vec3(-2.7f, -0.625f, 0.725f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-
-
-	//Table Under-Support Right (larger)
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(4.25f, 0.4f, 0.9f));
-	rotation = glm::rotate(1.575f, glm::vec3(0.0f, 1.0f, 0.0f));
-	location = glm::vec3(2.75f, -0.625f, 0.725f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-
-
-	//Table Support VERTICAL Left 1/2
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(2.75f, 0.4f, 0.9f));
-	rotation = glm::rotate(1.575f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(-2.935f, -2.2f, 2.4f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-
-
-	//Table Support VERTICAL Left 2/2
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(2.75f, 0.4f, 0.9f));
-	rotation = glm::rotate(1.575f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(-2.95f, -2.2f, -0.95f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-
-
-	//Table Support VERTICAL Right 1/2
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(2.75f, 0.4f, 0.9f));
-	rotation = glm::rotate(1.575f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(3.0125f, -2.2f, 2.4f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-
-
-	//Table Support VERTICAL Right 2/2
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(2.75f, 0.4f, 0.9f));
-	rotation = glm::rotate(1.575f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(3.0f, -2.2f, -0.95f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-
-
-	//Table Support Right Legs Bottom Support
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(0.9f, 0.35f, 4.25f));
-	rotation = glm::rotate(1.575f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(3.39f, -3.1225f, 0.7235f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-
-
-	//Table Support Left Legs Bottom Support
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(0.9f, 0.35f, 4.25f));
-	rotation = glm::rotate(1.575f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(-3.31f, -3.1225f, 0.7235f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-
-
-	//Table Middle Support Front
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(5.65f, 0.9f, 0.4f));
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	location = glm::vec3(0.05f, -2.2f, 2.4f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
-
-
-	//Table Middle Support Front
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(5.65f, 0.9f, 0.4f));
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	location = glm::vec3(0.05f, -2.2f, -0.95f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the Table Piece
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
 
+	for (const UGpuDrawBatch& batch : gGpuDrawBatches)
+	{
+		if (!gTextureArray.id)
+			glBindTexture(GL_TEXTURE_2D, gTextureIds[batch.texture]);
 
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
-
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(gCylinderMesh.vao);
+		GLintptr offset = UCommandOffset(gUniformRing) + sizeof(UDrawElementsIndirectCommand) * batch.firstCommand;
+		glMultiDrawElementsIndirect(GL_TRIANGLES, arena.indexType, (const void*)offset, (GLsizei)batch.commandCount, 0);
 
-	//HEADPHONES
+		++gFrameStats.drawCalls;
+		gFrameStats.indirectCommands += batch.commandCount;
+	}
 
-	// bind textures on corresponding texture units
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gHeadphoneTextureId);
-
-	//Headphones 
-	scale = glm::scale(glm::vec3(0.35f, 0.25f, 0.2f));
-	rotation = glm::rotate(0.0f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(0.0f, 0.215f, 0.0f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draw the top and bottom of the curve
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 72);
-	// Draw the circumference of the curve
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 180);
-	
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
 
-	// Medical Tape
-	// bind textures on corresponding texture units
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gTapeTextureId);
+// Copies the batched commands into the indirect buffer and draws them with one call
+void UFlushIndirectBatch(UDrawElementsIndirectCommand* commands, GLuint& written)
+{
+	vector<UDrawElementsIndirectCommand>& batch = gIndirectBatch;
+	if (batch.empty())
+		return;
 
-	scale = glm::scale(glm::vec3(0.15f, 0.23f, 0.15f));
-	rotation = glm::rotate(0.0f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(0.55f, 0.2f, 0.0f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	memcpy(commands + written, batch.data(), batch.size() * sizeof(UDrawElementsIndirectCommand));
 
-	// Draw the Medical Tape
-	// Draw the circumference of the Tape
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 180);
+	GLintptr offset = UCommandOffset(gUniformRing) + sizeof(UDrawElementsIndirectCommand) * written;
+	glMultiDrawElementsIndirect(GL_TRIANGLES, gMeshArenas[gVertexFormat].indexType, (const void*)offset, (GLsizei)batch.size(), 0);
 
+	written += (GLuint)batch.size();
+	++gFrameStats.drawCalls;
+	gFrameStats.indirectCommands += (GLuint)batch.size();
+	batch.clear();
+}
 
-	//WALL
+// Walks the sorted queue, changing program, VAO and texture only when the key's fields change
+void USubmitRenderQueue()
+{
+	UShaderProgram* const programs[RENDER_PROGRAM_COUNT] = { &gSurfaceProgram, &gSurfaceInstancedProgram };
 
-	// bind textures on corresponding texture units
+	GLuint boundProgram = RENDER_PROGRAM_COUNT;
+	GLuint boundMesh = MESH_COUNT;
+	GLuint boundTexture = (GLuint)-1;
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gWallTextureId);
-
-	//North Wall
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(gPlaneMesh.vao);
-	scale = glm::scale(glm::vec3(10.0f, 1.0f, 10.0f));
-	rotation = glm::rotate(1.575f, glm::vec3(1.0f, 0.0f, 0.0f));
-	location = glm::vec3(0.0f, 6.4f, -10.0f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the plane for the wall.
-	glDrawArrays(GL_TRIANGLES, 0, gPlaneMesh.nVertices);
-
-	//East Wall
-	scale = glm::scale(glm::vec3(10.0f, 1.0f, 10.0f));
-	rotation = glm::rotate(1.575f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(9.9f, 6.4f, -0.2f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the plane for the wall.
-	glDrawArrays(GL_TRIANGLES, 0, gPlaneMesh.nVertices);
-
-	//West Wall
-	scale = glm::scale(glm::vec3(10.0f, 1.0f, 10.0f));
-	rotation = glm::rotate(1.575f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(-9.9f, 6.4f, -0.2f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draws the plane for the wall.
-	glDrawArrays(GL_TRIANGLES, 0, gPlaneMesh.nVertices);
 
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
-
-
-	//Nail
-
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(gCylinderMesh.vao);
+	for (const URenderItem& draw : gRenderQueue.items)
+	{
+		const GLuint program = USortKeyProgram(draw.key);
+		const GLuint mesh = USortKeyVertexArray(draw.key);
+		const GLuint texture = USortKeyTexture(draw.key);
 
-	// bind textures on corresponding texture units
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gMetalTextureId);
-
-	//Nail Head 
-	scale = glm::scale(glm::vec3(0.02f, 0.002f, 0.02f));
-	rotation = glm::rotate(0.0f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(-0.5f, 0.218f, 0.0f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
-
-	// Draw the top and bottom of the curve
-	glDrawArrays(GL_TRIANGLE_FAN, 0, 36);
-	glDrawArrays(GL_TRIANGLE_FAN, 36, 72);
-	// Draw the circumference of the curve
-	glDrawArrays(GL_TRIANGLE_STRIP, 72, 180);
+		// Set the shader to be used
+		if (program != boundProgram)
+		{
+			glUseProgram(programs[program]->id);
+			boundProgram = program;
+		}
 
-	glBindVertexArray(0);
+		// Activate the VBOs contained within the mesh's VAO
+		if (mesh != boundMesh)
+		{
+			glBindVertexArray(gMeshes[mesh].vao[gVertexFormat]);
+			boundMesh = mesh;
+		}
 
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(gPyramidMesh.vao);
+		// bind textures on corresponding texture units, the texture array stays bound
+		if (texture != boundTexture && !gTextureArray.id)
+		{
+			glBindTexture(GL_TEXTURE_2D, gTextureIds[texture]);
+			boundTexture = texture;
+		}
 
-	//Nail Body
-	scale = glm::scale(glm::vec3(0.004f, 0.05f, 0.004f));
-	rotation = glm::rotate(0.0f, glm::vec3(0.0f, 0.0f, 1.0f));
-	location = glm::vec3(-0.5f, 0.24f, 0.0f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+		if (program == RENDER_PROGRAM_SURFACE_INSTANCED)
+			UDrawInstanceGroup(gInstanceGroups[draw.item]);
+		else
+			UDrawObject(draw.item);
+	}
+}
 
-	// Draws the plane for the wall.
-	glDrawArrays(GL_TRIANGLES, 0, gPyramidMesh.nVertices);
+// Returns the vertices a scene draw range covers, looking up named parts in the mesh
+USceneDrawRange UResolveDrawRange(GLuint mesh, const USceneDrawRange& range)
+{
+	if (range.part == MESH_PART_COUNT)
+		return range;
+	return gMeshes[mesh].parts[range.part];
+}
 
-	// Deactivate the Vertex Array Object
-	glBindVertexArray(0);
+// Checks every explicit draw range against the index buffer of the mesh it draws from.
+// A binary scene skips the text parser, so the triangle list mode is checked here too.
+bool UValidateDrawRanges()
+{
+	for (GLuint object = 0; object < gSceneView.objectCount; ++object)
+	{
+		const USceneMeshRef& meshRef = gSceneView.meshRefs[object];
+		const GLMesh& mesh = gMeshes[meshRef.mesh];
+		for (GLuint i = 0; i < meshRef.rangeCount; ++i)
+		{
+			const USceneDrawRange& range = gSceneView.ranges[meshRef.firstRange + i];
+			if (range.part != MESH_PART_COUNT)
+				continue;
+
+			if (range.mode != GL_TRIANGLES || range.first < 0 || range.count < 0
+				|| (GLuint)range.first + (GLuint)range.count > mesh.nIndices)
+			{
+				cout << "Failed to validate object " << gSceneView.strings + gSceneView.objectNames[object]
+					<< ": draw range " << range.first << " " << range.count << " is not a triangle list range of a mesh with "
+					<< mesh.nIndices << " indices" << endl;
+				return false;
+			}
+		}
+	}
+	return true;
+}
 
-	// Activate the VBOs contained within the mesh's VAO
-	glBindVertexArray(gCubeMesh.vao);
+// Maps a mesh's stored positions to model space for the vertex format being drawn
+glm::vec4 UPositionDecode(GLuint mesh)
+{
+	if (gVertexFormat == VERTEX_FORMAT_PACKED)
+		return gMeshes[mesh].packedDecode;
+	return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+}
 
-	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, gCigaretteBoxTextureId);
+// Draws one object with its uniform block, its mesh and texture must be bound
+void UDrawObject(GLuint object)
+{
+	const USceneMeshRef& meshRef = gSceneView.meshRefs[object];
+	const GLMesh& mesh = gMeshes[meshRef.mesh];
 
-	// Cigarette Box
-	// Manipulate the mesh matrix
-	scale = glm::scale(glm::vec3(0.5f, 0.21f, 0.8f));
-	rotation = glm::rotate(0.0f, glm::vec3(1.0f, 1.0f, 1.0f));
-	location = glm::vec3(0.0f, 0.32f, 1.0f);
-	translation = glm::translate(location);
-	model = translation * rotation * scale;
-	glUniformMatrix4fv(modelLoc, 1, GL_FALSE, glm::value_ptr(model));
+	UBindObjectData(gUniformRing, object);
+	++gFrameStats.objectBinds;
 
-	// Draws the top face of the book
-	glDrawArrays(GL_TRIANGLES, 0, gCubeMesh.nVertices);
+	if (meshRef.rangeCount == 0)
+	{
+		glDrawElements(GL_TRIANGLES, mesh.nIndices, mesh.indexType, NULL);
+		++gFrameStats.drawCalls;
+		return;
+	}
 
+	for (GLuint i = 0; i < meshRef.rangeCount; ++i)
+	{
+		USceneDrawRange range = UResolveDrawRange(meshRef.mesh, gSceneView.ranges[meshRef.firstRange + i]);
+		glDrawElements(range.mode, range.count, mesh.indexType, (void*)((size_t)range.first * UIndexSize(mesh.indexType)));
+	}
+	gFrameStats.drawCalls += meshRef.rangeCount;
+}
 
-	glUseProgram(0);
+// Draws one instance group with one glDrawElementsInstancedBaseInstance per draw range
+void UDrawInstanceGroup(const UInstanceGroup& group)
+{
+	// The base instance selects this frame's region of the instance buffer
+	const GLuint baseInstance = UInstanceBase(gUniformRing) + group.firstVisible;
 
-	// glfw: swap buffers and poll IO events (keys pressed/released, mouse moved etc.)
-	glfwSwapBuffers(gWindow);    // Flips the the back buffer with the front buffer every frame.
+	const GLMesh& mesh = gMeshes[group.mesh];
+	if (group.rangeCount == 0)
+	{
+		glDrawElementsInstancedBaseInstance(GL_TRIANGLES, mesh.nIndices, mesh.indexType, NULL, group.visibleCount, baseInstance);
+		++gFrameStats.drawCalls;
+	}
+	else
+	{
+		for (GLuint i = 0; i < group.rangeCount; ++i)
+		{
+			USceneDrawRange range = UResolveDrawRange(group.mesh, gSceneView.ranges[group.firstRange + i]);
+			glDrawElementsInstancedBaseInstance(range.mode, range.count, mesh.indexType,
+				(void*)((size_t)range.first * UIndexSize(mesh.indexType)), group.visibleCount, baseInstance);
+		}
+		gFrameStats.drawCalls += group.rangeCount;
+	}
+	gFrameStats.instances += group.visibleCount;
 }
 
 // Implements the UCreateMesh function
@@ -1241,33 +1948,7 @@ void UCreatePlaneMesh(GLMesh& mesh)
 		-1.0f, 0.0f, 1.0f,		0.0f,  1.0f,  0.0f,		0.0f, 0.0f
 	};
 
-	const GLuint floatsPerVertex = 3;
-	const GLuint floatsPerNormal = 3;
-	const GLuint floatsPerUV = 2;
-
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
-
-	// Create 2 buffers: first one for the vertex data; second one for the indices
-	glGenBuffers(1, &mesh.vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-
-	// Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
-
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-	glEnableVertexAttribArray(1);
-
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+	UCreateIndexedMesh(mesh, "plane", verts, sizeof(verts) / (sizeof(verts[0]) * MESH_VERTEX_FLOATS), NULL, 0);
 }
 
 
@@ -1293,32 +1974,7 @@ void UCreatePyramidMesh(GLMesh& mesh)
 		-0.5f, -0.5f, -0.5f,	0.0f, 0.0f, 0.0f,	0.0f, 0.0f,
 	};
 
-	const GLuint floatsPerVertex = 3;
-	const GLuint floatsPerNormal = 3;
-	const GLuint floatsPerUV = 2;
-
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
-
-	// Create 2 buffers: first one for the vertex data; second one for the indices
-	glGenBuffers(1, &mesh.vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-	// Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
-
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-	glEnableVertexAttribArray(1);
-
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+	UCreateIndexedMesh(mesh, "pyramid", verts, sizeof(verts) / (sizeof(verts[0]) * MESH_VERTEX_FLOATS), NULL, 0);
 }
 
 
@@ -1373,433 +2029,330 @@ void UCreateCubeMesh(GLMesh& mesh)
 
 	};
 
-	const GLuint floatsPerVertex = 3;
-	const GLuint floatsPerNormal = 3;
-	const GLuint floatsPerUV = 2;
-
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
-
-	// Create 2 buffers: first one for the vertex data; second one for the indices
-	glGenBuffers(1, &mesh.vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
-
-	// Strides between vertex coordinates is 6 (x, y, z, r, g, b, a). A tightly packed stride is 0.
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);// The number of floats before each
-
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, 0);
-	glEnableVertexAttribArray(0);
-
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * floatsPerVertex));
-	glEnableVertexAttribArray(1);
-
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+	UCreateIndexedMesh(mesh, "cube", verts, sizeof(verts) / (sizeof(verts[0]) * MESH_VERTEX_FLOATS), NULL, 0);
 }
 
 
 
-void UCreateCylinderMesh(GLMesh& mesh)
+// Generates a cylinder and records its caps and body as parts
+void UCreateCylinderMesh(GLMesh& mesh, const char* name, const UCylinderDesc& desc)
 {
-	GLfloat verts[] = {
+	vector<float> verts(UCylinderVertexCount(desc) * MESH_VERTEX_FLOATS);
+	UCylinderRanges ranges = {};
+	GLuint vertexCount = UBuildCylinder(desc, verts.data(), UCylinderVertexCount(desc), ranges);
 
+	// Same order as UMeshPart
+	const UShapeRange parts[MESH_PART_COUNT] = { ranges.bottom, ranges.top, ranges.body };
+	UCreateIndexedMesh(mesh, name, verts.data(), vertexCount, parts, MESH_PART_COUNT);
+}
 
-		// cylinder bottom		// normals			// texture coords
-		1.0f, 0.0f, 0.0f,		0.0f, -1.0f, 0.0f,	0.5f,0.0f,
-		.98f, 0.0f, -0.17f,		0.0f, -1.0f, 0.0f,	0.6f, 0.017f,
-		.94f, 0.0f, -0.34f,		0.0f, -1.0f, 0.0f,	0.68f, 0.04f,
-		.87f, 0.0f, -0.5f,		0.0f, -1.0f, 0.0f,	0.77f, 0.08f,
-		.77f, 0.0f, -0.64f,		0.0f, -1.0f, 0.0f,	0.83f, 0.13f,
-		.64f, 0.0f, -0.77f,		0.0f, -1.0f, 0.0f,	0.88f, 0.17f,
-		.5f, 0.0f, -0.87f,		0.0f, -1.0f, 0.0f,	0.93f, 0.25f,
-		.34f, 0.0f, -0.94f,		0.0f, -1.0f, 0.0f,	0.97f, 0.33f,
-		.17f, 0.0f, -0.98f,		0.0f, -1.0f, 0.0f,	0.99f, 0.41f,
-		0.0f, 0.0f, -1.0f,		0.0f, -1.0f, 0.0f,	1.0f,0.5f,
-		-.17f, 0.0f, -0.98f,	0.0f, -1.0f, 0.0f,	0.99f, 0.41f,
-		-.34f, 0.0f, -0.94f,	0.0f, -1.0f, 0.0f,	0.97f, 0.33f,
-		-.5f, 0.0f, -0.87f,		0.0f, -1.0f, 0.0f,	0.93f, 0.25f,
-		-.64f, 0.0f, -0.77f,	0.0f, -1.0f, 0.0f,	0.88f, 0.17f,
-		-.77f, 0.0f, -0.64f,	0.0f, -1.0f, 0.0f,	0.83f, 0.13f,
-		-.87f, 0.0f, -0.5f,		0.0f, -1.0f, 0.0f,	0.77f, 0.08f,
-		-.94f, 0.0f, -0.34f,	0.0f, -1.0f, 0.0f,	0.68f, 0.04f,
-		-.98f, 0.0f, -0.17f,	0.0f, -1.0f, 0.0f,	0.6f, 0.017f,
-		-1.0f, 0.0f, 0.0f,		0.0f, -1.0f, 0.0f,	0.5f, 1.0f,
-		-.98f, 0.0f, 0.17f,		0.0f, -1.0f, 0.0f,	0.41f, 0.99f,
-		-.94f, 0.0f, 0.34f,		0.0f, -1.0f, 0.0f,	0.33f, 0.97f,
-		-.87f, 0.0f, 0.5f,		0.0f, -1.0f, 0.0f,	0.25f, 0.93f,
-		-.77f, 0.0f, 0.64f,		0.0f, -1.0f, 0.0f,	0.17f, 0.88f,
-		-.64f, 0.0f, 0.77f,		0.0f, -1.0f, 0.0f,	0.13f, 0.83f,
-		-.5f, 0.0f, 0.87f,		0.0f, -1.0f, 0.0f,	0.08f, 0.77f,
-		-.34f, 0.0f, 0.94f,		0.0f, -1.0f, 0.0f,	0.04f, 0.68f,
-		-.17f, 0.0f, 0.98f,		0.0f, -1.0f, 0.0f,	0.017f, 0.6f,
-		0.0f, 0.0f, 1.0f,		0.0f, -1.0f, 0.0f,	0.0f, 0.5f,
-		.17f, 0.0f, 0.98f,		0.0f, -1.0f, 0.0f,	0.017f, 0.41f,
-		.34f, 0.0f, 0.94f,		0.0f, -1.0f, 0.0f,	0.04f, 0.33f,
-		.5f, 0.0f, 0.87f,		0.0f, -1.0f, 0.0f,	0.08f, 0.25f,
-		.64f, 0.0f, 0.77f,		0.0f, -1.0f, 0.0f,	0.13f, 0.17f,
-		.77f, 0.0f, 0.64f,		0.0f, -1.0f, 0.0f,	0.17f, 0.13f,
-		.87f, 0.0f, 0.5f,		0.0f, -1.0f, 0.0f,	0.25f, 0.08f,
-		.94f, 0.0f, 0.34f,		0.0f, -1.0f, 0.0f,	0.33f, 0.04f,
-		.98f, 0.0f, 0.17f,		0.0f, -1.0f, 0.0f,	0.41f, 0.017f,
-
-		// cylinder top			// normals			// texture coords
-		1.0f, 1.0f, 0.0f,		0.0f, 1.0f, 0.0f,	0.5f,0.0f,
-		.98f, 1.0f, -0.17f,		0.0f, 1.0f, 0.0f,	0.6f, 0.017f,
-		.94f, 1.0f, -0.34f,		0.0f, 1.0f, 0.0f,	0.68f, 0.04f,
-		.87f, 1.0f, -0.5f,		0.0f, 1.0f, 0.0f,	0.77f, 0.08f,
-		.77f, 1.0f, -0.64f,		0.0f, 1.0f, 0.0f,	0.83f, 0.13f,
-		.64f, 1.0f, -0.77f,		0.0f, 1.0f, 0.0f,	0.88f, 0.17f,
-		.5f, 1.0f, -0.87f,		0.0f, 1.0f, 0.0f,	0.93f, 0.25f,
-		.34f, 1.0f, -0.94f,		0.0f, 1.0f, 0.0f,	0.97f, 0.33f,
-		.17f, 1.0f, -0.98f,		0.0f, 1.0f, 0.0f,	0.99f, 0.41f,
-		0.0f, 1.0f, -1.0f,		0.0f, 1.0f, 0.0f,	1.0f,0.5f,
-		-.17f, 1.0f, -0.98f,	0.0f, 1.0f, 0.0f,	0.99f, 0.41f,
-		-.34f, 1.0f, -0.94f,	0.0f, 1.0f, 0.0f,	0.97f, 0.33f,
-		-.5f, 1.0f, -0.87f,		0.0f, 1.0f, 0.0f,	0.93f, 0.25f,
-		-.64f, 1.0f, -0.77f,	0.0f, 1.0f, 0.0f,	0.88f, 0.17f,
-		-.77f, 1.0f, -0.64f,	0.0f, 1.0f, 0.0f,	0.83f, 0.13f,
-		-.87f, 1.0f, -0.5f,		0.0f, 1.0f, 0.0f,	0.77f, 0.08f,
-		-.94f, 1.0f, -0.34f,	0.0f, 1.0f, 0.0f,	0.68f, 0.04f,
-		-.98f, 1.0f, -0.17f,	0.0f, 1.0f, 0.0f,	0.6f, 0.017f,
-		-1.0f, 1.0f, 0.0f,		0.0f, 1.0f, 0.0f,	0.5f, 1.0f,
-		-.98f, 1.0f, 0.17f,		0.0f, 1.0f, 0.0f,	0.41f, 0.99f,
-		-.94f, 1.0f, 0.34f,		0.0f, 1.0f, 0.0f,	0.33f, 0.97f,
-		-.87f, 1.0f, 0.5f,		0.0f, 1.0f, 0.0f,	0.25f, 0.93f,
-		-.77f, 1.0f, 0.64f,		0.0f, 1.0f, 0.0f,	0.17f, 0.88f,
-		-.64f, 1.0f, 0.77f,		0.0f, 1.0f, 0.0f,	0.13f, 0.83f,
-		-.5f, 1.0f, 0.87f,		0.0f, 1.0f, 0.0f,	0.08f, 0.77f,
-		-.34f, 1.0f, 0.94f,		0.0f, 1.0f, 0.0f,	0.04f, 0.68f,
-		-.17f, 1.0f, 0.98f,		0.0f, 1.0f, 0.0f,	0.017f, 0.6f,
-		0.0f, 1.0f, 1.0f,		0.0f, 1.0f, 0.0f,	0.0f, 0.5f,
-		.17f, 1.0f, 0.98f,		0.0f, 1.0f, 0.0f,	0.017f, 0.41f,
-		.34f, 1.0f, 0.94f,		0.0f, 1.0f, 0.0f,	0.04f, 0.33f,
-		.5f, 1.0f, 0.87f,		0.0f, 1.0f, 0.0f,	0.08f, 0.25f,
-		.64f, 1.0f, 0.77f,		0.0f, 1.0f, 0.0f,	0.13f, 0.17f,
-		.77f, 1.0f, 0.64f,		0.0f, 1.0f, 0.0f,	0.17f, 0.13f,
-		.87f, 1.0f, 0.5f,		0.0f, 1.0f, 0.0f,	0.25f, 0.08f,
-		.94f, 1.0f, 0.34f,		0.0f, 1.0f, 0.0f,	0.33f, 0.04f,
-		.98f, 1.0f, 0.17f,		0.0f, 1.0f, 0.0f,	0.41f, 0.017f,
-
-		// cylinder body		// normals			// texture coords
-		1.0f, 1.0f, 0.0f,	1.0f, 0.0f, 0.0f,	0.0,1.0,
-		1.0f, 0.0f, 0.0f,	1.0f, 0.0f, 0.0f,	0.0,0.0,
-		.98f, 0.0f, -0.17f,	1.0f, 0.0f, 0.0f,	0.027,0.0,
-		1.0f, 1.0f, 0.0f,	0.92f, 0.0f, -0.08f,	0.0,1.0,
-		.98f, 1.0f, -0.17f,	0.92f, 0.0f, -0.08f,	0.027,1.0,
-		.98f, 0.0f, -0.17f,	0.92f, 0.0f, -0.08f,	0.027,0.0,
-		.94f, 0.0f, -0.34f,	0.83f, 0.0f, -0.17f,	0.054,0.0,
-		.98f, 1.0f, -0.17f,	0.83f, 0.0f, -0.17f,	0.027,1.0,
-		.94f, 1.0f, -0.34f,	0.83f, 0.0f, -0.17f,	0.054,1.0,
-		.94f, 0.0f, -0.34f,	0.75f, 0.0f, -0.25f,	0.054,0.0,
-		.87f, 0.0f, -0.5f,	0.75f, 0.0f, -0.25f,	0.081,0.0,
-		.94f, 1.0f, -0.34f,	0.75f, 0.0f, -0.25f,	0.054,1.0,
-		.87f, 1.0f, -0.5f,	0.67f, 0.0f, -0.33f,	0.081,1.0,
-		.87f, 0.0f, -0.5f,	0.67f, 0.0f, -0.33f,	0.081,0.0,
-		.77f, 0.0f, -0.64f,	0.67f, 0.0f, -0.33f,	0.108,0.0,
-		.87f, 1.0f, -0.5f,	0.58f, 0.0f, -0.42f,	0.081,1.0,
-		.77f, 1.0f, -0.64f,	0.58f, 0.0f, -0.42f,	0.108,1.0,
-		.77f, 0.0f, -0.64f,	0.58f, 0.0f, -0.42f,	0.108,0.0,
-		.64f, 0.0f, -0.77f,	0.5f, 0.0f, -0.5f,	0.135,0.0,
-		.77f, 1.0f, -0.64f,	0.5f, 0.0f, -0.5f,	0.108,1.0,
-		.64f, 1.0f, -0.77f,	0.5f, 0.0f, -0.5f,	0.135,1.0,
-		.64f, 0.0f, -0.77f,	0.42f, 0.0f, -0.58f,	0.135,0.0,
-		.5f, 0.0f, -0.87f,	0.42f, 0.0f, -0.58f,	0.162,0.0,
-		.64f, 1.0f, -0.77f,	0.42f, 0.0f, -0.58f,	0.135, 1.0,
-		.5f, 1.0f, -0.87f,  0.33f, 0.0f, -0.67f, 0.162, 1.0,
-		.5f, 0.0f, -0.87f,  0.33f, 0.0f, -0.67f, 0.162, 0.0,
-		.34f, 0.0f, -0.94f, 0.33f, 0.0f, -0.67f, 0.189, 0.0,
-		.5f, 1.0f, -0.87f,  0.25f, 0.0f, -0.75f, 0.162, 1.0,
-		.34f, 1.0f, -0.94f, 0.25f, 0.0f, -0.75f, 0.189, 1.0,
-		.34f, 0.0f, -0.94f, 0.25f, 0.0f, -0.75f, 0.189, 0.0,
-		.17f, 0.0f, -0.98f, 0.17f, 0.0f, -0.83f, 0.216, 0.0,
-		.34f, 1.0f, -0.94f, 0.17f, 0.0f, -0.83f, 0.189, 1.0,
-		.17f, 1.0f, -0.98f, 0.17f, 0.0f, -0.83f, 0.216, 1.0,
-		.17f, 0.0f, -0.98f, 0.08f, 0.0f, -0.92f, 0.216, 0.0,
-		0.0f, 0.0f, -1.0f,  0.08f, 0.0f, -0.92f, 0.243, 0.0,
-		.17f, 1.0f, -0.98f, 0.08f, 0.0f, -0.92f, 0.216, 1.0,
-		0.0f, 1.0f, -1.0f,  0.0f, 0.0f, -1.0f, 0.243, 1.0,
-		0.0f, 0.0f, -1.0f,  0.0f, 0.0f, -1.0f, 0.243, 0.0,
-		-.17f, 0.0f, -0.98f, 0.0f, 0.0f, -1.0f, 0.270, 0.0,
-		0.0f, 1.0f, -1.0f, 0.08f, 0.0f, -1.08f, 0.243, 1.0,
-		-.17f, 1.0f, -0.98f, -0.08f, 0.0f, -0.92f, 0.270, 1.0,
-		-.17f, 0.0f, -0.98f, -0.08f, 0.0f, -0.92f, 0.270, 0.0,
-		-.34f, 0.0f, -0.94f, -0.08f, 0.0f, -0.92f, 0.297, 0.0,
-		-.17f, 1.0f, -0.98f, -0.08f, 0.0f, -0.92f, 0.270, 1.0,
-		-.34f, 1.0f, -0.94f, -0.17f, 0.0f, -0.83f, 0.297, 1.0,
-		-.34f, 0.0f, -0.94f, -0.17f, 0.0f, -0.83f, 0.297, 0.0,
-		-.5f, 0.0f, -0.87f, -0.17f, 0.0f, -0.83f, 0.324, 0.0,
-		-.34f, 1.0f, -0.94f, -0.25f, 0.0f, -0.75f, 0.297, 1.0,
-		-.5f, 1.0f, -0.87f, -0.25f, 0.0f, -0.75f, 0.324, 1.0,
-		-.5f, 0.0f, -0.87f, -0.25f, 0.0f, -0.75f, 0.324, 0.0,
-		-.64f, 0.0f, -0.77f, -0.33f, 0.0f, -0.67f, 0.351, 0.0,
-		-.5f, 1.0f, -0.87f, -0.33f, 0.0f, -0.67f, 0.324, 1.0,
-		-.64f, 1.0f, -0.77f, -0.33f, 0.0f, -0.67f, 0.351, 1.0,
-		-.64f, 0.0f, -0.77f, -0.42f, 0.0f, -0.58f, 0.351, 0.0,
-		-.77f, 0.0f, -0.64f, -0.42f, 0.0f, -0.58f, 0.378, 0.0,
-		-.64f, 1.0f, -0.77f, -0.42f, 0.0f, -0.58f, 0.351, 1.0,
-		-.77f, 1.0f, -0.64f, -0.5f, 0.0f, -0.5f, 0.378, 1.0,
-		-.77f, 0.0f, -0.64f, -0.5f, 0.0f, -0.5f, 0.378, 0.0,
-		-.87f, 0.0f, -0.5f, -0.5f, 0.0f, -0.5f, 0.405, 0.0,
-		-.77f, 1.0f, -0.64f, -0.58f, 0.0f, -0.42f, 0.378, 1.0,
-		-.87f, 1.0f, -0.5f, -0.58f, 0.0f, -0.42f, 0.405, 1.0,
-		-.87f, 0.0f, -0.5f, -0.58f, 0.0f, -0.42f, 0.405, 0.0,
-		-.94f, 0.0f, -0.34f, -0.67f, 0.0f, -0.33f, 0.432, 0.0,
-		-.87f, 1.0f, -0.5f, -0.67f, 0.0f, -0.33f, 0.405, 1.0,
-		-.94f, 1.0f, -0.34f, -0.67f, 0.0f, -0.33f, 0.432, 1.0,
-		-.94f, 0.0f, -0.34f, -0.75f, 0.0f, -0.25f, 0.432, 0.0,
-		-.98f, 0.0f, -0.17f, -0.75f, 0.0f, -0.25f, 0.459, 0.0,
-		-.94f, 1.0f, -0.34f, -0.75f, 0.0f, -0.25f, 0.432, 1.0,
-		-.98f, 1.0f, -0.17f, -0.83f, 0.0f, -0.17f, 0.459, 1.0,
-		-.98f, 0.0f, -0.17f, -0.83f, 0.0f, -0.17f, 0.459, 0.0,
-		-1.0f, 0.0f, 0.0f, -0.83f, 0.0f, -0.17f, 0.486, 0.0,
-		-.98f, 1.0f, -0.17f, -0.92f, 0.0f, -0.08f, 0.459, 1.0,
-		-1.0f, 1.0f, 0.0f, -0.92f, 0.0f, -0.08f, 0.486, 1.0,
-		-1.0f, 0.0f, 0.0f, -0.92f, 0.0f, -0.08f, 0.486, 0.0,
-		-.98f, 0.0f, 0.17f, -1.0f, 0.0f, 0.0f, 0.513, 0.0,
-		-1.0f, 1.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.486, 1.0,
-		-.98f, 1.0f, 0.17f, -1.0f, 0.0f, 0.0f, 0.513, 1.0,
-		-.98f, 0.0f, 0.17f, -0.92f, 0.0f, 0.08f, 0.513, 0.0,
-		-.94f, 0.0f, 0.34f, -0.92f, 0.0f, 0.08f, 0.54, 0.0,
-		-.98f, 1.0f, 0.17f, -0.92f, 0.0f, 0.08f, 0.513, 1.0,
-		-.94f, 1.0f, 0.34f, -0.83f, 0.0f, 0.17f, 0.54, 1.0,
-		-.94f, 0.0f, 0.34f, -0.83f, 0.0f, 0.17f, 0.54, 0.0,
-		-.87f, 0.0f, 0.5f, -0.83f, 0.0f, 0.17f, 0.567, 0.0,
-		-.94f, 1.0f, 0.34f, -0.75f, 0.0f, 0.25f, 0.54, 1.0,
-		-.87f, 1.0f, 0.5f, -0.75f, 0.0f, 0.25f, 0.567, 1.0,
-		-.87f, 0.0f, 0.5f, -0.75f, 0.0f, 0.25f, 0.567, 0.0,
-		-.77f, 0.0f, 0.64f, -0.67f, 0.0f, 0.33f, 0.594, 0.0,
-		-.87f, 1.0f, 0.5f, -0.67f, 0.0f, 0.33f, 0.567, 1.0,
-		-.77f, 1.0f, 0.64f, -0.67f, 0.0f, 0.33f, 0.594, 1.0,
-		-.77f, 0.0f, 0.64f, -0.58f, 0.0f, 0.42f, 0.594, 0.0,
-		-.64f, 0.0f, 0.77f, -0.58f, 0.0f, 0.42f, 0.621, 0.0,
-		-.77f, 1.0f, 0.64f, -0.58f, 0.0f, 0.42f, 0.594, 1.0,
-		-.64f, 1.0f, 0.77f, -0.5f, 0.0f, 0.5f, 0.621, 1.0,
-		-.64f, 0.0f, 0.77f, -0.5f, 0.0f, 0.5f, 0.621, 0.0,
-		-.5f, 0.0f, 0.87f, -0.5f, 0.0f, 0.5f, 0.648, 0.0,
-		-.64f, 1.0f, 0.77f, -0.42f, 0.0f, 0.58f, 0.621, 1.0,
-		-.5f, 1.0f, 0.87f, -0.42f, 0.0f, 0.58f, 0.648, 1.0,
-		-.5f, 0.0f, 0.87f, -0.42f, 0.0f, 0.58f, 0.648, 0.0,
-		-.34f, 0.0f, 0.94f, -0.33f, 0.0f, 0.67f, 0.675, 0.0,
-		-.5f, 1.0f, 0.87f, -0.33f, 0.0f, 0.67f, 0.648, 1.0,
-		-.34f, 1.0f, 0.94f, -0.33f, 0.0f, 0.67f, 0.675, 1.0,
-		-.34f, 0.0f, 0.94f, -0.25f, 0.0f, 0.75f, 0.675, 0.0,
-		-.17f, 0.0f, 0.98f, -0.25f, 0.0f, 0.75f, 0.702, 0.0,
-		-.34f, 1.0f, 0.94f, -0.25f, 0.0f, 0.75f, 0.675, 1.0,
-		-.17f, 1.0f, 0.98f, -0.17f, 0.0f, 0.83f, 0.702, 1.0,
-		-.17f, 0.0f, 0.98f, -0.17f, 0.0f, 0.83f, 0.702, 0.0,
-		0.0f, 0.0f, 1.0f, -0.17f, 0.0f, 0.83f, 0.729, 0.0,
-		-.17f, 1.0f, 0.98f, -0.08f, 0.0f, 0.92f, 0.702, 1.0,
-		0.0f, 1.0f, 1.0f, -0.08f, 0.0f, 0.92f, 0.729, 1.0,
-		0.0f, 0.0f, 1.0f, -0.08f, 0.0f, 0.92f, 0.729, 0.0,
-		.17f, 0.0f, 0.98f, -0.0f, 0.0f, 1.0f, 0.756, 0.0,
-		0.0f, 1.0f, 1.0f, -0.0f, 0.0f, 1.0f, 0.729, 1.0,
-		.17f, 1.0f, 0.98f, -0.0f, 0.0f, 1.0f, 0.756, 1.0,
-		.17f, 0.0f, 0.98f, 0.08f, 0.0f, 0.92f, 0.756, 0.0,
-		.34f, 0.0f, 0.94f, 0.08f, 0.0f, 0.92f, 0.783, 0.0,
-		.17f, 1.0f, 0.98f, 0.08f, 0.0f, 0.92f, 0.756, 1.0,
-		.34f, 1.0f, 0.94f, 0.17f, 0.0f, 0.83f, 0.783, 1.0,
-		.34f, 0.0f, 0.94f, 0.17f, 0.0f, 0.83f, 0.783, 0.0,
-		.5f, 0.0f, 0.87f, 0.17f, 0.0f, 0.83f, 0.810, 0.0,
-		.34f, 1.0f, 0.94f, 0.25f, 0.0f, 0.75f, 0.783, 1.0,
-		.5f, 1.0f, 0.87f, 0.25f, 0.0f, 0.75f, 0.810, 1.0,
-		.5f, 0.0f, 0.87f, 0.25f, 0.0f, 0.75f, 0.810, 0.0,
-		.64f, 0.0f, 0.77f, 0.33f, 0.0f, 0.67f, 0.837, 0.0,
-		.5f, 1.0f, 0.87f, 0.33f, 0.0f, 0.67f, 0.810, 1.0,
-		.64f, 1.0f, 0.77f, 0.33f, 0.0f, 0.67f, 0.837, 1.0,
-		.64f, 0.0f, 0.77f, 0.42f, 0.0f, 0.58f, 0.837, 0.0,
-		.77f, 0.0f, 0.64f, 0.42f, 0.0f, 0.58f, 0.864, 0.0,
-		.64f, 1.0f, 0.77f, 0.42f, 0.0f, 0.58f, 0.837, 1.0,
-		.77f, 1.0f, 0.64f, 0.5f, 0.0f, 0.5f, 0.864, 1.0,
-		.77f, 0.0f, 0.64f, 0.5f, 0.0f, 0.5f, 0.864, 0.0,
-		.87f, 0.0f, 0.5f, 0.5f, 0.0f, 0.5f, 0.891, 0.0,
-		.77f, 1.0f, 0.64f, 0.58f, 0.0f, 0.42f, 0.864, 1.0,
-		.87f, 1.0f, 0.5f, 0.58f, 0.0f, 0.42f, 0.891, 1.0,
-		.87f, 0.0f, 0.5f, 0.58f, 0.0f, 0.42f, 0.891, 0.0,
-		.94f, 0.0f, 0.34f, 0.67f, 0.0f, 0.33f, 0.918, 0.0,
-		.87f, 1.0f, 0.5f, 0.67f, 0.0f, 0.33f, 0.891, 1.0,
-		.94f, 1.0f, 0.34f, 0.67f, 0.0f, 0.33f, 0.918, 1.0,
-		.94f, 0.0f, 0.34f, 0.75f, 0.0f, 0.25f, 0.918, 0.0,
-		.98f, 0.0f, 0.17f, 0.75f, 0.0f, 0.25f, 0.945, 0.0,
-		.94f, 1.0f, 0.34f, 0.75f, 0.0f, 0.25f, 0.918, 0.0,
-		.98f, 1.0f, 0.17f, 0.83f, 0.0f, 0.17f, 0.945, 1.0,
-		.98f, 0.0f, 0.17f, 0.83f, 0.0f, 0.17f, 0.945, 0.0,
-		1.0f, 0.0f, 0.0f, 0.83f, 0.0f, 0.17f, 1.0, 0.0,
-		.98f, 1.0f, 0.17f, 0.92f, 0.0f, 0.08f, 0.945, 1.0,
-		1.0f, 1.0f, 0.0f, 0.92f, 0.0f, 0.08f, 1.0, 1.0,
-		1.0f, 0.0f, 0.0f, 0.92f, 0.0f, 0.08f, 1.0, 0.0
-	};
 
-	// total float values per each type
-	const GLuint floatsPerVertex = 3;
-	const GLuint floatsPerNormal = 3;
-	const GLuint floatsPerUV = 2;
+// Welds a triangle soup into an indexed mesh, optimizes it for the vertex cache and
+// vertex fetch, and uploads it. Each part is optimized on its own so it stays one
+// contiguous index range. Prints the ACMR before and after.
+void UCreateIndexedMesh(GLMesh& mesh, const char* name, const float* soup, GLuint soupVertexCount, const UShapeRange* parts, GLuint partCount)
+{
+	// Only whole triangles are drawn
+	soupVertexCount -= soupVertexCount % 3;
+
+	vector<float> vertices;
+	vector<GLuint> indices;
+	UWeldVertices(soup, soupVertexCount, MESH_VERTEX_FLOATS, vertices, indices);
+	GLuint vertexCount = (GLuint)(vertices.size() / MESH_VERTEX_FLOATS);
+
+	// Sphere around the box of the positions, the texture streamer projects it to the screen
+	glm::vec3 low(vertices[0], vertices[1], vertices[2]);
+	glm::vec3 high = low;
+	for (size_t i = 0; i < vertices.size(); i += MESH_VERTEX_FLOATS)
+	{
+		glm::vec3 position(vertices[i], vertices[i + 1], vertices[i + 2]);
+		low = glm::min(low, position);
+		high = glm::max(high, position);
+	}
+	glm::vec3 center = (low + high) * 0.5f;
+	float radius = 0.0f;
+	for (size_t i = 0; i < vertices.size(); i += MESH_VERTEX_FLOATS)
+		radius = max(radius, glm::length(glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]) - center));
+	mesh.bounds = glm::vec4(center, radius);
+	mesh.boxMin = low;
+	mesh.boxMax = high;
+	float acmrBefore = UComputeACMR(indices, vertexCount, VERTEX_CACHE_SIZE);
+
+	if (partCount == 0)
+		UOptimizeVertexCache(indices, 0, (GLuint)indices.size(), vertexCount, VERTEX_CACHE_SIZE);
+	for (GLuint i = 0; i < partCount; ++i)
+		UOptimizeVertexCache(indices, parts[i].first, parts[i].count, vertexCount, VERTEX_CACHE_SIZE);
+
+	UOptimizeVertexFetch(vertices, MESH_VERTEX_FLOATS, indices);
+	vertexCount = (GLuint)(vertices.size() / MESH_VERTEX_FLOATS);
+	float acmrAfter = UComputeACMR(indices, vertexCount, VERTEX_CACHE_SIZE);
+
+	// Part ranges are index ranges now, they were vertex ranges of the soup
+	for (GLuint i = 0; i < MESH_PART_COUNT; ++i)
+	{
+		mesh.parts[i].mode = GL_TRIANGLES;
+		mesh.parts[i].first = i < partCount ? parts[i].first : 0;
+		mesh.parts[i].count = i < partCount ? parts[i].count : 0;
+		mesh.parts[i].part = MESH_PART_COUNT;
+	}
 
 	// store vertex and index count
-	mesh.nVertices = sizeof(verts) / (sizeof(verts[0]) * (floatsPerVertex + floatsPerNormal + floatsPerUV));
-
-	// Create VAO
-	glGenVertexArrays(1, &mesh.vao); // we can also generate multiple VAOs or buffers at the same time
-	glBindVertexArray(mesh.vao);
-
-	// Create VBO
-	glGenBuffers(1, &mesh.vbo);
-	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo); // Activates the buffer
-	glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
+	mesh.nVertices = vertexCount;
+	mesh.nIndices = (GLuint)indices.size();
+	mesh.indexType = vertexCount <= 0xFFFF ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+	mesh.positions.clear();
+	for (size_t i = 0; i < vertices.size(); i += MESH_VERTEX_FLOATS)
+		mesh.positions.push_back(glm::vec3(vertices[i], vertices[i + 1], vertices[i + 2]));
+	mesh.indices = indices;
+
+	cout << "INFO: Mesh " << name << ": " << soupVertexCount << " -> " << vertexCount << " vertices, "
+		<< mesh.nIndices << (mesh.indexType == GL_UNSIGNED_SHORT ? " 16-bit" : " 32-bit") << " indices, ACMR "
+		<< acmrBefore << " -> " << acmrAfter << " (unindexed 3)" << endl;
+
+	// The index buffer is shared by the VAO of every vertex format
+	glGenBuffers(1, &mesh.ibo);
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.ibo);
+	if (mesh.indexType == GL_UNSIGNED_SHORT)
+	{
+		vector<GLushort> shortIndices(indices.begin(), indices.end());
+		glBufferData(GL_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+	}
+	else
+		glBufferData(GL_ARRAY_BUFFER, indices.size() * sizeof(GLuint), indices.data(), GL_STATIC_DRAW);
 
-	// Strides between vertex coordinates
-	GLint stride = sizeof(float) * (floatsPerVertex + floatsPerNormal + floatsPerUV);
+	vector<UPackedVertex> packed;
+	mesh.packedDecode = UQuantizeVertices(vertices, packed);
 
-	// Create Vertex Attribute Pointers
-	glVertexAttribPointer(0, floatsPerVertex, GL_FLOAT, GL_FALSE, stride, (void*)0);
-	glEnableVertexAttribArray(0);
+	for (GLuint format = 0; format < VERTEX_FORMAT_COUNT; ++format)
+	{
+		mesh.vao[format] = 0;
+		mesh.vbo[format] = 0;
+		if (format != gVertexFormat && !gCompareVertexFormats)
+			continue;
+
+		// Create VAO
+		glGenVertexArrays(1, &mesh.vao[format]);
+		glBindVertexArray(mesh.vao[format]);
+
+		glGenBuffers(1, &mesh.vbo[format]);
+		glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo[format]); // Activates the buffer
+		if (format == VERTEX_FORMAT_PACKED)
+			glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(UPackedVertex), packed.data(), GL_STATIC_DRAW);
+		else
+			glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), vertices.data(), GL_STATIC_DRAW); // Sends vertex or coordinate data to the GPU
 
-	glVertexAttribPointer(1, floatsPerNormal, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex)));
-	glEnableVertexAttribArray(1);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ibo);
 
-	glVertexAttribPointer(2, floatsPerUV, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float)* (floatsPerVertex + floatsPerNormal)));
-	glEnableVertexAttribArray(2);
+		// Create Vertex Attribute Pointers
+		USetVertexAttributes(format);
+	}
+	glBindVertexArray(0);
 }
 
 
 void UDestroyMesh(GLMesh& mesh)
 {
-	glDeleteVertexArrays(1, &mesh.vao);
-	glDeleteBuffers(1, &mesh.vbo);
+	glDeleteVertexArrays(VERTEX_FORMAT_COUNT, mesh.vao);
+	glDeleteBuffers(VERTEX_FORMAT_COUNT, mesh.vbo);
+	glDeleteBuffers(1, &mesh.ibo);
 }
 
-// Implements the UCreateShaders function
-bool UCreateShaderProgram(const char* vtxShaderSource, const char* fragShaderSource, GLuint& programId)
+// Resolves the handles of every uniform set on a surface program
+void UResolveSurfaceUniforms(const UShaderProgram& program, USurfaceUniforms& uniforms)
 {
-	// Compilation and linkage error reporting
-	int success = 0;
-	char infoLog[512];
+	UGetUniform(program, "uTexture", uniforms.texture);
+	UGetUniform(program, "uvScale", uniforms.uvScale);
+	UGetUniform(program, "uOctahedralNormals", uniforms.octahedralNormals);
+	UGetUniform(program, "uTextureArray", uniforms.textureArray);
+	UGetUniform(program, "uUseTextureArray", uniforms.useTextureArray);
+}
 
-	// Create a Shader program object.
-	programId = glCreateProgram();
+// Tells both surface programs how the normals of the current vertex format are stored
+void UApplyVertexFormat()
+{
+	const int octahedral = gVertexFormat == VERTEX_FORMAT_PACKED ? 1 : 0;
 
-	// Create the vertex and fragment shader objects
-	GLuint vertexShaderId = glCreateShader(GL_VERTEX_SHADER);
-	GLuint fragmentShaderId = glCreateShader(GL_FRAGMENT_SHADER);
+	glUseProgram(gSurfaceProgram.id);
+	USetUniform(gSurfaceProgram, gSurfaceUniforms.octahedralNormals, octahedral);
+	glUseProgram(gSurfaceInstancedProgram.id);
+	USetUniform(gSurfaceInstancedProgram, gSurfaceInstancedUniforms.octahedralNormals, octahedral);
+	glUseProgram(0);
+}
 
-	// Retrive the shader source
-	glShaderSource(vertexShaderId, 1, &vtxShaderSource, NULL);
-	glShaderSource(fragmentShaderId, 1, &fragShaderSource, NULL);
+/*Generate and load the texture*/
+bool UCreateTexture(const UDecodedImage& image, GLuint& textureId)
+{
+	if (image.compressed.format)
+		return UCreateCompressedTexture(image, textureId);
 
-	// Compile the vertex shader, and print compilation errors (if any)
-	glCompileShader(vertexShaderId); // compile the vertex shader
-	// check for shader compile errors
-	glGetShaderiv(vertexShaderId, GL_COMPILE_STATUS, &success);
-	if (!success)
+	GLenum internalFormat;
+	GLenum format;
+	if (image.channels == 3)
 	{
-		glGetShaderInfoLog(vertexShaderId, 512, NULL, infoLog);
-		std::cout << "ERROR::SHADER::VERTEX::COMPILATION_FAILED\n" << infoLog << std::endl;
-
-		return false;
+		internalFormat = GL_RGB8;
+		format = GL_RGB;
 	}
-
-	glCompileShader(fragmentShaderId); // compile the fragment shader
-	// check for shader compile errors
-	glGetShaderiv(fragmentShaderId, GL_COMPILE_STATUS, &success);
-	if (!success)
+	else if (image.channels == 4)
 	{
-		glGetShaderInfoLog(fragmentShaderId, sizeof(infoLog), NULL, infoLog);
-		std::cout << "ERROR::SHADER::FRAGMENT::COMPILATION_FAILED\n" << infoLog << std::endl;
-
+		internalFormat = GL_RGBA8;
+		format = GL_RGBA;
+	}
+	else
+	{
+		cout << "Not implemented to handle image with " << image.channels << " channels" << endl;
 		return false;
 	}
 
-	// Attached compiled shaders to the shader program
-	glAttachShader(programId, vertexShaderId);
-	glAttachShader(programId, fragmentShaderId);
+	glGenTextures(1, &textureId);
+	glBindTexture(GL_TEXTURE_2D, textureId);
 
-	glLinkProgram(programId);   // links the shader program
-	// check for linking errors
-	glGetProgramiv(programId, GL_LINK_STATUS, &success);
-	if (!success)
-	{
-		glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
-		std::cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << std::endl;
+	// set the texture wrapping parameters
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// set texture filtering parameters, minification blends the two nearest mip levels
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 
-		return false;
-	}
+	glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, image.width, image.height, 0, format, GL_UNSIGNED_BYTE, image.pixels);
+
+	glGenerateMipmap(GL_TEXTURE_2D);
 
-	glUseProgram(programId);    // Uses the shader program
+	glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
 
 	return true;
 }
 
+// Uploads the BC blocks and mip chain read from the texture cache
+bool UCreateCompressedTexture(const UDecodedImage& image, GLuint& textureId)
+{
+	const UCompressedTexture& texture = image.compressed;
+
+	glGenTextures(1, &textureId);
+	glBindTexture(GL_TEXTURE_2D, textureId);
+
+	// Same sampling as uncompressed textures, the cache supplies the mip chain glGenerateMipmap would
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, (GLint)texture.levels.size() - 1);
+
+	for (GLuint i = 0; i < texture.levels.size(); ++i)
+	{
+		const UCompressedLevel& level = texture.levels[i];
+		glCompressedTexImage2D(GL_TEXTURE_2D, i, texture.format, level.width, level.height, 0, level.size, &texture.blocks[level.offset]);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
 
-void UDestroyShaderProgram(GLuint programId)
+	// Memory footprint against the same mip chain uncompressed
+	cout << "INFO: Texture " << image.filename << ": " << image.width << "x" << image.height
+		<< (texture.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? " BC3, " : " BC1, ") << texture.levels.size() << " levels, "
+		<< texture.blocks.size() / 1024 << " KB (" << UUncompressedTextureSize(texture) / 1024 << " KB uncompressed), "
+		<< (image.transcoded ? "transcoded" : "cached") << endl;
+	return true;
+}
+
+// A single mid grey texel drawn in place of textures that are still decoding or failed to load
+void UCreatePlaceholderTexture(GLuint& textureId)
 {
-	glDeleteProgram(programId);
+	const unsigned char grey[4] = { 128, 128, 128, 255 };
+
+	glGenTextures(1, &textureId);
+	glBindTexture(GL_TEXTURE_2D, textureId);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+	glBindTexture(GL_TEXTURE_2D, 0);
 }
 
-// Images are loaded with Y axis going down, but OpenGL's Y axis goes up, so let's flip it
-void flipImageVertically(unsigned char* image, int width, int height, int channels)
+// Uploads the images the texture loader finished since the last frame and swaps them in for the placeholder
+void UUploadDecodedTextures()
 {
-	for (int j = 0; j < height / 2; ++j)
-	{
-		int index1 = j * width * channels;
-		int index2 = (height - 1 - j) * width * channels;
+	static vector<UDecodedImage> images;
+	static bool loading = true;
 
-		for (int i = width * channels; i > 0; --i)
+	UTakeDecodedImages(gTextureLoader, images);
+	for (UDecodedImage& image : images)
+	{
+		GLuint textureId;
+		if (gStreamTextures)
 		{
-			unsigned char tmp = image[index1];
-			image[index1] = image[index2];
-			image[index2] = tmp;
-			++index1;
-			++index2;
+			if (!UReceiveStreamedLevels(gTextureStreamer, image.index, image.compressed))
+				cout << "Failed to load texture " << image.filename << endl;
 		}
+		else if (gTextureArray.id)
+		{
+			if (!USetTextureArrayLayer(gTextureArray, image.index, image))
+				cout << "Failed to load texture " << image.filename << endl;
+		}
+		else if ((image.pixels || image.compressed.format) && UCreateTexture(image, textureId))
+			gTextureIds[image.index] = textureId;
+		else
+			cout << "Failed to load texture " << image.filename << endl;
+		UFreeDecodedImage(image);
 	}
-}
 
-/*Generate and load the texture*/
-bool UCreateTexture(const char* filename, GLuint& textureId)
-{
-	int width, height, channels;
-	unsigned char* image = stbi_load(filename, &width, &height, &channels, 0);
-	if (image)
-	{
-		flipImageVertically(image, width, height, channels);
-
-		glGenTextures(1, &textureId);
-		glBindTexture(GL_TEXTURE_2D, textureId);
-
-		// set the texture wrapping parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		// set texture filtering parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		if (channels == 3)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-		else if (channels == 4)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-		else
+	// Streamed textures move to new GL textures whenever their levels change
+	if (gStreamTextures)
+	{
+		UUpdateTextureStreaming(gTextureStreamer, gTextureLoader);
+		for (GLuint i = 0; i < gSceneView.textureCount; ++i)
 		{
-			cout << "Not implemented to handle image with " << channels << " channels" << endl;
-			return false;
+			GLuint id = gTextureStreamer.textures[i].id;
+			gTextureIds[i] = id ? id : gPlaceholderTexture;
 		}
+	}
 
-		glGenerateMipmap(GL_TEXTURE_2D);
+	// With streaming, ready means every level the first view needs
+	if (loading && !UTextureLoaderBusy(gTextureLoader))
+	{
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - gStartTime;
+		cout << "INFO: " << gSceneView.textureCount << " textures ready after " << elapsed.count() << " ms" << endl;
+		if (gStreamTextures)
+			UPrintTextureStreaming(gTextureStreamer);
+		loading = false;
+	}
+}
 
-		stbi_image_free(image);
-		glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+// Tells the texture streamer how large each object's texture is on screen
+void UNoteTextureUses(const glm::mat4& view)
+{
+	UBeginTextureStreamingFrame(gTextureStreamer);
 
-		return true;
-	}
+	const float tanY = tan(glm::radians(g_pCurrentCamera->Zoom) * 0.5f);
+	const float tanX = tanY * (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT;
+	const float pixelsPerUnit = WINDOW_HEIGHT * 0.5f / tanY;    // Pixels one unit covers one unit away
+	const float repeats = max(gUVScale.x, gUVScale.y);          // The texture repeats across each face
 
-	// Error loading the image
-	return false;
+	for (GLuint object = 0; object < gSceneView.objectCount; ++object)
+	{
+		const glm::mat4& transform = gSceneView.transforms[object];
+		const glm::vec4& bounds = gMeshes[gSceneView.meshRefs[object].mesh].bounds;
+		const glm::vec3 center = glm::vec3(view * transform * glm::vec4(glm::vec3(bounds), 1.0f));
+		const float scale = max(glm::length(glm::vec3(transform[0])), max(glm::length(glm::vec3(transform[1])), glm::length(glm::vec3(transform[2]))));
+		const float radius = bounds.w * scale;
+
+		// Skip spheres behind the camera or outside a side of the view, the camera looks down -Z
+		if (center.z > radius
+			|| fabs(center.x) + center.z * tanX > radius * sqrt(1.0f + tanX * tanX)
+			|| fabs(center.y) + center.z * tanY > radius * sqrt(1.0f + tanY * tanY))
+			continue;
+
+		const float distance = max(glm::length(center) - radius, 0.1f);
+		UNoteTextureUse(gTextureStreamer, gSceneView.materials[object].texture, 2.0f * radius * pixelsPerUnit / distance / repeats);
+	}
 }
 
 
 void UDestroyTexture(GLuint textureId)
 {
-	glGenTextures(1, &textureId);
+	glDeleteTextures(1, &textureId);
+}
+
+
+// Texture an object is sorted and grouped by. Objects drawn from the texture array share one.
+GLuint USortTexture(GLuint object)
+{
+	return gTextureArraySize ? 0 : gSceneView.materials[object].texture;
 }
\ No newline at end of file
@@ -0,0 +1,89 @@
+#include "mappedfile.h"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+bool UMapFile(const char* filename, UMappedFile& file)
+{
+	file = UMappedFile();
+
+#ifdef _WIN32
+	HANDLE fileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(fileHandle, &size) || size.QuadPart == 0)
+	{
+		CloseHandle(fileHandle);
+		return false;
+	}
+
+	HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle == NULL)
+	{
+		CloseHandle(fileHandle);
+		return false;
+	}
+
+	void* data = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	if (data == NULL)
+	{
+		CloseHandle(mappingHandle);
+		CloseHandle(fileHandle);
+		return false;
+	}
+
+	file.data = (const unsigned char*)data;
+	file.size = (size_t)size.QuadPart;
+	file.fileHandle = fileHandle;
+	file.mappingHandle = mappingHandle;
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	if (fstat(fd, &info) != 0 || info.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+
+	void* data = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd); // the mapping keeps its own reference to the file
+	if (data == MAP_FAILED)
+		return false;
+
+	file.data = (const unsigned char*)data;
+	file.size = (size_t)info.st_size;
+#endif
+
+	return true;
+}
+
+
+void UUnmapFile(UMappedFile& file)
+{
+	if (!file.data)
+		return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(file.data);
+	CloseHandle(file.mappingHandle);
+	CloseHandle(file.fileHandle);
+#else
+	munmap((void*)file.data, file.size);
+#endif
+
+	file = UMappedFile();
+}
@@ -0,0 +1,21 @@
+#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>          // size_t
+
+// A read-only memory mapping of a whole file
+struct UMappedFile
+{
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+};
+
+// Maps the file read-only. Pages are faulted in on first access.
+bool UMapFile(const char* filename, UMappedFile& file);
+void UUnmapFile(UMappedFile& file);
+
+#endif
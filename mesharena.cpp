@@ -0,0 +1,121 @@
+#include <iostream>         // cout
+#include <cstddef>          // offsetof
+
+#include "mesharena.h"
+
+using namespace std; // Uses the standard namespace
+
+
+GLsizei UVertexSize(GLuint format)
+{
+	return format == VERTEX_FORMAT_PACKED ? sizeof(UPackedVertex) : sizeof(float) * MESH_VERTEX_FLOATS;
+}
+
+
+void USetVertexAttributes(GLuint format)
+{
+	const GLsizei stride = UVertexSize(format);
+
+	if (format == VERTEX_FORMAT_PACKED)
+	{
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, stride, (void*)offsetof(UPackedVertex, position));
+		glVertexAttribPointer(1, 2, GL_BYTE, GL_TRUE, stride, (void*)offsetof(UPackedVertex, normal));
+		glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(UPackedVertex, uv));
+	}
+	else
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 3));
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 6));
+	}
+
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glEnableVertexAttribArray(2);
+}
+
+
+bool UCreateMeshArena(UMeshArena& arena, const UMeshBuffers* meshes, GLuint meshCount, GLuint format)
+{
+	UDestroyMeshArena(arena);
+
+	const GLsizeiptr vertexSize = UVertexSize(format);
+
+	arena.baseVertex.resize(meshCount);
+	arena.firstIndex.resize(meshCount);
+	arena.indexCount.resize(meshCount);
+	arena.indexType = GL_UNSIGNED_SHORT;
+	GLint totalVertices = 0;
+	GLuint totalIndices = 0;
+	for (GLuint i = 0; i < meshCount; ++i)
+	{
+		arena.baseVertex[i] = totalVertices;
+		arena.firstIndex[i] = totalIndices;
+		arena.indexCount[i] = meshes[i].indexCount;
+		totalVertices += meshes[i].vertexCount;
+		totalIndices += meshes[i].indexCount;
+		if (meshes[i].indexType != GL_UNSIGNED_SHORT)
+			arena.indexType = GL_UNSIGNED_INT;
+	}
+
+	if (totalIndices == 0)
+	{
+		cout << "Failed to create the mesh arena: no triangles" << endl;
+		return false;
+	}
+
+	glGenVertexArrays(1, &arena.vao);
+	glBindVertexArray(arena.vao);
+
+	glGenBuffers(1, &arena.vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, arena.vbo);
+	glBufferStorage(GL_ARRAY_BUFFER, vertexSize * totalVertices, NULL, 0);
+
+	// The index buffer binding is VAO state, it is bound while the arena VAO is
+	const GLuint indexSize = UIndexSize(arena.indexType);
+	glGenBuffers(1, &arena.ibo);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, arena.ibo);
+	glBufferStorage(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)indexSize * totalIndices, NULL, GL_DYNAMIC_STORAGE_BIT);
+
+	// The meshes are already on the GPU, copy them over without a round trip through the CPU
+	for (GLuint i = 0; i < meshCount; ++i)
+	{
+		const UMeshBuffers& mesh = meshes[i];
+
+		glBindBuffer(GL_COPY_READ_BUFFER, mesh.vbo);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ARRAY_BUFFER, 0, vertexSize * arena.baseVertex[i], vertexSize * mesh.vertexCount);
+
+		glBindBuffer(GL_COPY_READ_BUFFER, mesh.ibo);
+		if (mesh.indexType == arena.indexType)
+		{
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_ELEMENT_ARRAY_BUFFER, 0,
+				(GLintptr)indexSize * arena.firstIndex[i], (GLsizeiptr)indexSize * mesh.indexCount);
+			continue;
+		}
+
+		// 16-bit indices of a mesh in a 32-bit arena are widened on the CPU
+		vector<GLushort> shortIndices(mesh.indexCount);
+		glGetBufferSubData(GL_COPY_READ_BUFFER, 0, shortIndices.size() * sizeof(GLushort), shortIndices.data());
+		vector<GLuint> indices(shortIndices.begin(), shortIndices.end());
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, (GLintptr)indexSize * arena.firstIndex[i], indices.size() * sizeof(GLuint), indices.data());
+	}
+	glBindBuffer(GL_COPY_READ_BUFFER, 0);
+
+	// Same attribute layout as the individual mesh VAOs
+	USetVertexAttributes(format);
+
+	glBindVertexArray(0);
+	return true;
+}
+
+
+void UDestroyMeshArena(UMeshArena& arena)
+{
+	if (arena.vao)
+		glDeleteVertexArrays(1, &arena.vao);
+	if (arena.vbo)
+		glDeleteBuffers(1, &arena.vbo);
+	if (arena.ibo)
+		glDeleteBuffers(1, &arena.ibo);
+	arena = UMeshArena();
+}
@@ -0,0 +1,71 @@
+#ifndef MESHARENA_H
+#define MESHARENA_H
+
+#include <GL/glew.h>
+
+#include <vector>
+
+// Floats per vertex shared by every mesh: position (3), normal (3), texture coordinate (2)
+const GLuint MESH_VERTEX_FLOATS = 8;
+
+// Layouts a mesh's vertex buffer can be uploaded in. Attributes 0 - 2 are position,
+// normal and texture coordinate in both.
+enum UVertexFormat
+{
+	VERTEX_FORMAT_FLOAT,        // MESH_VERTEX_FLOATS floats, 32 bytes
+	VERTEX_FORMAT_PACKED,       // UPackedVertex, 12 bytes
+	VERTEX_FORMAT_COUNT
+};
+
+/* Quantized vertex. The position is unorm16 inside the mesh's bounding box scaled
+ * the same on every axis, so decoding it is a translate and uniform scale that is
+ * folded into the model matrix and leaves the normal matrix alone. The normal is
+ * octahedral encoded in two snorm8 values and decoded in the vertex shader.
+ */
+struct UPackedVertex
+{
+	GLushort position[3];
+	GLbyte normal[2];
+	GLhalf uv[2];
+};
+
+// Bytes per vertex in a format
+GLsizei UVertexSize(GLuint format);
+// Points attributes 0 - 2 of the bound VAO at the bound GL_ARRAY_BUFFER
+void USetVertexAttributes(GLuint format);
+
+// The GPU buffers of one indexed mesh, as input to the arena
+struct UMeshBuffers
+{
+	GLuint vbo;
+	GLuint ibo;
+	GLsizei vertexCount;
+	GLsizei indexCount;
+	GLenum indexType;       // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+};
+
+/* The vertices and indices of every mesh packed back to back into one VBO and one
+ * index buffer, behind one VAO. Indices stay relative to their mesh: a mesh is drawn
+ * from the arena with its baseVertex and by adding its firstIndex to the first index
+ * of each draw, so draws of different meshes can share a multi-draw call.
+ */
+struct UMeshArena
+{
+	GLuint vao = 0;
+	GLuint vbo = 0;
+	GLuint ibo = 0;
+	GLenum indexType = GL_UNSIGNED_SHORT;   // 32-bit as soon as one mesh needs it
+	std::vector<GLint> baseVertex;          // Per mesh, in arena vertices
+	std::vector<GLuint> firstIndex;         // Per mesh, in arena indices
+	std::vector<GLsizei> indexCount;        // Per mesh
+};
+
+// Copies the mesh buffers, all in the given vertex format, into the arena on the GPU
+// and sets up vertex attributes 0 - 2 of the arena VAO
+bool UCreateMeshArena(UMeshArena& arena, const UMeshBuffers* meshes, GLuint meshCount, GLuint format);
+void UDestroyMeshArena(UMeshArena& arena);
+
+// Bytes per index of GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+inline GLuint UIndexSize(GLenum indexType) { return indexType == GL_UNSIGNED_SHORT ? 2 : 4; }
+
+#endif
@@ -0,0 +1,313 @@
+#include <cstring>          // memcmp, memcpy
+#include <cmath>            // fabs, floor
+#include <algorithm>        // max, min
+
+#include "meshopt.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	GLuint UHashVertex(const float* vertex, GLuint floatsPerVertex)
+	{
+		// FNV-1a over the bytes of the vertex
+		const unsigned char* bytes = (const unsigned char*)vertex;
+		GLuint hash = 2166136261u;
+		for (size_t i = 0; i < floatsPerVertex * sizeof(float); ++i)
+			hash = (hash ^ bytes[i]) * 16777619u;
+		return hash;
+	}
+
+	// Triangles adjacent to each vertex, stored as one array with per-vertex offsets
+	struct UAdjacency
+	{
+		vector<GLuint> offsets;     // vertexCount + 1 entries
+		vector<GLuint> triangles;
+	};
+
+	void UBuildAdjacency(const GLuint* indices, GLuint triangleCount, GLuint vertexCount, UAdjacency& adjacency)
+	{
+		adjacency.offsets.assign(vertexCount + 1, 0);
+		for (GLuint i = 0; i < triangleCount * 3; ++i)
+			++adjacency.offsets[indices[i] + 1];
+		for (GLuint v = 0; v < vertexCount; ++v)
+			adjacency.offsets[v + 1] += adjacency.offsets[v];
+
+		vector<GLuint> fill(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+		adjacency.triangles.resize(triangleCount * 3);
+		for (GLuint t = 0; t < triangleCount; ++t)
+		{
+			for (GLuint k = 0; k < 3; ++k)
+				adjacency.triangles[fill[indices[t * 3 + k]]++] = t;
+		}
+	}
+
+	GLbyte USnorm8(float value)
+	{
+		value = max(-1.0f, min(1.0f, value));
+		return (GLbyte)floor(value * 127.0f + 0.5f);
+	}
+
+	// Octahedral encoding: project onto |x| + |y| + |z| = 1 and fold the lower half over the upper.
+	// A zero normal has no direction and comes out as +Z.
+	void UEncodeOctahedral(const float* normal, GLbyte* encoded)
+	{
+		float length = fabs(normal[0]) + fabs(normal[1]) + fabs(normal[2]);
+		float x = length > 0.0f ? normal[0] / length : 0.0f;
+		float y = length > 0.0f ? normal[1] / length : 0.0f;
+		if (length > 0.0f && normal[2] < 0.0f)
+		{
+			float foldedX = (1.0f - fabs(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+			float foldedY = (1.0f - fabs(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+			x = foldedX;
+			y = foldedY;
+		}
+		encoded[0] = USnorm8(x);
+		encoded[1] = USnorm8(y);
+	}
+
+	// Float to IEEE half, rounding to nearest. Texture coordinates never need infinities or NaNs.
+	GLhalf UFloatToHalf(float value)
+	{
+		GLuint bits;
+		memcpy(&bits, &value, sizeof(bits));
+
+		GLuint sign = (bits >> 16) & 0x8000;
+		int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+		GLuint mantissa = bits & 0x7FFFFF;
+
+		if (exponent >= 31)
+			return (GLhalf)(sign | 0x7BFF);      // Largest finite half
+		if (exponent <= 0)
+		{
+			if (exponent < -10)
+				return (GLhalf)sign;
+			// Denormal: shift the implicit one into the mantissa
+			mantissa |= 0x800000;
+			GLuint shift = (GLuint)(14 - exponent);
+			GLuint half = mantissa >> shift;
+			if ((mantissa >> (shift - 1)) & 1)
+				++half;
+			return (GLhalf)(sign | half);
+		}
+
+		GLuint half = sign | ((GLuint)exponent << 10) | (mantissa >> 13);
+		if (mantissa & 0x1000)
+			++half;         // A carry into the exponent is still the correctly rounded value
+		return (GLhalf)half;
+	}
+}
+
+
+void UWeldVertices(const float* soup, GLuint vertexCount, GLuint floatsPerVertex,
+	vector<float>& vertices, vector<GLuint>& indices)
+{
+	// Open addressing table of unique vertex ids, at most half full
+	GLuint tableSize = 1;
+	while (tableSize < vertexCount * 2)
+		tableSize *= 2;
+	vector<GLuint> table(tableSize, (GLuint)-1);
+
+	vertices.clear();
+	indices.resize(vertexCount);
+
+	for (GLuint i = 0; i < vertexCount; ++i)
+	{
+		const float* vertex = soup + (size_t)i * floatsPerVertex;
+		GLuint slot = UHashVertex(vertex, floatsPerVertex) & (tableSize - 1);
+
+		while (table[slot] != (GLuint)-1
+			&& memcmp(&vertices[(size_t)table[slot] * floatsPerVertex], vertex, floatsPerVertex * sizeof(float)) != 0)
+			slot = (slot + 1) & (tableSize - 1);
+
+		if (table[slot] == (GLuint)-1)
+		{
+			table[slot] = (GLuint)(vertices.size() / floatsPerVertex);
+			vertices.insert(vertices.end(), vertex, vertex + floatsPerVertex);
+		}
+		indices[i] = table[slot];
+	}
+}
+
+
+void UOptimizeVertexCache(vector<GLuint>& indices, GLuint first, GLuint count, GLuint vertexCount, GLuint cacheSize)
+{
+	const GLuint triangleCount = count / 3;
+	if (triangleCount < 2)
+		return;
+
+	const GLuint* input = &indices[first];
+	UAdjacency adjacency;
+	UBuildAdjacency(input, triangleCount, vertexCount, adjacency);
+
+	// Triangles of each vertex not emitted yet
+	vector<GLuint> live(vertexCount);
+	for (GLuint v = 0; v < vertexCount; ++v)
+		live[v] = adjacency.offsets[v + 1] - adjacency.offsets[v];
+
+	vector<GLuint> cacheTime(vertexCount, 0);
+	vector<bool> emitted(triangleCount, false);
+	vector<GLuint> deadEnd;
+	vector<GLuint> candidates;
+	vector<GLuint> output;
+	output.reserve(triangleCount * 3);
+
+	GLuint time = cacheSize + 1;
+	GLuint cursor = 0;
+
+	// Start from the first vertex that is used at all
+	GLint fanning = -1;
+	for (GLuint v = 0; v < vertexCount && fanning < 0; ++v)
+	{
+		if (live[v] > 0)
+			fanning = (GLint)v;
+	}
+
+	while (fanning >= 0)
+	{
+		// Emit every remaining triangle around the fanning vertex
+		candidates.clear();
+		for (GLuint a = adjacency.offsets[fanning]; a < adjacency.offsets[fanning + 1]; ++a)
+		{
+			GLuint t = adjacency.triangles[a];
+			if (emitted[t])
+				continue;
+
+			for (GLuint k = 0; k < 3; ++k)
+			{
+				GLuint v = input[t * 3 + k];
+				output.push_back(v);
+				deadEnd.push_back(v);
+				candidates.push_back(v);
+				--live[v];
+				if (time - cacheTime[v] > cacheSize)
+					cacheTime[v] = time++;
+			}
+			emitted[t] = true;
+		}
+
+		// Next fanning vertex: the candidate that stays in the cache longest and still has work
+		GLint best = -1;
+		GLint bestPriority = -1;
+		for (GLuint v : candidates)
+		{
+			if (live[v] == 0)
+				continue;
+
+			GLint priority = 0;
+			if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+				priority = (GLint)(time - cacheTime[v]);
+			if (priority > bestPriority)
+			{
+				best = (GLint)v;
+				bestPriority = priority;
+			}
+		}
+
+		// Dead end: back off to a recently used vertex, then to any vertex with triangles left
+		while (best < 0 && !deadEnd.empty())
+		{
+			GLuint v = deadEnd.back();
+			deadEnd.pop_back();
+			if (live[v] > 0)
+				best = (GLint)v;
+		}
+		while (best < 0 && cursor < vertexCount)
+		{
+			if (live[cursor] > 0)
+				best = (GLint)cursor;
+			++cursor;
+		}
+
+		fanning = best;
+	}
+
+	copy(output.begin(), output.end(), indices.begin() + first);
+}
+
+
+void UOptimizeVertexFetch(vector<float>& vertices, GLuint floatsPerVertex, vector<GLuint>& indices)
+{
+	const GLuint vertexCount = (GLuint)(vertices.size() / floatsPerVertex);
+	vector<GLuint> remap(vertexCount, (GLuint)-1);
+	vector<float> reordered(vertices.size());
+
+	GLuint next = 0;
+	for (GLuint& index : indices)
+	{
+		if (remap[index] == (GLuint)-1)
+		{
+			remap[index] = next;
+			copy(vertices.begin() + (size_t)index * floatsPerVertex, vertices.begin() + (size_t)(index + 1) * floatsPerVertex,
+				reordered.begin() + (size_t)next * floatsPerVertex);
+			++next;
+		}
+		index = remap[index];
+	}
+
+	// Vertices no triangle uses are dropped
+	reordered.resize((size_t)next * floatsPerVertex);
+	vertices.swap(reordered);
+}
+
+
+glm::vec4 UQuantizeVertices(const vector<float>& vertices, vector<UPackedVertex>& packed)
+{
+	const size_t vertexCount = vertices.size() / MESH_VERTEX_FLOATS;
+	packed.resize(vertexCount);
+	if (vertexCount == 0)
+		return glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+	glm::vec3 lower(vertices[0], vertices[1], vertices[2]);
+	glm::vec3 upper = lower;
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		const float* position = &vertices[i * MESH_VERTEX_FLOATS];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			lower[axis] = min(lower[axis], position[axis]);
+			upper[axis] = max(upper[axis], position[axis]);
+		}
+	}
+
+	// One scale for every axis, the longest side of the box
+	float scale = max(upper.x - lower.x, max(upper.y - lower.y, upper.z - lower.z));
+	if (scale <= 0.0f)
+		scale = 1.0f;
+
+	for (size_t i = 0; i < vertexCount; ++i)
+	{
+		const float* vertex = &vertices[i * MESH_VERTEX_FLOATS];
+		UPackedVertex& out = packed[i];
+		for (int axis = 0; axis < 3; ++axis)
+		{
+			float unit = max(0.0f, min(1.0f, (vertex[axis] - lower[axis]) / scale));
+			out.position[axis] = (GLushort)floor(unit * 65535.0f + 0.5f);
+		}
+		UEncodeOctahedral(vertex + 3, out.normal);
+		out.uv[0] = UFloatToHalf(vertex[6]);
+		out.uv[1] = UFloatToHalf(vertex[7]);
+	}
+
+	return glm::vec4(lower, scale);
+}
+
+
+float UComputeACMR(const vector<GLuint>& indices, GLuint vertexCount, GLuint cacheSize)
+{
+	if (indices.size() < 3)
+		return 0.0f;
+
+	// FIFO cache: a vertex is in the cache when it entered less than cacheSize misses ago
+	vector<GLuint> entered(vertexCount, 0);
+	GLuint misses = 0;
+	for (GLuint index : indices)
+	{
+		if (entered[index] == 0 || misses - entered[index] + 1 > cacheSize)
+		{
+			++misses;
+			entered[index] = misses;
+		}
+	}
+	return (float)misses / (indices.size() / 3);
+}
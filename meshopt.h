@@ -0,0 +1,37 @@
+#ifndef MESHOPT_H
+#define MESHOPT_H
+
+#include <GL/glew.h>        // GLuint
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "mesharena.h"      // UPackedVertex
+
+// Post-transform vertex cache size the optimizer and the ACMR report assume
+const GLuint VERTEX_CACHE_SIZE = 16;
+
+/* Load-time mesh processing for triangle lists. Vertices are opaque runs of
+ * floatsPerVertex floats, two vertices are the same when all their bits match.
+ */
+
+// Collapses identical vertices of a triangle soup into an indexed mesh
+void UWeldVertices(const float* soup, GLuint vertexCount, GLuint floatsPerVertex,
+	std::vector<float>& vertices, std::vector<GLuint>& indices);
+
+// Reorders the triangles of indices[first, first + count) for the post-transform
+// vertex cache (Tipsify). Triangles never move out of the range, so draw ranges stay valid.
+void UOptimizeVertexCache(std::vector<GLuint>& indices, GLuint first, GLuint count, GLuint vertexCount, GLuint cacheSize);
+
+// Renumbers the vertices in the order the index buffer first uses them so fetches walk memory forwards
+void UOptimizeVertexFetch(std::vector<float>& vertices, GLuint floatsPerVertex, std::vector<GLuint>& indices);
+
+// Packs MESH_VERTEX_FLOATS vertices into UPackedVertex. Returns the position decode as
+// xyz = bounding box minimum, w = scale: position = xyz + w * unorm16 position.
+glm::vec4 UQuantizeVertices(const std::vector<float>& vertices, std::vector<UPackedVertex>& packed);
+
+// Average cache miss ratio: vertex shader runs per triangle with a FIFO cache of cacheSize entries
+float UComputeACMR(const std::vector<GLuint>& indices, GLuint vertexCount, GLuint cacheSize);
+
+#endif
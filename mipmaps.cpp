@@ -0,0 +1,363 @@
+#include <iostream>         // cout
+#include <cmath>            // pow, sqrt, sin
+#include <cstring>          // strcmp
+#include <algorithm>        // min, max
+#include <chrono>           // benchmark timing
+#include <thread>
+
+#include <emmintrin.h>      // SSE2
+
+#include <stb_image.h>      // stbi_load, the implementation is compiled into main.cpp
+
+#include "mipmaps.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	// sRGB decode for every byte value and encode at 12 bits of linear precision
+	struct UGammaTables
+	{
+		float toLinear[256];
+		unsigned char toSrgb[4096];
+
+		UGammaTables()
+		{
+			for (int i = 0; i < 256; ++i)
+			{
+				float c = i / 255.0f;
+				toLinear[i] = c <= 0.04045f ? c / 12.92f : (float)pow((c + 0.055f) / 1.055f, 2.4f);
+			}
+			for (int i = 0; i < 4096; ++i)
+			{
+				float c = i / 4095.0f;
+				float srgb = c <= 0.0031308f ? c * 12.92f : 1.055f * (float)pow(c, 1.0f / 2.4f) - 0.055f;
+				toSrgb[i] = (unsigned char)(srgb * 255.0f + 0.5f);
+			}
+		}
+	};
+
+	const UGammaTables& UGetGammaTables()
+	{
+		static const UGammaTables tables;
+		return tables;
+	}
+
+	// Kaiser windowed sinc for halving: taps at source texels 2x - 3 .. 2x + 4
+	const int KAISER_TAPS = 8;
+	const int KAISER_FIRST_TAP = -3;
+
+	struct UKaiserKernel
+	{
+		float weights[KAISER_TAPS];
+
+		UKaiserKernel()
+		{
+			// Modified Bessel function of the first kind, order 0
+			auto bessel = [](double x)
+			{
+				double sum = 1.0;
+				double term = 1.0;
+				for (int k = 1; k < 20; ++k)
+				{
+					term *= (x / (2.0 * k)) * (x / (2.0 * k));
+					sum += term;
+				}
+				return sum;
+			};
+
+			const double pi = 3.14159265358979323846;
+			const double alpha = 4.0;
+			const double radius = 4.0;
+			double total = 0.0;
+			double raw[KAISER_TAPS];
+			for (int k = 0; k < KAISER_TAPS; ++k)
+			{
+				// Distance from the destination texel center, in source texels
+				double d = k + KAISER_FIRST_TAP - 0.5;
+				double x = d * 0.5;
+				double sinc = x == 0.0 ? 1.0 : sin(pi * x) / (pi * x);
+				double window = bessel(alpha * sqrt(max(0.0, 1.0 - (d / radius) * (d / radius)))) / bessel(alpha);
+				raw[k] = sinc * window;
+				total += raw[k];
+			}
+			for (int k = 0; k < KAISER_TAPS; ++k)
+				weights[k] = (float)(raw[k] / total);
+		}
+	};
+
+	const UKaiserKernel& UGetKaiserKernel()
+	{
+		static const UKaiserKernel kernel;
+		return kernel;
+	}
+
+	// Linear RGBA, four floats per texel
+	struct UFloatImage
+	{
+		GLuint width = 0;
+		GLuint height = 0;
+		vector<float> texels;
+	};
+
+	// Runs function(firstRow, endRow) over rows split across threads
+	template<typename Function>
+	void UParallelRows(GLuint rows, GLuint threadCount, Function function)
+	{
+		threadCount = max(1u, min(threadCount, rows / 16));
+		if (threadCount == 1)
+		{
+			function(0u, rows);
+			return;
+		}
+
+		vector<thread> threads;
+		for (GLuint i = 0; i < threadCount; ++i)
+			threads.emplace_back(function, rows * i / threadCount, rows * (i + 1) / threadCount);
+		for (thread& worker : threads)
+			worker.join();
+	}
+
+	void UToLinear(const unsigned char* pixels, GLuint width, GLuint height, int channels, GLuint threadCount, UFloatImage& image)
+	{
+		const UGammaTables& tables = UGetGammaTables();
+		image.width = width;
+		image.height = height;
+		image.texels.resize((size_t)width * height * 4);
+
+		UParallelRows(height, threadCount, [&](GLuint first, GLuint end)
+		{
+			for (size_t i = (size_t)first * width; i < (size_t)end * width; ++i)
+			{
+				const unsigned char* texel = pixels + i * channels;
+				float* out = &image.texels[i * 4];
+				out[0] = tables.toLinear[texel[0]];
+				out[1] = tables.toLinear[texel[1]];
+				out[2] = tables.toLinear[texel[2]];
+				out[3] = channels == 4 ? texel[3] / 255.0f : 1.0f;
+			}
+		});
+	}
+
+	void UToBytes(const UFloatImage& image, int channels, GLuint threadCount, vector<unsigned char>& pixels)
+	{
+		const UGammaTables& tables = UGetGammaTables();
+		pixels.resize((size_t)image.width * image.height * channels);
+
+		UParallelRows(image.height, threadCount, [&](GLuint first, GLuint end)
+		{
+			const __m128 zero = _mm_setzero_ps();
+			const __m128 one = _mm_set1_ps(1.0f);
+			const __m128 scale = _mm_set_ps(255.0f, 4095.0f, 4095.0f, 4095.0f);
+			const __m128 half = _mm_set1_ps(0.5f);
+			for (size_t i = (size_t)first * image.width; i < (size_t)end * image.width; ++i)
+			{
+				// The Kaiser filter rings below 0 and above 1
+				__m128 texel = _mm_min_ps(_mm_max_ps(_mm_loadu_ps(&image.texels[i * 4]), zero), one);
+				__m128i index = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(texel, scale), half));
+
+				int lanes[4];
+				_mm_storeu_si128((__m128i*)lanes, index);
+				unsigned char* out = &pixels[i * channels];
+				out[0] = tables.toSrgb[lanes[0]];
+				out[1] = tables.toSrgb[lanes[1]];
+				out[2] = tables.toSrgb[lanes[2]];
+				if (channels == 4)
+					out[3] = (unsigned char)lanes[3];
+			}
+		});
+	}
+
+	// 2x2 average, odd edges reuse their last row or column
+	void UBoxDownsample(const UFloatImage& source, UFloatImage& target, GLuint threadCount)
+	{
+		UParallelRows(target.height, threadCount, [&](GLuint first, GLuint end)
+		{
+			const __m128 quarter = _mm_set1_ps(0.25f);
+			for (GLuint y = first; y < end; ++y)
+			{
+				const float* row0 = &source.texels[(size_t)min(y * 2, source.height - 1) * source.width * 4];
+				const float* row1 = &source.texels[(size_t)min(y * 2 + 1, source.height - 1) * source.width * 4];
+				float* out = &target.texels[(size_t)y * target.width * 4];
+				for (GLuint x = 0; x < target.width; ++x)
+				{
+					const size_t x0 = (size_t)min(x * 2, source.width - 1) * 4;
+					const size_t x1 = (size_t)min(x * 2 + 1, source.width - 1) * 4;
+					__m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(row0 + x0), _mm_loadu_ps(row0 + x1)),
+						_mm_add_ps(_mm_loadu_ps(row1 + x0), _mm_loadu_ps(row1 + x1)));
+					_mm_storeu_ps(out + x * 4, _mm_mul_ps(sum, quarter));
+				}
+			}
+		});
+	}
+
+	// Separable Kaiser: halve the width into a scratch image, then the height. Taps wrap
+	// around the edges like the GL_REPEAT textures they are built for.
+	void UKaiserDownsample(const UFloatImage& source, UFloatImage& target, GLuint threadCount)
+	{
+		const UKaiserKernel& kernel = UGetKaiserKernel();
+		__m128 weights[KAISER_TAPS];
+		for (int k = 0; k < KAISER_TAPS; ++k)
+			weights[k] = _mm_set1_ps(kernel.weights[k]);
+
+		UFloatImage columns;
+		columns.width = target.width;
+		columns.height = source.height;
+		columns.texels.resize((size_t)columns.width * columns.height * 4);
+
+		UParallelRows(source.height, threadCount, [&](GLuint first, GLuint end)
+		{
+			for (GLuint y = first; y < end; ++y)
+			{
+				const float* row = &source.texels[(size_t)y * source.width * 4];
+				float* out = &columns.texels[(size_t)y * columns.width * 4];
+				for (GLuint x = 0; x < columns.width; ++x)
+				{
+					__m128 sum = _mm_setzero_ps();
+					for (int k = 0; k < KAISER_TAPS; ++k)
+					{
+						int sx = ((int)(x * 2) + k + KAISER_FIRST_TAP) % (int)source.width;
+						sx += sx < 0 ? (int)source.width : 0;
+						sum = _mm_add_ps(sum, _mm_mul_ps(weights[k], _mm_loadu_ps(row + (size_t)sx * 4)));
+					}
+					_mm_storeu_ps(out + x * 4, sum);
+				}
+			}
+		});
+
+		UParallelRows(target.height, threadCount, [&](GLuint first, GLuint end)
+		{
+			const float* rows[KAISER_TAPS];
+			for (GLuint y = first; y < end; ++y)
+			{
+				for (int k = 0; k < KAISER_TAPS; ++k)
+				{
+					int sy = ((int)(y * 2) + k + KAISER_FIRST_TAP) % (int)columns.height;
+					sy += sy < 0 ? (int)columns.height : 0;
+					rows[k] = &columns.texels[(size_t)sy * columns.width * 4];
+				}
+
+				float* out = &target.texels[(size_t)y * target.width * 4];
+				for (size_t i = 0; i < (size_t)target.width * 4; i += 4)
+				{
+					__m128 sum = _mm_setzero_ps();
+					for (int k = 0; k < KAISER_TAPS; ++k)
+						sum = _mm_add_ps(sum, _mm_mul_ps(weights[k], _mm_loadu_ps(rows[k] + i)));
+					_mm_storeu_ps(out + i, sum);
+				}
+			}
+		});
+	}
+}
+
+
+void UBuildMipChain(const unsigned char* pixels, GLuint width, GLuint height, int channels, GLuint filter,
+	GLuint threadCount, vector<UMipLevel>& levels)
+{
+	if (threadCount == 0)
+		threadCount = max(1u, thread::hardware_concurrency());
+
+	levels.clear();
+	levels.push_back({ width, height, vector<unsigned char>(pixels, pixels + (size_t)width * height * channels) });
+
+	UFloatImage current;
+	UFloatImage next;
+	UToLinear(pixels, width, height, channels, threadCount, current);
+
+	while (current.width > 1 || current.height > 1)
+	{
+		next.width = max(1u, current.width / 2);
+		next.height = max(1u, current.height / 2);
+		next.texels.resize((size_t)next.width * next.height * 4);
+
+		// The Kaiser taps need a few texels around them, tiny levels are averaged
+		if (filter == MIP_FILTER_KAISER && current.width >= 8 && current.height >= 8)
+			UKaiserDownsample(current, next, threadCount);
+		else
+			UBoxDownsample(current, next, threadCount);
+
+		levels.push_back({ next.width, next.height, vector<unsigned char>() });
+		UToBytes(next, channels, threadCount, levels.back().pixels);
+		swap(current, next);
+	}
+}
+
+
+GLuint UMipFilterFromName(const char* name)
+{
+	for (GLuint i = 0; i < MIP_FILTER_COUNT; ++i)
+	{
+		if (strcmp(name, MIP_FILTER_NAMES[i]) == 0)
+			return i;
+	}
+	return MIP_FILTER_COUNT;
+}
+
+
+bool UBenchmarkMipmaps(const vector<string>& filenames)
+{
+	const GLuint threadCount = max(1u, thread::hardware_concurrency());
+	double totals[1 + MIP_FILTER_COUNT * 2] = {};
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+
+	for (const string& filename : filenames)
+	{
+		int width, height, channels;
+		unsigned char* pixels = stbi_load(filename.c_str(), &width, &height, &channels, 0);
+		if (!pixels || (channels != 3 && channels != 4))
+		{
+			cout << "Failed to load image " << filename << endl;
+			if (pixels)
+				stbi_image_free(pixels);
+			glDeleteTextures(1, &texture);
+			return false;
+		}
+		const GLenum format = channels == 4 ? GL_RGBA : GL_RGB;
+		const GLenum internalFormat = channels == 4 ? GL_RGBA8 : GL_RGB8;
+
+		// Driver path: upload level 0 and let GL build the rest
+		glFinish();
+		auto start = chrono::steady_clock::now();
+		glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glFinish();
+		chrono::duration<double, milli> driver = chrono::steady_clock::now() - start;
+
+		cout << filename << " (" << width << "x" << height << "): upload + glGenerateMipmap " << driver.count() << " ms";
+		totals[0] += driver.count();
+
+		// CPU path: building the chain happens once when the texture cache is written,
+		// at runtime only the upload of the stored levels is left
+		for (GLuint filter = 0; filter < MIP_FILTER_COUNT; ++filter)
+		{
+			vector<UMipLevel> levels;
+			start = chrono::steady_clock::now();
+			UBuildMipChain(pixels, width, height, channels, filter, threadCount, levels);
+			chrono::duration<double, milli> build = chrono::steady_clock::now() - start;
+
+			glFinish();
+			start = chrono::steady_clock::now();
+			for (GLuint i = 0; i < levels.size(); ++i)
+				glTexImage2D(GL_TEXTURE_2D, i, internalFormat, levels[i].width, levels[i].height, 0, format, GL_UNSIGNED_BYTE, levels[i].pixels.data());
+			glFinish();
+			chrono::duration<double, milli> upload = chrono::steady_clock::now() - start;
+
+			cout << ", " << MIP_FILTER_NAMES[filter] << " build " << build.count() << " ms + upload " << upload.count() << " ms";
+			totals[1 + filter * 2] += build.count();
+			totals[2 + filter * 2] += upload.count();
+		}
+		cout << endl;
+		stbi_image_free(pixels);
+	}
+
+	glDeleteTextures(1, &texture);
+
+	cout << "Total on " << threadCount << " threads: upload + glGenerateMipmap " << totals[0] << " ms";
+	for (GLuint filter = 0; filter < MIP_FILTER_COUNT; ++filter)
+		cout << ", " << MIP_FILTER_NAMES[filter] << " build " << totals[1 + filter * 2] << " ms (once) + upload " << totals[2 + filter * 2] << " ms";
+	cout << endl;
+	return true;
+}
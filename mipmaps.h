@@ -0,0 +1,41 @@
+#ifndef MIPMAPS_H
+#define MIPMAPS_H
+
+#include <GL/glew.h>        // GLuint
+
+#include <string>
+#include <vector>
+
+// Downsampling filters for building mip chains on the CPU
+enum UMipFilter
+{
+	MIP_FILTER_BOX,         // 2x2 average
+	MIP_FILTER_KAISER,      // 8-tap Kaiser windowed sinc, keeps distant textures sharper
+	MIP_FILTER_COUNT
+};
+const char* const MIP_FILTER_NAMES[MIP_FILTER_COUNT] = { "box", "kaiser" };
+
+// One level of a mip chain, same channel count as the source image
+struct UMipLevel
+{
+	GLuint width;
+	GLuint height;
+	std::vector<unsigned char> pixels;
+};
+
+/* Builds the whole mip chain of a 3 or 4 channel sRGB image, level 0 is a copy
+ * of the image. Color is filtered in linear space with SSE, alpha as is, and every
+ * level is made from the previous one at float precision. Rows are split over
+ * threadCount threads, 0 uses one per hardware thread.
+ */
+void UBuildMipChain(const unsigned char* pixels, GLuint width, GLuint height, int channels, GLuint filter,
+	GLuint threadCount, std::vector<UMipLevel>& levels);
+
+// Returns the UMipFilter for a name, or MIP_FILTER_COUNT if the name is unknown
+GLuint UMipFilterFromName(const char* name);
+
+// Times glGenerateMipmap against building the chain on the CPU and uploading every
+// level, for each image. Needs a current GL context.
+bool UBenchmarkMipmaps(const std::vector<std::string>& filenames);
+
+#endif
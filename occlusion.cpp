@@ -0,0 +1,334 @@
+#include <algorithm>        // min, max
+#include <chrono>           // pass timing
+#include <cmath>            // floor, ceil, fabs
+
+#include <emmintrin.h>      // SSE2
+
+#include "occlusion.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	enum UOcclusionPass
+	{
+		OCCLUSION_PASS_DRAW,
+		OCCLUSION_PASS_TEST
+	};
+
+	// Clips the polygon against the near plane z + w >= 0, where 1/w stays finite. Returns the new corner count.
+	int UClipNear(const glm::vec4* corners, int count, glm::vec4* clipped)
+	{
+		int clippedCount = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			const glm::vec4& a = corners[i];
+			const glm::vec4& b = corners[(i + 1) % count];
+			const float da = a.z + a.w;
+			const float db = b.z + b.w;
+			if (da >= 0.0f)
+				clipped[clippedCount++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f))
+				clipped[clippedCount++] = a + (b - a) * (da / (da - db));
+		}
+		return clippedCount;
+	}
+
+	// Projects the occluders and keeps the triangles that reach the buffer
+	void USetupTriangles(UOcclusionCuller& culler)
+	{
+		culler.triangles.clear();
+		const float width = (float)culler.width;
+		const float height = (float)culler.height;
+		for (size_t i = 0; i + 2 < culler.occluders.size(); i += 3)
+		{
+			glm::vec4 corners[3];
+			for (int k = 0; k < 3; ++k)
+				corners[k] = culler.viewProjection * glm::vec4(culler.occluders[i + k], 1.0f);
+
+			glm::vec4 clipped[4];
+			const int count = UClipNear(corners, 3, clipped);
+			for (int fan = 1; fan + 1 < count; ++fan)
+			{
+				UOcclusionTriangle triangle;
+				const glm::vec4* fanCorners[3] = { &clipped[0], &clipped[fan], &clipped[fan + 1] };
+				for (int k = 0; k < 3; ++k)
+				{
+					// Pixel coordinates with y up, the buffer's row 0 is the bottom of the view
+					const float inverseW = 1.0f / fanCorners[k]->w;
+					triangle.x[k] = (fanCorners[k]->x * inverseW * 0.5f + 0.5f) * width;
+					triangle.y[k] = (fanCorners[k]->y * inverseW * 0.5f + 0.5f) * height;
+					triangle.z[k] = inverseW;
+				}
+
+				const float minX = min(min(triangle.x[0], triangle.x[1]), triangle.x[2]);
+				const float maxX = max(max(triangle.x[0], triangle.x[1]), triangle.x[2]);
+				const float minY = min(min(triangle.y[0], triangle.y[1]), triangle.y[2]);
+				const float maxY = max(max(triangle.y[0], triangle.y[1]), triangle.y[2]);
+				if (maxX < 0.0f || maxY < 0.0f || minX > width || minY > height)
+					continue;
+				culler.triangles.push_back(triangle);
+			}
+		}
+	}
+
+	// Draws the triangles into the rows of the bands this participant owns
+	void UDrawOccluders(UOcclusionCuller& culler, GLuint participant, GLuint participants)
+	{
+		const int width = (int)culler.width;
+		const int height = (int)culler.height;
+		for (int band = (int)participant; band * (int)OCCLUSION_BAND_ROWS < height; band += (int)participants)
+		{
+			const int first = band * (int)OCCLUSION_BAND_ROWS;
+			const int end = min(first + (int)OCCLUSION_BAND_ROWS, height);
+			fill(culler.depth.begin() + (size_t)first * width, culler.depth.begin() + (size_t)end * width, 0.0f);
+		}
+
+		const __m128 laneOffsets = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		for (const UOcclusionTriangle& triangle : culler.triangles)
+		{
+			const float* x = triangle.x;
+			const float* y = triangle.y;
+			const float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+			if (fabs(area) < 1e-6f)
+				continue;
+
+			// Edge functions A x + B y + C, positive inside whatever the winding
+			const float sign = area > 0.0f ? 1.0f : -1.0f;
+			float a[3], b[3], c[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				const int next = (k + 1) % 3;
+				a[k] = (y[k] - y[next]) * sign;
+				b[k] = (x[next] - x[k]) * sign;
+				c[k] = -(a[k] * x[k] + b[k] * y[k]);
+			}
+
+			// Depth plane, lowered to the farthest value it takes inside each pixel
+			const float* z = triangle.z;
+			const float dzdx = ((z[1] - z[0]) * (y[2] - y[0]) - (z[2] - z[0]) * (y[1] - y[0])) / area;
+			const float dzdy = ((z[2] - z[0]) * (x[1] - x[0]) - (z[1] - z[0]) * (x[2] - x[0])) / area;
+			const float dzc = z[0] - dzdx * x[0] - dzdy * y[0] - 0.5f * (fabs(dzdx) + fabs(dzdy));
+
+			// Clamped as floats, corners near the near plane can be far outside the buffer
+			const int minX = (int)max(0.0f, floor(min(min(x[0], x[1]), x[2]))) & ~3;
+			const int maxX = (int)min(width - 1.0f, ceil(max(max(x[0], x[1]), x[2])));
+			const int minY = (int)max(0.0f, floor(min(min(y[0], y[1]), y[2])));
+			const int maxY = (int)min(height - 1.0f, ceil(max(max(y[0], y[1]), y[2])));
+
+			const __m128 dzdx4 = _mm_set1_ps(dzdx * 4.0f);
+			const __m128 a4[3] = { _mm_set1_ps(a[0] * 4.0f), _mm_set1_ps(a[1] * 4.0f), _mm_set1_ps(a[2] * 4.0f) };
+			const __m128 zero = _mm_setzero_ps();
+			for (int row = minY; row <= maxY; ++row)
+			{
+				// Skip to the next row of a band this participant owns
+				if (((GLuint)row / OCCLUSION_BAND_ROWS) % participants != participant)
+				{
+					row = ((row / (int)OCCLUSION_BAND_ROWS) + 1) * (int)OCCLUSION_BAND_ROWS - 1;
+					continue;
+				}
+
+				const float centerY = row + 0.5f;
+				const __m128 pixelX = _mm_add_ps(_mm_set1_ps((float)minX), laneOffsets);
+				__m128 edge[3];
+				for (int k = 0; k < 3; ++k)
+					edge[k] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(a[k]), pixelX), _mm_set1_ps(b[k] * centerY + c[k]));
+				__m128 depth = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(dzdx), pixelX), _mm_set1_ps(dzdy * centerY + dzc));
+
+				float* pixels = &culler.depth[(size_t)row * width];
+				for (int column = minX; column <= maxX; column += 4)
+				{
+					const __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edge[0], zero), _mm_cmpge_ps(edge[1], zero)),
+						_mm_cmpge_ps(edge[2], zero));
+					if (_mm_movemask_ps(inside))
+					{
+						const __m128 current = _mm_loadu_ps(pixels + column);
+						const __m128 nearer = _mm_max_ps(current, depth);
+						_mm_storeu_ps(pixels + column, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, current)));
+					}
+					for (int k = 0; k < 3; ++k)
+						edge[k] = _mm_add_ps(edge[k], a4[k]);
+					depth = _mm_add_ps(depth, dzdx4);
+				}
+			}
+		}
+	}
+
+	// True when the occluders are nearer than the box at every pixel around it
+	bool UBoxOccluded(const UOcclusionCuller& culler, const glm::mat4& box)
+	{
+		const glm::mat4 clip = culler.viewProjection * box;
+		float minX = culler.width + 1.0f, maxX = -1.0f;
+		float minY = culler.height + 1.0f, maxY = -1.0f;
+		float nearest = 0.0f;
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			const glm::vec4 point = clip[3] + clip[0] * ((corner & 1) ? 1.0f : -1.0f)
+				+ clip[1] * ((corner & 2) ? 1.0f : -1.0f) + clip[2] * ((corner & 4) ? 1.0f : -1.0f);
+
+			// Boxes through the near plane are in the viewer's face
+			if (point.z + point.w < 0.0f)
+				return false;
+
+			const float inverseW = 1.0f / point.w;
+			const float x = (point.x * inverseW * 0.5f + 0.5f) * culler.width;
+			const float y = (point.y * inverseW * 0.5f + 0.5f) * culler.height;
+			minX = min(minX, x);
+			maxX = max(maxX, x);
+			minY = min(minY, y);
+			maxY = max(maxY, y);
+			nearest = max(nearest, inverseW);
+		}
+
+		// Every pixel the box touches and one more all around
+		const int firstX = (int)max(0.0f, floor(minX) - 1.0f);
+		const int lastX = (int)min(culler.width - 1.0f, floor(maxX) + 1.0f);
+		const int firstY = (int)max(0.0f, floor(minY) - 1.0f);
+		const int lastY = (int)min(culler.height - 1.0f, floor(maxY) + 1.0f);
+		if (firstX > lastX || firstY > lastY)
+			return false;
+
+		const __m128 nearest4 = _mm_set1_ps(nearest);
+		const __m128i first4 = _mm_set1_epi32(firstX - 1);
+		const __m128i last4 = _mm_set1_epi32(lastX + 1);
+		for (int row = firstY; row <= lastY; ++row)
+		{
+			const float* pixels = &culler.depth[(size_t)row * culler.width];
+			for (int column = firstX & ~3; column <= lastX; column += 4)
+			{
+				const __m128i lanes = _mm_add_epi32(_mm_set1_epi32(column), _mm_setr_epi32(0, 1, 2, 3));
+				const __m128 inRange = _mm_castsi128_ps(_mm_and_si128(_mm_cmpgt_epi32(lanes, first4), _mm_cmplt_epi32(lanes, last4)));
+				const __m128 behind = _mm_cmple_ps(_mm_loadu_ps(pixels + column), nearest4);
+				if (_mm_movemask_ps(_mm_and_ps(inRange, behind)))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	void UTestOccludees(UOcclusionCuller& culler, GLuint participant, GLuint participants)
+	{
+		const GLuint first = (GLuint)((size_t)culler.testedCount * participant / participants);
+		const GLuint end = (GLuint)((size_t)culler.testedCount * (participant + 1) / participants);
+		for (GLuint i = first; i < end; ++i)
+			culler.occluded[i] = UBoxOccluded(culler, culler.boxes[culler.tested[i]]) ? 1 : 0;
+	}
+
+	void URunOcclusionPass(UOcclusionCuller& culler, GLuint pass, GLuint participant)
+	{
+		const GLuint participants = (GLuint)culler.workers.size() + 1;
+		if (pass == OCCLUSION_PASS_DRAW)
+			UDrawOccluders(culler, participant, participants);
+		else
+			UTestOccludees(culler, participant, participants);
+	}
+
+	void UOcclusionWorker(UOcclusionCuller& culler, GLuint participant)
+	{
+		GLuint seen = 0;
+		while (true)
+		{
+			GLuint pass;
+			{
+				unique_lock<mutex> lock(culler.mutex);
+				culler.wake.wait(lock, [&] { return culler.stopping || culler.generation != seen; });
+				if (culler.stopping)
+					return;
+				seen = culler.generation;
+				pass = culler.pass;
+			}
+
+			URunOcclusionPass(culler, pass, participant);
+
+			lock_guard<mutex> lock(culler.mutex);
+			if (--culler.running == 0)
+				culler.done.notify_one();
+		}
+	}
+
+	// Runs a pass on every worker and the calling thread, returns when all are done
+	void URunOcclusionPassEverywhere(UOcclusionCuller& culler, GLuint pass)
+	{
+		{
+			lock_guard<mutex> lock(culler.mutex);
+			culler.pass = pass;
+			culler.running = (GLuint)culler.workers.size();
+			++culler.generation;
+		}
+		culler.wake.notify_all();
+
+		URunOcclusionPass(culler, pass, 0);
+
+		unique_lock<mutex> lock(culler.mutex);
+		culler.done.wait(lock, [&] { return culler.running == 0; });
+	}
+}
+
+
+void UStartOcclusionCuller(UOcclusionCuller& culler, GLuint width, GLuint height, GLuint threadCount)
+{
+	culler.width = max(4u, (width + 3) & ~3u);
+	culler.height = max(1u, height);
+	culler.depth.assign((size_t)culler.width * culler.height, 0.0f);
+
+	if (threadCount == 0)
+		threadCount = max(1u, thread::hardware_concurrency()) - 1;
+	culler.stopping = false;
+	for (GLuint i = 0; i < threadCount; ++i)
+		culler.workers.emplace_back(UOcclusionWorker, ref(culler), i + 1);
+}
+
+
+void UStopOcclusionCuller(UOcclusionCuller& culler)
+{
+	{
+		lock_guard<mutex> lock(culler.mutex);
+		culler.stopping = true;
+	}
+	culler.wake.notify_all();
+	for (thread& worker : culler.workers)
+		worker.join();
+	culler.workers.clear();
+}
+
+
+void UAddOccluder(UOcclusionCuller& culler, const vector<glm::vec3>& positions, const vector<GLuint>& indices,
+	const glm::mat4& transform)
+{
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		for (int k = 0; k < 3; ++k)
+			culler.occluders.push_back(glm::vec3(transform * glm::vec4(positions[indices[i + k]], 1.0f)));
+	}
+}
+
+
+void UCullOccludedObjects(UOcclusionCuller& culler, const glm::mat4& viewProjection, vector<GLuint>& objects)
+{
+	auto start = chrono::steady_clock::now();
+	culler.viewProjection = viewProjection;
+	USetupTriangles(culler);
+	URunOcclusionPassEverywhere(culler, OCCLUSION_PASS_DRAW);
+	chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+	culler.drawMilliseconds = elapsed.count();
+
+	start = chrono::steady_clock::now();
+	culler.tested = objects.data();
+	culler.testedCount = (GLuint)objects.size();
+	culler.occluded.assign(objects.size(), 0);
+	URunOcclusionPassEverywhere(culler, OCCLUSION_PASS_TEST);
+
+	size_t kept = 0;
+	for (size_t i = 0; i < objects.size(); ++i)
+	{
+		if (!culler.occluded[i])
+			objects[kept++] = objects[i];
+	}
+	culler.occludedCount = (GLuint)(objects.size() - kept);
+	objects.resize(kept);
+	culler.tested = nullptr;
+	culler.testedCount = 0;
+
+	elapsed = chrono::steady_clock::now() - start;
+	culler.testMilliseconds = elapsed.count();
+}
@@ -0,0 +1,76 @@
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <GL/glew.h>        // GLuint
+
+#include <glm/glm.hpp>
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Rows of the depth buffer a worker draws at a time, workers take turns by band
+const GLuint OCCLUSION_BAND_ROWS = 8;
+
+// An occluder triangle after projection: pixel coordinates and 1/w at each corner
+struct UOcclusionTriangle
+{
+	float x[3];
+	float y[3];
+	float z[3];
+};
+
+/* Software occlusion culling. Each frame the occluders are drawn into a small CPU
+ * depth buffer holding 1/w, larger is nearer and 0 is empty, then every object's
+ * box is tested against it. Both passes are split between the calling thread and
+ * a pool of workers: drawing by bands of rows, testing by runs of objects.
+ *
+ * Occluders write the farthest depth their plane reaches within each pixel and
+ * boxes are tested over their screen rectangle grown by a pixel, so an object is
+ * only dropped when the occluders hide every part of it.
+ */
+struct UOcclusionCuller
+{
+	GLuint width = 0;                       // A multiple of 4, the SSE passes work on four pixels
+	GLuint height = 0;
+	std::vector<float> depth;
+	std::vector<glm::vec3> occluders;       // World-space occluder triangles, three corners each
+	std::vector<glm::mat4> boxes;           // Per object, maps the [-1, 1] cube onto its box in world space
+
+	// This frame's work, read by the workers
+	glm::mat4 viewProjection;
+	std::vector<UOcclusionTriangle> triangles;
+	const GLuint* tested = nullptr;         // Objects to test
+	GLuint testedCount = 0;
+	std::vector<unsigned char> occluded;    // Per tested object
+
+	std::vector<std::thread> workers;
+	std::mutex mutex;                       // Guards the fields below
+	std::condition_variable wake;           // Signaled when a pass starts or the culler stops
+	std::condition_variable done;           // Signaled when the last worker finishes a pass
+	GLuint pass = 0;
+	GLuint generation = 0;                  // Counts passes started, workers wait for it to change
+	GLuint running = 0;                     // Workers still in the current pass
+	bool stopping = false;
+
+	// Last frame
+	GLuint occludedCount = 0;
+	double drawMilliseconds = 0.0;
+	double testMilliseconds = 0.0;
+};
+
+// Sizes the depth buffer and starts threadCount workers besides the calling thread,
+// 0 starts one per hardware thread past the first
+void UStartOcclusionCuller(UOcclusionCuller& culler, GLuint width, GLuint height, GLuint threadCount);
+void UStopOcclusionCuller(UOcclusionCuller& culler);
+
+// Adds a mesh's triangles as an occluder, indices address positions three per triangle
+void UAddOccluder(UOcclusionCuller& culler, const std::vector<glm::vec3>& positions, const std::vector<GLuint>& indices,
+	const glm::mat4& transform);
+
+// Draws the occluders as seen through viewProjection, then removes the objects they hide
+// from objects, keeping the order of the rest. Boxes must be set for every object.
+void UCullOccludedObjects(UOcclusionCuller& culler, const glm::mat4& viewProjection, std::vector<GLuint>& objects);
+
+#endif
@@ -0,0 +1,347 @@
+#include <iostream>         // cout
+#include <cstring>          // memcmp, memcpy
+#include <chrono>           // compile and benchmark timing
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include "program.h"
+#include "programcache.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	// Bytes needed to shadow one element of a uniform type
+	GLuint UUniformTypeSize(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_FLOAT_VEC2:
+			return 2 * sizeof(float);
+		case GL_FLOAT_VEC3:
+			return 3 * sizeof(float);
+		case GL_FLOAT_VEC4:
+		case GL_FLOAT_MAT2:
+			return 4 * sizeof(float);
+		case GL_FLOAT_MAT3:
+			return 9 * sizeof(float);
+		case GL_FLOAT_MAT4:
+			return 16 * sizeof(float);
+		default:
+			return 4; // float, int, bool and samplers
+		}
+	}
+
+	// Samplers and bools are set through glUniform1i like ints
+	bool UIsIntLike(GLenum type)
+	{
+		switch (type)
+		{
+		case GL_INT:
+		case GL_BOOL:
+		case GL_SAMPLER_2D:
+		case GL_SAMPLER_2D_ARRAY:
+		case GL_SAMPLER_CUBE:
+			return true;
+		default:
+			return false;
+		}
+	}
+
+	// Compares the value against the shadow copy and updates it.
+	// Returns true when the value has to be sent to the driver.
+	bool UUpdateShadow(UShaderProgram& program, GLint index, const void* value, size_t size)
+	{
+		UProgramUniform& uniform = program.uniforms[index];
+		unsigned char* shadow = &program.shadow[uniform.shadowOffset];
+
+		if (uniform.shadowValid && memcmp(shadow, value, size) == 0)
+		{
+			++program.skippedUpdates;
+			return false;
+		}
+
+		memcpy(shadow, value, size);
+		uniform.shadowValid = true;
+		++program.issuedUpdates;
+		return true;
+	}
+
+	// Compiles one stage, prints the info log and returns 0 when it fails
+	GLuint UCompileShader(GLenum stage, const char* source)
+	{
+		GLuint shaderId = glCreateShader(stage);
+		glShaderSource(shaderId, 1, &source, NULL);
+		glCompileShader(shaderId);
+
+		int success = 0;
+		glGetShaderiv(shaderId, GL_COMPILE_STATUS, &success);
+		if (!success)
+		{
+			char infoLog[512];
+			glGetShaderInfoLog(shaderId, sizeof(infoLog), NULL, infoLog);
+			const char* stageName = stage == GL_VERTEX_SHADER ? "VERTEX" : (stage == GL_FRAGMENT_SHADER ? "FRAGMENT" : "COMPUTE");
+			cout << "ERROR::SHADER::" << stageName << "::COMPILATION_FAILED\n" << infoLog << endl;
+			glDeleteShader(shaderId);
+			return 0;
+		}
+		return shaderId;
+	}
+
+	/* Builds a program from stageCount stages, either from the cache or by compiling.
+	 * sourceHash identifies every source, see UHashProgramSources.
+	 */
+	bool UBuildProgram(const char* name, const GLenum* stages, const char* const* sources, GLuint stageCount,
+		uint64_t sourceHash, const char* cacheFolder, UShaderProgram& program)
+	{
+		auto start = chrono::steady_clock::now();
+
+		GLuint programId = glCreateProgram();
+		program.id = programId;
+
+		const string cacheFilename = cacheFolder ? string(cacheFolder) + "/" + name + ".glprog" : string();
+		double compileMilliseconds = 0.0;
+		if (cacheFolder && ULoadProgramBinary(cacheFilename.c_str(), sourceHash, programId, compileMilliseconds))
+		{
+			chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+			cout << "INFO: Program " << name << " loaded from " << cacheFilename << " in " << elapsed.count()
+				<< " ms, compiling took " << compileMilliseconds << " ms (" << compileMilliseconds - elapsed.count() << " ms saved)" << endl;
+		}
+		else
+		{
+			GLuint shaderIds[2] = {};
+			GLuint compiled = 0;
+			while (compiled < stageCount && (shaderIds[compiled] = UCompileShader(stages[compiled], sources[compiled])) != 0)
+				++compiled;
+			if (compiled < stageCount)
+			{
+				for (GLuint i = 0; i < compiled; ++i)
+					glDeleteShader(shaderIds[i]);
+				glDeleteProgram(programId);
+				program = UShaderProgram();
+				return false;
+			}
+
+			for (GLuint i = 0; i < stageCount; ++i)
+				glAttachShader(programId, shaderIds[i]);
+
+			// Ask the driver to keep the binary around for the cache
+			glProgramParameteri(programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+			glLinkProgram(programId);
+
+			// The linked program no longer needs the shader objects
+			for (GLuint i = 0; i < stageCount; ++i)
+			{
+				glDetachShader(programId, shaderIds[i]);
+				glDeleteShader(shaderIds[i]);
+			}
+
+			int success = 0;
+			glGetProgramiv(programId, GL_LINK_STATUS, &success);
+			if (!success)
+			{
+				char infoLog[512];
+				glGetProgramInfoLog(programId, sizeof(infoLog), NULL, infoLog);
+				cout << "ERROR::SHADER::PROGRAM::LINKING_FAILED\n" << infoLog << endl;
+				glDeleteProgram(programId);
+				program = UShaderProgram();
+				return false;
+			}
+
+			chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+			cout << "INFO: Program " << name << " compiled in " << elapsed.count() << " ms" << endl;
+
+			// Best effort like the other caches, the next run just compiles again
+			if (cacheFolder && !USaveProgramBinary(cacheFilename.c_str(), sourceHash, programId, elapsed.count()))
+				cout << "Failed to write program cache " << cacheFilename << endl;
+		}
+
+		glUseProgram(programId);
+
+		// Enumerate the active uniforms once so no name lookups are needed while rendering
+		UReflectProgram(program);
+		return true;
+	}
+}
+
+
+bool UCreateShaderProgram(const char* name, const char* vertexSource, const char* fragmentSource, const char* cacheFolder, UShaderProgram& program)
+{
+	const GLenum stages[2] = { GL_VERTEX_SHADER, GL_FRAGMENT_SHADER };
+	const char* const sources[2] = { vertexSource, fragmentSource };
+	return UBuildProgram(name, stages, sources, 2, UHashProgramSources(vertexSource, fragmentSource), cacheFolder, program);
+}
+
+
+bool UCreateComputeProgram(const char* name, const char* computeSource, const char* cacheFolder, UShaderProgram& program)
+{
+	const GLenum stage = GL_COMPUTE_SHADER;
+	return UBuildProgram(name, &stage, &computeSource, 1, UHashProgramSources(computeSource, ""), cacheFolder, program);
+}
+
+
+void UDestroyShaderProgram(UShaderProgram& program)
+{
+	glDeleteProgram(program.id);
+	program = UShaderProgram();
+}
+
+
+void UReflectProgram(UShaderProgram& program)
+{
+	program.uniforms.clear();
+	program.shadow.clear();
+
+	GLint uniformCount = 0;
+	GLint maxNameLength = 0;
+	glGetProgramiv(program.id, GL_ACTIVE_UNIFORMS, &uniformCount);
+	glGetProgramiv(program.id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+	vector<char> name(maxNameLength + 1);
+	GLuint shadowSize = 0;
+	for (GLint i = 0; i < uniformCount; ++i)
+	{
+		UProgramUniform uniform;
+		GLsizei nameLength = 0;
+		glGetActiveUniform(program.id, (GLuint)i, (GLsizei)name.size(), &nameLength, &uniform.size, &uniform.type, name.data());
+		uniform.name.assign(name.data(), nameLength);
+
+		// Arrays are reported as "name[0]"
+		size_t bracket = uniform.name.find('[');
+		if (bracket != string::npos)
+			uniform.name.erase(bracket);
+
+		// Uniforms inside blocks have no location and are not set through glUniform*
+		uniform.location = glGetUniformLocation(program.id, uniform.name.c_str());
+		if (uniform.location < 0)
+			continue;
+
+		uniform.shadowOffset = shadowSize;
+		uniform.shadowSize = UUniformTypeSize(uniform.type) * uniform.size;
+		uniform.shadowValid = false;
+		shadowSize += uniform.shadowSize;
+
+		program.uniforms.push_back(uniform);
+	}
+
+	program.shadow.resize(shadowSize);
+}
+
+
+GLint UFindUniform(const UShaderProgram& program, const char* name, GLenum type)
+{
+	for (size_t i = 0; i < program.uniforms.size(); ++i)
+	{
+		const UProgramUniform& uniform = program.uniforms[i];
+		if (uniform.name != name)
+			continue;
+
+		if (uniform.type == type || (type == GL_INT && UIsIntLike(uniform.type)))
+			return (GLint)i;
+
+		cout << "WARNING::PROGRAM::UNIFORM_TYPE_MISMATCH " << name << endl;
+		return -1;
+	}
+
+	// Not an error: the compiler removes uniforms a program does not use
+	return -1;
+}
+
+
+void USetUniform(UShaderProgram& program, UUniform<int> handle, int value)
+{
+	if (handle.index >= 0 && UUpdateShadow(program, handle.index, &value, sizeof(value)))
+		glUniform1i(program.uniforms[handle.index].location, value);
+}
+
+void USetUniform(UShaderProgram& program, UUniform<float> handle, float value)
+{
+	if (handle.index >= 0 && UUpdateShadow(program, handle.index, &value, sizeof(value)))
+		glUniform1f(program.uniforms[handle.index].location, value);
+}
+
+void USetUniform(UShaderProgram& program, UUniform<glm::vec2> handle, const glm::vec2& value)
+{
+	if (handle.index >= 0 && UUpdateShadow(program, handle.index, glm::value_ptr(value), sizeof(value)))
+		glUniform2fv(program.uniforms[handle.index].location, 1, glm::value_ptr(value));
+}
+
+void USetUniform(UShaderProgram& program, UUniform<glm::vec3> handle, const glm::vec3& value)
+{
+	if (handle.index >= 0 && UUpdateShadow(program, handle.index, glm::value_ptr(value), sizeof(value)))
+		glUniform3fv(program.uniforms[handle.index].location, 1, glm::value_ptr(value));
+}
+
+void USetUniform(UShaderProgram& program, UUniform<glm::vec4> handle, const glm::vec4& value)
+{
+	if (handle.index >= 0 && UUpdateShadow(program, handle.index, glm::value_ptr(value), sizeof(value)))
+		glUniform4fv(program.uniforms[handle.index].location, 1, glm::value_ptr(value));
+}
+
+void USetUniform(UShaderProgram& program, UUniform<glm::mat2> handle, const glm::mat2& value)
+{
+	if (handle.index >= 0 && UUpdateShadow(program, handle.index, glm::value_ptr(value), sizeof(value)))
+		glUniformMatrix2fv(program.uniforms[handle.index].location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void USetUniform(UShaderProgram& program, UUniform<glm::mat3> handle, const glm::mat3& value)
+{
+	if (handle.index >= 0 && UUpdateShadow(program, handle.index, glm::value_ptr(value), sizeof(value)))
+		glUniformMatrix3fv(program.uniforms[handle.index].location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+void USetUniform(UShaderProgram& program, UUniform<glm::mat4> handle, const glm::mat4& value)
+{
+	if (handle.index >= 0 && UUpdateShadow(program, handle.index, glm::value_ptr(value), sizeof(value)))
+		glUniformMatrix4fv(program.uniforms[handle.index].location, 1, GL_FALSE, glm::value_ptr(value));
+}
+
+
+bool UBenchmarkUniforms(UShaderProgram& program, const char* name)
+{
+	UUniform<glm::mat4> handle;
+	UGetUniform(program, name, handle);
+	if (handle.index < 0)
+	{
+		cout << "Program has no mat4 uniform " << name << " to benchmark" << endl;
+		return false;
+	}
+
+	// A few distinct values so the driver cannot skip repeated ones either
+	const int ITERATIONS = 200000;
+	glm::mat4 values[16];
+	for (int i = 0; i < 16; ++i)
+		values[i] = glm::mat4(1.0f + (float)i);
+
+	glUseProgram(program.id);
+	const string uniformName = name;
+	const GLint location = program.uniforms[handle.index].location;
+	const char* labels[] = {
+		"name lookup per call (old Shader::setMat4)",
+		"cached location",
+		"cached handle, changing value",
+		"cached handle, repeated value"
+	};
+
+	for (int method = 0; method < 4; ++method)
+	{
+		auto start = chrono::steady_clock::now();
+		for (int i = 0; i < ITERATIONS; ++i)
+		{
+			const glm::mat4& value = values[i & 15];
+			if (method == 0)
+				glUniformMatrix4fv(glGetUniformLocation(program.id, uniformName.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+			else if (method == 1)
+				glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value));
+			else if (method == 2)
+				USetUniform(program, handle, value);
+			else
+				USetUniform(program, handle, values[0]);
+		}
+		glFinish();
+
+		chrono::duration<double, nano> elapsed = chrono::steady_clock::now() - start;
+		cout << "INFO: Uniform " << labels[method] << ": " << elapsed.count() / ITERATIONS << " ns per set" << endl;
+	}
+	return true;
+}
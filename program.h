@@ -0,0 +1,88 @@
+#ifndef PROGRAM_H
+#define PROGRAM_H
+
+#include <GL/glew.h>
+
+#include <glm/glm.hpp>
+
+#include <string>
+#include <vector>
+
+// An active default-block uniform found when the program was linked
+struct UProgramUniform
+{
+	std::string name;
+	GLint location;
+	GLenum type;            // GL_FLOAT_MAT4, GL_FLOAT_VEC3, GL_SAMPLER_2D, ...
+	GLint size;             // Array length, 1 for plain uniforms
+	GLuint shadowOffset;    // Where the last value sent lives in UShaderProgram::shadow
+	GLuint shadowSize;
+	bool shadowValid;       // False until the first value has been sent
+};
+
+// A linked program together with its reflected uniforms and a shadow copy of their values
+struct UShaderProgram
+{
+	GLuint id = 0;
+	std::vector<UProgramUniform> uniforms;
+	std::vector<unsigned char> shadow;
+	// Uniform updates sent to the driver and those skipped because the value was unchanged
+	unsigned long long issuedUpdates = 0;
+	unsigned long long skippedUpdates = 0;
+};
+
+// Typed handle to a reflected uniform, resolved once with UGetUniform
+template<typename T>
+struct UUniform
+{
+	GLint index = -1;       // Index into UShaderProgram::uniforms, -1 when the program does not use it
+};
+
+/* Compiles and links a program, then reflects its uniforms and leaves it current. With a
+ * cache folder the linked binary is kept as <cacheFolder>/<name>.glprog and later runs
+ * load it instead of compiling, as long as the sources and driver are unchanged.
+ */
+bool UCreateShaderProgram(const char* name, const char* vertexSource, const char* fragmentSource, const char* cacheFolder, UShaderProgram& program);
+// The same for a single compute shader, dispatched with glDispatchCompute after glUseProgram
+bool UCreateComputeProgram(const char* name, const char* computeSource, const char* cacheFolder, UShaderProgram& program);
+void UDestroyShaderProgram(UShaderProgram& program);
+
+// Enumerates the active uniforms of a linked program and sizes its shadow copy
+void UReflectProgram(UShaderProgram& program);
+
+// Looks up a reflected uniform by name, returns -1 when it is missing or of another type
+GLint UFindUniform(const UShaderProgram& program, const char* name, GLenum type);
+
+template<typename T> struct UUniformType;
+template<> struct UUniformType<int> { static const GLenum value = GL_INT; };
+template<> struct UUniformType<float> { static const GLenum value = GL_FLOAT; };
+template<> struct UUniformType<glm::vec2> { static const GLenum value = GL_FLOAT_VEC2; };
+template<> struct UUniformType<glm::vec3> { static const GLenum value = GL_FLOAT_VEC3; };
+template<> struct UUniformType<glm::vec4> { static const GLenum value = GL_FLOAT_VEC4; };
+template<> struct UUniformType<glm::mat2> { static const GLenum value = GL_FLOAT_MAT2; };
+template<> struct UUniformType<glm::mat3> { static const GLenum value = GL_FLOAT_MAT3; };
+template<> struct UUniformType<glm::mat4> { static const GLenum value = GL_FLOAT_MAT4; };
+
+// Resolves a typed handle. Samplers and bools resolve as UUniform<int>.
+template<typename T>
+void UGetUniform(const UShaderProgram& program, const char* name, UUniform<T>& handle)
+{
+	handle.index = UFindUniform(program, name, UUniformType<T>::value);
+}
+
+/* Setters. The program must be current. A value equal to the one last sent
+ * through the same program is not passed to the driver at all.
+ */
+void USetUniform(UShaderProgram& program, UUniform<int> handle, int value);
+void USetUniform(UShaderProgram& program, UUniform<float> handle, float value);
+void USetUniform(UShaderProgram& program, UUniform<glm::vec2> handle, const glm::vec2& value);
+void USetUniform(UShaderProgram& program, UUniform<glm::vec3> handle, const glm::vec3& value);
+void USetUniform(UShaderProgram& program, UUniform<glm::vec4> handle, const glm::vec4& value);
+void USetUniform(UShaderProgram& program, UUniform<glm::mat2> handle, const glm::mat2& value);
+void USetUniform(UShaderProgram& program, UUniform<glm::mat3> handle, const glm::mat3& value);
+void USetUniform(UShaderProgram& program, UUniform<glm::mat4> handle, const glm::mat4& value);
+
+// Times setting a mat4 uniform through a name lookup per call against the cached handles and prints the cost per set
+bool UBenchmarkUniforms(UShaderProgram& program, const char* name);
+
+#endif
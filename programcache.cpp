@@ -0,0 +1,128 @@
+#include <fstream>          // ofstream
+#include <cstring>          // memcpy, memcmp
+#include <string>
+#include <vector>
+
+#include "mappedfile.h"
+#include "programcache.h"
+#include "texturecache.h"   // UHashBytes
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	// Cache file layout: this header, then the binary as glGetProgramBinary returned it
+	const char PROGRAM_CACHE_MAGIC[4] = { 'U', 'P', 'R', 'G' };
+	const uint32_t PROGRAM_CACHE_VERSION = 1;
+
+	struct UProgramCacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t headerSize;
+		uint32_t binaryFormat;
+		uint64_t sourceHash;
+		uint64_t driverHash;
+		uint64_t binarySize;
+		double compileMilliseconds;
+	};
+
+	// Binaries only load on the driver build that produced them
+	uint64_t UHashDriver()
+	{
+		string driver;
+		for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+		{
+			const GLubyte* value = glGetString(name);
+			driver += value ? (const char*)value : "";
+			driver += '\n';
+		}
+		return UHashBytes((const unsigned char*)driver.data(), driver.size());
+	}
+
+	bool UProgramBinariesSupported()
+	{
+		GLint formats = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+		return formats > 0;
+	}
+}
+
+
+uint64_t UHashProgramSources(const char* vertexSource, const char* fragmentSource)
+{
+	// The separator keeps moving text from one stage to the other from giving the same key
+	string sources = vertexSource;
+	sources += '\0';
+	sources += fragmentSource;
+	return UHashBytes((const unsigned char*)sources.data(), sources.size());
+}
+
+
+bool ULoadProgramBinary(const char* cacheFilename, uint64_t sourceHash, GLuint programId, double& compileMilliseconds)
+{
+	if (!UProgramBinariesSupported())
+		return false;
+
+	UMappedFile file;
+	if (!UMapFile(cacheFilename, file))
+		return false;
+
+	const UProgramCacheHeader* header = (const UProgramCacheHeader*)file.data;
+	bool valid = file.size >= sizeof(UProgramCacheHeader)
+		&& memcmp(header->magic, PROGRAM_CACHE_MAGIC, sizeof(header->magic)) == 0
+		&& header->version == PROGRAM_CACHE_VERSION
+		&& header->headerSize == sizeof(UProgramCacheHeader)
+		&& header->sourceHash == sourceHash
+		&& header->driverHash == UHashDriver()
+		&& header->binarySize == file.size - sizeof(UProgramCacheHeader);
+
+	if (valid)
+	{
+		glProgramBinary(programId, header->binaryFormat, file.data + sizeof(UProgramCacheHeader), (GLsizei)header->binarySize);
+		GLint linked = GL_FALSE;
+		glGetProgramiv(programId, GL_LINK_STATUS, &linked);
+		valid = linked == GL_TRUE;
+		compileMilliseconds = header->compileMilliseconds;
+	}
+
+	UUnmapFile(file);
+	return valid;
+}
+
+
+bool USaveProgramBinary(const char* cacheFilename, uint64_t sourceHash, GLuint programId, double compileMilliseconds)
+{
+	if (!UProgramBinariesSupported())
+		return false;
+
+	GLint length = 0;
+	glGetProgramiv(programId, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return false;
+
+	vector<unsigned char> binary(length);
+	GLsizei written = 0;
+	GLenum binaryFormat = 0;
+	glGetProgramBinary(programId, length, &written, &binaryFormat, binary.data());
+	if (written <= 0)
+		return false;
+
+	UProgramCacheHeader header = {};
+	memcpy(header.magic, PROGRAM_CACHE_MAGIC, sizeof(header.magic));
+	header.version = PROGRAM_CACHE_VERSION;
+	header.headerSize = sizeof(UProgramCacheHeader);
+	header.binaryFormat = binaryFormat;
+	header.sourceHash = sourceHash;
+	header.driverHash = UHashDriver();
+	header.binarySize = (uint64_t)written;
+	header.compileMilliseconds = compileMilliseconds;
+
+	ofstream file(cacheFilename, ios::binary | ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)binary.data(), written);
+	return file.good();
+}
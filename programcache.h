@@ -0,0 +1,23 @@
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <GL/glew.h>
+
+#include <cstdint>
+
+/* Linked program binaries saved with glGetProgramBinary so later runs can skip
+ * compiling and linking. A cache is only used for the same shader sources on the
+ * same driver: vendor, renderer and version strings all have to match.
+ */
+
+// Identifies a program's sources, the key a cache was built from
+uint64_t UHashProgramSources(const char* vertexSource, const char* fragmentSource);
+
+// Loads a cached binary into programId, which ends up linked. Fails on any mismatch or when the
+// driver rejects the binary, the program can then be compiled as usual. compileMilliseconds gets
+// the time compiling took when the cache was written.
+bool ULoadProgramBinary(const char* cacheFilename, uint64_t sourceHash, GLuint programId, double& compileMilliseconds);
+// Saves a program linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+bool USaveProgramBinary(const char* cacheFilename, uint64_t sourceHash, GLuint programId, double compileMilliseconds);
+
+#endif
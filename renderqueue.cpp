@@ -0,0 +1,104 @@
+#include <cstring>          // memcpy
+
+#include "renderqueue.h"
+
+using namespace std; // Uses the standard namespace
+
+
+USortKey UMakeSortKey(GLuint program, GLuint texture, GLuint vertexArray, float depth)
+{
+	// Non-negative floats order the same as their bit patterns
+	if (!(depth > 0.0f))
+		depth = 0.0f;
+	GLuint depthBits;
+	memcpy(&depthBits, &depth, sizeof(depthBits));
+
+	return ((USortKey)(program & 0xF) << 60)
+		| ((USortKey)(texture & 0xFFFF) << 44)
+		| ((USortKey)(vertexArray & 0xFFF) << 32)
+		| depthBits;
+}
+
+
+void UClearRenderQueue(URenderQueue& queue)
+{
+	queue.items.clear();
+}
+
+
+void UPushDraw(URenderQueue& queue, USortKey key, GLuint item)
+{
+	URenderItem draw;
+	draw.key = key;
+	draw.item = item;
+	queue.items.push_back(draw);
+}
+
+
+void USortRenderQueue(URenderQueue& queue)
+{
+	const size_t count = queue.items.size();
+	if (count < 2)
+		return;
+
+	// One histogram per key byte, all gathered in a single read of the keys
+	size_t histograms[8][256] = {};
+	for (const URenderItem& draw : queue.items)
+	{
+		for (int byte = 0; byte < 8; ++byte)
+			++histograms[byte][(draw.key >> (byte * 8)) & 0xFF];
+	}
+
+	queue.scratch.resize(count);
+	URenderItem* source = queue.items.data();
+	URenderItem* target = queue.scratch.data();
+
+	for (int byte = 0; byte < 8; ++byte)
+	{
+		size_t* histogram = histograms[byte];
+
+		// Every key has the same value in this byte, the pass would not move anything
+		if (histogram[(source[0].key >> (byte * 8)) & 0xFF] == count)
+			continue;
+
+		size_t offset = 0;
+		for (int bucket = 0; bucket < 256; ++bucket)
+		{
+			size_t bucketCount = histogram[bucket];
+			histogram[bucket] = offset;
+			offset += bucketCount;
+		}
+
+		for (size_t i = 0; i < count; ++i)
+			target[histogram[(source[i].key >> (byte * 8)) & 0xFF]++] = source[i];
+
+		URenderItem* swap = source;
+		source = target;
+		target = swap;
+	}
+
+	// An odd number of passes leaves the result in the scratch array
+	if (source != queue.items.data())
+		queue.items.swap(queue.scratch);
+}
+
+
+UStateChanges UCountStateChanges(const URenderQueue& queue)
+{
+	UStateChanges changes;
+	for (size_t i = 0; i < queue.items.size(); ++i)
+	{
+		USortKey key = queue.items[i].key;
+		if (i == 0)
+		{
+			changes.programs = changes.textures = changes.vertexArrays = 1;
+			continue;
+		}
+
+		USortKey previous = queue.items[i - 1].key;
+		changes.programs += USortKeyProgram(key) != USortKeyProgram(previous);
+		changes.textures += USortKeyTexture(key) != USortKeyTexture(previous);
+		changes.vertexArrays += USortKeyVertexArray(key) != USortKeyVertexArray(previous);
+	}
+	return changes;
+}
@@ -0,0 +1,55 @@
+#ifndef RENDERQUEUE_H
+#define RENDERQUEUE_H
+
+#include <GL/glew.h>        // GLuint
+
+#include <vector>
+
+/* Draw sort key, most significant field first so sorting the keys groups draws
+ * by the state that is most expensive to change:
+ *
+ *   63..60  program     (index into the caller's program table)
+ *   59..44  texture     (index into the scene's texture table)
+ *   43..32  vertex array (mesh type)
+ *   31..0   depth       (view distance as float bits, nearest first)
+ */
+typedef unsigned long long USortKey;
+
+// A queued draw: its sort key and what to draw (an object or group index)
+struct URenderItem
+{
+	USortKey key;
+	GLuint item;
+};
+
+// Draws collected for one frame. The scratch array is reused by the radix sort.
+struct URenderQueue
+{
+	std::vector<URenderItem> items;
+	std::vector<URenderItem> scratch;
+};
+
+// Number of times each piece of state changes when walking a queue in order
+struct UStateChanges
+{
+	GLuint programs = 0;
+	GLuint textures = 0;
+	GLuint vertexArrays = 0;
+};
+
+USortKey UMakeSortKey(GLuint program, GLuint texture, GLuint vertexArray, float depth);
+
+inline GLuint USortKeyProgram(USortKey key) { return (GLuint)(key >> 60); }
+inline GLuint USortKeyTexture(USortKey key) { return (GLuint)(key >> 44) & 0xFFFF; }
+inline GLuint USortKeyVertexArray(USortKey key) { return (GLuint)(key >> 32) & 0xFFF; }
+
+void UClearRenderQueue(URenderQueue& queue);
+void UPushDraw(URenderQueue& queue, USortKey key, GLuint item);
+
+// Stable LSD radix sort on the keys, one pass per byte that is not the same in every key
+void USortRenderQueue(URenderQueue& queue);
+
+// Counts the state changes needed to submit the queue in its current order
+UStateChanges UCountStateChanges(const URenderQueue& queue);
+
+#endif
@@ -0,0 +1,577 @@
+#include <iostream>         // cout
+#include <fstream>
+#include <sstream>
+#include <cstring>          // memcpy, memcmp, strcmp
+#include <cstdint>
+#include <cfloat>           // FLT_MAX
+#include <sys/stat.h>       // stat
+
+// GLM Math Header inclusions
+#include <glm/glm.hpp>
+#include <glm/gtx/transform.hpp>
+
+#include "scene.h"
+
+using namespace std; // Uses the standard namespace
+
+/* Scene file format, one statement per line, '#' starts a comment:
+ *
+ *   texture <name> <filename>
+ *   light <px> <py> <pz> <r> <g> <b>
+ *   object <name> <mesh> <texture> <sx> <sy> <sz> <angle> <ax> <ay> <az> <tx> <ty> <tz> [<mode> <first> <count> | @<part> | occluder]...
+ *
+ * <mesh> is one of plane, pyramid, cube, cylinder or cylinder_low, <angle> is in
+ * radians around the axis (ax, ay, az) and <mode> must be triangles.
+ * @<part> draws a named part of a generated mesh: @bottom, @top or @body of a
+ * cylinder. Without any draw ranges the whole mesh is drawn as GL_TRIANGLES.
+ * <first> and <count> address the mesh's optimized index buffer, a triangle list
+ * whose triangle order is only stable inside named parts, so prefer parts where a
+ * mesh has them. The renderer rejects ranges past the end of the index buffer.
+ * occluder marks a large solid object, such as a wall, that hides objects behind it.
+ */
+
+namespace
+{
+	const char* const MESH_NAMES[MESH_COUNT] = { "plane", "pyramid", "cube", "cylinder", "cylinder_low" };
+	const char* const MESH_PART_NAMES[MESH_PART_COUNT] = { "bottom", "top", "body" };
+
+	// Mesh index buffers are welded and reordered into triangle lists, the only mode a range can draw
+	bool UParseDrawMode(const string& name, GLenum& mode)
+	{
+		if (name != "triangles")
+			return false;
+		mode = GL_TRIANGLES;
+		return true;
+	}
+
+	// Appends a zero terminated string to the string table and returns its offset
+	GLuint UAddString(UScene& scene, const string& value)
+	{
+		GLuint offset = (GLuint)scene.strings.size();
+		scene.strings.insert(scene.strings.end(), value.begin(), value.end());
+		scene.strings.push_back('\0');
+		return offset;
+	}
+
+	bool UFindTexture(const UScene& scene, const string& name, GLuint& index)
+	{
+		for (size_t i = 0; i < scene.textures.size(); ++i)
+		{
+			if (name == &scene.strings[scene.textures[i].name])
+			{
+				index = (GLuint)i;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void UReportSceneError(const char* filename, int lineNumber, const string& message)
+	{
+		cout << "ERROR::SCENE::" << filename << ":" << lineNumber << ": " << message << endl;
+	}
+
+	/* Binary scene layout: a header followed by one array per section. Every section
+	 * starts on a SECTION_ALIGNMENT boundary and holds the same structs the renderer
+	 * uses, so a mapped file is used in place with no parsing or allocation.
+	 */
+	const char SCENE_BIN_MAGIC[4] = { 'U', 'S', 'C', 'N' };
+	const uint32_t SCENE_BIN_VERSION = 3;
+	const uint64_t SECTION_ALIGNMENT = 64;
+
+	enum USceneSection
+	{
+		SECTION_STRINGS,
+		SECTION_TEXTURES,
+		SECTION_LIGHTS,
+		SECTION_TRANSFORMS,
+		SECTION_MATERIALS,
+		SECTION_MESHREFS,
+		SECTION_NAMES,
+		SECTION_FLAGS,
+		SECTION_RANGES,
+		SECTION_COUNT
+	};
+
+	// Element size of every section, stored in the header to reject caches written with a different struct layout
+	const uint32_t SECTION_RECORD_SIZES[SECTION_COUNT] = {
+		sizeof(char),
+		sizeof(USceneTexture),
+		sizeof(USceneLight),
+		sizeof(glm::mat4),
+		sizeof(USceneMaterial),
+		sizeof(USceneMeshRef),
+		sizeof(GLuint),
+		sizeof(GLuint),
+		sizeof(USceneDrawRange)
+	};
+
+	struct USceneBinSection
+	{
+		uint64_t offset;    // Byte offset from the start of the file
+		uint64_t count;     // Number of elements
+	};
+
+	struct USceneBinHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t headerSize;
+		uint32_t recordSizes[SECTION_COUNT];
+		uint64_t sourceSize;    // Size and modification time of the text scene the cache was built from
+		int64_t sourceTime;
+		USceneBinSection sections[SECTION_COUNT];
+	};
+
+	bool UGetSourceStamp(const char* filename, uint64_t& size, int64_t& time)
+	{
+		struct stat info;
+		if (stat(filename, &info) != 0)
+			return false;
+		size = (uint64_t)info.st_size;
+		time = (int64_t)info.st_mtime;
+		return true;
+	}
+
+	uint64_t UAlignOffset(uint64_t offset)
+	{
+		return (offset + SECTION_ALIGNMENT - 1) & ~(SECTION_ALIGNMENT - 1);
+	}
+
+	// True if the offset starts a string inside the table. The table ends with a terminator, so every string is terminated.
+	bool UIsStringOffset(const USceneView& view, GLuint offset)
+	{
+		return offset < view.stringSize;
+	}
+
+	// Checks every index a mapped scene stores against the array it indexes
+	bool UValidateSceneIndices(const USceneView& view)
+	{
+		if (view.stringSize > 0 && view.strings[view.stringSize - 1] != '\0')
+			return false;
+
+		for (GLuint i = 0; i < view.textureCount; ++i)
+		{
+			if (!UIsStringOffset(view, view.textures[i].name) || !UIsStringOffset(view, view.textures[i].filename))
+				return false;
+		}
+
+		for (GLuint i = 0; i < view.rangeCount; ++i)
+		{
+			if (view.ranges[i].part > MESH_PART_COUNT)
+				return false;
+		}
+
+		for (GLuint i = 0; i < view.objectCount; ++i)
+		{
+			const USceneMeshRef& meshRef = view.meshRefs[i];
+			if (meshRef.mesh >= MESH_COUNT
+				|| view.materials[i].texture >= view.textureCount
+				|| meshRef.firstRange > view.rangeCount
+				|| meshRef.rangeCount > view.rangeCount - meshRef.firstRange
+				|| !UIsStringOffset(view, view.objectNames[i]))
+				return false;
+		}
+
+		return true;
+	}
+}
+
+
+GLuint UMeshTypeFromName(const char* name)
+{
+	for (GLuint i = 0; i < MESH_COUNT; ++i)
+	{
+		if (strcmp(name, MESH_NAMES[i]) == 0)
+			return i;
+	}
+	return MESH_COUNT;
+}
+
+
+GLuint UMeshPartFromName(const char* name)
+{
+	for (GLuint i = 0; i < MESH_PART_COUNT; ++i)
+	{
+		if (strcmp(name, MESH_PART_NAMES[i]) == 0)
+			return i;
+	}
+	return MESH_PART_COUNT;
+}
+
+
+bool ULoadScene(const char* filename, UScene& scene)
+{
+	ifstream file(filename);
+	if (!file.is_open())
+	{
+		cout << "Failed to open scene " << filename << endl;
+		return false;
+	}
+
+	scene = UScene();
+
+	string line;
+	int lineNumber = 0;
+	while (getline(file, line))
+	{
+		++lineNumber;
+
+		// Strip comments
+		size_t comment = line.find('#');
+		if (comment != string::npos)
+			line.erase(comment);
+
+		istringstream tokens(line);
+		string keyword;
+		if (!(tokens >> keyword))
+			continue; // blank line
+
+		if (keyword == "texture")
+		{
+			string name, textureFilename;
+			if (!(tokens >> name >> textureFilename))
+			{
+				UReportSceneError(filename, lineNumber, "expected: texture <name> <filename>");
+				return false;
+			}
+			USceneTexture texture;
+			texture.name = UAddString(scene, name);
+			texture.filename = UAddString(scene, textureFilename);
+			scene.textures.push_back(texture);
+		}
+		else if (keyword == "light")
+		{
+			USceneLight light;
+			if (!(tokens >> light.position.x >> light.position.y >> light.position.z
+				>> light.color.x >> light.color.y >> light.color.z))
+			{
+				UReportSceneError(filename, lineNumber, "expected: light <px> <py> <pz> <r> <g> <b>");
+				return false;
+			}
+			scene.lights.push_back(light);
+		}
+		else if (keyword == "object")
+		{
+			string name, meshName, textureName;
+			glm::vec3 scale, axis, location;
+			float angle;
+			if (!(tokens >> name >> meshName >> textureName
+				>> scale.x >> scale.y >> scale.z
+				>> angle >> axis.x >> axis.y >> axis.z
+				>> location.x >> location.y >> location.z))
+			{
+				UReportSceneError(filename, lineNumber, "malformed object statement");
+				return false;
+			}
+
+			USceneMeshRef meshRef;
+			USceneMaterial material;
+			meshRef.mesh = UMeshTypeFromName(meshName.c_str());
+			if (meshRef.mesh == MESH_COUNT)
+			{
+				UReportSceneError(filename, lineNumber, "unknown mesh '" + meshName + "'");
+				return false;
+			}
+			if (!UFindTexture(scene, textureName, material.texture))
+			{
+				UReportSceneError(filename, lineNumber, "unknown texture '" + textureName + "'");
+				return false;
+			}
+
+			// Optional draw ranges and flags
+			meshRef.firstRange = (GLuint)scene.ranges.size();
+			GLuint flags = 0;
+			string modeName;
+			while (tokens >> modeName)
+			{
+				if (modeName == "occluder")
+				{
+					flags |= SCENE_OBJECT_OCCLUDER;
+					continue;
+				}
+
+				USceneDrawRange range;
+				if (modeName[0] == '@')
+				{
+					range.mode = GL_TRIANGLES;
+					range.first = 0;
+					range.count = 0;
+					range.part = UMeshPartFromName(modeName.c_str() + 1);
+					if (range.part == MESH_PART_COUNT)
+					{
+						UReportSceneError(filename, lineNumber, "unknown mesh part '" + modeName + "'");
+						return false;
+					}
+				}
+				else
+				{
+					range.part = MESH_PART_COUNT;
+					if (!UParseDrawMode(modeName, range.mode) || !(tokens >> range.first >> range.count)
+						|| range.first < 0 || range.count < 0)
+					{
+						UReportSceneError(filename, lineNumber, "expected: triangles <first> <count>, @<part> or occluder");
+						return false;
+					}
+				}
+				scene.ranges.push_back(range);
+			}
+			meshRef.rangeCount = (GLuint)scene.ranges.size() - meshRef.firstRange;
+
+			// Model matrix: transformations are applied right-to-left order
+			scene.transforms.push_back(glm::translate(location) * glm::rotate(angle, axis) * glm::scale(scale));
+			scene.materials.push_back(material);
+			scene.meshRefs.push_back(meshRef);
+			scene.objectNames.push_back(UAddString(scene, name));
+			scene.objectFlags.push_back(flags);
+		}
+		else
+		{
+			UReportSceneError(filename, lineNumber, "unknown statement '" + keyword + "'");
+			return false;
+		}
+	}
+
+	cout << "INFO: Loaded scene " << filename << ": " << scene.transforms.size() << " objects, "
+		<< scene.textures.size() << " textures, " << scene.lights.size() << " lights" << endl;
+
+	return true;
+}
+
+
+USceneView UGetSceneView(const UScene& scene)
+{
+	USceneView view;
+	view.strings = scene.strings.data();
+	view.textures = scene.textures.data();
+	view.lights = scene.lights.data();
+	view.transforms = scene.transforms.data();
+	view.materials = scene.materials.data();
+	view.meshRefs = scene.meshRefs.data();
+	view.objectNames = scene.objectNames.data();
+	view.objectFlags = scene.objectFlags.data();
+	view.ranges = scene.ranges.data();
+	view.textureCount = (GLuint)scene.textures.size();
+	view.lightCount = (GLuint)scene.lights.size();
+	view.objectCount = (GLuint)scene.transforms.size();
+	view.rangeCount = (GLuint)scene.ranges.size();
+	view.stringSize = (GLuint)scene.strings.size();
+	return view;
+}
+
+
+void UReplicateScene(const USceneView& view, GLuint columns, GLuint rows, UScene& scene)
+{
+	// Footprint of the scene on the XZ plane, every mesh fits in the [-1, 1] cube
+	glm::vec3 boundsMin(FLT_MAX);
+	glm::vec3 boundsMax(-FLT_MAX);
+	for (GLuint object = 0; object < view.objectCount; ++object)
+	{
+		for (int corner = 0; corner < 8; ++corner)
+		{
+			glm::vec4 local((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f, 1.0f);
+			glm::vec3 world = glm::vec3(view.transforms[object] * local);
+			boundsMin = glm::min(boundsMin, world);
+			boundsMax = glm::max(boundsMax, world);
+		}
+	}
+	glm::vec3 spacing = view.objectCount ? boundsMax - boundsMin : glm::vec3(0.0f);
+
+	// Tables shared by every copy
+	scene.strings.assign(view.strings, view.strings + view.stringSize);
+	scene.textures.assign(view.textures, view.textures + view.textureCount);
+	scene.lights.assign(view.lights, view.lights + view.lightCount);
+	scene.ranges.assign(view.ranges, view.ranges + view.rangeCount);
+
+	const size_t copies = (size_t)columns * rows;
+	scene.transforms.clear();
+	scene.materials.clear();
+	scene.meshRefs.clear();
+	scene.objectNames.clear();
+	scene.objectFlags.clear();
+	scene.transforms.reserve(view.objectCount * copies);
+	scene.materials.reserve(view.objectCount * copies);
+	scene.meshRefs.reserve(view.objectCount * copies);
+	scene.objectNames.reserve(view.objectCount * copies);
+	scene.objectFlags.reserve(view.objectCount * copies);
+
+	// The original stays in place, the copies extend along +X and -Z away from the default camera
+	for (GLuint row = 0; row < rows; ++row)
+	{
+		for (GLuint column = 0; column < columns; ++column)
+		{
+			glm::mat4 offset = glm::translate(glm::vec3(column * spacing.x, 0.0f, -(float)row * spacing.z));
+			for (GLuint object = 0; object < view.objectCount; ++object)
+			{
+				scene.transforms.push_back(offset * view.transforms[object]);
+				scene.materials.push_back(view.materials[object]);
+				scene.meshRefs.push_back(view.meshRefs[object]);
+				scene.objectNames.push_back(view.objectNames[object]);
+				scene.objectFlags.push_back(view.objectFlags[object]);
+			}
+		}
+	}
+
+	cout << "INFO: Replicated scene " << columns << "x" << rows << ": " << scene.transforms.size() << " objects" << endl;
+}
+
+
+bool UWriteBinaryScene(const UScene& scene, const char* binFilename, const char* sourceFilename)
+{
+	const void* sectionData[SECTION_COUNT] = {
+		scene.strings.data(),
+		scene.textures.data(),
+		scene.lights.data(),
+		scene.transforms.data(),
+		scene.materials.data(),
+		scene.meshRefs.data(),
+		scene.objectNames.data(),
+		scene.objectFlags.data(),
+		scene.ranges.data()
+	};
+	const uint64_t sectionCounts[SECTION_COUNT] = {
+		scene.strings.size(),
+		scene.textures.size(),
+		scene.lights.size(),
+		scene.transforms.size(),
+		scene.materials.size(),
+		scene.meshRefs.size(),
+		scene.objectNames.size(),
+		scene.objectFlags.size(),
+		scene.ranges.size()
+	};
+
+	USceneBinHeader header = {};
+	memcpy(header.magic, SCENE_BIN_MAGIC, sizeof(header.magic));
+	header.version = SCENE_BIN_VERSION;
+	header.headerSize = sizeof(USceneBinHeader);
+	memcpy(header.recordSizes, SECTION_RECORD_SIZES, sizeof(header.recordSizes));
+	if (sourceFilename)
+		UGetSourceStamp(sourceFilename, header.sourceSize, header.sourceTime);
+
+	uint64_t offset = UAlignOffset(sizeof(USceneBinHeader));
+	for (int i = 0; i < SECTION_COUNT; ++i)
+	{
+		header.sections[i].offset = offset;
+		header.sections[i].count = sectionCounts[i];
+		offset = UAlignOffset(offset + sectionCounts[i] * SECTION_RECORD_SIZES[i]);
+	}
+
+	ofstream file(binFilename, ios::binary | ios::trunc);
+	if (!file.is_open())
+	{
+		cout << "Failed to create binary scene " << binFilename << endl;
+		return false;
+	}
+
+	const char padding[SECTION_ALIGNMENT] = {};
+	uint64_t written = sizeof(USceneBinHeader);
+	file.write((const char*)&header, sizeof(header));
+	for (int i = 0; i < SECTION_COUNT; ++i)
+	{
+		file.write(padding, (streamsize)(header.sections[i].offset - written));
+		uint64_t bytes = sectionCounts[i] * SECTION_RECORD_SIZES[i];
+		file.write((const char*)sectionData[i], (streamsize)bytes);
+		written = header.sections[i].offset + bytes;
+	}
+
+	if (!file.good())
+	{
+		cout << "Failed to write binary scene " << binFilename << endl;
+		return false;
+	}
+
+	return true;
+}
+
+
+bool UViewBinaryScene(const unsigned char* data, size_t size, USceneView& view)
+{
+	// The header is validated first, then every index stored in the arrays
+	const USceneBinHeader* header = (const USceneBinHeader*)data;
+	bool valid = size >= sizeof(USceneBinHeader)
+		&& memcmp(header->magic, SCENE_BIN_MAGIC, sizeof(header->magic)) == 0
+		&& header->version == SCENE_BIN_VERSION
+		&& header->headerSize == sizeof(USceneBinHeader)
+		&& memcmp(header->recordSizes, SECTION_RECORD_SIZES, sizeof(SECTION_RECORD_SIZES)) == 0;
+
+	for (int i = 0; valid && i < SECTION_COUNT; ++i)
+	{
+		const USceneBinSection& section = header->sections[i];
+		valid = section.offset % SECTION_ALIGNMENT == 0
+			&& section.offset <= size
+			&& section.count <= (size - section.offset) / SECTION_RECORD_SIZES[i]
+			&& section.count <= UINT32_MAX;
+	}
+
+	// The per-object arrays must agree with each other
+	if (!valid
+		|| header->sections[SECTION_MATERIALS].count != header->sections[SECTION_TRANSFORMS].count
+		|| header->sections[SECTION_MESHREFS].count != header->sections[SECTION_TRANSFORMS].count
+		|| header->sections[SECTION_NAMES].count != header->sections[SECTION_TRANSFORMS].count
+		|| header->sections[SECTION_FLAGS].count != header->sections[SECTION_TRANSFORMS].count)
+		return false;
+
+	view.strings = (const char*)(data + header->sections[SECTION_STRINGS].offset);
+	view.textures = (const USceneTexture*)(data + header->sections[SECTION_TEXTURES].offset);
+	view.lights = (const USceneLight*)(data + header->sections[SECTION_LIGHTS].offset);
+	view.transforms = (const glm::mat4*)(data + header->sections[SECTION_TRANSFORMS].offset);
+	view.materials = (const USceneMaterial*)(data + header->sections[SECTION_MATERIALS].offset);
+	view.meshRefs = (const USceneMeshRef*)(data + header->sections[SECTION_MESHREFS].offset);
+	view.objectNames = (const GLuint*)(data + header->sections[SECTION_NAMES].offset);
+	view.objectFlags = (const GLuint*)(data + header->sections[SECTION_FLAGS].offset);
+	view.ranges = (const USceneDrawRange*)(data + header->sections[SECTION_RANGES].offset);
+	view.textureCount = (GLuint)header->sections[SECTION_TEXTURES].count;
+	view.lightCount = (GLuint)header->sections[SECTION_LIGHTS].count;
+	view.objectCount = (GLuint)header->sections[SECTION_TRANSFORMS].count;
+	view.rangeCount = (GLuint)header->sections[SECTION_RANGES].count;
+	view.stringSize = (GLuint)header->sections[SECTION_STRINGS].count;
+	if (!UValidateSceneIndices(view))
+	{
+		view = USceneView();
+		return false;
+	}
+	return true;
+}
+
+
+bool UMapBinaryScene(const char* binFilename, const char* sourceFilename, UMappedFile& file, USceneView& view)
+{
+	if (!UMapFile(binFilename, file))
+		return false;
+
+	bool valid = UViewBinaryScene(file.data, file.size, view);
+
+	// Reject caches built from an older version of the text scene
+	if (valid && sourceFilename)
+	{
+		const USceneBinHeader* header = (const USceneBinHeader*)file.data;
+		uint64_t sourceSize;
+		int64_t sourceTime;
+		valid = UGetSourceStamp(sourceFilename, sourceSize, sourceTime)
+			&& sourceSize == header->sourceSize && sourceTime == header->sourceTime;
+	}
+
+	if (!valid)
+	{
+		UUnmapFile(file);
+		view = USceneView();
+		return false;
+	}
+
+	return true;
+}
+
+
+bool UConvertScene(const char* sceneFilename, const char* binFilename)
+{
+	UScene scene;
+	if (!ULoadScene(sceneFilename, scene))
+		return false;
+
+	if (!UWriteBinaryScene(scene, binFilename, sceneFilename))
+		return false;
+
+	cout << "INFO: Wrote binary scene " << binFilename << endl;
+	return true;
+}
@@ -0,0 +1,134 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <GL/glew.h>        // GLenum, GLuint
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "mappedfile.h"
+
+// Mesh shapes the renderer builds at startup. Scene files refer to them by name.
+enum UMeshType
+{
+	MESH_PLANE,
+	MESH_PYRAMID,
+	MESH_CUBE,
+	MESH_CYLINDER,
+	MESH_CYLINDER_LOW,      // Same shape with fewer segments for small objects
+	MESH_COUNT
+};
+
+// Named sub-ranges a generated mesh can expose. Scene files refer to them as @<name>.
+enum UMeshPart
+{
+	MESH_PART_BOTTOM,
+	MESH_PART_TOP,
+	MESH_PART_BODY,
+	MESH_PART_COUNT
+};
+
+// A single draw call made for an object, either an explicit range of the mesh's
+// index buffer or a named part of the mesh that the renderer looks up when drawing
+struct USceneDrawRange
+{
+	GLenum mode;        // GL_TRIANGLES, the only mode that fits the triangle list index buffers
+	GLint first;        // First index of the range
+	GLsizei count;      // Number of indices in the range
+	GLuint part;        // UMeshPart, MESH_PART_COUNT for an explicit range
+};
+
+// Which mesh an object draws and how
+struct USceneMeshRef
+{
+	GLuint mesh;        // UMeshType of the mesh to draw
+	GLuint firstRange;  // First entry in the draw range table
+	GLuint rangeCount;  // Number of draw ranges, 0 draws the whole mesh as GL_TRIANGLES
+};
+
+// Flags of an object
+enum USceneObjectFlag
+{
+	SCENE_OBJECT_OCCLUDER = 1 << 0,     // Large and solid, drawn into the occlusion buffer to hide what is behind it
+};
+
+// Surface properties of an object
+struct USceneMaterial
+{
+	GLuint texture;     // Index into the texture table
+};
+
+// A texture referenced by the scene, both names are offsets into the string table
+struct USceneTexture
+{
+	GLuint name;
+	GLuint filename;
+};
+
+// A point light feeding the surface shader
+struct USceneLight
+{
+	glm::vec3 position;
+	glm::vec3 color;
+};
+
+/* Everything loaded from a text scene file. Objects are stored as parallel
+ * arrays (transforms, materials, meshRefs) so they can be written to and mapped
+ * from the binary scene cache without any per-object conversion.
+ */
+struct UScene
+{
+	std::vector<char> strings;              // Zero terminated names and filenames
+	std::vector<USceneTexture> textures;
+	std::vector<USceneLight> lights;
+	std::vector<glm::mat4> transforms;      // Model matrix per object: translation * rotation * scale
+	std::vector<USceneMaterial> materials;
+	std::vector<USceneMeshRef> meshRefs;
+	std::vector<GLuint> objectNames;        // String table offset per object, only used for diagnostics
+	std::vector<GLuint> objectFlags;        // USceneObjectFlag bits per object
+	std::vector<USceneDrawRange> ranges;
+};
+
+// Read-only view over the scene arrays the renderer walks. It either points into a
+// UScene or straight into a memory-mapped binary scene.
+struct USceneView
+{
+	const char* strings = nullptr;
+	const USceneTexture* textures = nullptr;
+	const USceneLight* lights = nullptr;
+	const glm::mat4* transforms = nullptr;
+	const USceneMaterial* materials = nullptr;
+	const USceneMeshRef* meshRefs = nullptr;
+	const GLuint* objectNames = nullptr;
+	const GLuint* objectFlags = nullptr;
+	const USceneDrawRange* ranges = nullptr;
+	GLuint textureCount = 0;
+	GLuint lightCount = 0;
+	GLuint objectCount = 0;
+	GLuint rangeCount = 0;
+	GLuint stringSize = 0;      // Bytes in the string table
+};
+
+// Parses a text scene description into a flat object table
+bool ULoadScene(const char* filename, UScene& scene);
+// Returns a view over the arrays owned by the scene
+USceneView UGetSceneView(const UScene& scene);
+// Fills the scene with columns x rows copies of the view laid side by side on the XZ plane
+void UReplicateScene(const USceneView& view, GLuint columns, GLuint rows, UScene& scene);
+// Returns the UMeshType for a mesh name, or MESH_COUNT if the name is unknown
+GLuint UMeshTypeFromName(const char* name);
+// Returns the UMeshPart for a part name, or MESH_PART_COUNT if the name is unknown
+GLuint UMeshPartFromName(const char* name);
+
+// Writes the scene as a binary cache that UMapBinaryScene can use in place
+bool UWriteBinaryScene(const UScene& scene, const char* binFilename, const char* sourceFilename);
+// Maps a binary scene and points the view at it. The mapping must outlive the view.
+// With a source filename, fails if the cache was built from a different version of it.
+bool UMapBinaryScene(const char* binFilename, const char* sourceFilename, UMappedFile& file, USceneView& view);
+// Points the view at a binary scene already in memory, such as one inside an asset pack
+bool UViewBinaryScene(const unsigned char* data, size_t size, USceneView& view);
+// Converts a text scene to a binary scene
+bool UConvertScene(const char* sceneFilename, const char* binFilename);
+
+#endif
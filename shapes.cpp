@@ -0,0 +1,100 @@
+#include <cmath>            // cos, sin
+
+#include "shapes.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	// Appends one interleaved vertex and advances the write pointer
+	inline void UPutVertex(float*& out, float x, float y, float z, float nx, float ny, float nz, float u, float v)
+	{
+		out[0] = x;
+		out[1] = y;
+		out[2] = z;
+		out[3] = nx;
+		out[4] = ny;
+		out[5] = nz;
+		out[6] = u;
+		out[7] = v;
+		out += 8;
+	}
+
+	// Writes one cap as a fan of separate triangles around its centre
+	void UPutCap(float*& out, const UCylinderDesc& desc, float y, float ny)
+	{
+		const float step = desc.arcAngle / desc.segments;
+		for (GLuint i = 0; i < desc.segments; ++i)
+		{
+			float a = desc.arcStart + step * i;
+			float b = a + step;
+			float ax = cosf(a), az = -sinf(a);
+			float bx = cosf(b), bz = -sinf(b);
+
+			// Caps map the unit disc onto the whole texture
+			UPutVertex(out, 0.0f, y, 0.0f, 0.0f, ny, 0.0f, 0.5f, 0.5f);
+			if (ny > 0.0f)
+			{
+				UPutVertex(out, ax, y, az, 0.0f, ny, 0.0f, 0.5f - 0.5f * az, 0.5f - 0.5f * ax);
+				UPutVertex(out, bx, y, bz, 0.0f, ny, 0.0f, 0.5f - 0.5f * bz, 0.5f - 0.5f * bx);
+			}
+			else
+			{
+				UPutVertex(out, bx, y, bz, 0.0f, ny, 0.0f, 0.5f - 0.5f * bz, 0.5f - 0.5f * bx);
+				UPutVertex(out, ax, y, az, 0.0f, ny, 0.0f, 0.5f - 0.5f * az, 0.5f - 0.5f * ax);
+			}
+		}
+	}
+}
+
+
+GLuint UCylinderVertexCount(const UCylinderDesc& desc)
+{
+	GLuint capVertices = desc.segments * 3;
+	return (desc.bottomCap ? capVertices : 0) + (desc.topCap ? capVertices : 0) + desc.segments * 6;
+}
+
+
+GLuint UBuildCylinder(const UCylinderDesc& desc, float* vertices, GLuint vertexCapacity, UCylinderRanges& ranges)
+{
+	const GLuint vertexCount = UCylinderVertexCount(desc);
+	if (desc.segments == 0 || vertexCapacity < vertexCount)
+		return 0;
+
+	const GLsizei capVertices = desc.segments * 3;
+	float* out = vertices;
+
+	ranges.bottom.first = 0;
+	ranges.bottom.count = desc.bottomCap ? capVertices : 0;
+	if (desc.bottomCap)
+		UPutCap(out, desc, 0.0f, -1.0f);
+
+	ranges.top.first = ranges.bottom.first + ranges.bottom.count;
+	ranges.top.count = desc.topCap ? capVertices : 0;
+	if (desc.topCap)
+		UPutCap(out, desc, 1.0f, 1.0f);
+
+	// Body: two triangles per segment, smooth normals, U wraps once around the arc
+	ranges.body.first = ranges.top.first + ranges.top.count;
+	ranges.body.count = desc.segments * 6;
+
+	const float step = desc.arcAngle / desc.segments;
+	for (GLuint i = 0; i < desc.segments; ++i)
+	{
+		float a = desc.arcStart + step * i;
+		float b = a + step;
+		float ax = cosf(a), az = -sinf(a);
+		float bx = cosf(b), bz = -sinf(b);
+		float ua = (float)i / desc.segments;
+		float ub = (float)(i + 1) / desc.segments;
+
+		UPutVertex(out, ax, 0.0f, az, ax, 0.0f, az, ua, 0.0f);
+		UPutVertex(out, bx, 0.0f, bz, bx, 0.0f, bz, ub, 0.0f);
+		UPutVertex(out, bx, 1.0f, bz, bx, 0.0f, bz, ub, 1.0f);
+		UPutVertex(out, ax, 0.0f, az, ax, 0.0f, az, ua, 0.0f);
+		UPutVertex(out, bx, 1.0f, bz, bx, 0.0f, bz, ub, 1.0f);
+		UPutVertex(out, ax, 1.0f, az, ax, 0.0f, az, ua, 1.0f);
+	}
+
+	return vertexCount;
+}
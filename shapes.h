@@ -0,0 +1,43 @@
+#ifndef SHAPES_H
+#define SHAPES_H
+
+#include <GL/glew.h>        // GLint, GLsizei, GLuint
+
+// A run of vertices inside a generated shape, drawn as GL_TRIANGLES
+struct UShapeRange
+{
+	GLint first;
+	GLsizei count;
+};
+
+/* A unit cylinder around the Y axis: radius 1, from y = 0 to y = 1. The arc starts
+ * at +X and turns towards -Z, a full turn gives a closed cylinder and anything less
+ * a partial arc (the caps become pie slices, the cut sides are left open).
+ */
+struct UCylinderDesc
+{
+	GLuint segments = 36;
+	float arcStart = 0.0f;                      // Radians
+	float arcAngle = 6.28318530718f;            // Radians, 2 pi for a full cylinder
+	bool bottomCap = true;
+	bool topCap = true;
+};
+
+// Named sub-ranges of a generated cylinder, a missing cap has a count of 0
+struct UCylinderRanges
+{
+	UShapeRange bottom;
+	UShapeRange top;
+	UShapeRange body;
+};
+
+// Vertices UBuildCylinder writes for the description
+GLuint UCylinderVertexCount(const UCylinderDesc& desc);
+
+/* Writes the cylinder as GL_TRIANGLES straight into the caller's buffer, interleaved
+ * as position (3), normal (3) and texture coordinate (2) floats. Returns the number of
+ * vertices written, or 0 when vertexCapacity is smaller than UCylinderVertexCount.
+ */
+GLuint UBuildCylinder(const UCylinderDesc& desc, float* vertices, GLuint vertexCapacity, UCylinderRanges& ranges);
+
+#endif
@@ -0,0 +1,390 @@
+#include <algorithm>        // min, max
+#include <cmath>            // floor
+#include <limits>           // infinity
+
+#include "spatialgrid.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	// Cell coordinates packed 21 bits each into a key
+	const int64_t KEY_OFFSET = 1 << 20;
+	const uint64_t KEY_MASK = (1 << 21) - 1;
+
+	uint64_t UCellKey(const glm::ivec3& cell)
+	{
+		return ((uint64_t)(cell.x + KEY_OFFSET) & KEY_MASK) << 42
+			| ((uint64_t)(cell.y + KEY_OFFSET) & KEY_MASK) << 21
+			| ((uint64_t)(cell.z + KEY_OFFSET) & KEY_MASK);
+	}
+
+	glm::ivec3 UCellOf(const USpatialGrid& grid, const glm::vec3& point)
+	{
+		return glm::ivec3(glm::floor(point / grid.cellSize));
+	}
+
+	// Cells whose loose boxes touch the box, limited to the occupied ones. Fails when there are none.
+	bool UCellRange(const USpatialGrid& grid, const UBounds& box, glm::ivec3& first, glm::ivec3& last)
+	{
+		// Clamped as floats, a box reaching far past the grid would overflow the coordinates
+		const float half = grid.cellSize * 0.5f;
+		const glm::vec3 low = glm::floor((box.min - glm::vec3(half)) / grid.cellSize);
+		const glm::vec3 high = glm::floor((box.max + glm::vec3(half)) / grid.cellSize);
+		first = glm::ivec3(glm::max(low, glm::vec3(grid.cellMin)));
+		last = glm::ivec3(glm::min(high, glm::vec3(grid.cellMax)));
+		return !grid.cells.empty() && first.x <= last.x && first.y <= last.y && first.z <= last.z;
+	}
+
+	float UCellRangeVolume(const glm::ivec3& first, const glm::ivec3& last)
+	{
+		const glm::vec3 span = glm::vec3(last - first) + glm::vec3(1.0f);
+		return span.x * span.y * span.z;
+	}
+
+	// Everything the objects of a cell can cover, half a cell past each side
+	UBounds ULooseCellBounds(const USpatialGrid& grid, const glm::ivec3& cell)
+	{
+		const glm::vec3 corner = glm::vec3(cell) * grid.cellSize;
+		const float half = grid.cellSize * 0.5f;
+		return { corner - glm::vec3(half), corner + glm::vec3(grid.cellSize + half) };
+	}
+
+	enum UFrustumOverlap { FRUSTUM_OUTSIDE, FRUSTUM_CROSSES, FRUSTUM_INSIDE };
+
+	// Tests both corners of the box against each plane in one pass
+	UFrustumOverlap UClassifyBox(const UBounds& box, const UFrustum& frustum)
+	{
+		UFrustumOverlap overlap = FRUSTUM_INSIDE;
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			const glm::vec3 normal(plane);
+			const glm::vec3 furthest(plane.x >= 0.0f ? box.max.x : box.min.x,
+				plane.y >= 0.0f ? box.max.y : box.min.y,
+				plane.z >= 0.0f ? box.max.z : box.min.z);
+			if (glm::dot(normal, furthest) + plane.w < 0.0f)
+				return FRUSTUM_OUTSIDE;
+			const glm::vec3 nearest(plane.x >= 0.0f ? box.min.x : box.max.x,
+				plane.y >= 0.0f ? box.min.y : box.max.y,
+				plane.z >= 0.0f ? box.min.z : box.max.z);
+			if (glm::dot(normal, nearest) + plane.w < 0.0f)
+				overlap = FRUSTUM_CROSSES;
+		}
+		return overlap;
+	}
+
+	// Box around the points where the side planes meet the near and far planes.
+	// Fails when planes are parallel, the corners are then too far out to help.
+	bool UFrustumBox(const UFrustum& frustum, UBounds& box)
+	{
+		box = { glm::vec3(numeric_limits<float>::max()), glm::vec3(-numeric_limits<float>::max()) };
+		for (int i = 0; i < 8; ++i)
+		{
+			const glm::vec4& a = frustum.planes[i & 1];
+			const glm::vec4& b = frustum.planes[2 + ((i >> 1) & 1)];
+			const glm::vec4& c = frustum.planes[4 + (i >> 2)];
+			const glm::vec3 bc = glm::cross(glm::vec3(b), glm::vec3(c));
+			const float determinant = glm::dot(glm::vec3(a), bc);
+			if (fabs(determinant) < 1e-6f)
+				return false;
+
+			const glm::vec3 corner = -(a.w * bc + b.w * glm::cross(glm::vec3(c), glm::vec3(a))
+				+ c.w * glm::cross(glm::vec3(a), glm::vec3(b))) / determinant;
+			box.min = glm::min(box.min, corner);
+			box.max = glm::max(box.max, corner);
+		}
+
+		// Rounding in the intersections must not lose cells a box touches by a hair
+		const glm::vec3 margin = (box.max - box.min) * 0.001f;
+		box.min -= margin;
+		box.max += margin;
+		return true;
+	}
+
+	void URayTestObjects(const USpatialGrid& grid, const vector<GLuint>& objects, const glm::vec3& origin, const glm::vec3& inverseDirection,
+		bool& hit, GLuint& object, float& distance)
+	{
+		for (GLuint candidate : objects)
+		{
+			float entry;
+			if (URayEntersBox(grid.bounds[candidate], origin, inverseDirection, distance, entry) && (!hit || entry < distance))
+			{
+				hit = true;
+				object = candidate;
+				distance = entry;
+			}
+		}
+	}
+
+	void URayTestCell(const USpatialGrid& grid, const glm::ivec3& cell, const glm::vec3& origin, const glm::vec3& inverseDirection,
+		bool& hit, GLuint& object, float& distance)
+	{
+		// Most neighbours of the walk are beside the ray, not on it
+		float entry;
+		if (!URayEntersBox(ULooseCellBounds(grid, cell), origin, inverseDirection, distance, entry))
+			return;
+
+		auto found = grid.cellIndices.find(UCellKey(cell));
+		if (found != grid.cellIndices.end())
+			URayTestObjects(grid, grid.cells[found->second].objects, origin, inverseDirection, hit, object, distance);
+	}
+
+	// Index of the cell, added when it is new
+	GLuint UFindOrAddCell(USpatialGrid& grid, const glm::ivec3& coordinates)
+	{
+		auto found = grid.cellIndices.emplace(UCellKey(coordinates), (GLuint)grid.cells.size());
+		if (found.second)
+		{
+			grid.cellMin = grid.cells.empty() ? coordinates : glm::min(grid.cellMin, coordinates);
+			grid.cellMax = grid.cells.empty() ? coordinates : glm::max(grid.cellMax, coordinates);
+			grid.cells.push_back({ coordinates, {} });
+		}
+		return found.first->second;
+	}
+
+	// Whether a box of this size centered in the cell stays within half a cell of it
+	bool UFitsCell(const USpatialGrid& grid, const UBounds& bounds)
+	{
+		const glm::vec3 halfSize = (bounds.max - bounds.min) * 0.5f;
+		return max(max(halfSize.x, halfSize.y), halfSize.z) <= grid.cellSize * 0.5f;
+	}
+}
+
+
+void UResetSpatialGrid(USpatialGrid& grid, float cellSize)
+{
+	grid = USpatialGrid();
+	grid.cellSize = cellSize;
+}
+
+
+void UInsertGridObject(USpatialGrid& grid, GLuint object, const UBounds& bounds)
+{
+	if (object >= grid.bounds.size())
+	{
+		grid.bounds.resize(object + 1);
+		grid.objectCells.resize(object + 1);
+		grid.slots.resize(object + 1);
+		grid.present.resize(object + 1, 0);
+	}
+	if (grid.present[object])
+		URemoveGridObject(grid, object);
+
+	// Boxes reaching more than half a cell past their center's cell would escape the loose cell
+	vector<GLuint>* list = &grid.large;
+	grid.objectCells[object] = GRID_LARGE_OBJECT;
+	if (UFitsCell(grid, bounds))
+	{
+		grid.objectCells[object] = UFindOrAddCell(grid, UCellOf(grid, (bounds.min + bounds.max) * 0.5f));
+		list = &grid.cells[grid.objectCells[object]].objects;
+	}
+
+	grid.bounds[object] = bounds;
+	grid.slots[object] = (GLuint)list->size();
+	grid.present[object] = 1;
+	list->push_back(object);
+}
+
+
+void URemoveGridObject(USpatialGrid& grid, GLuint object)
+{
+	if (object >= grid.present.size() || !grid.present[object])
+		return;
+
+	// Swap with the last object of the list, whose slot changes
+	const GLuint cell = grid.objectCells[object];
+	vector<GLuint>& list = cell == GRID_LARGE_OBJECT ? grid.large : grid.cells[cell].objects;
+	const GLuint last = list.back();
+	list[grid.slots[object]] = last;
+	grid.slots[last] = grid.slots[object];
+	list.pop_back();
+	grid.present[object] = 0;
+}
+
+
+void UMoveGridObject(USpatialGrid& grid, GLuint object, const UBounds& bounds)
+{
+	// Most moves stay in the same cell and only update the box
+	if (object < grid.present.size() && grid.present[object] && grid.objectCells[object] != GRID_LARGE_OBJECT
+		&& UCellOf(grid, (bounds.min + bounds.max) * 0.5f) == grid.cells[grid.objectCells[object]].coordinates
+		&& UFitsCell(grid, bounds))
+	{
+		grid.bounds[object] = bounds;
+		return;
+	}
+
+	UInsertGridObject(grid, object, bounds);
+}
+
+
+void UCullGrid(const USpatialGrid& grid, const UFrustum& frustum, vector<GLuint>& visible)
+{
+	for (GLuint object : grid.large)
+	{
+		if (UBoxTouchesFrustum(grid.bounds[object], frustum))
+			visible.push_back(object);
+	}
+
+	auto cullCell = [&](const UGridCell& cell)
+	{
+		if (cell.objects.empty())
+			return;
+
+		const UFrustumOverlap overlap = UClassifyBox(ULooseCellBounds(grid, cell.coordinates), frustum);
+		if (overlap == FRUSTUM_INSIDE)
+			visible.insert(visible.end(), cell.objects.begin(), cell.objects.end());
+		else if (overlap == FRUSTUM_CROSSES)
+		{
+			for (GLuint object : cell.objects)
+			{
+				if (UBoxTouchesFrustum(grid.bounds[object], frustum))
+					visible.push_back(object);
+			}
+		}
+	};
+
+	// A view covering fewer cells than are occupied looks its cells up, otherwise every cell is tested
+	UBounds view;
+	glm::ivec3 first, last;
+	if (UFrustumBox(frustum, view))
+	{
+		if (!UCellRange(grid, view, first, last))
+			return;
+		if (UCellRangeVolume(first, last) < (float)grid.cells.size())
+		{
+			for (int x = first.x; x <= last.x; ++x)
+			{
+				for (int y = first.y; y <= last.y; ++y)
+				{
+					for (int z = first.z; z <= last.z; ++z)
+					{
+						auto found = grid.cellIndices.find(UCellKey(glm::ivec3(x, y, z)));
+						if (found != grid.cellIndices.end())
+							cullCell(grid.cells[found->second]);
+					}
+				}
+			}
+			return;
+		}
+	}
+
+	for (const UGridCell& cell : grid.cells)
+		cullCell(cell);
+}
+
+
+bool URaycastGrid(const USpatialGrid& grid, const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+	GLuint& object, float& distance)
+{
+	const glm::vec3 inverseDirection = 1.0f / direction;
+	bool hit = false;
+	distance = maxDistance;
+	URayTestObjects(grid, grid.large, origin, inverseDirection, hit, object, distance);
+
+	/* Walk the cells the ray passes through. A box the ray enters at some distance
+	 * belongs to a cell next to the one the ray is in at that distance, so each cell
+	 * stepped into adds the face of neighbours ahead of it, and the walk ends once
+	 * the next cell starts beyond the nearest hit or the block leaves the occupied cells.
+	 * Rays from outside start where they enter the occupied cells.
+	 */
+	const float half = grid.cellSize * 0.5f;
+	const UBounds occupied = { glm::vec3(grid.cellMin) * grid.cellSize - glm::vec3(half),
+		glm::vec3(grid.cellMax + glm::ivec3(1)) * grid.cellSize + glm::vec3(half) };
+	float start;
+	if (grid.cells.empty() || !URayEntersBox(occupied, origin, inverseDirection, distance, start))
+		return hit;
+
+	glm::ivec3 cell = UCellOf(grid, origin + direction * start);
+	const glm::ivec3 step(direction.x >= 0.0f ? 1 : -1, direction.y >= 0.0f ? 1 : -1, direction.z >= 0.0f ? 1 : -1);
+	const glm::vec3 delta = glm::abs(glm::vec3(grid.cellSize) * inverseDirection);
+	glm::vec3 next;
+	for (int axis = 0; axis < 3; ++axis)
+	{
+		const float boundary = (cell[axis] + (step[axis] > 0 ? 1 : 0)) * grid.cellSize;
+		next[axis] = direction[axis] != 0.0f ? (boundary - origin[axis]) * inverseDirection[axis] : numeric_limits<float>::infinity();
+	}
+
+	for (int x = -1; x <= 1; ++x)
+		for (int y = -1; y <= 1; ++y)
+			for (int z = -1; z <= 1; ++z)
+				URayTestCell(grid, cell + glm::ivec3(x, y, z), origin, inverseDirection, hit, object, distance);
+
+	while (true)
+	{
+		const int axis = next.x <= next.y && next.x <= next.z ? 0 : (next.y <= next.z ? 1 : 2);
+		if (next[axis] > distance)
+			break;
+
+		cell[axis] += step[axis];
+		next[axis] += delta[axis];
+		if (step[axis] > 0 ? cell[axis] - 1 > grid.cellMax[axis] : cell[axis] + 1 < grid.cellMin[axis])
+			break;
+
+		// The face of the 3x3x3 block that is new after the step
+		const int u = (axis + 1) % 3;
+		const int v = (axis + 2) % 3;
+		for (int i = -1; i <= 1; ++i)
+		{
+			for (int j = -1; j <= 1; ++j)
+			{
+				glm::ivec3 neighbour = cell;
+				neighbour[axis] += step[axis];
+				neighbour[u] += i;
+				neighbour[v] += j;
+				URayTestCell(grid, neighbour, origin, inverseDirection, hit, object, distance);
+			}
+		}
+	}
+	return hit;
+}
+
+
+void UQueryGridSphere(const USpatialGrid& grid, const glm::vec3& center, float radius, vector<GLuint>& results)
+{
+	for (GLuint object : grid.large)
+	{
+		if (UBoxTouchesSphere(grid.bounds[object], center, radius))
+			results.push_back(object);
+	}
+
+	glm::ivec3 first, last;
+	if (!UCellRange(grid, { center - glm::vec3(radius), center + glm::vec3(radius) }, first, last))
+		return;
+
+	auto testCell = [&](const UGridCell& cell)
+	{
+		if (!UBoxTouchesSphere(ULooseCellBounds(grid, cell.coordinates), center, radius))
+			return;
+		for (GLuint object : cell.objects)
+		{
+			if (UBoxTouchesSphere(grid.bounds[object], center, radius))
+				results.push_back(object);
+		}
+	};
+
+	// A sphere covering more cells than are occupied is cheaper to answer from the occupied ones
+	if (UCellRangeVolume(first, last) > (float)grid.cells.size())
+	{
+		for (const UGridCell& cell : grid.cells)
+		{
+			const glm::ivec3& coordinates = cell.coordinates;
+			if (coordinates.x >= first.x && coordinates.y >= first.y && coordinates.z >= first.z
+				&& coordinates.x <= last.x && coordinates.y <= last.y && coordinates.z <= last.z)
+				testCell(cell);
+		}
+		return;
+	}
+
+	for (int x = first.x; x <= last.x; ++x)
+	{
+		for (int y = first.y; y <= last.y; ++y)
+		{
+			for (int z = first.z; z <= last.z; ++z)
+			{
+				auto found = grid.cellIndices.find(UCellKey(glm::ivec3(x, y, z)));
+				if (found != grid.cellIndices.end())
+					testCell(grid.cells[found->second]);
+			}
+		}
+	}
+}
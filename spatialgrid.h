@@ -0,0 +1,59 @@
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include <GL/glew.h>        // GLuint
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "bvh.h"            // UBounds
+#include "culling.h"        // UFrustum
+
+/* Loose uniform grid over object boxes, hashed so only occupied cells take memory.
+ * An object lives in the one cell holding the center of its box, so inserting,
+ * moving and removing it touch a single cell. A box may reach half a cell past its
+ * cell, so queries look at the cells around what they cover. Objects too big for
+ * that are kept in a list every query tests. Cells that empty out keep their
+ * list, so objects moving back and forth do not reallocate.
+ */
+struct UGridCell
+{
+	glm::ivec3 coordinates;
+	std::vector<GLuint> objects;
+};
+
+struct USpatialGrid
+{
+	float cellSize = 1.0f;
+	std::vector<UGridCell> cells;                       // Dense so queries walk them in order
+	std::unordered_map<uint64_t, GLuint> cellIndices;   // Packed coordinates to index in cells
+	glm::ivec3 cellMin, cellMax;                        // Coordinates every cell lies within
+	std::vector<GLuint> large;
+	// Per object: its box, the cell holding it and its position in that cell's list
+	std::vector<UBounds> bounds;
+	std::vector<GLuint> objectCells;
+	std::vector<GLuint> slots;
+	std::vector<unsigned char> present;
+};
+
+// Marks the cell of objects in the large list
+const GLuint GRID_LARGE_OBJECT = ~0u;
+
+// Empties the grid and sets its cell size
+void UResetSpatialGrid(USpatialGrid& grid, float cellSize);
+
+void UInsertGridObject(USpatialGrid& grid, GLuint object, const UBounds& bounds);
+void URemoveGridObject(USpatialGrid& grid, GLuint object);
+void UMoveGridObject(USpatialGrid& grid, GLuint object, const UBounds& bounds);
+
+// The same queries as the BVH: UCullBvh, URaycastBvh and UQueryBvhSphere. Culling only looks at
+// cells inside the corners of the frustum, so it may leave out a box the planes alone would pass.
+void UCullGrid(const USpatialGrid& grid, const UFrustum& frustum, std::vector<GLuint>& visible);
+bool URaycastGrid(const USpatialGrid& grid, const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+	GLuint& object, float& distance);
+void UQueryGridSphere(const USpatialGrid& grid, const glm::vec3& center, float radius, std::vector<GLuint>& results);
+
+#endif
@@ -0,0 +1,322 @@
+#include <iostream>         // cout
+#include <algorithm>        // max, nth_element, shuffle
+#include <chrono>           // benchmark timing
+#include <cmath>            // cbrt
+#include <cstring>          // strcmp
+#include <random>           // synthetic benchmark scene
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "spatialindex.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	// Objects a cell holds on average when the scene is spread evenly
+	const float GRID_OBJECTS_PER_CELL = 8.0f;
+
+	/* Cells fit GRID_OBJECTS_PER_CELL objects of the scene's average density, so
+	 * queries visit few cells and test few objects in each. Cells are never smaller
+	 * than four times the median half size, so the typical object fits well inside
+	 * one and only the odd big one goes to the large list.
+	 */
+	float UGridCellSize(const UBounds* bounds, GLuint count)
+	{
+		if (count == 0)
+			return 1.0f;
+
+		vector<float> halfSizes(count);
+		UBounds scene = bounds[0];
+		for (GLuint i = 0; i < count; ++i)
+		{
+			const glm::vec3 halfSize = (bounds[i].max - bounds[i].min) * 0.5f;
+			halfSizes[i] = max(max(halfSize.x, halfSize.y), halfSize.z);
+			scene.min = glm::min(scene.min, bounds[i].min);
+			scene.max = glm::max(scene.max, bounds[i].max);
+		}
+		nth_element(halfSizes.begin(), halfSizes.begin() + count / 2, halfSizes.end());
+
+		// Flat scenes have no height to spread over, the median size stands in for it
+		const glm::vec3 extent = glm::max(scene.max - scene.min, glm::vec3(2.0f * halfSizes[count / 2]));
+		const float densityCellSize = cbrt(extent.x * extent.y * extent.z / count * GRID_OBJECTS_PER_CELL);
+		return max(max(densityCellSize, 4.0f * halfSizes[count / 2]), 0.001f);
+	}
+
+	// Synthetic scene of the benchmarks: spheres spread through a cube with about one
+	// object per 64 cubic units, and the views, rays and spheres every index is queried with
+	struct UBenchmarkScene
+	{
+		float side = 0.0f;
+		vector<glm::vec4> spheres;      // Center and radius
+		vector<UBounds> bounds;         // Box of each sphere
+		vector<UFrustum> frustums;      // Views from inside the scene, the same frustum the renderer uses
+		vector<glm::vec3> origins;      // Ray origins, also the centers of the proximity queries
+		vector<glm::vec3> directions;
+	};
+
+	const int BENCHMARK_VIEWS = 64;
+	const int BENCHMARK_QUERIES = 100000;
+
+	// Fills the scene from random, which the benchmarks keep drawing from for their updates
+	void UMakeBenchmarkScene(GLuint objectCount, mt19937& random, UBenchmarkScene& scene)
+	{
+		scene.side = 4.0f * cbrt((float)objectCount);
+		uniform_real_distribution<float> position(-0.5f * scene.side, 0.5f * scene.side);
+		uniform_real_distribution<float> size(0.2f, 1.0f);
+		uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+		scene.spheres.resize(objectCount);
+		scene.bounds.resize(objectCount);
+		for (GLuint i = 0; i < objectCount; ++i)
+		{
+			const glm::vec3 center(position(random), position(random), position(random));
+			const float radius = size(random);
+			scene.spheres[i] = glm::vec4(center, radius);
+			scene.bounds[i] = USphereBounds(center, radius);
+		}
+
+		scene.frustums.resize(BENCHMARK_VIEWS);
+		const glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 100.0f);
+		for (UFrustum& frustum : scene.frustums)
+		{
+			const glm::vec3 eye(position(random), position(random), position(random));
+			const glm::vec3 direction(unit(random), unit(random), unit(random) + 0.01f);
+			UExtractFrustum(projection * glm::lookAt(eye, eye + direction, glm::vec3(0.0f, 1.0f, 0.0f)), frustum);
+		}
+
+		scene.origins.resize(BENCHMARK_QUERIES);
+		scene.directions.resize(BENCHMARK_QUERIES);
+		for (int i = 0; i < BENCHMARK_QUERIES; ++i)
+		{
+			scene.origins[i] = glm::vec3(position(random), position(random), position(random));
+			scene.directions[i] = glm::vec3(unit(random), unit(random), unit(random) + 0.01f);
+		}
+	}
+
+	// Timed queries of one index, the same views, rays and spheres for each
+	void UBenchmarkQueries(const USpatialIndex& index, const UBenchmarkScene& scene)
+	{
+		const vector<UFrustum>& frustums = scene.frustums;
+		const vector<glm::vec3>& origins = scene.origins;
+		const vector<glm::vec3>& directions = scene.directions;
+		const float maxDistance = scene.side;
+
+		vector<GLuint> results;
+		size_t visible = 0;
+		auto start = chrono::steady_clock::now();
+		for (const UFrustum& frustum : frustums)
+		{
+			results.clear();
+			UCullSpatialIndex(index, frustum, results);
+			visible += results.size();
+		}
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+		cout << "    Frustum culling: " << elapsed.count() / frustums.size() << " ms per view ("
+			<< visible / frustums.size() << " visible boxes)" << endl;
+
+		GLuint hits = 0;
+		start = chrono::steady_clock::now();
+		for (size_t i = 0; i < origins.size(); ++i)
+		{
+			GLuint object;
+			float distance;
+			hits += URaycastSpatialIndex(index, origins[i], directions[i], maxDistance, object, distance) ? 1 : 0;
+		}
+		elapsed = chrono::steady_clock::now() - start;
+		cout << "    Ray picking: " << origins.size() / elapsed.count() * 1000.0 << " rays per second, "
+			<< hits << " of " << origins.size() << " hit" << endl;
+
+		size_t found = 0;
+		start = chrono::steady_clock::now();
+		for (const glm::vec3& center : origins)
+		{
+			results.clear();
+			UQuerySpatialIndexSphere(index, center, 2.0f, results);
+			found += results.size();
+		}
+		elapsed = chrono::steady_clock::now() - start;
+		cout << "    Proximity (radius 2): " << origins.size() / elapsed.count() * 1000.0 << " queries per second, "
+			<< (double)found / origins.size() << " objects each" << endl;
+	}
+}
+
+
+GLuint USpatialIndexFromName(const char* name)
+{
+	for (GLuint i = 0; i < SPATIAL_INDEX_COUNT; ++i)
+	{
+		if (strcmp(name, SPATIAL_INDEX_NAMES[i]) == 0)
+			return i;
+	}
+	return SPATIAL_INDEX_COUNT;
+}
+
+
+void UBuildSpatialIndex(USpatialIndex& index, GLuint type, const UBounds* bounds, GLuint count)
+{
+	index = USpatialIndex();
+	index.type = type;
+	if (type == SPATIAL_INDEX_GRID)
+	{
+		UResetSpatialGrid(index.grid, UGridCellSize(bounds, count));
+		for (GLuint object = 0; object < count; ++object)
+			UInsertGridObject(index.grid, object, bounds[object]);
+	}
+	else
+		UBuildBvh(index.bvh, bounds, count);
+}
+
+
+void UMoveSpatialIndexObjects(USpatialIndex& index, const UBounds* bounds, const GLuint* moved, GLuint movedCount)
+{
+	if (index.type == SPATIAL_INDEX_GRID)
+	{
+		for (GLuint i = 0; i < movedCount; ++i)
+			UMoveGridObject(index.grid, moved[i], bounds[moved[i]]);
+	}
+	else if (movedCount > 0)
+		URefitBvh(index.bvh, bounds);
+}
+
+
+void UCullSpatialIndex(const USpatialIndex& index, const UFrustum& frustum, vector<GLuint>& visible)
+{
+	if (index.type == SPATIAL_INDEX_GRID)
+		UCullGrid(index.grid, frustum, visible);
+	else
+		UCullBvh(index.bvh, frustum, visible);
+}
+
+
+bool URaycastSpatialIndex(const USpatialIndex& index, const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+	GLuint& object, float& distance)
+{
+	if (index.type == SPATIAL_INDEX_GRID)
+		return URaycastGrid(index.grid, origin, direction, maxDistance, object, distance);
+	return URaycastBvh(index.bvh, origin, direction, maxDistance, object, distance);
+}
+
+
+void UQuerySpatialIndexSphere(const USpatialIndex& index, const glm::vec3& center, float radius, vector<GLuint>& results)
+{
+	if (index.type == SPATIAL_INDEX_GRID)
+		UQueryGridSphere(index.grid, center, radius, results);
+	else
+		UQueryBvhSphere(index.bvh, center, radius, results);
+}
+
+
+void UBenchmarkBvh(GLuint objectCount)
+{
+	mt19937 random(1);
+	UBenchmarkScene scene;
+	UMakeBenchmarkScene(objectCount, random, scene);
+	uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+	cout << "BVH benchmark over " << objectCount << " objects in a cube of side " << scene.side << endl;
+
+	USpatialIndex index;
+	auto start = chrono::steady_clock::now();
+	UBuildSpatialIndex(index, SPATIAL_INDEX_BVH, scene.bounds.data(), objectCount);
+	chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+	cout << "  Build: " << elapsed.count() << " ms, " << index.bvh.nodes.size() << " nodes of " << sizeof(UBvhNode) << " bytes" << endl;
+
+	// Every object moves a little, as if animated
+	for (UBounds& box : scene.bounds)
+	{
+		const glm::vec3 offset(unit(random) * 0.1f, unit(random) * 0.1f, unit(random) * 0.1f);
+		box.min += offset;
+		box.max += offset;
+	}
+	start = chrono::steady_clock::now();
+	URefitBvh(index.bvh, scene.bounds.data());
+	elapsed = chrono::steady_clock::now() - start;
+	cout << "  Refit: " << elapsed.count() << " ms" << endl;
+
+	// The flat cull the BVH replaces, over the spheres before the move
+	UCullBounds spheres;
+	UResetCullBounds(spheres, objectCount);
+	for (GLuint i = 0; i < objectCount; ++i)
+		USetCullBounds(spheres, i, scene.spheres[i], glm::mat4(1.0f));
+
+	vector<GLuint> visible;
+	size_t flatVisible = 0;
+	start = chrono::steady_clock::now();
+	for (const UFrustum& frustum : scene.frustums)
+	{
+		visible.clear();
+		UCullSpheres(spheres, frustum, visible);
+		flatVisible += visible.size();
+	}
+	elapsed = chrono::steady_clock::now() - start;
+	cout << "  Flat frustum culling: " << elapsed.count() / scene.frustums.size() << " ms per view ("
+		<< flatVisible / scene.frustums.size() << " visible)" << endl;
+
+	cout << "  BVH queries:" << endl;
+	UBenchmarkQueries(index, scene);
+}
+
+
+void UBenchmarkSpatialIndexes(GLuint objectCount, float movingFraction)
+{
+	mt19937 random(1);
+	UBenchmarkScene scene;
+	UMakeBenchmarkScene(objectCount, random, scene);
+	uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	vector<UBounds>& bounds = scene.bounds;
+
+	// The moving objects keep a velocity of up to a quarter unit per frame
+	vector<GLuint> moved(objectCount);
+	for (GLuint i = 0; i < objectCount; ++i)
+		moved[i] = i;
+	shuffle(moved.begin(), moved.end(), random);
+	moved.resize((size_t)(objectCount * min(max(movingFraction, 0.0f), 1.0f)));
+	vector<glm::vec3> velocities(moved.size());
+	for (glm::vec3& velocity : velocities)
+		velocity = glm::vec3(unit(random), unit(random), unit(random)) * 0.25f;
+
+	cout << "Spatial index benchmark over " << objectCount << " objects in a cube of side " << scene.side
+		<< ", " << moved.size() << " of them moving" << endl;
+
+	USpatialIndex indexes[SPATIAL_INDEX_COUNT];
+	for (GLuint type = 0; type < SPATIAL_INDEX_COUNT; ++type)
+	{
+		auto start = chrono::steady_clock::now();
+		UBuildSpatialIndex(indexes[type], type, bounds.data(), objectCount);
+		chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+		cout << "  " << SPATIAL_INDEX_NAMES[type] << " build: " << elapsed.count() << " ms";
+		if (type == SPATIAL_INDEX_GRID)
+			cout << ", " << indexes[type].grid.cells.size() << " cells of " << indexes[type].grid.cellSize
+				<< ", " << indexes[type].grid.large.size() << " large objects" << endl;
+		else
+			cout << ", " << indexes[type].bvh.nodes.size() << " nodes" << endl;
+	}
+
+	const int FRAMES = 32;
+	double moveMilliseconds[SPATIAL_INDEX_COUNT] = {};
+	for (int frame = 0; frame < FRAMES; ++frame)
+	{
+		for (size_t i = 0; i < moved.size(); ++i)
+		{
+			bounds[moved[i]].min += velocities[i];
+			bounds[moved[i]].max += velocities[i];
+		}
+		for (GLuint type = 0; type < SPATIAL_INDEX_COUNT; ++type)
+		{
+			auto start = chrono::steady_clock::now();
+			UMoveSpatialIndexObjects(indexes[type], bounds.data(), moved.data(), (GLuint)moved.size());
+			chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+			moveMilliseconds[type] += elapsed.count();
+		}
+	}
+	for (GLuint type = 0; type < SPATIAL_INDEX_COUNT; ++type)
+		cout << "  " << SPATIAL_INDEX_NAMES[type] << " update: " << moveMilliseconds[type] / FRAMES << " ms per frame" << endl;
+
+	// Queries after the moves, when a refitted BVH has had its boxes stretched
+	for (GLuint type = 0; type < SPATIAL_INDEX_COUNT; ++type)
+	{
+		cout << "  " << SPATIAL_INDEX_NAMES[type] << " queries after " << FRAMES << " frames:" << endl;
+		UBenchmarkQueries(indexes[type], scene);
+	}
+}
@@ -0,0 +1,52 @@
+#ifndef SPATIALINDEX_H
+#define SPATIALINDEX_H
+
+#include <GL/glew.h>        // GLuint
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "bvh.h"
+#include "spatialgrid.h"
+
+// Structures the scene's objects can be indexed with
+enum USpatialIndexType
+{
+	SPATIAL_INDEX_BVH,      // Best queries, moving objects refit the whole tree
+	SPATIAL_INDEX_GRID,     // Loose hashed grid, moving an object touches one cell
+	SPATIAL_INDEX_COUNT
+};
+const char* const SPATIAL_INDEX_NAMES[SPATIAL_INDEX_COUNT] = { "bvh", "grid" };
+
+/* Whichever index the scene was loaded with, behind one set of queries so culling
+ * and picking do not care which it is.
+ */
+struct USpatialIndex
+{
+	GLuint type = SPATIAL_INDEX_BVH;
+	UBvh bvh;
+	USpatialGrid grid;
+};
+
+// Returns the USpatialIndexType for a name, or SPATIAL_INDEX_COUNT if the name is unknown
+GLuint USpatialIndexFromName(const char* name);
+
+// Indexes count object boxes. The grid's cell size follows the size of the objects.
+void UBuildSpatialIndex(USpatialIndex& index, GLuint type, const UBounds* bounds, GLuint count);
+// Takes the new boxes of the moved objects. bounds is indexed by object like for the build.
+void UMoveSpatialIndexObjects(USpatialIndex& index, const UBounds* bounds, const GLuint* moved, GLuint movedCount);
+
+void UCullSpatialIndex(const USpatialIndex& index, const UFrustum& frustum, std::vector<GLuint>& visible);
+bool URaycastSpatialIndex(const USpatialIndex& index, const glm::vec3& origin, const glm::vec3& direction, float maxDistance,
+	GLuint& object, float& distance);
+void UQuerySpatialIndexSphere(const USpatialIndex& index, const glm::vec3& center, float radius, std::vector<GLuint>& results);
+
+// Times building, refitting and querying a BVH over a synthetic scene of objectCount spheres,
+// with the flat sphere cull for comparison
+void UBenchmarkBvh(GLuint objectCount);
+// Times indexing, moving movingFraction of the objects each frame and querying, with the BVH
+// against the grid, over the same synthetic scene
+void UBenchmarkSpatialIndexes(GLuint objectCount, float movingFraction);
+
+#endif
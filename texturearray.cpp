@@ -0,0 +1,125 @@
+#include <iostream>         // cout
+#include <algorithm>        // max
+#include <vector>
+
+#include "mipmaps.h"
+#include "texturearray.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	// BC1 block with both endpoints at RGB565 (16, 32, 16), mid grey
+	const unsigned char GREY_BC1_BLOCK[8] = { 0x10, 0x84, 0x10, 0x84, 0, 0, 0, 0 };
+}
+
+
+bool UCreateTextureArray(UTextureArray& array, GLuint layers, GLuint size, bool compressed)
+{
+	if (layers == 0 || size == 0)
+		return false;
+
+	array.internalFormat = compressed ? GL_COMPRESSED_RGB_S3TC_DXT1_EXT : GL_RGBA8;
+	array.size = size;
+	array.layers = layers;
+	array.levels = 1;
+	while ((size >> array.levels) > 0)
+		++array.levels;
+
+	glGenTextures(1, &array.id);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, array.levels, array.internalFormat, size, size, layers);
+
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// Storage starts undefined, grey stands in like the placeholder texture does
+	for (GLuint level = 0; level < array.levels; ++level)
+	{
+		const GLuint levelSize = max(1u, size >> level);
+		if (compressed)
+		{
+			const GLuint blocks = ((levelSize + 3) / 4) * ((levelSize + 3) / 4) * layers;
+			vector<unsigned char> grey(blocks * sizeof(GREY_BC1_BLOCK));
+			for (GLuint i = 0; i < blocks; ++i)
+				copy(GREY_BC1_BLOCK, GREY_BC1_BLOCK + sizeof(GREY_BC1_BLOCK), &grey[i * sizeof(GREY_BC1_BLOCK)]);
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, levelSize, levelSize, layers,
+				array.internalFormat, (GLsizei)grey.size(), grey.data());
+		}
+		else
+		{
+			vector<unsigned char> grey((size_t)levelSize * levelSize * layers * 4, 128);
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, levelSize, levelSize, layers, GL_RGBA, GL_UNSIGNED_BYTE, grey.data());
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	cout << "INFO: Texture array: " << layers << " layers of " << size << "x" << size
+		<< (compressed ? " BC1" : " RGBA8") << ", " << array.levels << " levels" << endl;
+	return true;
+}
+
+
+void UDestroyTextureArray(UTextureArray& array)
+{
+	if (array.id)
+		glDeleteTextures(1, &array.id);
+	array = UTextureArray();
+}
+
+
+bool USetTextureArrayLayer(UTextureArray& array, GLuint layer, const UDecodedImage& image)
+{
+	if (image.compressed.format && image.compressed.format != array.internalFormat)
+	{
+		cout << "Texture " << image.filename << " has alpha, which the BC1 texture array cannot hold" << endl;
+		return false;
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, array.id);
+
+	bool fits = false;
+	if (image.compressed.format)
+	{
+		// The cache already holds the whole chain, the layer starts at the level of the array's size
+		const UCompressedTexture& texture = image.compressed;
+		for (GLuint i = 0; i < texture.levels.size() && !fits; ++i)
+			fits = texture.levels[i].width == array.size && texture.levels[i].height == array.size;
+		for (GLuint i = 0, level = 0; fits && i < texture.levels.size(); ++i)
+		{
+			const UCompressedLevel& source = texture.levels[i];
+			if (source.width > array.size || source.height > array.size || level >= array.levels)
+				continue;
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level++, 0, 0, layer, source.width, source.height, 1,
+				texture.format, source.size, &texture.blocks[source.offset]);
+		}
+	}
+	else if (!image.mipLevels.empty())
+	{
+		// The loader built the chain, only the uploads are left for the GL thread
+		const vector<UMipLevel>& levels = image.mipLevels;
+		for (const UMipLevel& source : levels)
+			fits = fits || (source.width == array.size && source.height == array.size);
+
+		// Rows of RGB levels are not 4-byte aligned once they get small
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+		for (GLuint i = 0, level = 0; fits && i < levels.size(); ++i)
+		{
+			const UMipLevel& source = levels[i];
+			if (source.width > array.size || source.height > array.size || level >= array.levels)
+				continue;
+			glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level++, 0, 0, layer, source.width, source.height, 1,
+				image.channels == 4 ? GL_RGBA : GL_RGB, GL_UNSIGNED_BYTE, source.pixels.data());
+		}
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	if (!fits)
+		cout << "Texture " << image.filename << " (" << image.width << "x" << image.height
+			<< ") has no " << array.size << "x" << array.size << " mip level for the texture array" << endl;
+	return fits;
+}
@@ -0,0 +1,29 @@
+#ifndef TEXTUREARRAY_H
+#define TEXTUREARRAY_H
+
+#include <GL/glew.h>
+
+#include "textureloader.h"
+
+/* Every scene texture as one layer of a GL_TEXTURE_2D_ARRAY, so the whole scene
+ * draws with a single texture bound. Layers share one size: each image contributes
+ * the mip level that is that size and the levels below it.
+ */
+struct UTextureArray
+{
+	GLuint id = 0;
+	GLenum internalFormat = 0;  // BC1 or RGBA8
+	GLuint size = 0;            // Width and height of every layer
+	GLuint levels = 0;
+	GLuint layers = 0;
+};
+
+// Creates the array with every layer mid grey until its image arrives. Compressed arrays hold BC1 images only.
+bool UCreateTextureArray(UTextureArray& array, GLuint layers, GLuint size, bool compressed);
+void UDestroyTextureArray(UTextureArray& array);
+
+// Fills a layer from a decoded image, which must come as BC blocks or as a mip chain
+// built by the loader. Fails when the image has no mip level of the layer size or the wrong format.
+bool USetTextureArrayLayer(UTextureArray& array, GLuint layer, const UDecodedImage& image);
+
+#endif
@@ -0,0 +1,477 @@
+#include <iostream>         // cout
+#include <fstream>          // ofstream
+#include <cstring>          // memcpy, memcmp
+#include <algorithm>        // min, max, swap
+#include <string>
+
+#include <stb_image.h>      // stbi_load_from_memory, the implementation is compiled into main.cpp
+
+#include "assetpack.h"
+#include "mappedfile.h"
+#include "mipmaps.h"
+#include "texturecache.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	/* Cache file layout: a header with the level table, then the blocks of every
+	 * level back to back. The hash of the source image decides whether the cache
+	 * is still valid, so editing or replacing the image rebuilds it.
+	 */
+	const char TEXTURE_CACHE_MAGIC[4] = { 'U', 'T', 'E', 'X' };
+	const uint32_t TEXTURE_CACHE_VERSION = 2;
+	const uint32_t MAX_TEXTURE_LEVELS = 16;
+
+	struct UTextureCacheHeader
+	{
+		char magic[4];
+		uint32_t version;
+		uint32_t headerSize;
+		uint32_t format;
+		uint64_t sourceHash;
+		uint32_t mipFilter;     // UMipFilter the levels were built with
+		uint32_t levelCount;
+		uint32_t dataSize;
+		UCompressedLevel levels[MAX_TEXTURE_LEVELS];
+	};
+
+	GLuint UBlockBytes(GLenum format)
+	{
+		return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT ? 8 : 16;
+	}
+
+	// Quantizes one channel to bits, rounding towards the outside of the endpoint range
+	int UQuantizeChannel(int value, int maximum, bool roundUp)
+	{
+		return roundUp ? (value * maximum + 254) / 255 : value * maximum / 255;
+	}
+
+	GLushort UPack565(const int* color, const bool* roundUp)
+	{
+		return (GLushort)(UQuantizeChannel(color[0], 31, roundUp[0]) << 11
+			| UQuantizeChannel(color[1], 63, roundUp[1]) << 5
+			| UQuantizeChannel(color[2], 31, roundUp[2]));
+	}
+
+	void UUnpack565(GLushort packed, int* color)
+	{
+		int r = (packed >> 11) & 31;
+		int g = (packed >> 5) & 63;
+		int b = packed & 31;
+		color[0] = (r << 3) | (r >> 2);
+		color[1] = (g << 2) | (g >> 4);
+		color[2] = (b << 3) | (b >> 2);
+	}
+
+	/* BC1 color block: the endpoints are the corners of the block's color bounding
+	 * box, on the diagonal that follows how red and blue vary against green, pulled
+	 * in by 1/16 of the range. They are quantized away from each other so the palette
+	 * still spans a nearly flat block instead of collapsing onto one 565 color.
+	 * Each texel takes the nearest of the four palette colors.
+	 */
+	void UEncodeColorBlock(const unsigned char texels[16][4], unsigned char* out)
+	{
+		int lower[3] = { 255, 255, 255 };
+		int upper[3] = { 0, 0, 0 };
+		for (int i = 0; i < 16; ++i)
+		{
+			for (int c = 0; c < 3; ++c)
+			{
+				lower[c] = min(lower[c], (int)texels[i][c]);
+				upper[c] = max(upper[c], (int)texels[i][c]);
+			}
+		}
+
+		int center[3];
+		for (int c = 0; c < 3; ++c)
+			center[c] = (lower[c] + upper[c]) / 2;
+		int redGreen = 0;
+		int blueGreen = 0;
+		for (int i = 0; i < 16; ++i)
+		{
+			int g = texels[i][1] - center[1];
+			redGreen += (texels[i][0] - center[0]) * g;
+			blueGreen += (texels[i][2] - center[2]) * g;
+		}
+
+		int end0[3] = { upper[0], upper[1], upper[2] };
+		int end1[3] = { lower[0], lower[1], lower[2] };
+		if (redGreen < 0)
+			swap(end0[0], end1[0]);
+		if (blueGreen < 0)
+			swap(end0[2], end1[2]);
+		for (int c = 0; c < 3; ++c)
+		{
+			int inset = (end0[c] - end1[c]) / 16;
+			end0[c] -= inset;
+			end1[c] += inset;
+		}
+
+		bool roundUp0[3];
+		bool roundUp1[3];
+		for (int c = 0; c < 3; ++c)
+		{
+			roundUp0[c] = end0[c] >= end1[c];
+			roundUp1[c] = !roundUp0[c];
+		}
+		GLushort color0 = UPack565(end0, roundUp0);
+		GLushort color1 = UPack565(end1, roundUp1);
+		if (color0 < color1)
+			swap(color0, color1);   // color0 > color1 selects the four color mode in BC1
+
+		int palette[4][3];
+		UUnpack565(color0, palette[0]);
+		UUnpack565(color1, palette[1]);
+		for (int c = 0; c < 3; ++c)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+
+		uint32_t indices = 0;
+		if (color0 != color1)
+		{
+			for (int i = 0; i < 16; ++i)
+			{
+				int best = 0;
+				int bestDistance = INT32_MAX;
+				for (int p = 0; p < 4; ++p)
+				{
+					int dr = texels[i][0] - palette[p][0];
+					int dg = texels[i][1] - palette[p][1];
+					int db = texels[i][2] - palette[p][2];
+					int distance = dr * dr + dg * dg + db * db;
+					if (distance < bestDistance)
+					{
+						best = p;
+						bestDistance = distance;
+					}
+				}
+				indices |= (uint32_t)best << (i * 2);
+			}
+		}
+
+		out[0] = (unsigned char)(color0 & 0xFF);
+		out[1] = (unsigned char)(color0 >> 8);
+		out[2] = (unsigned char)(color1 & 0xFF);
+		out[3] = (unsigned char)(color1 >> 8);
+		for (int b = 0; b < 4; ++b)
+			out[4 + b] = (unsigned char)(indices >> (b * 8));
+	}
+
+	// BC3 alpha block: alpha0 > alpha1 selects eight evenly spaced values between them
+	void UEncodeAlphaBlock(const unsigned char texels[16][4], unsigned char* out)
+	{
+		int alpha0 = 0;
+		int alpha1 = 255;
+		for (int i = 0; i < 16; ++i)
+		{
+			alpha0 = max(alpha0, (int)texels[i][3]);
+			alpha1 = min(alpha1, (int)texels[i][3]);
+		}
+
+		uint64_t indices = 0;
+		if (alpha0 != alpha1)
+		{
+			const int range = alpha0 - alpha1;
+			for (int i = 0; i < 16; ++i)
+			{
+				// Step 0 is alpha0 and step 7 is alpha1, the index order puts the endpoints first
+				int step = ((alpha0 - texels[i][3]) * 7 + range / 2) / range;
+				int index = step == 0 ? 0 : step == 7 ? 1 : step + 1;
+				indices |= (uint64_t)index << (i * 3);
+			}
+		}
+
+		out[0] = (unsigned char)alpha0;
+		out[1] = (unsigned char)alpha1;
+		for (int b = 0; b < 6; ++b)
+			out[2 + b] = (unsigned char)(indices >> (b * 8));
+	}
+
+	void UEncodeLevel(const vector<unsigned char>& pixels, GLuint width, GLuint height, int channels, GLenum format, unsigned char* out)
+	{
+		const GLuint blockBytes = UBlockBytes(format);
+		unsigned char texels[16][4];
+
+		for (GLuint by = 0; by < height; by += 4)
+		{
+			for (GLuint bx = 0; bx < width; bx += 4)
+			{
+				// Blocks hanging over the edge repeat the last row and column
+				for (GLuint i = 0; i < 16; ++i)
+				{
+					GLuint x = min(bx + i % 4, width - 1);
+					GLuint y = min(by + i / 4, height - 1);
+					const unsigned char* texel = &pixels[((size_t)y * width + x) * channels];
+					texels[i][0] = texel[0];
+					texels[i][1] = texel[1];
+					texels[i][2] = texel[2];
+					texels[i][3] = channels == 4 ? texel[3] : 255;
+				}
+
+				if (format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT)
+				{
+					UEncodeAlphaBlock(texels, out);
+					UEncodeColorBlock(texels, out + 8);
+				}
+				else
+					UEncodeColorBlock(texels, out);
+				out += blockBytes;
+			}
+		}
+	}
+
+	// Reads the cache of the image or transcodes the image and writes the cache. written
+	// is false only when a cache had to be written and could not be.
+	bool UReadOrTranscodeTexture(const char* filename, GLuint mipFilter, GLuint firstLevel, GLuint endLevel,
+		UCompressedTexture& texture, bool& transcoded, bool& written)
+	{
+		transcoded = false;
+		written = true;
+
+		UMappedFile source;
+		if (!UMapFile(filename, source))
+			return false;
+
+		const uint64_t sourceHash = UHashBytes(source.data, source.size);
+		const string cacheFilename = string(filename) + ".btc";
+		if (UReadTextureCache(cacheFilename.c_str(), sourceHash, mipFilter, firstLevel, endLevel, texture))
+		{
+			UUnmapFile(source);
+			return true;
+		}
+
+		bool decoded = UTranscodeImage(source.data, source.size, mipFilter, texture);
+		UUnmapFile(source);
+		if (!decoded)
+			return false;
+
+		transcoded = true;
+		written = UWriteTextureCache(cacheFilename.c_str(), sourceHash, mipFilter, texture);
+		if (!written)
+			cout << "Failed to write texture cache " << cacheFilename << endl;
+		UTrimCompressedTexture(texture, firstLevel, endLevel);
+		return true;
+	}
+}
+
+
+uint64_t UHashBytes(const unsigned char* data, size_t size)
+{
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i)
+		hash = (hash ^ data[i]) * 1099511628211ull;
+	return hash;
+}
+
+
+bool UTranscodeImage(const unsigned char* data, size_t size, GLuint mipFilter, UCompressedTexture& texture)
+{
+	// Grey images are expanded to RGB, anything with alpha to RGBA
+	int width, height, channels;
+	if (!stbi_info_from_memory(data, (int)size, &width, &height, &channels))
+		return false;
+
+	const int wanted = channels == 2 || channels == 4 ? 4 : 3;
+	unsigned char* pixels = stbi_load_from_memory(data, (int)size, &width, &height, &channels, wanted);
+	if (!pixels)
+		return false;
+
+	UCompressTexture(pixels, width, height, wanted, mipFilter, texture);
+	stbi_image_free(pixels);
+	return true;
+}
+
+
+void UCompressTexture(const unsigned char* pixels, int width, int height, int channels, GLuint mipFilter, UCompressedTexture& texture)
+{
+	texture.format = channels == 4 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	texture.width = (GLuint)width;
+	texture.height = (GLuint)height;
+	texture.firstLevel = 0;
+	texture.levels.clear();
+	texture.blocks.clear();
+
+	const GLuint blockBytes = UBlockBytes(texture.format);
+
+	// One thread per texture, the texture loader already compresses several at once
+	vector<UMipLevel> levels;
+	UBuildMipChain(pixels, (GLuint)width, (GLuint)height, channels, mipFilter, 1, levels);
+	if (levels.size() > MAX_TEXTURE_LEVELS)
+		levels.resize(MAX_TEXTURE_LEVELS);
+
+	for (const UMipLevel& level : levels)
+	{
+		UCompressedLevel entry;
+		entry.width = level.width;
+		entry.height = level.height;
+		entry.offset = (GLuint)texture.blocks.size();
+		entry.size = ((level.width + 3) / 4) * ((level.height + 3) / 4) * blockBytes;
+		texture.levels.push_back(entry);
+
+		texture.blocks.resize(texture.blocks.size() + entry.size);
+		UEncodeLevel(level.pixels, level.width, level.height, channels, texture.format, &texture.blocks[entry.offset]);
+	}
+	texture.chainLevels = (GLuint)texture.levels.size();
+}
+
+
+void UTrimCompressedTexture(UCompressedTexture& texture, GLuint firstLevel, GLuint endLevel)
+{
+	// Chain levels to indices into levels
+	const GLuint loadedEnd = texture.firstLevel + (GLuint)texture.levels.size();
+	endLevel = max(texture.firstLevel + 1, min(endLevel, loadedEnd));
+	firstLevel = min(max(firstLevel, texture.firstLevel), endLevel - 1);
+	const GLuint first = firstLevel - texture.firstLevel;
+	const GLuint end = endLevel - texture.firstLevel;
+
+	const GLuint start = texture.levels[first].offset;
+	const GLuint stop = texture.levels[end - 1].offset + texture.levels[end - 1].size;
+	texture.blocks.erase(texture.blocks.begin() + stop, texture.blocks.end());
+	texture.blocks.erase(texture.blocks.begin(), texture.blocks.begin() + start);
+
+	texture.levels.erase(texture.levels.begin() + end, texture.levels.end());
+	texture.levels.erase(texture.levels.begin(), texture.levels.begin() + first);
+	for (UCompressedLevel& level : texture.levels)
+		level.offset -= start;
+	texture.firstLevel = firstLevel;
+}
+
+
+bool UWriteTextureCache(const char* cacheFilename, uint64_t sourceHash, GLuint mipFilter, const UCompressedTexture& texture)
+{
+	if (texture.firstLevel != 0 || texture.levels.size() != texture.chainLevels)
+		return false;
+
+	UTextureCacheHeader header = {};
+	memcpy(header.magic, TEXTURE_CACHE_MAGIC, sizeof(header.magic));
+	header.version = TEXTURE_CACHE_VERSION;
+	header.headerSize = sizeof(UTextureCacheHeader);
+	header.format = texture.format;
+	header.sourceHash = sourceHash;
+	header.mipFilter = mipFilter;
+	header.levelCount = (uint32_t)texture.levels.size();
+	header.dataSize = (uint32_t)texture.blocks.size();
+	copy(texture.levels.begin(), texture.levels.end(), header.levels);
+
+	ofstream file(cacheFilename, ios::binary | ios::trunc);
+	if (!file.is_open())
+		return false;
+
+	file.write((const char*)&header, sizeof(header));
+	file.write((const char*)texture.blocks.data(), (streamsize)texture.blocks.size());
+	return file.good();
+}
+
+
+bool UReadTextureCache(const char* cacheFilename, uint64_t sourceHash, GLuint mipFilter,
+	GLuint firstLevel, GLuint endLevel, UCompressedTexture& texture)
+{
+	UMappedFile file;
+	if (!UMapFile(cacheFilename, file))
+		return false;
+
+	bool valid = UParseTextureCache(file.data, file.size, sourceHash, mipFilter, firstLevel, endLevel, texture);
+	UUnmapFile(file);
+	return valid;
+}
+
+
+bool UParseTextureCache(const unsigned char* data, size_t size, uint64_t sourceHash, GLuint mipFilter,
+	GLuint firstLevel, GLuint endLevel, UCompressedTexture& texture)
+{
+	const UTextureCacheHeader* header = (const UTextureCacheHeader*)data;
+	bool valid = size >= sizeof(UTextureCacheHeader)
+		&& memcmp(header->magic, TEXTURE_CACHE_MAGIC, sizeof(header->magic)) == 0
+		&& header->version == TEXTURE_CACHE_VERSION
+		&& header->headerSize == sizeof(UTextureCacheHeader)
+		&& (sourceHash == 0 || header->sourceHash == sourceHash)
+		&& header->mipFilter == mipFilter
+		&& header->levelCount > 0 && header->levelCount <= MAX_TEXTURE_LEVELS
+		&& header->dataSize == size - sizeof(UTextureCacheHeader);
+
+	for (uint32_t i = 0; valid && i < header->levelCount; ++i)
+		valid = (uint64_t)header->levels[i].offset + header->levels[i].size <= header->dataSize;
+
+	// Only the requested levels are copied, the pages of the others are never touched
+	if (valid)
+	{
+		endLevel = max(1u, min(endLevel, header->levelCount));
+		firstLevel = min(firstLevel, endLevel - 1);
+
+		texture.format = header->format;
+		texture.width = header->levels[0].width;
+		texture.height = header->levels[0].height;
+		texture.chainLevels = header->levelCount;
+		texture.firstLevel = firstLevel;
+		texture.levels.assign(header->levels + firstLevel, header->levels + endLevel);
+
+		const GLuint start = texture.levels.front().offset;
+		const GLuint stop = texture.levels.back().offset + texture.levels.back().size;
+		const unsigned char* blocks = data + sizeof(UTextureCacheHeader);
+		texture.blocks.assign(blocks + start, blocks + stop);
+		for (UCompressedLevel& level : texture.levels)
+			level.offset -= start;
+	}
+	return valid;
+}
+
+
+bool ULoadCompressedTexture(const char* filename, GLuint mipFilter, GLuint firstLevel, GLuint endLevel,
+	UCompressedTexture& texture, bool& transcoded)
+{
+	// Best effort, without a writable folder the texture is transcoded again next run
+	bool written;
+	return UReadOrTranscodeTexture(filename, mipFilter, firstLevel, endLevel, texture, transcoded, written);
+}
+
+
+bool UBuildTextureCache(const char* filename, GLuint mipFilter, bool& transcoded)
+{
+	// Only the coarsest level is read back, the texture itself is not needed
+	UCompressedTexture texture;
+	bool written;
+	return UReadOrTranscodeTexture(filename, mipFilter, TEXTURE_CHAIN_END, TEXTURE_CHAIN_END, texture, transcoded, written)
+		&& written;
+}
+
+
+bool ULoadPackedTexture(const UAssetPack& pack, const char* filename, GLuint mipFilter, GLuint firstLevel, GLuint endLevel,
+	UCompressedTexture& texture, bool& transcoded)
+{
+	transcoded = false;
+
+	// The pack was built from the sources, so the cache is not checked against them
+	UAssetSpan cache;
+	const string cacheName = string(filename) + ".btc";
+	if (UFindAsset(pack, cacheName.c_str(), cache)
+		&& UParseTextureCache(cache.data, cache.size, 0, mipFilter, firstLevel, endLevel, texture))
+		return true;
+
+	// Packed with another mip filter or without its cache
+	UAssetSpan image;
+	if (!UFindAsset(pack, filename, image) || !UTranscodeImage(image.data, image.size, mipFilter, texture))
+		return false;
+
+	transcoded = true;
+	UTrimCompressedTexture(texture, firstLevel, endLevel);
+	return true;
+}
+
+
+GLsizeiptr UCompressedLevelSize(GLenum format, GLuint width, GLuint height)
+{
+	return (GLsizeiptr)((width + 3) / 4) * ((height + 3) / 4) * UBlockBytes(format);
+}
+
+
+GLsizeiptr UUncompressedTextureSize(const UCompressedTexture& texture)
+{
+	const GLsizeiptr bytesPerTexel = texture.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? 4 : 3;
+	GLsizeiptr size = 0;
+	for (const UCompressedLevel& level : texture.levels)
+		size += (GLsizeiptr)level.width * level.height * bytesPerTexel;
+	return size;
+}
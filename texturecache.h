@@ -0,0 +1,75 @@
+#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <GL/glew.h>
+
+#include <cstdint>
+#include <vector>
+
+struct UAssetPack;
+
+// One mip level inside UCompressedTexture::blocks
+struct UCompressedLevel
+{
+	GLuint width;
+	GLuint height;
+	GLuint offset;      // Byte offset into blocks
+	GLuint size;        // Bytes of 4x4 blocks
+};
+
+// A block-compressed texture with a run of its mip chain, finest level first
+struct UCompressedTexture
+{
+	GLenum format = 0;      // GL_COMPRESSED_RGB_S3TC_DXT1_EXT (BC1) or GL_COMPRESSED_RGBA_S3TC_DXT5_EXT (BC3)
+	GLuint width = 0;       // Size of chain level 0, also when it was not read
+	GLuint height = 0;
+	GLuint chainLevels = 0; // Levels in the whole chain, each half the size of the one before
+	GLuint firstLevel = 0;  // Chain level of levels[0]
+	std::vector<UCompressedLevel> levels;
+	std::vector<unsigned char> blocks;
+};
+
+// Pass as endLevel to read to the end of the chain
+const GLuint TEXTURE_CHAIN_END = 0xFFFFFFFF;
+
+// FNV-1a over the bytes of a file's contents, identifies the source a cache was built from
+uint64_t UHashBytes(const unsigned char* data, size_t size);
+
+// Builds the mip chain of 3 or 4 channel pixels with a UMipFilter and encodes it as BC1 or BC3
+void UCompressTexture(const unsigned char* pixels, int width, int height, int channels, GLuint mipFilter, UCompressedTexture& texture);
+// Decodes an image file held in memory and compresses it with UCompressTexture
+bool UTranscodeImage(const unsigned char* data, size_t size, GLuint mipFilter, UCompressedTexture& texture);
+
+// Keeps chain levels firstLevel to endLevel - 1. The range is clamped so at least the coarsest level stays.
+void UTrimCompressedTexture(UCompressedTexture& texture, GLuint firstLevel, GLuint endLevel);
+
+// Writes a whole chain
+bool UWriteTextureCache(const char* cacheFilename, uint64_t sourceHash, GLuint mipFilter, const UCompressedTexture& texture);
+// Reads chain levels firstLevel to endLevel - 1, clamped like UTrimCompressedTexture. Fails when
+// the cache is missing, damaged, or was built from a different source or with another mip filter.
+bool UReadTextureCache(const char* cacheFilename, uint64_t sourceHash, GLuint mipFilter,
+	GLuint firstLevel, GLuint endLevel, UCompressedTexture& texture);
+// UReadTextureCache on a cache already in memory. A sourceHash of 0 accepts any source.
+bool UParseTextureCache(const unsigned char* data, size_t size, uint64_t sourceHash, GLuint mipFilter,
+	GLuint firstLevel, GLuint endLevel, UCompressedTexture& texture);
+
+/* Loads levels firstLevel to endLevel - 1 from <filename>.btc when it was built from the
+ * current contents of the image, otherwise decodes the image, compresses it and writes the
+ * cache for the next run. transcoded tells which of the two happened.
+ */
+bool ULoadCompressedTexture(const char* filename, GLuint mipFilter, GLuint firstLevel, GLuint endLevel,
+	UCompressedTexture& texture, bool& transcoded);
+// Makes <filename>.btc current like ULoadCompressedTexture, but fails when the cache could not be written
+bool UBuildTextureCache(const char* filename, GLuint mipFilter, bool& transcoded);
+// ULoadCompressedTexture reading <filename>.btc, or the image when that fails, from an asset pack.
+// Nothing is written back, the pack is rebuilt instead.
+bool ULoadPackedTexture(const UAssetPack& pack, const char* filename, GLuint mipFilter, GLuint firstLevel, GLuint endLevel,
+	UCompressedTexture& texture, bool& transcoded);
+
+// Bytes of one level's 4x4 blocks
+GLsizeiptr UCompressedLevelSize(GLenum format, GLuint width, GLuint height);
+
+// Bytes the levels read would take as uncompressed RGB8 or RGBA8
+GLsizeiptr UUncompressedTextureSize(const UCompressedTexture& texture);
+
+#endif
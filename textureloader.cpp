@@ -0,0 +1,213 @@
+#include <iostream>         // cout
+#include <cstring>          // memcpy
+#include <algorithm>        // max, min
+#include <chrono>           // benchmark timing
+
+#include <stb_image.h>      // stbi_load, the implementation is compiled into main.cpp
+
+#include "assetpack.h"
+#include "textureloader.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	void UWorkerLoop(UTextureLoader& loader)
+	{
+		for (;;)
+		{
+			UImageJob job;
+			{
+				unique_lock<mutex> lock(loader.mutex);
+				loader.wake.wait(lock, [&loader] { return loader.stopping || !loader.pending.empty(); });
+				if (loader.stopping)
+					return;
+				job = move(loader.pending.front());
+				loader.pending.pop_front();
+			}
+
+			// stbi_load keeps no shared state, several workers can decode at once
+			UDecodedImage image;
+			image.index = job.index;
+			image.filename = move(job.filename);
+			image.pixels = nullptr;
+			image.transcoded = false;
+			UAssetSpan packed;
+			if (loader.compress)
+			{
+				bool loaded = loader.pack && ULoadPackedTexture(*loader.pack, image.filename.c_str(), loader.mipFilter,
+					job.firstLevel, job.endLevel, image.compressed, image.transcoded);
+				if (loaded || ULoadCompressedTexture(image.filename.c_str(), loader.mipFilter, job.firstLevel, job.endLevel, image.compressed, image.transcoded))
+				{
+					image.width = (int)image.compressed.width;
+					image.height = (int)image.compressed.height;
+					image.channels = image.compressed.format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT ? 4 : 3;
+				}
+			}
+			else if (loader.pack && UFindAsset(*loader.pack, image.filename.c_str(), packed))
+				image.pixels = stbi_load_from_memory(packed.data, (int)packed.size, &image.width, &image.height, &image.channels, 0);
+			else
+				image.pixels = stbi_load(image.filename.c_str(), &image.width, &image.height, &image.channels, 0);
+
+			// Filtering the chain is the slow part of an upload, so it stays off the GL thread.
+			// One thread per chain, the other workers are busy with their own images.
+			if (loader.buildMips && image.pixels && (image.channels == 3 || image.channels == 4))
+			{
+				UBuildMipChain(image.pixels, (GLuint)image.width, (GLuint)image.height, image.channels, loader.mipFilter, 1, image.mipLevels);
+				stbi_image_free(image.pixels);
+				image.pixels = nullptr;
+			}
+
+			lock_guard<mutex> lock(loader.mutex);
+			loader.finished.push_back(move(image));
+		}
+	}
+}
+
+
+void UStartTextureLoader(UTextureLoader& loader, GLuint threadCount)
+{
+	if (threadCount == 0)
+		threadCount = max(1u, thread::hardware_concurrency());
+
+	loader.stopping = false;
+	for (GLuint i = 0; i < threadCount; ++i)
+		loader.workers.emplace_back(UWorkerLoop, ref(loader));
+}
+
+
+void UStopTextureLoader(UTextureLoader& loader)
+{
+	{
+		lock_guard<mutex> lock(loader.mutex);
+		loader.stopping = true;
+		loader.pending.clear();
+	}
+	loader.wake.notify_all();
+
+	for (thread& worker : loader.workers)
+		worker.join();
+	loader.workers.clear();
+
+	for (UDecodedImage& image : loader.finished)
+		UFreeDecodedImage(image);
+	loader.finished.clear();
+	loader.outstanding = 0;
+}
+
+
+void UQueueImageDecode(UTextureLoader& loader, GLuint index, const char* filename, GLuint firstLevel, GLuint endLevel)
+{
+	{
+		lock_guard<mutex> lock(loader.mutex);
+		loader.pending.push_back({ index, filename, firstLevel, endLevel });
+		++loader.outstanding;
+	}
+	loader.wake.notify_one();
+}
+
+
+void UTakeDecodedImages(UTextureLoader& loader, vector<UDecodedImage>& images)
+{
+	images.clear();
+
+	lock_guard<mutex> lock(loader.mutex);
+	images.swap(loader.finished);
+	loader.outstanding -= (GLuint)images.size();
+}
+
+
+bool UTextureLoaderBusy(UTextureLoader& loader)
+{
+	lock_guard<mutex> lock(loader.mutex);
+	return loader.outstanding > 0;
+}
+
+
+void UFreeDecodedImage(UDecodedImage& image)
+{
+	if (image.pixels)
+		stbi_image_free(image.pixels);
+	image.pixels = nullptr;
+	image.compressed = UCompressedTexture();
+	image.mipLevels.clear();
+}
+
+
+void UFlipImageBytewise(unsigned char* image, int width, int height, int channels)
+{
+	for (int j = 0; j < height / 2; ++j)
+	{
+		int index1 = j * width * channels;
+		int index2 = (height - 1 - j) * width * channels;
+
+		for (int i = width * channels; i > 0; --i)
+		{
+			unsigned char tmp = image[index1];
+			image[index1] = image[index2];
+			image[index2] = tmp;
+			++index1;
+			++index2;
+		}
+	}
+}
+
+
+void UFlipImageRows(unsigned char* image, int width, int height, int channels)
+{
+	const size_t rowSize = (size_t)width * channels;
+	vector<unsigned char> scratch(rowSize);
+
+	for (int j = 0; j < height / 2; ++j)
+	{
+		unsigned char* row1 = image + j * rowSize;
+		unsigned char* row2 = image + (height - 1 - j) * rowSize;
+		memcpy(scratch.data(), row1, rowSize);
+		memcpy(row1, row2, rowSize);
+		memcpy(row2, scratch.data(), rowSize);
+	}
+}
+
+
+bool UBenchmarkImageFlip(const vector<string>& filenames)
+{
+	const int runs = 5;
+	double totals[2] = {};
+
+	for (const string& filename : filenames)
+	{
+		int width, height, channels;
+		unsigned char* pixels = stbi_load(filename.c_str(), &width, &height, &channels, 0);
+		if (!pixels)
+		{
+			cout << "Failed to load image " << filename << endl;
+			return false;
+		}
+
+		// Best of a few runs, each run flips the image back for the next one
+		double best[2] = { 1e30, 1e30 };
+		for (int run = 0; run < runs; ++run)
+		{
+			for (int method = 0; method < 2; ++method)
+			{
+				auto start = chrono::steady_clock::now();
+				if (method == 0)
+					UFlipImageBytewise(pixels, width, height, channels);
+				else
+					UFlipImageRows(pixels, width, height, channels);
+				chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start;
+				best[method] = min(best[method], elapsed.count());
+			}
+		}
+		stbi_image_free(pixels);
+
+		cout << filename << " (" << width << "x" << height << "x" << channels << "): byte loop "
+			<< best[0] << " ms, row memcpy " << best[1] << " ms, shader flip 0 ms" << endl;
+		totals[0] += best[0];
+		totals[1] += best[1];
+	}
+
+	cout << "Total: byte loop " << totals[0] << " ms, row memcpy " << totals[1]
+		<< " ms, shader flip 0 ms (no pass, the surface shader samples with V reversed)" << endl;
+	return true;
+}
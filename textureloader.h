@@ -0,0 +1,83 @@
+#ifndef TEXTURELOADER_H
+#define TEXTURELOADER_H
+
+#include <GL/glew.h>        // GLuint
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "mipmaps.h"
+#include "texturecache.h"
+
+// Pixels of one decoded image as stored in the file, top row first. Nothing flips them:
+// uploaded as is, the image is upside down in GL terms and the surface shader reverses V.
+// With compression on, the image comes as BC blocks from the texture cache instead,
+// limited to the chain levels the job asked for. With mip chains on, the pixels come
+// as the levels of the chain the worker built.
+struct UDecodedImage
+{
+	GLuint index;               // Slot given when the image was queued
+	int width;
+	int height;
+	int channels;
+	unsigned char* pixels;      // nullptr when the file could not be decoded, is compressed or came as a mip chain
+	UCompressedTexture compressed;  // format 0 when not compressed
+	std::vector<UMipLevel> mipLevels;   // Empty unless the loader builds mip chains, level 0 is the image
+	bool transcoded;            // The cache was missing or stale and has been rebuilt
+	std::string filename;
+};
+
+// A decode request waiting for a worker
+struct UImageJob
+{
+	GLuint index;
+	std::string filename;
+	GLuint firstLevel;          // Chain levels to read when compressing, see ULoadCompressedTexture
+	GLuint endLevel;
+};
+
+/* Decodes image files on a pool of worker threads. The GL thread queues files,
+ * then polls for finished images each frame and uploads them itself: workers
+ * never touch GL, so no second context is needed.
+ */
+struct UTextureLoader
+{
+	std::vector<std::thread> workers;
+	std::mutex mutex;                       // Guards everything below
+	std::condition_variable wake;           // Signaled when a job is queued or the loader stops
+	std::deque<UImageJob> pending;
+	std::vector<UDecodedImage> finished;    // Decoded, waiting for UTakeDecodedImages
+	GLuint outstanding = 0;                 // Queued or decoding
+	bool stopping = false;
+	bool compress = false;                  // Load BC compressed textures through the cache, set before starting
+	bool buildMips = false;                 // Build the mip chain of uncompressed images, set before starting
+	GLuint mipFilter = 0;                   // UMipFilter for the chains the cache or the workers build
+	const UAssetPack* pack = nullptr;       // Read images and caches from this pack first, files fill the gaps
+};
+
+// Starts threadCount workers, 0 uses one per hardware thread
+void UStartTextureLoader(UTextureLoader& loader, GLuint threadCount);
+// Drops the jobs not started yet, waits for the workers and frees images nobody took
+void UStopTextureLoader(UTextureLoader& loader);
+
+void UQueueImageDecode(UTextureLoader& loader, GLuint index, const char* filename,
+	GLuint firstLevel = 0, GLuint endLevel = TEXTURE_CHAIN_END);
+// Moves the images finished so far into images without waiting for the rest
+void UTakeDecodedImages(UTextureLoader& loader, std::vector<UDecodedImage>& images);
+// True until every queued image has been decoded and taken
+bool UTextureLoaderBusy(UTextureLoader& loader);
+
+void UFreeDecodedImage(UDecodedImage& image);
+
+// Vertical flips that used to run after every decode, kept for --bench-flip.
+// The original swaps one byte at a time, the other swaps whole rows with memcpy.
+void UFlipImageBytewise(unsigned char* image, int width, int height, int channels);
+void UFlipImageRows(unsigned char* image, int width, int height, int channels);
+// Times both flips on each image and prints them next to the shader flip, which costs no pass
+bool UBenchmarkImageFlip(const std::vector<std::string>& filenames);
+
+#endif
@@ -0,0 +1,282 @@
+#include <iostream>         // cout
+#include <algorithm>        // min, max
+#include <cmath>            // floor, log2
+
+#include "texturestream.h"
+
+using namespace std; // Uses the standard namespace
+
+namespace
+{
+	// First load of every texture: chain level 4, 128 pixels for the 2048 textures
+	const GLuint STREAM_FIRST_LEVEL = 4;
+	// Frames levels stay resident after the last object that needed them went away
+	const GLuint STREAM_IDLE_FRAMES = 120;
+
+	GLuint ULevelSize(GLuint size, GLuint level)
+	{
+		return max(1u, size >> level);
+	}
+
+	GLsizeiptr ULevelsBytes(const UStreamedTexture& texture, GLuint firstLevel, GLuint endLevel)
+	{
+		GLsizeiptr bytes = 0;
+		for (GLuint level = firstLevel; level < endLevel; ++level)
+			bytes += UCompressedLevelSize(texture.format, ULevelSize(texture.width, level), ULevelSize(texture.height, level));
+		return bytes;
+	}
+
+	// Finest level that still has a texel per pixel where the texture is largest on screen
+	GLuint UWantedLevel(const UStreamedTexture& texture)
+	{
+		if (texture.screenSize <= 0.0f)
+			return texture.chainLevels - 1;
+
+		float texels = (float)max(texture.width, texture.height);
+		int level = (int)floor(log2(texels / texture.screenSize));
+		return (GLuint)min(max(level, 0), (int)texture.chainLevels - 1);
+	}
+
+	/* Moves the texture to new storage holding chain levels residentLevel and coarser.
+	 * Levels both textures have are copied on the GPU, the others come from incoming.
+	 * Without sparse textures this is the only way to give back a level's memory.
+	 */
+	void UResizeStreamedTexture(UTextureStreamer& streamer, UStreamedTexture& texture, GLuint residentLevel, const UCompressedTexture* incoming)
+	{
+		GLuint id;
+		glGenTextures(1, &id);
+		glBindTexture(GL_TEXTURE_2D, id);
+		glTexStorage2D(GL_TEXTURE_2D, texture.chainLevels - residentLevel, texture.format,
+			ULevelSize(texture.width, residentLevel), ULevelSize(texture.height, residentLevel));
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		for (GLuint level = residentLevel; level < texture.chainLevels; ++level)
+		{
+			const GLuint width = ULevelSize(texture.width, level);
+			const GLuint height = ULevelSize(texture.height, level);
+			if (texture.id && level >= texture.residentLevel)
+			{
+				glCopyImageSubData(texture.id, GL_TEXTURE_2D, level - texture.residentLevel, 0, 0, 0,
+					id, GL_TEXTURE_2D, level - residentLevel, 0, 0, 0, width, height, 1);
+			}
+			else
+			{
+				const UCompressedLevel& source = incoming->levels[level - incoming->firstLevel];
+				glCompressedTexSubImage2D(GL_TEXTURE_2D, level - residentLevel, 0, 0, width, height,
+					texture.format, source.size, &incoming->blocks[source.offset]);
+			}
+		}
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		if (texture.id)
+			glDeleteTextures(1, &texture.id);
+		texture.id = id;
+		texture.residentLevel = residentLevel;
+
+		streamer.residentBytes -= texture.residentBytes;
+		texture.residentBytes = ULevelsBytes(texture, residentLevel, texture.chainLevels);
+		streamer.residentBytes += texture.residentBytes;
+	}
+
+	// Drops the finest level of the texture unused the longest, never the one asking for room
+	bool UEvictLeastRecentlyUsed(UTextureStreamer& streamer, const UStreamedTexture& requester)
+	{
+		UStreamedTexture* victim = nullptr;
+		for (UStreamedTexture& texture : streamer.textures)
+		{
+			if (&texture == &requester || !texture.id || texture.loading
+				|| texture.lastUsedFrame == streamer.frame || texture.residentLevel + 1 >= texture.chainLevels)
+				continue;
+			if (!victim || texture.lastUsedFrame < victim->lastUsedFrame)
+				victim = &texture;
+		}
+		if (!victim)
+			return false;
+
+		UResizeStreamedTexture(streamer, *victim, victim->residentLevel + 1, nullptr);
+		++streamer.evictions;
+		return true;
+	}
+
+	// Forgets every level, the next UUpdateTextureStreaming starts over with a coarse load
+	void UResetStreamedTexture(UTextureStreamer& streamer, UStreamedTexture& texture)
+	{
+		if (texture.id)
+			glDeleteTextures(1, &texture.id);
+		streamer.residentBytes -= texture.residentBytes;
+
+		UStreamedTexture reset;
+		reset.filename = move(texture.filename);
+		reset.lastUsedFrame = texture.lastUsedFrame;
+		texture = move(reset);
+	}
+}
+
+
+void UStartTextureStreaming(UTextureStreamer& streamer, UTextureLoader& loader, const vector<string>& filenames, GLsizeiptr budget)
+{
+	streamer.budget = budget;
+	streamer.textures.assign(filenames.size(), UStreamedTexture());
+	for (GLuint i = 0; i < filenames.size(); ++i)
+	{
+		UStreamedTexture& texture = streamer.textures[i];
+		texture.filename = filenames[i];
+		texture.loading = true;
+		UQueueImageDecode(loader, i, texture.filename.c_str(), STREAM_FIRST_LEVEL, TEXTURE_CHAIN_END);
+	}
+}
+
+
+void UStopTextureStreaming(UTextureStreamer& streamer)
+{
+	for (UStreamedTexture& texture : streamer.textures)
+	{
+		if (texture.id)
+			glDeleteTextures(1, &texture.id);
+	}
+	streamer = UTextureStreamer();
+}
+
+
+void UBeginTextureStreamingFrame(UTextureStreamer& streamer)
+{
+	++streamer.frame;
+	for (UStreamedTexture& texture : streamer.textures)
+		texture.screenSize = 0.0f;
+}
+
+
+void UNoteTextureUse(UTextureStreamer& streamer, GLuint texture, float screenSize)
+{
+	UStreamedTexture& streamed = streamer.textures[texture];
+	streamed.screenSize = max(streamed.screenSize, screenSize);
+	streamed.lastUsedFrame = streamer.frame;
+}
+
+
+bool UReceiveStreamedLevels(UTextureStreamer& streamer, GLuint texture, const UCompressedTexture& levels)
+{
+	UStreamedTexture& streamed = streamer.textures[texture];
+	streamer.loadingBytes -= streamed.loadingBytes;
+	streamed.loadingBytes = 0;
+	streamed.loading = false;
+
+	if (!levels.format || levels.levels.empty())
+	{
+		streamed.failed = true;
+		return false;
+	}
+
+	if (!streamed.id)
+	{
+		streamed.format = levels.format;
+		streamed.width = levels.width;
+		streamed.height = levels.height;
+		streamed.chainLevels = levels.chainLevels;
+		streamed.residentLevel = levels.chainLevels;
+	}
+
+	// The new levels have to join the resident ones. A cache rebuilt in between may not
+	// match, then the texture starts over from the new chain.
+	const GLuint endLevel = levels.firstLevel + (GLuint)levels.levels.size();
+	if (levels.format != streamed.format || levels.chainLevels != streamed.chainLevels
+		|| (endLevel < streamed.residentLevel && endLevel != streamed.chainLevels))
+	{
+		cout << "INFO: Texture " << streamed.filename << " changed while streaming, reloading it" << endl;
+		UResetStreamedTexture(streamer, streamed);
+		return true;
+	}
+
+	if (levels.firstLevel < streamed.residentLevel)
+		UResizeStreamedTexture(streamer, streamed, levels.firstLevel, &levels);
+	return true;
+}
+
+
+void UUpdateTextureStreaming(UTextureStreamer& streamer, UTextureLoader& loader)
+{
+	// Give back levels nobody needed for a while. Waiting keeps a camera moving
+	// back and forth from loading the same levels over and over.
+	for (UStreamedTexture& texture : streamer.textures)
+	{
+		if (!texture.id)
+			continue;
+
+		texture.wantedLevel = UWantedLevel(texture);
+		if (!texture.loading && texture.residentLevel < texture.wantedLevel)
+		{
+			if (++texture.idleFrames >= STREAM_IDLE_FRAMES)
+			{
+				UResizeStreamedTexture(streamer, texture, texture.wantedLevel, nullptr);
+				texture.idleFrames = 0;
+			}
+		}
+		else
+			texture.idleFrames = 0;
+	}
+
+	for (GLuint i = 0; i < streamer.textures.size(); ++i)
+	{
+		UStreamedTexture& texture = streamer.textures[i];
+
+		// A texture that was reset starts over like at startup
+		if (!texture.id && !texture.loading && !texture.failed)
+		{
+			UQueueImageDecode(loader, i, texture.filename.c_str(), STREAM_FIRST_LEVEL, TEXTURE_CHAIN_END);
+			texture.loading = true;
+			continue;
+		}
+
+		if (!texture.id || texture.loading || texture.failed || texture.wantedLevel >= texture.residentLevel)
+			continue;
+
+		GLuint firstLevel = texture.wantedLevel;
+		GLsizeiptr bytes = ULevelsBytes(texture, firstLevel, texture.residentLevel);
+		while (streamer.budget && streamer.residentBytes + streamer.loadingBytes + bytes > streamer.budget)
+		{
+			if (UEvictLeastRecentlyUsed(streamer, texture))
+				continue;
+
+			// Everything else is in use, settle for coarser levels
+			if (++firstLevel == texture.residentLevel)
+				break;
+			bytes = ULevelsBytes(texture, firstLevel, texture.residentLevel);
+		}
+		if (firstLevel == texture.residentLevel)
+			continue;
+
+		UQueueImageDecode(loader, i, texture.filename.c_str(), firstLevel, texture.residentLevel);
+		texture.loading = true;
+		texture.loadingBytes = bytes;
+		streamer.loadingBytes += bytes;
+	}
+}
+
+
+void UPrintTextureStreaming(const UTextureStreamer& streamer)
+{
+	cout << "Texture streaming: " << streamer.residentBytes / 1024 << " KB resident, budget ";
+	if (streamer.budget)
+		cout << streamer.budget / 1024 << " KB";
+	else
+		cout << "none";
+	cout << ", " << streamer.evictions << " levels evicted" << endl;
+
+	for (const UStreamedTexture& texture : streamer.textures)
+	{
+		cout << "  " << texture.filename << ": ";
+		if (!texture.id)
+		{
+			cout << (texture.failed ? "failed" : "loading") << endl;
+			continue;
+		}
+		cout << "levels " << texture.residentLevel << "-" << texture.chainLevels - 1 << " ("
+			<< ULevelSize(texture.width, texture.residentLevel) << "x" << ULevelSize(texture.height, texture.residentLevel)
+			<< "), wants " << texture.wantedLevel << ", " << texture.residentBytes / 1024 << " KB"
+			<< (texture.loading ? ", loading" : "") << endl;
+	}
+}
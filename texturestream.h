@@ -0,0 +1,65 @@
+#ifndef TEXTURESTREAM_H
+#define TEXTURESTREAM_H
+
+#include <GL/glew.h>
+
+#include <string>
+#include <vector>
+
+#include "texturecache.h"
+#include "textureloader.h"
+
+/* One texture whose finer mip levels come and go. The GL texture only has
+ * storage for chain levels residentLevel and coarser: its level 0 is chain level
+ * residentLevel, so sampling can never reach a level that is not there.
+ */
+struct UStreamedTexture
+{
+	std::string filename;
+	GLuint id = 0;                  // 0 until the first levels arrive
+	GLenum format = 0;
+	GLuint width = 0;               // Size of chain level 0
+	GLuint height = 0;
+	GLuint chainLevels = 0;         // 0 until the first levels arrive
+	GLuint residentLevel = 0;       // Finest chain level in the GL texture
+	GLsizeiptr residentBytes = 0;
+	float screenSize = 0.0f;        // Largest on-screen size in pixels this frame, 0 when unused
+	GLuint wantedLevel = 0;         // Finest level screenSize needs
+	GLuint lastUsedFrame = 0;
+	GLuint idleFrames = 0;          // Frames the resident levels have been finer than wanted
+	bool loading = false;           // A load of levels wantedLevel.. is in flight
+	GLsizeiptr loadingBytes = 0;    // Budget reserved for that load
+	bool failed = false;
+};
+
+struct UTextureStreamer
+{
+	std::vector<UStreamedTexture> textures;
+	GLsizeiptr budget = 0;          // Bytes of resident levels allowed, 0 for no limit
+	GLsizeiptr residentBytes = 0;
+	GLsizeiptr loadingBytes = 0;
+	GLuint frame = 0;
+	GLuint evictions = 0;           // Levels dropped to stay in the budget
+};
+
+// Queues a coarse run of levels of every texture, finer ones follow as objects need them
+void UStartTextureStreaming(UTextureStreamer& streamer, UTextureLoader& loader, const std::vector<std::string>& filenames, GLsizeiptr budget);
+void UStopTextureStreaming(UTextureStreamer& streamer);
+
+// Forgets last frame's use, call before noting this frame's
+void UBeginTextureStreamingFrame(UTextureStreamer& streamer);
+// A drawn object spreads the whole texture over screenSize pixels
+void UNoteTextureUse(UTextureStreamer& streamer, GLuint texture, float screenSize);
+
+// Adds levels a load brought to the GL texture. Levels from a chain that changed since the
+// texture's first load reset it to be loaded again. Fails when the load failed.
+bool UReceiveStreamedLevels(UTextureStreamer& streamer, GLuint texture, const UCompressedTexture& levels);
+/* Drops levels no object has needed for a while, then queues loads for the levels
+ * objects need. A load that does not fit in the budget first evicts the finest levels
+ * of the least recently used textures, then settles for coarser levels.
+ */
+void UUpdateTextureStreaming(UTextureStreamer& streamer, UTextureLoader& loader);
+
+void UPrintTextureStreaming(const UTextureStreamer& streamer);
+
+#endif
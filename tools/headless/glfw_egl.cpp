@@ -0,0 +1,323 @@
+#include <iostream>         // cout
+#include <chrono>
+#include <cstdlib>          // getenv, atoi
+#include <cstring>          // strcmp
+#include <string>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+using namespace std; // Uses the standard namespace
+
+/* GLFW and GLEW for headless runs: the window is an off-screen EGL pbuffer on a
+ * surfaceless display, so the renderer runs on Mesa's llvmpipe without a display
+ * server. The environment drives the run:
+ *
+ *   HEADLESS_FRAMES=<n>                  frames to draw before the window asks to close, 60 by default
+ *   HEADLESS_KEYS=<frame>:<key>,...      key presses to send before drawing a frame, GLFW key codes
+ *   HEADLESS_KEYS=<first>-<last>:<key>   a key held down from the first through the last frame, glfwGetKey
+ *                                        reports it, so the camera moves
+ *
+ * GL errors are reported through the debug output as lines starting with "GL error:".
+ */
+
+namespace
+{
+	// A HEADLESS_KEYS entry, a single press has first == last and is not held
+	struct UHeadlessKey
+	{
+		int first = 0;
+		int last = 0;
+		int key = 0;
+		bool held = false;
+	};
+
+	struct UHeadlessState
+	{
+		EGLDisplay display = EGL_NO_DISPLAY;
+		EGLSurface surface = EGL_NO_SURFACE;
+		EGLContext context = EGL_NO_CONTEXT;
+		int majorVersion = 3;
+		int minorVersion = 3;
+		int width = 0;
+		int height = 0;
+		int frame = 0;
+		int frameCount = 60;
+		bool closing = false;
+		GLFWkeyfun keyCallback = nullptr;
+		vector<UHeadlessKey> keys;
+		chrono::steady_clock::time_point start = chrono::steady_clock::now();
+	};
+
+	UHeadlessState gHeadless;
+	GLFWwindow* const HEADLESS_WINDOW = (GLFWwindow*)&gHeadless;
+
+	void APIENTRY UDebugMessage(GLenum, GLenum type, GLuint, GLenum, GLsizei, const GLchar* message, const void*)
+	{
+		if (type == GL_DEBUG_TYPE_ERROR)
+			cout << "GL error: " << message << endl;
+	}
+
+	void UParseKeys(const char* keys)
+	{
+		string list = keys;
+		size_t start = 0;
+		while (start < list.size())
+		{
+			size_t end = list.find(',', start);
+			if (end == string::npos)
+				end = list.size();
+			const string entry = list.substr(start, end - start);
+			const size_t colon = entry.find(':');
+			const size_t dash = entry.find('-');
+			if (colon != string::npos)
+			{
+				UHeadlessKey key;
+				key.first = atoi(entry.c_str());
+				key.held = dash != string::npos && dash < colon;
+				key.last = key.held ? atoi(entry.c_str() + dash + 1) : key.first;
+				key.key = atoi(entry.c_str() + colon + 1);
+				gHeadless.keys.push_back(key);
+			}
+			start = end + 1;
+		}
+	}
+
+	// Sends the presses and releases of HEADLESS_KEYS for the frame about to be drawn
+	void USendKeys(int frame)
+	{
+		if (!gHeadless.keyCallback)
+			return;
+
+		for (const UHeadlessKey& key : gHeadless.keys)
+		{
+			if (key.first == frame)
+				gHeadless.keyCallback(HEADLESS_WINDOW, key.key, 0, GLFW_PRESS, 0);
+			else if (key.held && key.last + 1 == frame)
+				gHeadless.keyCallback(HEADLESS_WINDOW, key.key, 0, GLFW_RELEASE, 0);
+		}
+	}
+}
+
+
+GLboolean glewExperimental = GL_FALSE;
+GLboolean headlessGlewTextureCompressionS3tc = GL_FALSE;
+
+
+int glfwInit()
+{
+	PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+	if (getPlatformDisplay)
+		gHeadless.display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+	if (gHeadless.display == EGL_NO_DISPLAY)
+		gHeadless.display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+	EGLint major, minor;
+	if (gHeadless.display == EGL_NO_DISPLAY || !eglInitialize(gHeadless.display, &major, &minor))
+	{
+		cout << "Failed to initialize EGL" << endl;
+		return GLFW_FALSE;
+	}
+
+	if (const char* frames = getenv("HEADLESS_FRAMES"))
+		gHeadless.frameCount = atoi(frames);
+	if (const char* keys = getenv("HEADLESS_KEYS"))
+		UParseKeys(keys);
+	return GLFW_TRUE;
+}
+
+
+void glfwTerminate()
+{
+	if (gHeadless.display == EGL_NO_DISPLAY)
+		return;
+
+	eglMakeCurrent(gHeadless.display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+	if (gHeadless.context != EGL_NO_CONTEXT)
+		eglDestroyContext(gHeadless.display, gHeadless.context);
+	if (gHeadless.surface != EGL_NO_SURFACE)
+		eglDestroySurface(gHeadless.display, gHeadless.surface);
+	eglTerminate(gHeadless.display);
+	gHeadless.display = EGL_NO_DISPLAY;
+}
+
+
+void glfwWindowHint(int hint, int value)
+{
+	if (hint == GLFW_CONTEXT_VERSION_MAJOR)
+		gHeadless.majorVersion = value;
+	else if (hint == GLFW_CONTEXT_VERSION_MINOR)
+		gHeadless.minorVersion = value;
+}
+
+
+GLFWwindow* glfwCreateWindow(int width, int height, const char*, GLFWmonitor*, GLFWwindow*)
+{
+	const EGLint configAttributes[] = {
+		EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+		EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+		EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+		EGL_DEPTH_SIZE, 24,
+		EGL_NONE
+	};
+	EGLConfig config;
+	EGLint configCount = 0;
+	if (!eglChooseConfig(gHeadless.display, configAttributes, &config, 1, &configCount) || configCount == 0)
+	{
+		cout << "Failed to find an EGL config with a pbuffer" << endl;
+		return nullptr;
+	}
+
+	const EGLint surfaceAttributes[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+	gHeadless.surface = eglCreatePbufferSurface(gHeadless.display, config, surfaceAttributes);
+
+	// A debug context, so GL errors reach UDebugMessage without any glGetError calls
+	const EGLint contextAttributes[] = {
+		EGL_CONTEXT_MAJOR_VERSION, gHeadless.majorVersion,
+		EGL_CONTEXT_MINOR_VERSION, gHeadless.minorVersion,
+		EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+		EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+		EGL_NONE
+	};
+	eglBindAPI(EGL_OPENGL_API);
+	gHeadless.context = eglCreateContext(gHeadless.display, config, EGL_NO_CONTEXT, contextAttributes);
+	if (gHeadless.surface == EGL_NO_SURFACE || gHeadless.context == EGL_NO_CONTEXT)
+	{
+		cout << "Failed to create a " << width << "x" << height << " OpenGL " << gHeadless.majorVersion << "."
+			<< gHeadless.minorVersion << " core pbuffer" << endl;
+		return nullptr;
+	}
+	gHeadless.width = width;
+	gHeadless.height = height;
+	return HEADLESS_WINDOW;
+}
+
+
+void glfwMakeContextCurrent(GLFWwindow*)
+{
+	eglMakeCurrent(gHeadless.display, gHeadless.surface, gHeadless.surface, gHeadless.context);
+
+	// Synchronous, so an error is reported from inside the call that caused it
+	glEnable(GL_DEBUG_OUTPUT);
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageCallback(UDebugMessage, nullptr);
+}
+
+
+int glfwWindowShouldClose(GLFWwindow*)
+{
+	return gHeadless.closing || gHeadless.frame >= gHeadless.frameCount;
+}
+
+
+void glfwSetWindowShouldClose(GLFWwindow*, int value)
+{
+	gHeadless.closing = value != GLFW_FALSE;
+}
+
+
+// A pbuffer keeps the size it was created with
+void glfwGetFramebufferSize(GLFWwindow*, int* width, int* height)
+{
+	*width = gHeadless.width;
+	*height = gHeadless.height;
+}
+
+
+void glfwSwapBuffers(GLFWwindow*)
+{
+	eglSwapBuffers(gHeadless.display, gHeadless.surface);
+	++gHeadless.frame;
+}
+
+
+void glfwPollEvents()
+{
+	USendKeys(gHeadless.frame);
+}
+
+
+double glfwGetTime()
+{
+	chrono::duration<double> elapsed = chrono::steady_clock::now() - gHeadless.start;
+	return elapsed.count();
+}
+
+
+// No mouse, the cursor never moves
+void glfwSetInputMode(GLFWwindow*, int, int)
+{
+}
+
+
+// Only the keys HEADLESS_KEYS holds are ever down
+int glfwGetKey(GLFWwindow*, int key)
+{
+	for (const UHeadlessKey& held : gHeadless.keys)
+	{
+		if (held.held && held.key == key && held.first <= gHeadless.frame && gHeadless.frame <= held.last)
+			return GLFW_PRESS;
+	}
+	return GLFW_RELEASE;
+}
+
+
+GLFWframebuffersizefun glfwSetFramebufferSizeCallback(GLFWwindow*, GLFWframebuffersizefun)
+{
+	return nullptr;
+}
+
+
+GLFWcursorposfun glfwSetCursorPosCallback(GLFWwindow*, GLFWcursorposfun)
+{
+	return nullptr;
+}
+
+
+GLFWscrollfun glfwSetScrollCallback(GLFWwindow*, GLFWscrollfun)
+{
+	return nullptr;
+}
+
+
+GLFWmousebuttonfun glfwSetMouseButtonCallback(GLFWwindow*, GLFWmousebuttonfun)
+{
+	return nullptr;
+}
+
+
+GLFWkeyfun glfwSetKeyCallback(GLFWwindow*, GLFWkeyfun callback)
+{
+	GLFWkeyfun previous = gHeadless.keyCallback;
+	gHeadless.keyCallback = callback;
+	return previous;
+}
+
+
+GLenum glewInit()
+{
+	GLint major = 0, minor = 0;
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	if (major * 10 + minor < 43)
+		return 1;
+
+	GLint extensionCount = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+	for (GLint i = 0; i < extensionCount; ++i)
+	{
+		if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_EXT_texture_compression_s3tc") == 0)
+			headlessGlewTextureCompressionS3tc = GL_TRUE;
+	}
+	return GLEW_OK;
+}
+
+
+const GLubyte* glewGetErrorString(GLenum error)
+{
+	return (const GLubyte*)(error == GLEW_OK ? "No error" : "OpenGL 4.3 or later is needed");
+}
@@ -0,0 +1,26 @@
+#ifndef HEADLESS_GLEW_H
+#define HEADLESS_GLEW_H
+
+/* The part of GLEW the renderer uses, for headless runs. Mesa's libGL exports every
+ * core entry point, so the prototypes are used directly and glewInit only has to
+ * look up the extensions the renderer asks about. Implemented in glfw_egl.cpp.
+ */
+#define GL_GLEXT_PROTOTYPES 1
+#include <GL/glcorearb.h>
+
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+#define GLEW_OK 0
+
+extern GLboolean glewExperimental;
+extern GLboolean headlessGlewTextureCompressionS3tc;
+#define GLEW_EXT_texture_compression_s3tc headlessGlewTextureCompressionS3tc
+
+// Needs the context current, fails when no GL 4.3 context was created
+GLenum glewInit();
+const GLubyte* glewGetErrorString(GLenum error);
+
+#endif
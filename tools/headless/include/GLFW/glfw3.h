@@ -0,0 +1,73 @@
+#ifndef HEADLESS_GLFW3_H
+#define HEADLESS_GLFW3_H
+
+/* The part of the GLFW 3 API the renderer uses, for headless runs. Implemented in
+ * glfw_egl.cpp on an off-screen EGL surface, values match the real header.
+ */
+#define GLFW_TRUE                   1
+#define GLFW_FALSE                  0
+
+#define GLFW_RELEASE                0
+#define GLFW_PRESS                  1
+#define GLFW_REPEAT                 2
+
+#define GLFW_KEY_SPACE              32
+#define GLFW_KEY_A                  65
+#define GLFW_KEY_D                  68
+#define GLFW_KEY_E                  69
+#define GLFW_KEY_P                  80
+#define GLFW_KEY_Q                  81
+#define GLFW_KEY_S                  83
+#define GLFW_KEY_W                  87
+#define GLFW_KEY_ESCAPE             256
+#define GLFW_KEY_F1                 290
+#define GLFW_KEY_F2                 291
+#define GLFW_KEY_F3                 292
+#define GLFW_KEY_F4                 293
+#define GLFW_KEY_F5                 294
+#define GLFW_KEY_F6                 295
+#define GLFW_KEY_LEFT_CONTROL       341
+
+#define GLFW_MOUSE_BUTTON_LEFT      0
+#define GLFW_MOUSE_BUTTON_RIGHT     1
+#define GLFW_MOUSE_BUTTON_MIDDLE    2
+
+#define GLFW_CURSOR                 0x00033001
+#define GLFW_CURSOR_DISABLED        0x00034003
+
+#define GLFW_CONTEXT_VERSION_MAJOR  0x00022002
+#define GLFW_CONTEXT_VERSION_MINOR  0x00022003
+#define GLFW_OPENGL_FORWARD_COMPAT  0x00022006
+#define GLFW_OPENGL_PROFILE         0x00022008
+#define GLFW_OPENGL_CORE_PROFILE    0x00032001
+
+typedef struct GLFWmonitor GLFWmonitor;
+typedef struct GLFWwindow GLFWwindow;
+
+typedef void (*GLFWframebuffersizefun)(GLFWwindow*, int, int);
+typedef void (*GLFWcursorposfun)(GLFWwindow*, double, double);
+typedef void (*GLFWscrollfun)(GLFWwindow*, double, double);
+typedef void (*GLFWmousebuttonfun)(GLFWwindow*, int, int, int);
+typedef void (*GLFWkeyfun)(GLFWwindow*, int, int, int, int);
+
+int glfwInit();
+void glfwTerminate();
+void glfwWindowHint(int hint, int value);
+GLFWwindow* glfwCreateWindow(int width, int height, const char* title, GLFWmonitor* monitor, GLFWwindow* share);
+void glfwMakeContextCurrent(GLFWwindow* window);
+int glfwWindowShouldClose(GLFWwindow* window);
+void glfwSetWindowShouldClose(GLFWwindow* window, int value);
+void glfwGetFramebufferSize(GLFWwindow* window, int* width, int* height);
+void glfwSwapBuffers(GLFWwindow* window);
+void glfwPollEvents();
+double glfwGetTime();
+
+void glfwSetInputMode(GLFWwindow* window, int mode, int value);
+int glfwGetKey(GLFWwindow* window, int key);
+GLFWframebuffersizefun glfwSetFramebufferSizeCallback(GLFWwindow* window, GLFWframebuffersizefun callback);
+GLFWcursorposfun glfwSetCursorPosCallback(GLFWwindow* window, GLFWcursorposfun callback);
+GLFWscrollfun glfwSetScrollCallback(GLFWwindow* window, GLFWscrollfun callback);
+GLFWmousebuttonfun glfwSetMouseButtonCallback(GLFWwindow* window, GLFWmousebuttonfun callback);
+GLFWkeyfun glfwSetKeyCallback(GLFWwindow* window, GLFWkeyfun callback);
+
+#endif
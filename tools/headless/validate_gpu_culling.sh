@@ -0,0 +1,52 @@
+#!/bin/sh
+# Builds the renderer on top of glfw_egl.cpp and runs --validate-gpu-culling on Mesa's
+# llvmpipe with no display, while the camera flies forward, sideways, up and back so the
+# pyramid lags the view. Fails when the build fails, when the GPU and the CPU disagree
+# about any object in any frame, or when GL reports an error.
+#
+#   tools/headless/validate_gpu_culling.sh [stress size] [frames]
+#
+# Needs g++, the EGL, GL and glm headers and stb_image.h. Extra compiler flags, such as
+# the folder holding stb_image.h, go in CXXFLAGS and extra libraries in LIBS. Objects
+# are built in $BUILD_DIR, _headless_build by default. HEADLESS_KEYS replaces the camera
+# path, see glfw_egl.cpp.
+set -e
+
+root=$(cd "$(dirname "$0")/../.." && pwd)
+stress=${1:-20}
+frames=${2:-120}
+build=${BUILD_DIR:-$root/_headless_build}
+
+# Held GLFW keys per frame range: W forward, A left, Q up, then S back and D right together
+keys=${HEADLESS_KEYS:-10-39:87,40-59:65,60-79:81,80-109:83,80-109:68}
+
+mkdir -p "$build"
+objects=""
+for source in "$root"/*.cpp "$root"/tools/headless/glfw_egl.cpp; do
+	object="$build/$(basename "$source" .cpp).o"
+	g++ -std=c++17 -O2 -msse4.1 -pthread -I"$root/tools/headless/include" -I"$root" $CXXFLAGS -c "$source" -o "$object"
+	objects="$objects $object"
+done
+g++ -pthread $objects $LIBS -lEGL -lGL -o "$build/scene"
+
+# The scene loads its resources relative to the repository root
+log="$build/validate_gpu_culling.log"
+cd "$root"
+status=0
+LIBGL_ALWAYS_SOFTWARE=1 GALLIUM_DRIVER=llvmpipe HEADLESS_FRAMES=$frames HEADLESS_KEYS=$keys \
+	"$build/scene" --validate-gpu-culling --stress "$stress" --no-program-cache > "$log" 2>&1 || status=$?
+cat "$log"
+
+if [ $status -ne 0 ]; then
+	echo "FAILED: the run exited with status $status"
+	exit 1
+fi
+if grep -q "^GL error:" "$log"; then
+	echo "FAILED: GL reported errors"
+	exit 1
+fi
+if ! grep -q "^INFO: GPU culling validation: 0 mismatches" "$log"; then
+	echo "FAILED: no validation verdict"
+	exit 1
+fi
+echo "PASSED: GPU culling matched the CPU in every frame of a ${stress}x${stress} stress scene with a moving camera"